@@ -1,8 +1,11 @@
 #include "contiki.h"
 #include "coap-engine.h"
+#include "rd_client.h"
 #include "dev/button-hal.h"
 #include "coap-blocking-api.h"
-#include <stdio.h>
+#include "endpoint_registry.h"
+#include "ringlog.h"
+#include "param_store.h"
 #include <string.h>
 #include "net/ipv6/uip.h"
 #include "net/ipv6/uiplib.h"
@@ -10,8 +13,7 @@
 
 // resource for configuring the compactor sensor address - only needed for simulation
 extern coap_resource_t compactor_sensor_endpoint;
-extern coap_endpoint_t compactor_sensor_address;
-extern char compactor_sensor_endpoint_uri[64];
+extern endpoint_entry_t *compactor_sensor_node; // NULL until configured
 
 // resource for compactor actuator commands
 extern coap_resource_t compactor_actuator_command;
@@ -21,21 +23,34 @@ extern bool compactor_value_to_send;
 // bit flag to signal that we need to send a CoAP PUT request to the compactor sensor.
 // This is triggered by a button press event.
 static int coap_put_pending = 0;
+static bool compactor_sensor_responded;
+static clock_time_t request_start;
 
 // Button press event handler - button turns compactor on, it turns off automatically when it's done
 static void button_event_handler(button_hal_button_t *btn) {
     coap_put_pending = 1; // Signal to the main thread that a request is pending
-    printf("CoAP PUT request prepared to turn compactor ON.\n");
+    RINGLOG_INFO(RL_ACTUATOR_BUTTON);
 }
 
 void response_handler(coap_message_t *response) {
     const uint8_t *buffer;
     if (response == NULL) {
-        puts("Request timed out");
+        RINGLOG_WARN(RL_REQUEST_TIMEOUT);
         return;
     }
+    compactor_sensor_responded = true;
     int len = coap_get_payload(response, &buffer);
-    printf("|%.*s\n", len, (char *)buffer);
+    RINGLOG_DBG_STR((const char *)buffer, len, RL_RESPONSE_PAYLOAD);
+}
+
+// Parameters tuned at run time through the params resource
+static int32_t fail_threshold = ENDPOINT_REGISTRY_FAILURE_THRESHOLD;
+static const param_t params[] = {
+    { "fail_threshold", &fail_threshold, 1, 10 },
+};
+
+static void params_applied(void) {
+    endpoint_registry_set_failure_threshold((uint8_t)fail_threshold);
 }
 
 // Event that will be posted when a command is received
@@ -48,12 +63,18 @@ PROCESS_THREAD(compactor_actuator_process, ev, data)
 {
     PROCESS_BEGIN();
 
-    printf("Compactor Actuator Process started.\n");
+    ringlog_start();
+    param_store_init(params, sizeof(params) / sizeof(params[0]), params_applied);
+    params_applied();
+    RINGLOG_INFO_STR("Compactor", strlen("Compactor"), RL_ACTUATOR_STARTED);
 
     // Register the CoAP resources
     coap_activate_resource(&compactor_sensor_endpoint, "compactor/config");
     coap_activate_resource(&compactor_actuator_command, "compactor/command");
 
+    // Register with the resource directory, which provisions the actuator when it appears
+    rd_client_start();
+
     // Initialize button-hal
     button_hal_init();
 
@@ -75,14 +96,17 @@ PROCESS_THREAD(compactor_actuator_process, ev, data)
             // always turn on if button press event
             if (coap_put_pending) value_to_send = true;
 
-            printf("Sending CoAP PUT request to turn compactor %s.\n", value_to_send ? "ON" : "OFF");
+            const char *state_name = value_to_send ? "on" : "off";
+            RINGLOG_INFO_STR(state_name, strlen(state_name), RL_ACTUATOR_COMPACTOR_SEND);
 
-            char payload[16];
-            snprintf(payload, sizeof(payload), "%s", value_to_send ? "true" : "false");
+            const char *payload = value_to_send ? "true" : "false";
 
             // SIMULATION: need to update the compactor sensor state
-            if (strlen(compactor_sensor_endpoint_uri) == 0) {
-                printf("Compactor sensor endpoint not configured. Aborting request.\n");
+            if (compactor_sensor_node == NULL) {
+                RINGLOG_WARN_STR("not configured", strlen("not configured"), RL_ACTUATOR_SENSOR_UNAVAILABLE);
+            } else if (!endpoint_registry_allow(compactor_sensor_node)) {
+                // Only the requests that probe a sensor known to be down are sent
+                RINGLOG_WARN_STR("down", strlen("down"), RL_ACTUATOR_SENSOR_UNAVAILABLE);
             } else {
                 static coap_message_t request[1];
                 // Prepare the CoAP PUT request
@@ -90,7 +114,14 @@ PROCESS_THREAD(compactor_actuator_process, ev, data)
                 coap_set_header_uri_path(request, "/compactor/active");
                 coap_set_payload(request, (uint8_t *)payload, strlen(payload));
                 // Send the CoAP request
-                COAP_BLOCKING_REQUEST(&compactor_sensor_address, request, response_handler);
+                compactor_sensor_responded = false;
+                request_start = clock_time();
+                COAP_BLOCKING_REQUEST(&compactor_sensor_node->endpoint, request, response_handler);
+                if (compactor_sensor_responded) {
+                    endpoint_registry_success(compactor_sensor_node, clock_time() - request_start);
+                } else {
+                    endpoint_registry_failure(compactor_sensor_node);
+                }
             }
 
             // Reset the flags
@@ -1,8 +1,11 @@
 #include "contiki.h"
 #include "coap-engine.h"
+#include "rd_client.h"
 #include "dev/button-hal.h"
 #include "coap-blocking-api.h"
-#include <stdio.h>
+#include "endpoint_registry.h"
+#include "ringlog.h"
+#include "param_store.h"
 #include <string.h>
 #include <stdlib.h> // For rand()
 #include "net/ipv6/uip.h"
@@ -10,10 +13,11 @@
 #include "net/ipv6/uip-ds6.h"
 
 // CoAP resource for the lid sensor address configuration - only needed for simulation
-extern char lid_sensor_endpoint_uri[64]; // Buffer to store endpoint URI
-extern coap_endpoint_t lid_sensor_address;
+extern endpoint_entry_t *lid_sensor_node; // NULL until configured
 
 static coap_message_t request[1]; // CoAP request message
+static bool lid_sensor_responded;
+static clock_time_t request_start;
 
 static bool lid_sensor_state = false;  // Current state of the lid sensor (false: closed, true: open)
 static bool send_command_pending = false; // Flag to execute the command when button is pressed
@@ -28,14 +32,14 @@ extern bool lid_value_to_send; // flag to execute the command when requested via
 // The lid actuator will send a CoAP PUT request to the lid sensor to toggle its state
 static void toggle_lid_sensor_state(void) {
     // Validate that the lid sensor endpoint is configured
-    if (strlen(lid_sensor_endpoint_uri) == 0) {
-        printf("Lid sensor endpoint not configured. Skipping toggle operation.\n");
+    if (lid_sensor_node == NULL) {
+        RINGLOG_WARN_STR("not configured", strlen("not configured"), RL_ACTUATOR_SENSOR_UNAVAILABLE);
         return;
     }
 
     // Toggle the state
     lid_sensor_state = !lid_sensor_state;
-    printf("Toggling lid sensor state to: %d\n", lid_sensor_state);
+    RINGLOG_INFO(RL_ACTUATOR_LID_TOGGLE, lid_sensor_state);
 
     // Set flag to send the CoAP command
     send_command_pending = 1;
@@ -44,19 +48,30 @@ static void toggle_lid_sensor_state(void) {
 void response_handler(coap_message_t *response) {
     const uint8_t *buffer;
     if (response == NULL) {
-        puts("Request timed out");
+        RINGLOG_WARN(RL_REQUEST_TIMEOUT);
         return;
     }
+    lid_sensor_responded = true;
     int len = coap_get_payload(response, &buffer);
-    printf("|%.*s\n", len, (char *)buffer);
+    RINGLOG_DBG_STR((const char *)buffer, len, RL_RESPONSE_PAYLOAD);
 }
 
 // Button event handler to toggle the lid sensor
 static void button_event_handler(button_hal_button_t *btn) {
-    printf("Button pressed. Toggling lid sensor.\n");
+    RINGLOG_INFO(RL_ACTUATOR_BUTTON);
     toggle_lid_sensor_state();
 }
 
+// Parameters tuned at run time through the params resource
+static int32_t fail_threshold = ENDPOINT_REGISTRY_FAILURE_THRESHOLD;
+static const param_t params[] = {
+    { "fail_threshold", &fail_threshold, 1, 10 },
+};
+
+static void params_applied(void) {
+    endpoint_registry_set_failure_threshold((uint8_t)fail_threshold);
+}
+
 // Event that will be posted when a command is received
 extern process_event_t lid_command_event;
 
@@ -66,12 +81,18 @@ AUTOSTART_PROCESSES(&lid_actuator_process);
 PROCESS_THREAD(lid_actuator_process, ev, data) {
     PROCESS_BEGIN();
 
-    printf("Lid Actuator Process started.\n");
+    ringlog_start();
+    param_store_init(params, sizeof(params) / sizeof(params[0]), params_applied);
+    params_applied();
+    RINGLOG_INFO_STR("Lid", strlen("Lid"), RL_ACTUATOR_STARTED);
 
     // Register the resources
     coap_activate_resource(&lid_sensor_endpoint, "lid/config");
     coap_activate_resource(&lid_actuator_command, "lid/command");
 
+    // Register with the resource directory, which provisions the actuator when it appears
+    rd_client_start();
+
     // Initialize button handling
     button_hal_init();
 
@@ -92,6 +113,13 @@ PROCESS_THREAD(lid_actuator_process, ev, data) {
             send_lid_command = 0;
         }
 
+        // A lid sensor known to be down is only sent the requests that probe it
+        if (send_command_pending && (lid_sensor_node == NULL || !endpoint_registry_allow(lid_sensor_node))) {
+            const char *reason = lid_sensor_node == NULL ? "not configured" : "down";
+            RINGLOG_WARN_STR(reason, strlen(reason), RL_ACTUATOR_SENSOR_UNAVAILABLE);
+            send_command_pending = 0;
+        }
+
         if (send_command_pending) {
             // Prepare the CoAP PUT request
             coap_init_message(request, COAP_TYPE_CON, COAP_PUT, 0);
@@ -100,8 +128,15 @@ PROCESS_THREAD(lid_actuator_process, ev, data) {
                              strlen(lid_sensor_state ? "true" : "false"));
 
             // Send the CoAP request to the lid sensor address - only needed for simulation
-            COAP_BLOCKING_REQUEST(&lid_sensor_address, request, response_handler);
-            printf("Lid sensor state update sent: %d\n", lid_sensor_state);
+            lid_sensor_responded = false;
+            request_start = clock_time();
+            COAP_BLOCKING_REQUEST(&lid_sensor_node->endpoint, request, response_handler);
+            if (lid_sensor_responded) {
+                endpoint_registry_success(lid_sensor_node, clock_time() - request_start);
+            } else {
+                endpoint_registry_failure(lid_sensor_node);
+            }
+            RINGLOG_INFO(RL_ACTUATOR_LID_SENT, lid_sensor_state);
 
             // Reset the flag
             send_command_pending = 0;
@@ -1,7 +1,8 @@
 #include "contiki.h"
 #include "coap-engine.h"
 #include "coap-blocking-api.h"
-#include <stdio.h>
+#include "json_extract.h"
+#include "ringlog.h"
 #include <string.h>
 
 bool send_compactor_command = false;
@@ -10,38 +11,42 @@ bool compactor_value_to_send = false;
 // Event that will be posted when a command is received
 process_event_t compactor_command_event;
 
-// CoAP PUT handler to receive commands for the compactor actuator. Accepted values: turn on, turn off
+// CoAP PUT handler to receive commands for the compactor actuator. Accepted values: turn on, turn off,
+// either as plain text or as JSON {"command":"<value>"}
 static void compactor_actuator_command_put_handler(coap_message_t *request, coap_message_t *response,
                                             uint8_t *buffer, uint16_t preferred_size, int32_t *offset) {
 
     size_t len = coap_get_payload(request, (const uint8_t **)&buffer);
-    char* payload = (char *)buffer;
+    const char *payload = (const char *)buffer;
 
-    printf("CoAP handler invoked with payload: %.*s\n", preferred_size, buffer);
+    RINGLOG_DBG_STR(payload, len, RL_ACTUATOR_COMMAND_PAYLOAD);
+
+    // A JSON command is reduced to the span of its value, plain text is used as it is
+    json_extract(payload, len, "command", &payload, &len);
 
     if (len > 0) {
-        if (strncmp((char *)payload, "turn on", len) == 0) {
+        if (json_span_equals(payload, len, "turn on")) {
             compactor_value_to_send = true;
             send_compactor_command = true;
-            printf("Command received: turn on. compactor_value_to_send set to true.\n");
+            RINGLOG_INFO_STR(payload, len, RL_ACTUATOR_COMMAND);
             coap_set_status_code(response, CHANGED_2_04);
-        } else if (strncmp((char *)payload, "turn off", len) == 0) {
+        } else if (json_span_equals(payload, len, "turn off")) {
             compactor_value_to_send = false;
             send_compactor_command = true;
-            printf("Command received: turn off. compactor_value_to_send set to false.\n");
+            RINGLOG_INFO_STR(payload, len, RL_ACTUATOR_COMMAND);
             coap_set_status_code(response, CHANGED_2_04);
         } else {
-            printf("Invalid command received: %.*s\n", (int)len, payload);
+            RINGLOG_WARN_STR(payload, len, RL_ACTUATOR_INVALID_COMMAND);
             coap_set_status_code(response, BAD_REQUEST_4_00);
         }
         // Post event to wake up the main process that will handle the command
         process_post(PROCESS_BROADCAST, compactor_command_event, NULL);
     } else {
-        printf("Empty payload received.\n");
+        RINGLOG_WARN(RL_ACTUATOR_EMPTY_COMMAND);
         coap_set_status_code(response, BAD_REQUEST_4_00);
     }
 }
 
 // Configure the CoAP resource for the compactor actuator command
-RESOURCE(compactor_actuator_command, "title=\"Command Compactor Actuator\";rt=\"Text\"",
+RESOURCE(compactor_actuator_command, "title=\"Command Compactor Actuator\";rt=\"Text compactor_command\"",
          NULL, NULL, compactor_actuator_command_put_handler, NULL);
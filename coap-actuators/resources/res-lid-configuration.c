@@ -1,7 +1,9 @@
 #include "contiki.h"
 #include "coap-engine.h"
 #include "coap-blocking-api.h"
-#include <stdio.h>
+#include "payload_writer.h"
+#include "endpoint_registry.h"
+#include "ringlog.h"
 #include <string.h>
 
 // --------------------- ONLY NEEDED FOR SIMULATION ---------------------
@@ -10,28 +12,33 @@
 
 // Store the address of the lid sensor
 char lid_sensor_endpoint_uri[64] = "";
-coap_endpoint_t lid_sensor_address;
+endpoint_entry_t *lid_sensor_node; // NULL until configured
 
 // CoAP PUT handler to configure the lid sensor address
 static void lid_sensor_endpoint_put_handler(coap_message_t *request, coap_message_t *response,
                                             uint8_t *buffer, uint16_t preferred_size, int32_t *offset) {
 
-    printf("CoAP handler invoked with payload: %.*s\n", preferred_size, buffer);
     size_t len = coap_get_payload(request, (const uint8_t **)&buffer);
+    RINGLOG_DBG_STR((const char *)buffer, len, RL_ACTUATOR_CONFIG_PAYLOAD);
 
     if (len > 0 && len < sizeof(lid_sensor_endpoint_uri)) {
-        strncpy(lid_sensor_endpoint_uri, (char *)buffer, len);
-        lid_sensor_endpoint_uri[len] = '\0';
-
-        if (coap_endpoint_parse(lid_sensor_endpoint_uri, strlen(lid_sensor_endpoint_uri), &lid_sensor_address)) {
-            printf("Configured lid sensor endpoint: %s\n", lid_sensor_endpoint_uri);
+        // Parse the endpoint, respond with error if invalid
+        endpoint_entry_t *node = endpoint_registry_parse((const char *)buffer, len);
+        if (node != NULL) {
+            memcpy(lid_sensor_endpoint_uri, buffer, len);
+            lid_sensor_endpoint_uri[len] = '\0';
+            // Held, so that the registry does not give the entry to another node
+            endpoint_registry_release(lid_sensor_node);
+            endpoint_registry_hold(node);
+            lid_sensor_node = node;
+            RINGLOG_INFO_STR(lid_sensor_endpoint_uri, len, RL_ACTUATOR_SENSOR_CONFIGURED);
             coap_set_status_code(response, CHANGED_2_04);
         } else {
-            printf("Invalid CoAP endpoint: %s\n", lid_sensor_endpoint_uri);
+            RINGLOG_WARN_STR((const char *)buffer, len, RL_ACTUATOR_INVALID_ENDPOINT);
             coap_set_status_code(response, BAD_REQUEST_4_00);
         }
     } else {
-        printf("Invalid configuration payload.\n");
+        RINGLOG_WARN(RL_ACTUATOR_INVALID_CONFIG);
         coap_set_status_code(response, BAD_REQUEST_4_00);
     }
 }
@@ -39,11 +46,16 @@ static void lid_sensor_endpoint_put_handler(coap_message_t *request, coap_messag
 // CoAP GET handler to retrieve the lid sensor address
 static void lid_sensor_endpoint_get_handler(coap_message_t *request, coap_message_t *response,
                                             uint8_t *buffer, uint16_t preferred_size, int32_t *offset) {
-    snprintf((char *)buffer, preferred_size, "{\"uri\":\"%s\"}", lid_sensor_endpoint_uri);
+    payload_writer_t writer;
+    payload_writer_init(&writer, (char *)buffer, preferred_size);
+    payload_write_char(&writer, '{');
+    payload_write_string_field(&writer, "uri", lid_sensor_endpoint_uri);
+    payload_write_char(&writer, '}');
+
     coap_set_header_content_format(response, TEXT_PLAIN);
-    coap_set_payload(response, buffer, strlen((char *)buffer));
+    coap_set_payload(response, buffer, writer.length);
 }
 
 // CoAP resource for configuring the lid sensor address
-RESOURCE(lid_sensor_endpoint, "title=\"Configure Lid Sensor Endpoint\";rt=\"Text\"",
+RESOURCE(lid_sensor_endpoint, "title=\"Configure Lid Sensor Endpoint\";rt=\"Text lid_config\"",
          lid_sensor_endpoint_get_handler, NULL, lid_sensor_endpoint_put_handler, NULL);
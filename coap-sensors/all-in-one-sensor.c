@@ -0,0 +1,72 @@
+#include "contiki.h"
+#include "dev/leds.h"
+#include "coap-engine.h"
+#include "rd_client.h"
+#include "ringlog.h"
+#include "param_store.h"
+#include "sensor_utils.h"
+#include "net/ipv6/uip.h"
+#include "net/ipv6/uiplib.h"
+#include "net/ipv6/uip-ds6.h"
+
+// Optional firmware that hosts every bin sensor on a single mote. The collector reads all of them
+// with a single request to the node state resource. Build it with `make all-in-one-sensor`.
+extern coap_resource_t lid_sensor;
+extern coap_resource_t rfid_reader;
+extern coap_resource_t compactor_active_sensor;
+extern coap_resource_t scale_sensor;
+extern coap_resource_t waste_level_sensor;
+extern coap_resource_t collector_config;
+extern coap_resource_t node_state;
+
+extern generic_sensor_t lid_sensor_data;
+extern generic_sensor_t rfid_reader_data;
+extern generic_sensor_t compactor_sensor_data;
+extern generic_sensor_t scale_sensor_data;
+extern generic_sensor_t waste_level_sensor_data;
+extern int32_t compactor_active_ms;
+
+// Parameters tuned at run time through the params resource
+static const param_t params[] = {
+    { "compactor_ms", &compactor_active_ms, 1000, 600000 },
+};
+
+PROCESS(all_in_one_sensor_process, "All-in-one Sensor Process");
+AUTOSTART_PROCESSES(&all_in_one_sensor_process);
+
+PROCESS_THREAD(all_in_one_sensor_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  ringlog_start();
+  param_store_init(params, sizeof(params) / sizeof(params[0]), NULL);
+
+  // adjust the LED status to the initial state (lid closed)
+  leds_off(LEDS_ALL);
+  leds_on(LEDS_RED);
+
+  // Activate the CoAP resources, using the same paths as the single-sensor firmwares
+  coap_activate_resource(&lid_sensor, "lid/open");
+  coap_activate_resource(&rfid_reader, "rfid/value");
+  coap_activate_resource(&compactor_active_sensor, "compactor/active");
+  coap_activate_resource(&scale_sensor, "scale/value");
+  coap_activate_resource(&waste_level_sensor, "waste/level");
+  coap_activate_resource(&collector_config, "config/collector");
+
+  // Expose every sensor through the node state resource
+  register_node_sensor(&lid_sensor_data);
+  register_node_sensor(&rfid_reader_data);
+  register_node_sensor(&compactor_sensor_data);
+  register_node_sensor(&scale_sensor_data);
+  register_node_sensor(&waste_level_sensor_data);
+  coap_activate_resource(&node_state, "state");
+
+  // Announce the node to the resource directory
+  rd_client_start();
+
+  while (1) {
+    PROCESS_WAIT_EVENT();
+  }
+
+  PROCESS_END();
+}
@@ -1,5 +1,10 @@
 #include "contiki.h"
 #include "coap-engine.h"
+#include "rd_client.h"
+#include "ringlog.h"
+#include "sensor_utils.h"
+#include "endpoint_registry.h"
+#include "param_store.h"
 #include "net/ipv6/uip.h"
 #include "net/ipv6/uiplib.h"
 #include "net/ipv6/uip-ds6.h"
@@ -7,11 +12,27 @@
 // Declare the resource from the resource file
 extern coap_resource_t compactor_active_sensor;
 extern coap_resource_t collector_config;
+extern coap_resource_t node_state;
+extern generic_sensor_t compactor_sensor_data;
 extern char collector_address[64];
+extern endpoint_entry_t *collector_node;
 extern int compactor_state;
+extern int32_t compactor_active_ms;
+
+// Parameters tuned at run time through the params resource
+static int32_t fail_threshold = ENDPOINT_REGISTRY_FAILURE_THRESHOLD;
+static const param_t params[] = {
+    { "compactor_ms", &compactor_active_ms, 1000, 600000 },
+    { "fail_threshold", &fail_threshold, 1, 10 },
+};
+
+static void params_applied(void) {
+    endpoint_registry_set_failure_threshold((uint8_t)fail_threshold);
+}
 
-static coap_endpoint_t collector_endpoint;
 static coap_message_t request[1];
+static bool collector_responded;
+static clock_time_t request_start;
 
 
 // Flag to track whether an update is required
@@ -20,6 +41,11 @@ extern bool update_required;
 // Timer for periodic checking
 static struct etimer update_timer;
 
+static void collector_response_handler(coap_message_t *response) {
+    collector_responded = response != NULL;
+    client_chunk_handler(response);
+}
+
 PROCESS(device_process, "Compactor Sensor Process");
 AUTOSTART_PROCESSES(&device_process);
 
@@ -27,18 +53,29 @@ AUTOSTART_PROCESSES(&device_process);
 PROCESS_THREAD(device_process, ev, data) {
   PROCESS_BEGIN();
 
+  ringlog_start();
+  param_store_init(params, sizeof(params) / sizeof(params[0]), params_applied);
+  params_applied();
+
   // Activate the CoAP resource
   coap_activate_resource(&compactor_active_sensor, "compactor/active");
   coap_activate_resource(&collector_config, "config/collector");
 
+  // Expose the sensor through the node state resource
+  register_node_sensor(&compactor_sensor_data);
+  coap_activate_resource(&node_state, "state");
+
+  // Announce the node to the resource directory
+  rd_client_start();
+
   while (1) {
     PROCESS_YIELD();
 
     // Check if the timer expired
     if((ev == PROCESS_EVENT_TIMER && data == &update_timer)) {
-        if (update_required) {
-            printf("Compactor state updated. Will notify the collector: %s\n", collector_address);
-            coap_endpoint_parse(collector_address, strlen(collector_address), &collector_endpoint);
+        // While the collector is down, the update waits for its next probe
+        if (update_required && collector_node != NULL && endpoint_registry_allow(collector_node)) {
+            RINGLOG_INFO(RL_SENSOR_NOTIFY_COLLECTOR, compactor_state);
 
             // Send a CoAP PUT request to the collector, send "true" if compactor is active
             coap_init_message(request, COAP_TYPE_CON, COAP_PUT, 0);
@@ -49,7 +86,14 @@ PROCESS_THREAD(device_process, ev, data) {
             } else {
                 coap_set_payload(request, (uint8_t *)"false", strlen("false"));
             }
-            COAP_BLOCKING_REQUEST(&collector_endpoint, request, client_chunk_handler);
+            collector_responded = false;
+            request_start = clock_time();
+            COAP_BLOCKING_REQUEST(&collector_node->endpoint, request, collector_response_handler);
+            if (collector_responded) {
+                endpoint_registry_success(collector_node, clock_time() - request_start);
+            } else {
+                endpoint_registry_failure(collector_node);
+            }
 
             // Reset the flag after sending the update
             update_required = false;
@@ -1,6 +1,10 @@
 #include "contiki.h"
 #include "dev/leds.h" // Include LEDs header
 #include "coap-engine.h"
+#include "rd_client.h"
+#include "ringlog.h"
+#include "param_store.h"
+#include "sensor_utils.h"
 #include "net/ipv6/uip.h"
 #include "net/ipv6/uiplib.h"
 #include "net/ipv6/uip-ds6.h"
@@ -9,6 +13,9 @@
 // since the RFID value is generated when the lid is opened, simulating a real scenario where the RFID value is read
 extern coap_resource_t lid_sensor;
 extern coap_resource_t rfid_reader;
+extern coap_resource_t node_state;
+extern generic_sensor_t lid_sensor_data;
+extern generic_sensor_t rfid_reader_data;
 
 extern char rfid_code[64];
 
@@ -18,6 +25,9 @@ AUTOSTART_PROCESSES(&lid_sensor_process);
 PROCESS_THREAD(lid_sensor_process, ev, data) {
   PROCESS_BEGIN();
 
+  ringlog_start();
+  param_store_init(NULL, 0, NULL); // the log level only
+
   // adjust the LED status to the initial state
   leds_off(LEDS_ALL); // Turn off all LEDs
   leds_on(LEDS_RED); // Turn on the red LED
@@ -26,6 +36,14 @@ PROCESS_THREAD(lid_sensor_process, ev, data) {
   coap_activate_resource(&lid_sensor, "lid/open");
   coap_activate_resource(&rfid_reader, "rfid/value");
 
+  // Expose both sensors through the node state resource, read by the collector with one request
+  register_node_sensor(&lid_sensor_data);
+  register_node_sensor(&rfid_reader_data);
+  coap_activate_resource(&node_state, "state");
+
+  // Announce the node to the resource directory, the collector discovers it by resource type
+  rd_client_start();
+
   while(1) {
     PROCESS_WAIT_EVENT();
   }
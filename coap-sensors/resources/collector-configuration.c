@@ -1,10 +1,13 @@
 #include "contiki.h"
 #include "coap-engine.h"
-#include <stdio.h>
+#include "payload_writer.h"
+#include "endpoint_registry.h"
+#include "ringlog.h"
 #include <string.h>
 
 // Collector Address Configuration
 char collector_address[64] = ""; // Buffer to store the collector's address
+endpoint_entry_t *collector_node; // NULL until configured
 
 // PUT Handler to Configure Collector Address
 static void collector_config_put_handler(coap_message_t *req, coap_message_t *res,
@@ -12,16 +15,20 @@ static void collector_config_put_handler(coap_message_t *req, coap_message_t *re
     const uint8_t *payload = NULL;
     size_t len = coap_get_payload(req, &payload);
 
-    if (len > 0 && len < sizeof(collector_address)) {
-        // Save the collector address
-        strncpy(collector_address, (const char *)payload, len);
+    endpoint_entry_t *node = len < sizeof(collector_address) ? endpoint_registry_parse((const char *)payload, len) : NULL;
+    if (node != NULL) {
+        // Save the collector address, parsed once for the updates sent to the collector
+        memcpy(collector_address, payload, len);
         collector_address[len] = '\0';
-        printf("Configured collector address: %s\n", collector_address);
+        endpoint_registry_release(collector_node);
+        endpoint_registry_hold(node);
+        collector_node = node;
+        RINGLOG_INFO_STR(collector_address, len, RL_SENSOR_COLLECTOR_CONFIGURED);
 
         // Set response status
         coap_set_status_code(res, CHANGED_2_04);
     } else {
-        printf("Invalid or empty payload received for collector configuration.\n");
+        RINGLOG_WARN(RL_SENSOR_INVALID_COLLECTOR);
         coap_set_status_code(res, BAD_REQUEST_4_00);
     }
 }
@@ -29,11 +36,16 @@ static void collector_config_put_handler(coap_message_t *req, coap_message_t *re
 // GET Handler to Retrieve the Current Collector Address
 static void collector_config_get_handler(coap_message_t *req, coap_message_t *res,
                                          uint8_t *buf, uint16_t preferred_size, int32_t *offset) {
-    snprintf((char *)buf, preferred_size, "{\"collector_address\":\"%s\"}", collector_address);
+    payload_writer_t writer;
+    payload_writer_init(&writer, (char *)buf, preferred_size);
+    payload_write_char(&writer, '{');
+    payload_write_string_field(&writer, "collector_address", collector_address);
+    payload_write_char(&writer, '}');
+
     coap_set_header_content_format(res, APPLICATION_JSON);
-    coap_set_payload(res, buf, strlen((char *)buf));
+    coap_set_payload(res, buf, writer.length);
 }
 
 // CoAP Resource for Collector Configuration
-RESOURCE(collector_config, "title=\"Collector Config\";rt=\"Text\"",
+RESOURCE(collector_config, "title=\"Collector Config\";rt=\"Text collector_config\"",
          collector_config_get_handler, NULL, collector_config_put_handler, NULL);
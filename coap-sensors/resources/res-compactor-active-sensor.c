@@ -3,19 +3,19 @@
 #include "sensor_utils.h"
 #include "conversion_utils.h"
 #include "dev/leds.h"
-#include <stdio.h>
+#include "ringlog.h"
 #include <string.h>
 #include <stdbool.h>
 
 // Sensor State
 static bool compactor_state = false; // false: inactive, true: active
 
-// Timer for auto-reset
+// Timer for auto-reset, after compactor_active_ms (a run-time parameter of the firmwares)
 static struct ctimer compactor_timer;
-#define COMPACTOR_ACTIVE_DURATION (CLOCK_SECOND * 10)
+int32_t compactor_active_ms = 10000;
 
 // Define Sensor
-static generic_sensor_t compactor_sensor = {
+generic_sensor_t compactor_sensor_data = {
     "compactor_active", "Boolean", &compactor_state, boolean_to_string, boolean_update_state
 };
 
@@ -27,41 +27,39 @@ static void deactivate_compactor(void *ptr) {
     // Turn off the red LED
     leds_off(LEDS_RED);
 
-    printf("Compactor set to inactive. Red LED turned off.\n");
+    RINGLOG_INFO(RL_SENSOR_COMPACTOR_TIMER_EXPIRED);
 }
 
 // Handler for GET requests
 static void compactor_get_handler(coap_message_t *req, coap_message_t *res,
                                   uint8_t *buf, uint16_t size, int32_t *offset) {
-    generic_get_handler(req, res, buf, size, offset, &compactor_sensor);
+    generic_get_handler(req, res, buf, size, offset, &compactor_sensor_data);
 }
 
 // Handler for PUT requests
 static void compactor_put_handler(coap_message_t *req, coap_message_t *res,
                                   uint8_t *buf, uint16_t size, int32_t *offset) {
 
-    generic_put_handler(req, res, buf, size, offset, &compactor_sensor);
+    generic_put_handler(req, res, buf, size, offset, &compactor_sensor_data);
 
     // handle the received state
     if (compactor_state) {
         // If compactor is active, start or maintain the timer
         if (!ctimer_expired(&compactor_timer)) {
-            printf("Compactor is already active. Timer maintained.\n");
+            RINGLOG_DBG(RL_SENSOR_COMPACTOR_ALREADY_ACTIVE);
         } else {
-            printf("Compactor activated. Starting timer.\n");
-            ctimer_set(&compactor_timer, COMPACTOR_ACTIVE_DURATION, deactivate_compactor, NULL);
+            ctimer_set(&compactor_timer, (clock_time_t)compactor_active_ms * CLOCK_SECOND / 1000, deactivate_compactor, NULL);
             // Turn on the red LED
             leds_on(LEDS_RED);
-            printf("Compactor is active: Red LED ON\n");
+            RINGLOG_INFO(RL_SENSOR_COMPACTOR_ACTIVATED);
         }
     } else {
         // If compactor is inactive, stop the timer and turn off the red LED
-        printf("Compactor deactivated. Stopping timer and turning off the red LED.\n");
         ctimer_stop(&compactor_timer);
         leds_off(LEDS_RED);
-        printf("Compactor is inactive: Red LED OFF\n");
+        RINGLOG_INFO(RL_SENSOR_COMPACTOR_DEACTIVATED);
     }
 }
 
-RESOURCE(compactor_active_sensor, "title=\"Compactor Active\";rt=\"Boolean\"",
+RESOURCE(compactor_active_sensor, "title=\"Compactor Active\";rt=\"Boolean compactor_active\"",
          compactor_get_handler, NULL, compactor_put_handler, NULL);
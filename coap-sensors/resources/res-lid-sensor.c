@@ -3,7 +3,7 @@
 #include "sensor_utils.h"
 #include "dev/leds.h" // Include LEDs header
 #include "conversion_utils.h" // Include conversion utilities
-#include <stdio.h>
+#include "ringlog.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -25,19 +25,19 @@ static void lid_state_update_state(const char *payload, void *state) {
         *(bool *)state = true;
         // Assign a random RFID value when the lid is opened - for simulation purposes
         strcpy(rfid_code, rfid_values[rand() % rfid_values_count]);
-        printf("Lid state set to: open, RFID value assigned: %s\n", rfid_code);
+        RINGLOG_INFO_STR(rfid_code, strlen(rfid_code), RL_SENSOR_LID_OPENED);
     } else if (strcmp(payload, "false") == 0) {
         *(bool *)state = false;
         // Reset RFID value to "No value" when the lid is closed
         strcpy(rfid_code, "No value");
-        printf("Lid state set to: closed, RFID value reset to: %s\n", rfid_code);
+        RINGLOG_INFO(RL_SENSOR_LID_CLOSED);
     } else {
-        printf("Invalid payload for lid state: %s\n", payload);
+        RINGLOG_WARN_STR(payload, strlen(payload), RL_SENSOR_INVALID_LID_STATE);
     }
 }
 
 // define the generic sensor structure
-static generic_sensor_t lid_sensor_data = {
+generic_sensor_t lid_sensor_data = {
     .name = "lid_sensor",
     .type = "Boolean",
     .state = &lid_state,
@@ -62,17 +62,15 @@ static void lid_sensor_put_handler(coap_message_t *request, coap_message_t *resp
         // Lid is open - turn on green LED, turn off red LED
         leds_on(LEDS_GREEN);
         leds_off(LEDS_RED);
-        printf("Lid is open: Green LED ON, Red LED OFF\n");
     } else {
         // Lid is closed - turn on red LED, turn off green LED
         leds_on(LEDS_RED);
         leds_off(LEDS_GREEN);
-        printf("Lid is closed: Red LED ON, Green LED OFF\n");
     }
 }
 
 RESOURCE(lid_sensor,
-         "title=\"Lid Sensor\";rt=\"Boolean\"",
+         "title=\"Lid Sensor\";rt=\"Boolean lid_sensor\"",
          lid_sensor_get_handler,
          NULL,
          lid_sensor_put_handler, NULL);
\ No newline at end of file
@@ -0,0 +1,16 @@
+#include "contiki.h"
+#include "coap-engine.h"
+#include "sensor_utils.h"
+
+// GET handler for the node state, reports every sensor registered on this node
+static void node_state_get_handler(coap_message_t *request, coap_message_t *response,
+                                   uint8_t *buffer, uint16_t preferred_size, int32_t *offset) {
+    generic_state_handler(request, response, buffer, preferred_size, offset);
+}
+
+RESOURCE(node_state,
+         "title=\"Node State\";rt=\"State node_state\"",
+         node_state_get_handler,
+         NULL,
+         NULL,
+         NULL);
@@ -1,6 +1,7 @@
 #include "contiki.h"
 #include "coap-engine.h"
 #include "sensor_utils.h"
+#include "payload_writer.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -8,10 +9,12 @@ char rfid_code[64] = "No data"; // default RFID value when no code is read
 
 // Conversion functions for the RFID reader
 static void rfid_code_to_string(char *buffer, size_t size, void *state) {
-    snprintf(buffer, size, "%s", (char *)state);
+    payload_writer_t writer;
+    payload_writer_init(&writer, buffer, size);
+    payload_write_str(&writer, (char *)state);
 }
 
-static generic_sensor_t rfid_reader_data = {
+generic_sensor_t rfid_reader_data = {
     .name = "rfid_reader",
     .type = "String",
     .state = rfid_code,
@@ -26,7 +29,7 @@ static void rfid_reader_get_handler(coap_message_t *request, coap_message_t *res
 }
 
 RESOURCE(rfid_reader,
-         "title=\"String Sensor\";rt=\"String\"",
+         "title=\"String Sensor\";rt=\"String rfid_reader\"",
          rfid_reader_get_handler,
          NULL,
          NULL,
@@ -2,7 +2,8 @@
 #include "coap-engine.h"
 #include "sensor_utils.h"
 #include "conversion_utils.h"
-#include <stdio.h>
+#include "payload_writer.h"
+#include "ringlog.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -11,21 +12,15 @@ static float scale_value = 0.0;
 
 // Conversion function for the scale sensor
 static void scale_value_to_string(char *buffer, size_t size, void *state) {
-   float value = *(float *)state;
-
-   // separe the integer and decimal part of the value in two integers
-   // because float is not supported by snprintf on the device (it is in the simulator)
-    int integer_part = (int)value;
-    int decimal_part = (int)((value - integer_part) * 100);
-
-   snprintf(buffer, size, "%d.%02d", integer_part, decimal_part);
+    // float is not supported by printf on the device, the value is written as fixed-point with 2 decimals
+    payload_writer_t writer;
+    payload_writer_init(&writer, buffer, size);
+    payload_write_fixed(&writer, payload_round_fixed(*(float *)state, 2), 2);
 }
 
 // Update function for the scale sensor. The received payload is added to the current value
 // this is only for simulation purposes, in a real scenario the value would be read from the sensor
 static void scale_value_update_state(const char *payload, void *state) {
-  printf("Updating scale sensor value with payload: %s\n", payload);
-
   float new_value = atof(payload); // Convert payload string to float
   *(float *)state += new_value;
 
@@ -34,11 +29,13 @@ static void scale_value_update_state(const char *payload, void *state) {
       *(float *)state = 0.0f;
   }
 
-  printf("Scale sensor value updated to: %.2f\n", *(float *)state);
+  // In hundredths, the value is not negative
+  RINGLOG_DBG_STR(payload, strlen(payload), RL_SENSOR_SCALE_UPDATED,
+                  payload_round_fixed(*(float *)state, 2) / 100, payload_round_fixed(*(float *)state, 2) % 100);
 }
 
 // Define the generic sensor structure
-static generic_sensor_t scale_sensor_data = {
+generic_sensor_t scale_sensor_data = {
   .name = "scale_sensor",
   .type = "Numeric",
   .state = &scale_value,
@@ -61,7 +58,7 @@ static void scale_sensor_put_handler(coap_message_t *request, coap_message_t *re
 
 // Define the CoAP resource
 RESOURCE(scale_sensor,
-         "title=\"Scale Sensor\";rt=\"Numeric\"",
+         "title=\"Scale Sensor\";rt=\"Numeric scale_sensor\"",
          scale_sensor_get_handler,
          NULL,
          scale_sensor_put_handler,
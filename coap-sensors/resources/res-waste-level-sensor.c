@@ -2,13 +2,16 @@
 #include "coap-engine.h"
 #include "sensor_utils.h"
 #include "conversion_utils.h"
-#include <stdio.h>
+#include "payload_writer.h"
+#include "ringlog.h"
 #include <string.h>
 
 static int waste_level = 0; // Initial waste level (percentage)
 
 static void waste_level_to_string(char *buffer, size_t size, void *state) {
-    snprintf(buffer, size, "%.2d", *(int *)state);
+    payload_writer_t writer;
+    payload_writer_init(&writer, buffer, size);
+    payload_write_int(&writer, *(int *)state);
 }
 
 // Update function for the waste level sensor. The received payload is added to the current value
@@ -21,11 +24,11 @@ static void waste_level_update_state(const char *payload, void *state) {
     } else if (*(int *)state > 100.0) {
         *(int *)state = 100.0; // Clamp to maximum 100%
     }
-    printf("Waste level updated to: %.2d%%\n", *(int *)state);
+    RINGLOG_DBG(RL_SENSOR_WASTE_LEVEL_UPDATED, *(int *)state);
 }
 
 // Define the generic sensor structure
-static generic_sensor_t waste_level_sensor_data = {
+generic_sensor_t waste_level_sensor_data = {
     .name = "waste_level_sensor",
     .type = "Numeric",
     .state = &waste_level,
@@ -46,7 +49,7 @@ static void waste_level_sensor_put_handler(coap_message_t *request, coap_message
 }
 
 RESOURCE(waste_level_sensor,
-         "title=\"Waste Level Sensor\";rt=\"Numeric\"",
+         "title=\"Waste Level Sensor\";rt=\"Numeric waste_level_sensor\"",
          waste_level_sensor_get_handler,
          NULL,
          waste_level_sensor_put_handler, NULL);
@@ -1,7 +1,9 @@
 #include "sensor_utils.h"
 #include "coap-engine.h"
 #include "conversion_utils.h"
-#include <stdio.h>
+#include "cbor_utils.h"
+#include "payload_writer.h"
+#include "ringlog.h"
 #include <string.h>
 
 // flag used to know when to send an update
@@ -9,23 +11,76 @@ process_event_t collector_update_event;
 
 bool update_required = false;
 
+// Sensors hosted on this node, reported together by the node state resource
+static const generic_sensor_t *node_sensors[MAX_NODE_SENSORS];
+static uint8_t node_sensor_count = 0;
+
+
+// Representation requested with the Accept option. JSON is the default so that debugging tools keep
+// working, CBOR is the compact binary representation used by the collector
+static unsigned int requested_content_format(coap_message_t *request) {
+    unsigned int accept = APPLICATION_JSON;
+    coap_get_header_accept(request, &accept);
+    return accept;
+}
+
+// Set a CBOR payload built in the response buffer, or an error if it did not fit
+static void set_cbor_payload(coap_message_t *response, const cbor_writer_t *writer) {
+    if (writer->overflow) {
+        coap_set_status_code(response, INTERNAL_SERVER_ERROR_5_00);
+        return;
+    }
+    coap_set_header_content_format(response, APPLICATION_CBOR);
+    coap_set_payload(response, writer->buffer, writer->length);
+}
+
+// Set a JSON payload built in the response buffer, or an error if it did not fit
+static void set_json_payload(coap_message_t *response, const payload_writer_t *writer) {
+    if (writer->overflow) {
+        coap_set_status_code(response, INTERNAL_SERVER_ERROR_5_00);
+        return;
+    }
+    coap_set_header_content_format(response, APPLICATION_JSON);
+    coap_set_payload(response, writer->buffer, writer->length);
+}
 
 // Generic GET Handler
 void generic_get_handler(coap_message_t *request, coap_message_t *response,
                          uint8_t *buffer, uint16_t preferred_size, int32_t *offset,
                          const generic_sensor_t *sensor) {
     char state_buffer[64];
+    unsigned int format = requested_content_format(request);
+
+    if (format != APPLICATION_JSON && format != APPLICATION_CBOR) {
+        coap_set_status_code(response, NOT_ACCEPTABLE_4_06);
+        return;
+    }
 
     // Convert the sensor state to a string
     sensor->to_string(state_buffer, sizeof(state_buffer), sensor->state);
 
-    // Format the response payload
-    snprintf((char *)buffer, preferred_size,
-             "{\"%s\":{\"value\":\"%s\"}}",
-             sensor->name, state_buffer);
+    if (format == APPLICATION_CBOR) {
+        // {"<name>":"<value>"} encoded as CBOR
+        cbor_writer_t writer;
+        cbor_writer_init(&writer, buffer, preferred_size);
+        cbor_write_map(&writer, 1);
+        cbor_write_text(&writer, sensor->name, strlen(sensor->name));
+        cbor_write_text(&writer, state_buffer, strlen(state_buffer));
+        set_cbor_payload(response, &writer);
+        return;
+    }
+
+    // Format the response payload: {"<name>":{"value":"<value>"}}
+    payload_writer_t writer;
+    payload_writer_init(&writer, (char *)buffer, preferred_size);
+    payload_write_char(&writer, '{');
+    payload_write_key(&writer, sensor->name);
+    payload_write_char(&writer, '{');
+    payload_write_string_field(&writer, "value", state_buffer);
+    payload_write_str(&writer, "}}");
 
     // Set the CoAP response payload
-    coap_set_payload(response, buffer, strlen((char *)buffer));
+    set_json_payload(response, &writer);
 }
 
 // Generic PUT Handler
@@ -47,6 +102,51 @@ void generic_put_handler(coap_message_t *request, coap_message_t *response,
     }
 }
 
+// Register a sensor to be included in the node state resource
+void register_node_sensor(const generic_sensor_t *sensor) {
+    if (node_sensor_count >= MAX_NODE_SENSORS) {
+        RINGLOG_ERR_STR(sensor->name, strlen(sensor->name), RL_SENSOR_NODE_STATE_FULL);
+        return;
+    }
+    node_sensors[node_sensor_count++] = sensor;
+}
+
+// Node State GET Handler: {"<name>":"<value>",...} for every registered sensor,
+// so that the collector can read all the co-located sensors with a single request
+void generic_state_handler(coap_message_t *request, coap_message_t *response,
+                           uint8_t *buffer, uint16_t preferred_size, int32_t *offset) {
+    char state_buffer[64];
+    unsigned int format = requested_content_format(request);
+
+    if (format != APPLICATION_JSON && format != APPLICATION_CBOR) {
+        coap_set_status_code(response, NOT_ACCEPTABLE_4_06);
+        return;
+    }
+
+    if (format == APPLICATION_CBOR) {
+        cbor_writer_t writer;
+        cbor_writer_init(&writer, buffer, preferred_size);
+        cbor_write_map(&writer, node_sensor_count);
+        for (uint8_t i = 0; i < node_sensor_count; i++) {
+            node_sensors[i]->to_string(state_buffer, sizeof(state_buffer), node_sensors[i]->state);
+            cbor_write_text(&writer, node_sensors[i]->name, strlen(node_sensors[i]->name));
+            cbor_write_text(&writer, state_buffer, strlen(state_buffer));
+        }
+        set_cbor_payload(response, &writer);
+        return;
+    }
+
+    payload_writer_t writer;
+    payload_writer_init(&writer, (char *)buffer, preferred_size);
+    payload_write_char(&writer, '{');
+    for (uint8_t i = 0; i < node_sensor_count; i++) {
+        node_sensors[i]->to_string(state_buffer, sizeof(state_buffer), node_sensors[i]->state);
+        payload_write_string_field(&writer, node_sensors[i]->name, state_buffer);
+    }
+    payload_write_char(&writer, '}');
+
+    set_json_payload(response, &writer);
+}
 
 void
 client_chunk_handler(coap_message_t *response)
@@ -54,11 +154,11 @@ client_chunk_handler(coap_message_t *response)
     const uint8_t *chunk;
 
     if(response == NULL) {
-        puts("Request timed out");
+        RINGLOG_WARN(RL_REQUEST_TIMEOUT);
         return;
     }
 
     int len = coap_get_payload(response, &chunk);
 
-    printf("|%.*s\n", len, (char *)chunk);
+    RINGLOG_DBG_STR((const char *)chunk, len, RL_RESPONSE_PAYLOAD);
 }
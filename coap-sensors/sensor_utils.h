@@ -12,6 +12,9 @@ typedef struct {
     void (*update_state)(const char *payload, void *state);
 } generic_sensor_t;
 
+// Maximum number of sensors a single node can aggregate in its state resource
+#define MAX_NODE_SENSORS 5
+
 // Generic handlers
 void generic_get_handler(coap_message_t *request, coap_message_t *response,
                          uint8_t *buffer, uint16_t preferred_size, int32_t *offset,
@@ -20,6 +23,11 @@ void generic_put_handler(coap_message_t *request, coap_message_t *response,
                          uint8_t *buffer, uint16_t preferred_size, int32_t *offset,
                          const generic_sensor_t *sensor);
 
+// Node state: all the sensors registered on this node in a single payload
+void register_node_sensor(const generic_sensor_t *sensor);
+void generic_state_handler(coap_message_t *request, coap_message_t *response,
+                           uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+
 void
 client_chunk_handler(coap_message_t *response);
 
@@ -1,5 +1,9 @@
 #include "contiki.h"
 #include "coap-engine.h"
+#include "rd_client.h"
+#include "ringlog.h"
+#include "param_store.h"
+#include "sensor_utils.h"
 #include <stdio.h>
 #include "net/ipv6/uip.h"
 #include "net/ipv6/uiplib.h"
@@ -8,6 +12,8 @@
 // Declare the resource from the resource file
 extern coap_resource_t waste_level_sensor;
 extern coap_resource_t collector_config;
+extern coap_resource_t node_state;
+extern generic_sensor_t waste_level_sensor_data;
 
 PROCESS(waste_level_sensor_process, "Waste Level Sensor Process");
 AUTOSTART_PROCESSES(&waste_level_sensor_process);
@@ -16,10 +22,20 @@ PROCESS_THREAD(waste_level_sensor_process, ev, data)
 {
   PROCESS_BEGIN();
 
+  ringlog_start();
+  param_store_init(NULL, 0, NULL); // the log level only
+
   // Activate the CoAP resource
   coap_activate_resource(&waste_level_sensor, "waste/level");
   coap_activate_resource(&collector_config, "config/collector");
 
+  // Expose the sensor through the node state resource
+  register_node_sensor(&waste_level_sensor_data);
+  coap_activate_resource(&node_state, "state");
+
+  // Announce the node to the resource directory
+  rd_client_start();
+
   while (1) {
     PROCESS_WAIT_EVENT();
   }
@@ -0,0 +1,272 @@
+import logging
+import os
+import threading
+import time
+import xml.etree.ElementTree as ET
+from collections import OrderedDict
+from concurrent.futures import ThreadPoolExecutor
+
+from coapthon.client.helperclient import HelperClient
+
+# CoAP control of the bin nodes for scrap_remote_control.py:
+#   - BinConfig keeps config.xml parsed, indexed by bin and by node address, and reloads it when the file
+#     changes, instead of parsing it for every request
+#   - CoapClientPool keeps the clients of the recently used nodes open: a client is a socket and a receive
+#     thread, created once per node instead of once per request
+#   - CoapControl sends the PUTs, from a thread pool for the provisioning and the commands that nobody
+#     waits for, so that an unreachable node only holds one worker
+# Node addresses are bare IPv6 addresses (port 5683) or coap://[address]:port, as used by the emulators.
+
+COAP_PORT = 5683
+COAP_TIMEOUT = 5.0  # seconds
+COAP_WORKERS = 32
+CONFIG_CHECK_INTERVAL = 1.0  # seconds between checks of the modification time of config.xml
+CLIENTS_PER_ENDPOINT = 2  # idle clients kept per node
+MAX_IDLE_CLIENTS = 1024  # idle clients kept in total, the least recently used are closed first
+CLIENT_IDLE_TIMEOUT = 60.0  # seconds before an unused client is closed
+
+CONFIG_KEYS = [
+    'collector_address',
+    'lid_sensor_address',
+    'lid_actuator_address',
+    'compactor_sensor_address',
+    'scale_sensor_address',
+    'waste_level_sensor_address',
+    'compactor_actuator_address',
+]
+
+# Node of a resource path, by its first segment and whether it is an actuator resource
+ACTUATOR_RESOURCES = {'command', 'config'}
+PATH_ADDRESS_KEYS = {
+    ('compactor', True): 'compactor_actuator_address',
+    ('lid', True): 'lid_actuator_address',
+    ('compactor', False): 'compactor_sensor_address',
+    ('lid', False): 'lid_sensor_address',
+    ('scale', False): 'scale_sensor_address',
+    ('waste', False): 'waste_level_sensor_address',
+}
+
+
+# Parse config.xml into {bin_id: {configuration key: address}}. Node addresses are optional,
+# the nodes that are not listed are found through the resource directory
+def parse_config_xml(path):
+    bins = {}
+    for bin in ET.parse(path).getroot().findall('bin'):
+        bins[bin.get('id')] = {key: bin.findtext(key) for key in CONFIG_KEYS}
+    return bins
+
+
+def path_address_key(path):
+    segments = path.strip('/').split('/')
+    actuator = len(segments) > 1 and segments[1] in ACTUATOR_RESOURCES
+    return PATH_ADDRESS_KEYS.get((segments[0], actuator))
+
+
+# CoAP endpoint (host, port) of a node address
+def coap_endpoint(address):
+    if address.startswith('coap://'):
+        address = address[len('coap://'):]
+    host, port = address, COAP_PORT
+    if address.startswith('['):
+        host, _, rest = address[1:].partition(']')
+        if rest.startswith(':'):
+            port = int(rest[1:])
+    # replace fe80:: with fd00:: for local testing
+    return host.replace('fe80::', 'fd00::'), port
+
+
+class BinConfig:
+    """config.xml, parsed once and reloaded by a watcher thread when the file is modified."""
+
+    def __init__(self, path, on_change=None, check_interval=CONFIG_CHECK_INTERVAL):
+        self.path = path
+        # on_change(bin_ids) is called after a reload with the bins that were added or changed
+        self.on_change = on_change
+        self.check_interval = check_interval
+        self.lock = threading.Lock()
+        self.mtime = os.stat(path).st_mtime_ns
+        self.bins = parse_config_xml(path)
+        self.index_addresses()
+
+    def index_addresses(self):
+        self.bins_by_address = {address: bin_id for bin_id, bin_data in self.bins.items()
+                                for address in bin_data.values() if address}
+
+    # The configuration of the bins, not to be modified: a reload replaces it
+    def current(self):
+        with self.lock:
+            return self.bins
+
+    def get(self, bin_id):
+        with self.lock:
+            return self.bins.get(bin_id)
+
+    # Bin of a node listed in config.xml
+    def bin_of(self, address):
+        with self.lock:
+            return self.bins_by_address.get(address)
+
+    # Reload the file if it was modified, a file that does not parse is ignored until it is modified again
+    def check(self):
+        try:
+            mtime = os.stat(self.path).st_mtime_ns
+            if mtime == self.mtime:
+                return
+        except OSError as e:
+            logging.error(f"Could not reload {self.path}: {e}")
+            return
+        try:
+            bins = parse_config_xml(self.path)
+        except (OSError, ET.ParseError) as e:
+            logging.error(f"Could not reload {self.path}: {e}")
+            self.mtime = mtime
+            return
+        with self.lock:
+            changed = [bin_id for bin_id, bin_data in bins.items() if self.bins.get(bin_id) != bin_data]
+            self.mtime, self.bins = mtime, bins
+            self.index_addresses()
+        logging.info(f"Reloaded {self.path}: {len(bins)} bins, {len(changed)} added or changed")
+        if changed and self.on_change:
+            self.on_change(changed)
+
+    def watch(self):
+        def run():
+            while True:
+                time.sleep(self.check_interval)
+                self.check()
+
+        threading.Thread(target=run, daemon=True).start()
+
+
+class CoapClientPool:
+    """Idle CoAP clients by endpoint, in least recently used order."""
+
+    def __init__(self, clients_per_endpoint=CLIENTS_PER_ENDPOINT, max_idle=MAX_IDLE_CLIENTS,
+                 idle_timeout=CLIENT_IDLE_TIMEOUT, client_factory=HelperClient):
+        self.clients_per_endpoint = clients_per_endpoint
+        self.max_idle = max_idle
+        self.idle_timeout = idle_timeout
+        self.client_factory = client_factory
+        self.lock = threading.Lock()
+        # endpoint -> [(client, released at)]
+        self.idle = OrderedDict()
+        self.idle_count = 0
+        self.created = 0
+        threading.Thread(target=self.run_reaper, daemon=True).start()
+
+    def acquire(self, endpoint):
+        with self.lock:
+            clients = self.idle.get(endpoint)
+            if clients:
+                client, _ = clients.pop()
+                self.idle_count -= 1
+                if not clients:
+                    del self.idle[endpoint]
+                return client
+            self.created += 1
+        return self.client_factory(server=endpoint)
+
+    def release(self, endpoint, client):
+        with self.lock:
+            clients = self.idle.setdefault(endpoint, [])
+            self.idle.move_to_end(endpoint)
+            if len(clients) < self.clients_per_endpoint:
+                clients.append((client, time.monotonic()))
+                self.idle_count += 1
+                closed = self.evict()
+            else:
+                closed = [client]
+        for client in closed:
+            client.stop()
+
+    # Remove the least recently used clients beyond the limit or unused for too long, with the lock held
+    def evict(self):
+        now = time.monotonic()
+        closed = []
+        while self.idle:
+            oldest_endpoint, oldest = next(iter(self.idle.items()))
+            if self.idle_count <= self.max_idle and now - oldest[0][1] < self.idle_timeout:
+                break
+            closed.append(oldest.pop(0)[0])
+            self.idle_count -= 1
+            if not oldest:
+                del self.idle[oldest_endpoint]
+        return closed
+
+    # Close the clients left unused once the requests stop
+    def run_reaper(self):
+        while True:
+            time.sleep(self.idle_timeout / 2)
+            with self.lock:
+                closed = self.evict()
+            for client in closed:
+                client.stop()
+
+    # PUT through a pooled client. A client whose request failed or timed out is closed, so that a late
+    # response cannot be taken for the response of its next request.
+    def put(self, endpoint, path, payload, timeout=COAP_TIMEOUT):
+        client = self.acquire(endpoint)
+        try:
+            response = client.put(path, payload, timeout=timeout)
+        except Exception:
+            client.stop()
+            raise
+        if response is None:
+            client.stop()
+            raise TimeoutError(f"No response from [{endpoint[0]}]:{endpoint[1]} within {timeout} s")
+        self.release(endpoint, client)
+        return response
+
+    def close(self):
+        with self.lock:
+            clients = [client for idle in self.idle.values() for client, _ in idle]
+            self.idle.clear()
+            self.idle_count = 0
+        for client in clients:
+            client.stop()
+
+
+class CoapControl:
+    """PUTs to the nodes of the bins, addressed by bin and resource path."""
+
+    def __init__(self, bin_config, resolve_address=None, pool=None, workers=COAP_WORKERS, timeout=COAP_TIMEOUT):
+        self.bin_config = bin_config
+        # resolve_address(bin_id, key) gives the address of a node registered elsewhere, e.g. in the resource
+        # directory, which is preferred to the one in config.xml
+        self.resolve_address = resolve_address
+        self.pool = pool or CoapClientPool()
+        self.timeout = timeout
+        self.executor = ThreadPoolExecutor(workers, thread_name_prefix="coap")
+
+    def address(self, bin_id, key):
+        address = self.resolve_address(bin_id, key) if self.resolve_address else None
+        return address or (self.bin_config.get(bin_id) or {}).get(key)
+
+    # Send a PUT and wait for the response, returns whether it was delivered
+    def put(self, bin_id, path, payload):
+        key = path_address_key(path)
+        address = self.address(bin_id, key) if key else None
+        if not address:
+            logging.error(f"No CoAP server address found for path {path} of bin {bin_id}")
+            return False
+        try:
+            response = self.pool.put(coap_endpoint(address), path, payload, self.timeout)
+            logging.info(f"CoAP PUT request sent to {path} of bin {bin_id}. Response: {response.payload}")
+            return True
+        except Exception as e:
+            logging.error(f"CoAP request to {path} of bin {bin_id} failed: {e}")
+            return False
+
+    # Send a PUT from the thread pool, the future gives whether it was delivered
+    def submit(self, bin_id, path, payload):
+        return self.executor.submit(self.put, bin_id, path, payload)
+
+    # Give the actuators of a bin the address of the sensor they follow (FOR SIMULATION PURPOSES ONLY),
+    # returns the futures of the PUTs
+    def provision_bin(self, bin_id, bin_data):
+        futures = []
+        if bin_data.get('compactor_actuator_address') and bin_data.get('compactor_sensor_address'):
+            futures.append(self.submit(bin_id, '/compactor/config', f"{bin_data['compactor_sensor_address']}"))
+        if bin_data.get('lid_actuator_address') and bin_data.get('lid_sensor_address'):
+            futures.append(self.submit(bin_id, '/lid/config', f"{bin_data['lid_sensor_address']}"))
+        return futures
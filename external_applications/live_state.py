@@ -0,0 +1,82 @@
+import queue
+import threading
+from datetime import datetime
+
+# Live state of the dashboard: the current state of the bins, kept up to date from the "bins" MQTT stream,
+# and the events pushed to the connected dashboards (server-sent events). Every dashboard gets its own
+# bounded queue: a viewer that stops reading is dropped instead of slowing down the others.
+
+SUBSCRIBER_QUEUE_SIZE = 1000
+
+# Fields of bins_current_state and the telemetry fields they come from
+BIN_FIELDS = {
+    "rfid": "rfid",
+    "lid_state": "lid_sensor",
+    "compactor_state": "compactor_sensor",
+    "waste_level": "waste_level_sensor",
+    "scale_weight": "scale",
+}
+
+
+class EventBroadcaster:
+    def __init__(self):
+        self.subscribers = set()
+        self.lock = threading.Lock()
+
+    def subscribe(self):
+        subscriber = queue.Queue(SUBSCRIBER_QUEUE_SIZE)
+        with self.lock:
+            self.subscribers.add(subscriber)
+        return subscriber
+
+    # A dropped subscriber reads what is left in its queue and ends its stream
+    def is_subscribed(self, subscriber):
+        with self.lock:
+            return subscriber in self.subscribers
+
+    def unsubscribe(self, subscriber):
+        with self.lock:
+            self.subscribers.discard(subscriber)
+
+    def publish(self, event, data):
+        with self.lock:
+            subscribers = list(self.subscribers)
+        for subscriber in subscribers:
+            try:
+                subscriber.put_nowait((event, data))
+            except queue.Full:
+                self.unsubscribe(subscriber)
+
+
+class LiveBins:
+    """Current state of the bins, in the format of bins_current_state rows"""
+
+    def __init__(self, broadcaster):
+        self.broadcaster = broadcaster
+        self.bins = {}
+        self.lock = threading.Lock()
+
+    def load(self, rows):
+        with self.lock:
+            for row in rows:
+                self.bins[row["bin_id"]] = dict(row)
+
+    def snapshot(self):
+        with self.lock:
+            return [dict(row) for row in self.bins.values()]
+
+    # Apply a telemetry message, the dashboards are notified when the state of the bin changes
+    def update(self, data):
+        bin_id = data.get("bin_id")
+        if not bin_id:
+            return
+        values = {field: str(data[key]).replace(",", ".") if field in ("waste_level", "scale_weight") else data[key]
+                  for field, key in BIN_FIELDS.items() if data.get(key) is not None}
+        with self.lock:
+            row = self.bins.setdefault(bin_id, {"bin_id": bin_id})
+            if all(str(row.get(field)) == str(value) for field, value in values.items()):
+                return
+            row.update(values)
+            row["last_updated"] = datetime.now().replace(microsecond=0)
+            row = dict(row)
+        self.broadcaster.publish("bin", row)
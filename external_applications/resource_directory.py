@@ -0,0 +1,200 @@
+import logging
+import threading
+import time
+from coapthon import defines
+from coapthon.client.helperclient import HelperClient
+from coapthon.resources.resource import Resource
+from coapthon.server.coap import CoAP
+
+# Resource directory (RFC 9176) used by the nodes to announce themselves.
+# Nodes use simple registration: an empty POST to /.well-known/rd?ep=<name>&lt=<lifetime>[&d=<bin_id>],
+# then the directory reads /.well-known/core from the node. Refreshes of an unchanged node are only
+# a timestamp update, so the links are fetched and the listeners notified only when something changes.
+
+RD_ADDRESS = "::"
+RD_PORT = 5683
+COAP_PORT = 5683
+DEFAULT_LIFETIME = 90000  # seconds, default from RFC 9176
+EXPIRY_CHECK_INTERVAL = 1.0  # seconds between the scans for expired registrations
+
+
+# Parse a query string "a=1&b=2" into a dictionary
+def parse_query(query):
+    params = {}
+    for param in (query or "").split("&"):
+        if "=" in param:
+            key, value = param.split("=", 1)
+            params[key] = value
+    return params
+
+
+# Parse a link format document (RFC 6690) into a list of (path, attributes) tuples
+def parse_link_format(payload):
+    links = []
+    for link in (payload or "").split(","):
+        parts = link.strip().split(";")
+        if not parts[0].startswith("<") or not parts[0].endswith(">"):
+            continue
+        attributes = {}
+        for attribute in parts[1:]:
+            key, _, value = attribute.partition("=")
+            attributes[key] = value.strip('"')
+        links.append((parts[0][1:-1], attributes))
+    return links
+
+
+# Check if a link has the requested resource type, rt can hold several space separated types
+def has_resource_type(attributes, resource_type):
+    return resource_type in attributes.get("rt", "").split()
+
+
+class ResourceDirectory:
+    """Registrations of the nodes, indexed by endpoint name and by sector."""
+
+    def __init__(self, resolve_sector=None, on_change=None):
+        # resolve_sector(endpoint_name) gives the bin of nodes that registered without a sector
+        self.resolve_sector = resolve_sector
+        # on_change(endpoint_name, registration) is called for new or changed registrations
+        self.on_change = on_change
+        self.registrations = {}
+        self.sectors = {}
+        self.next_expiry_check = 0.0
+        self.lock = threading.Lock()
+
+    # Register or refresh a node, returns True if the registration is new or changed
+    def register(self, endpoint_name, address, lifetime, sector=None):
+        if not sector and self.resolve_sector:
+            sector = self.resolve_sector(endpoint_name)
+
+        with self.lock:
+            registration = self.registrations.get(endpoint_name)
+            if registration and registration["address"] == address and registration["sector"] == sector:
+                registration["expires"] = time.time() + lifetime
+                return False
+
+        links = self.fetch_links(address)
+        registration = {
+            "address": address,
+            "sector": sector,
+            "links": links,
+            "expires": time.time() + lifetime,
+        }
+        with self.lock:
+            self.remove(endpoint_name)
+            self.registrations[endpoint_name] = registration
+            self.sectors.setdefault(sector, set()).add(endpoint_name)
+
+        logging.info(f"Node {endpoint_name} registered at {address} for bin {sector} with {len(links)} resources")
+        if self.on_change:
+            self.on_change(endpoint_name, registration)
+        return True
+
+    # Read the resources of a node from its /.well-known/core
+    def fetch_links(self, address):
+        client = HelperClient(server=(address, COAP_PORT))
+        try:
+            response = client.discover()
+            return parse_link_format(response.payload if response else None)
+        except Exception as e:
+            logging.error(f"Resource discovery on {address} failed: {e}")
+            return []
+        finally:
+            client.stop()
+
+    # Remove a registration, with the lock held
+    def remove(self, endpoint_name):
+        registration = self.registrations.pop(endpoint_name, None)
+        if registration:
+            endpoints = self.sectors[registration["sector"]]
+            endpoints.discard(endpoint_name)
+            if not endpoints:
+                del self.sectors[registration["sector"]]
+
+    # Drop the registrations whose lifetime expired, scanning them at most once per EXPIRY_CHECK_INTERVAL
+    def expire(self):
+        now = time.time()
+        with self.lock:
+            if now < self.next_expiry_check:
+                return
+            self.next_expiry_check = now + EXPIRY_CHECK_INTERVAL
+            for endpoint_name in [ep for ep, reg in self.registrations.items() if reg["expires"] < now]:
+                logging.info(f"Registration of node {endpoint_name} expired")
+                self.remove(endpoint_name)
+
+    # Current registrations, without the expired ones
+    def list_registrations(self):
+        self.expire()
+        with self.lock:
+            return list(self.registrations.values())
+
+    # Find the resources with the given resource type and sector, as (address, path, attributes) tuples
+    def lookup(self, resource_type=None, sector=None):
+        self.expire()
+        results = []
+        with self.lock:
+            if sector:
+                registrations = [self.registrations[ep] for ep in self.sectors.get(sector, ())]
+            else:
+                registrations = self.registrations.values()
+            for registration in registrations:
+                for path, attributes in registration["links"]:
+                    if resource_type is None or has_resource_type(attributes, resource_type):
+                        results.append((registration["address"], path, attributes))
+        return results
+
+
+class RegistrationResource(Resource):
+    """/.well-known/rd: simple registration endpoint."""
+
+    def __init__(self, directory, name="RegistrationResource", coap_server=None):
+        super(RegistrationResource, self).__init__(name, coap_server, visible=True, observable=False, allow_children=False)
+        self.directory = directory
+
+    def render_POST_advanced(self, request, response):
+        params = parse_query(request.uri_query)
+        endpoint_name = params.get("ep")
+        if not endpoint_name:
+            response.code = defines.Codes.BAD_REQUEST.number
+            return self, response
+
+        address = request.source[0]
+        lifetime = int(params.get("lt", DEFAULT_LIFETIME))
+        sector = params.get("d")
+
+        # Fetching the links talks to the node, so it must not run in the server thread
+        threading.Thread(target=self.directory.register, args=(endpoint_name, address, lifetime, sector),
+                         daemon=True).start()
+        response.code = defines.Codes.CHANGED.number
+        return self, response
+
+
+class ResourceLookupResource(Resource):
+    """/rd-lookup/res: resource lookup filtered by rt and d."""
+
+    def __init__(self, directory, name="ResourceLookupResource", coap_server=None):
+        super(ResourceLookupResource, self).__init__(name, coap_server, visible=True, observable=False, allow_children=False)
+        self.directory = directory
+
+    def render_GET_advanced(self, request, response):
+        params = parse_query(request.uri_query)
+        links = []
+        for address, path, attributes in self.directory.lookup(params.get("rt"), params.get("d")):
+            link = f"<coap://[{address}]:{COAP_PORT}{path}>"
+            if "rt" in attributes:
+                link += f';rt="{attributes["rt"]}"'
+            links.append(link)
+
+        response.payload = ",".join(links)
+        response.content_type = defines.Content_types["application/link-format"]
+        response.code = defines.Codes.CONTENT.number
+        return self, response
+
+
+# Start the resource directory server in a background thread
+def start_resource_directory(directory, address=RD_ADDRESS, port=RD_PORT):
+    server = CoAP((address, port))
+    server.add_resource(".well-known/rd/", RegistrationResource(directory))
+    server.add_resource("rd-lookup/res/", ResourceLookupResource(directory))
+    threading.Thread(target=server.listen, args=(10,), daemon=True).start()
+    logging.info(f"Resource directory listening on [{address}]:{port}")
+    return server
@@ -0,0 +1,106 @@
+import logging
+import threading
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+# Rules on the telemetry of the bins, evaluated on every message of the "bins" MQTT stream:
+#   - waste level above the threshold with the compactor not running: activate the compactor
+#   - compactor stopping while the waste level is above the threshold: raise an alarm, unless the bin
+#     already has one that is not acknowledged
+# The state needed by the rules (last compactor state, unacknowledged alarms) is kept in memory, so a
+# message is evaluated without reading the database. The caller only passes the messages advancing the sequence
+# number of their bin (sequence_filter.py): a late or duplicate one would take the compactor state back.
+# Commands and alarms are issued by a thread pool, away from the MQTT thread.
+
+COMMAND_RETRY_INTERVAL = 10.0  # seconds before a compactor command without effect is sent again
+ACTION_WORKERS = 4
+
+
+def parse_level(value):
+    try:
+        return float(str(value).replace(",", "."))
+    except (TypeError, ValueError):
+        return None
+
+
+class BinRules:
+    """Rule state of a bin"""
+
+    def __init__(self):
+        self.compactor_state = None
+        self.last_command = None
+
+
+class RuleEngine:
+    def __init__(self, threshold, activate_compactor, raise_alarm, command_retry_interval=COMMAND_RETRY_INTERVAL):
+        self.threshold = threshold
+        # activate_compactor(bin_id) sends the command, raise_alarm(bin_id, message) stores the alarm and
+        # returns its ID, or None when it could not be stored
+        self.activate_compactor = activate_compactor
+        self.raise_alarm = raise_alarm
+        self.command_retry_interval = command_retry_interval
+        self.bins = {}
+        # Unacknowledged alarms: IDs by bin (with a placeholder while the alarm is stored) and bin by ID
+        self.alarms = {}
+        self.alarm_bins = {}
+        self.lock = threading.Lock()
+        self.executor = ThreadPoolExecutor(ACTION_WORKERS, thread_name_prefix="rules")
+
+    # Initial unacknowledged alarms, as (alarm_id, bin_id)
+    def load_alarms(self, alarms):
+        with self.lock:
+            for alarm_id, bin_id in alarms:
+                self.alarms.setdefault(bin_id, set()).add(alarm_id)
+                self.alarm_bins[alarm_id] = bin_id
+
+    def acknowledge(self, alarm_id):
+        with self.lock:
+            bin_id = self.alarm_bins.pop(alarm_id, None)
+            if bin_id is not None:
+                self.remove_alarm(bin_id, alarm_id)
+
+    def remove_alarm(self, bin_id, alarm_id):
+        self.alarms[bin_id].discard(alarm_id)
+        if not self.alarms[bin_id]:
+            del self.alarms[bin_id]
+
+    def on_update(self, data):
+        bin_id = data.get("bin_id")
+        waste_level = parse_level(data.get("waste_level_sensor"))
+        compactor_state = data.get("compactor_sensor")
+        if not bin_id or waste_level is None or compactor_state is None:
+            return
+
+        with self.lock:
+            rules = self.bins.setdefault(bin_id, BinRules())
+            previous_state = rules.compactor_state
+            rules.compactor_state = compactor_state
+            if compactor_state == "on":
+                rules.last_command = None
+
+            if waste_level <= self.threshold:
+                rules.last_command = None
+                return
+
+            if compactor_state == "off" and previous_state == "on" and bin_id not in self.alarms:
+                token = object()
+                self.alarms[bin_id] = {token}
+                self.executor.submit(self.store_alarm, bin_id, token,
+                                     f"Waste level exceeded in bin {bin_id}: {waste_level}%")
+
+            now = time.monotonic()
+            if compactor_state != "on" and (rules.last_command is None or
+                                            now - rules.last_command >= self.command_retry_interval):
+                rules.last_command = now
+                logging.warning(f"Waste level exceeded in bin {bin_id}: {waste_level}%")
+                self.executor.submit(self.activate_compactor, bin_id)
+
+    def store_alarm(self, bin_id, token, message):
+        alarm_id = self.raise_alarm(bin_id, message)
+        with self.lock:
+            self.remove_alarm(bin_id, token)
+            if alarm_id is not None:
+                self.alarms.setdefault(bin_id, set()).add(alarm_id)
+                self.alarm_bins[alarm_id] = bin_id
+        if alarm_id is not None:
+            logging.warning(f"Compactor turned off while waste level exceeded in bin {bin_id}. Alarm {alarm_id} raised.")
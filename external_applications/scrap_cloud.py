@@ -1,9 +1,22 @@
 import paho.mqtt.client as mqtt
 import mysql.connector
+import mysql.connector.pooling
 import xml.etree.ElementTree as ET
+import sqlite3
+import argparse
 import json
+import multiprocessing
+import signal
+import threading
+import time
+import re
+import zlib
+from contextlib import contextmanager
 from datetime import datetime
 
+import timeseries
+from sequence_filter import SequenceFilter, DUPLICATE
+
 # MySQL connection 
 DB_CONFIG = {
     "host": "localhost",
@@ -18,27 +31,66 @@ BROKER_PORT = 1883
 UPDATES_TOPIC = "bins"
 CONFIG_REQUEST_TOPIC = "config/request"
 CONFIG_RESPONSE_TOPIC = "config/response"
+# Progress of the ingest, followed by tools/telemetry_replay.py to measure throughput and backlog
+INGEST_STATS_TOPIC = "ingest/stats"
+INGEST_STATS_INTERVAL = 1.0  # seconds
+# Database writes are batched: committed every WRITE_BATCH_ROWS rows or WRITE_BATCH_INTERVAL seconds
+DB_POOL_SIZE = 4
+WRITE_BATCH_ROWS = 500
+WRITE_BATCH_INTERVAL = 0.2  # seconds
+# A batch the database failed to write is queued again, and tried after a delay doubling from
+# WRITE_BATCH_INTERVAL up to WRITE_RETRY_MAX_DELAY. The last flush before exiting makes WRITE_FINAL_ATTEMPTS
+WRITE_RETRY_MAX_DELAY = 30.0  # seconds
+WRITE_FINAL_ATTEMPTS = 3
+# Updates are processed by INGEST_WORKERS processes, each owning the bins whose bin_id hashes to it. Several
+# instances split the fleet the same way with --shard, every instance receiving all the updates
+INGEST_WORKERS = 4
+INGEST_QUEUE_SIZE = 10000  # updates waiting per worker before the MQTT receive blocks
+# The updates are sent to a worker DISPATCH_BATCH at a time, or after DISPATCH_INTERVAL seconds
+DISPATCH_BATCH = 100
+DISPATCH_INTERVAL = 0.01
 
 # In-memory state 
 bins_state = {}
 bins_config = {}
+bins_transactions = {}
+bins_sequence = SequenceFilter()  # late and duplicate updates are dropped, see sequence_filter.py
+ingest_stats = {"processed": 0, "errors": 0, "stale": 0, "duplicates": 0, "write_retries": 0}
+verbose = True
+shard_index, shard_count = 0, 1
+
+# Attributes of a <sensor> element sent to the collector as JSON numbers, the others as strings
+SENSOR_NUMBER_ATTRIBUTES = ("decimals", "min", "max", "poll")
+
+
+# Sensor of the table the collector polls and publishes, from the attributes of its element, e.g.
+# <sensor name="scale_sensor" field="scale" type="number" decimals="2" address="coap://[fe80::1]" poll="1"/>
+def load_sensor(element):
+    return {key: json.loads(value) if key in SENSOR_NUMBER_ATTRIBUTES else value
+            for key, value in element.attrib.items()}
+
 
 # Load configuration from XML
 def load_config_from_xml(xml_file):
-    global bins_config
     tree = ET.parse(xml_file)
     root = tree.getroot()
     for bin_element in root.findall("bin"):
         bin_id = bin_element.get("id")
+        # Node addresses are optional: the collector discovers the missing sensors in the resource directory
         bins_config[bin_id] = {
-            "collector_address": bin_element.find("collector_address").text,
-            "lid_sensor_address": bin_element.find("lid_sensor_address").text,
-            "compactor_sensor_address": bin_element.find("compactor_sensor_address").text,
-            "scale_sensor_address": bin_element.find("scale_sensor_address").text,
-            "waste_level_sensor_address": bin_element.find("waste_level_sensor_address").text,
-            "compactor_actuator_address": bin_element.find("compactor_actuator_address").text,
-            "lid_actuator_address": bin_element.find("lid_actuator_address").text
+            "collector_address": bin_element.findtext("collector_address"),
+            "lid_sensor_address": bin_element.findtext("lid_sensor_address"),
+            "compactor_sensor_address": bin_element.findtext("compactor_sensor_address"),
+            "scale_sensor_address": bin_element.findtext("scale_sensor_address"),
+            "waste_level_sensor_address": bin_element.findtext("waste_level_sensor_address"),
+            "compactor_actuator_address": bin_element.findtext("compactor_actuator_address"),
+            "lid_actuator_address": bin_element.findtext("lid_actuator_address")
         }
+        # A bin listing its sensors gets them as the sensor table of its collector, in place of the default
+        # sensors with one address per sensor
+        sensors = [load_sensor(element) for element in bin_element.findall("sensor")]
+        if sensors:
+            bins_config[bin_id]["sensors"] = sensors
     print(f"Loaded configuration for {len(bins_config)} bins.")
 
 # Handle configuration requests
@@ -46,68 +98,448 @@ def handle_config_request(request):
     collector_address = request.get("collector_address")
     for bin_id, config in bins_config.items():
         if config["collector_address"] == collector_address:
-            response = {"collector_address": collector_address, "bin_id": bin_id}
-            response.update(config)
+            # server_time (ms since the epoch) synchronizes the message timestamps of the collector, request_ts
+            # is echoed so that the collector pairs the response with the request it answers
+            response = {"collector_address": collector_address, "bin_id": bin_id, "server_time": now_ms()}
+            if "request_ts" in request:
+                response["request_ts"] = request["request_ts"]
+            response.update({key: value for key, value in config.items() if value})
             return response
     return None
 
-# Connect to the database
-def connect_to_db():
-    """Establish a connection to the MySQL database."""
-    return mysql.connector.connect(**DB_CONFIG)
-
-# Update the current state in the database
-def update_current_state(cursor, bin_id, data):
-    query = """
-        INSERT INTO bins_current_state (bin_id, rfid, lid_state, compactor_state, waste_level, scale_weight)
-        VALUES (%s, %s, %s, %s, %s, %s)
-        ON DUPLICATE KEY UPDATE
-            rfid = VALUES(rfid),
-            lid_state = VALUES(lid_state),
-            compactor_state = VALUES(compactor_state),
-            waste_level = VALUES(waste_level),
-            scale_weight = VALUES(scale_weight),
-            last_updated = CURRENT_TIMESTAMP;
-    """
-    cursor.execute(query, (
-        bin_id,
-        data.get("rfid"),
-        data.get("lid_sensor"),
-        data.get("compactor_sensor"),
-        data.get("waste_level_sensor"),
-        data.get("scale")
-    ))
-
-# Log changes in the database
-def log_changes(cursor, bin_id, changes):
-    query = """
-        INSERT INTO bins_change_log (bin_id, sensor_name, new_value, change_timestamp)
-        VALUES (%s, %s, %s, %s);
-    """
-    for sensor_name, new_value in changes.items():
-        cursor.execute(query, (bin_id, sensor_name, new_value, datetime.now()))
+# Database access: a pool of MySQL connections, or a SQLite file standing in for MySQL to benchmark
+# the ingest offline. Queries are written for MySQL, sql() adapts the placeholders to SQLite.
+class Database:
+    def __init__(self, sqlite_path=None, pool_size=DB_POOL_SIZE):
+        self.sqlite = sqlite_path is not None
+        if self.sqlite:
+            sqlite3.register_adapter(datetime, lambda value: value.isoformat(" "))
+            # Every ingest worker has its own connection, WAL lets them write while the others commit
+            self.sqlite_connection = sqlite3.connect(sqlite_path, check_same_thread=False, timeout=30)
+            self.sqlite_connection.execute("PRAGMA journal_mode=WAL")
+            self.sqlite_connection.executescript(SQLITE_SCHEMA + timeseries.SQLITE_SCHEMA)
+            self.sqlite_lock = threading.Lock()
+        else:
+            self.pool = mysql.connector.pooling.MySQLConnectionPool(pool_name="scrap_cloud", pool_size=pool_size,
+                                                                    **DB_CONFIG)
+
+    # Borrow a connection, given back to the pool (or unlocked) at the end of the block
+    @contextmanager
+    def connection(self):
+        if self.sqlite:
+            with self.sqlite_lock:
+                try:
+                    yield self.sqlite_connection
+                except Exception:
+                    self.sqlite_connection.rollback()
+                    raise
+        else:
+            db = self.pool.get_connection()
+            try:
+                yield db
+            finally:
+                db.close()
+
+    def sql(self, query):
+        return query.replace("%s", "?") if self.sqlite else query
+
+# Tables of the SQLite stand-in, the MySQL ones are created with the database
+SQLITE_SCHEMA = """
+    CREATE TABLE IF NOT EXISTS bins_current_state (
+        bin_id TEXT PRIMARY KEY,
+        rfid TEXT,
+        lid_state TEXT,
+        compactor_state TEXT,
+        waste_level REAL,
+        scale_weight REAL,
+        last_updated TIMESTAMP DEFAULT CURRENT_TIMESTAMP
+    );
+    CREATE TABLE IF NOT EXISTS bins_change_log (
+        id INTEGER PRIMARY KEY AUTOINCREMENT,
+        bin_id TEXT NOT NULL,
+        sensor_name TEXT NOT NULL,
+        new_value TEXT,
+        change_timestamp TIMESTAMP
+    );
+    CREATE TABLE IF NOT EXISTS bins_rfid_transactions (
+        transaction_id INTEGER PRIMARY KEY AUTOINCREMENT,
+        rfid TEXT,
+        bin_id TEXT NOT NULL,
+        weight_diff REAL,
+        start_time TIMESTAMP,
+        end_time TIMESTAMP
+    );
+    CREATE TABLE IF NOT EXISTS bins_message_trace (
+        id INTEGER PRIMARY KEY AUTOINCREMENT,
+        bin_id TEXT NOT NULL,
+        seq INTEGER NOT NULL,
+        sample_ts INTEGER,
+        publish_ts INTEGER,
+        ingest_ts INTEGER NOT NULL,
+        commit_ts INTEGER,
+        dropped TEXT
+    );
+    CREATE INDEX IF NOT EXISTS bins_message_trace_bin ON bins_message_trace (bin_id, id);
+"""
+
+database = None
+
+# Current time in milliseconds since the epoch, the unit of the trace timestamps
+def now_ms():
+    return int(time.time() * 1000)
+
+# Create the latency trace table. Times are in ms since the epoch: sample_ts and publish_ts come from
+# the collector (missing until its clock is synchronized), ingest_ts and commit_ts from this service
+# (commit_ts is missing when the message did not change the state). The id gives the arrival order.
+# dropped is "stale" or "duplicate" for the messages behind the last one of their bin, traced but not stored.
+def create_trace_table():
+    with database.connection() as db:
+        cursor = db.cursor()
+        if database.sqlite:
+            cursor.execute("PRAGMA table_info(bins_message_trace)")
+            columns = [row[1] for row in cursor.fetchall()]
+        else:
+            cursor.execute("""
+                CREATE TABLE IF NOT EXISTS bins_message_trace (
+                    id BIGINT AUTO_INCREMENT PRIMARY KEY,
+                    bin_id VARCHAR(64) NOT NULL,
+                    seq INT UNSIGNED NOT NULL,
+                    sample_ts BIGINT NULL,
+                    publish_ts BIGINT NULL,
+                    ingest_ts BIGINT NOT NULL,
+                    commit_ts BIGINT NULL,
+                    dropped VARCHAR(16) NULL,
+                    INDEX (bin_id, id)
+                );
+            """)
+            cursor.execute("SHOW COLUMNS FROM bins_message_trace")
+            columns = [row[0] for row in cursor.fetchall()]
+        # Tables created before the stale and duplicate messages were traced
+        if "dropped" not in columns:
+            cursor.execute("ALTER TABLE bins_message_trace ADD COLUMN dropped VARCHAR(16) NULL")
+        db.commit()
+
+# Multi-row INSERT of the given columns
+def insert_rows_sql(table, columns, count):
+    row = "(" + ", ".join(["%s"] * len(columns)) + ")"
+    return f"INSERT INTO {table} ({', '.join(columns)}) VALUES {', '.join([row] * count)}"
+
+CURRENT_STATE_COLUMNS = ["bin_id", "rfid", "lid_state", "compactor_state", "waste_level", "scale_weight"]
+CHANGE_LOG_COLUMNS = ["bin_id", "sensor_name", "new_value", "change_timestamp"]
+TRANSACTION_COLUMNS = ["rfid", "bin_id", "weight_diff", "start_time", "end_time"]
+TRACE_COLUMNS = ["bin_id", "seq", "sample_ts", "publish_ts", "ingest_ts", "commit_ts", "dropped"]
+
+# Upsert of the current state of several bins in one statement
+def upsert_current_state_sql(count):
+    updated = CURRENT_STATE_COLUMNS[1:]
+    if database.sqlite:
+        assignments = [f"{column} = excluded.{column}" for column in updated]
+        conflict = " ON CONFLICT (bin_id) DO UPDATE SET "
+    else:
+        assignments = [f"{column} = VALUES({column})" for column in updated]
+        conflict = " ON DUPLICATE KEY UPDATE "
+    return (insert_rows_sql("bins_current_state", CURRENT_STATE_COLUMNS, count) + conflict +
+            ", ".join(assignments + ["last_updated = CURRENT_TIMESTAMP"]))
+
+class WriteBehindBuffer:
+    """Groups the writes of the ingest into multi-row statements: the latest state of every changed bin,
+    the change log, the RFID transactions and the latency traces are committed together every max_rows rows
+    or max_delay seconds, instead of a connection and a commit per message."""
+
+    def __init__(self, max_rows=WRITE_BATCH_ROWS, max_delay=WRITE_BATCH_INTERVAL):
+        self.max_rows = max_rows
+        self.max_delay = max_delay
+        self.lock = threading.Lock()
+        self.flush_lock = threading.Lock()
+        self.states = {}
+        self.changes = []
+        self.transactions = []
+        self.traces = []
+        self.failures = 0  # flushes failed in a row
+        self.retry_at = 0.0
+
+    def pending_rows(self):
+        return len(self.states) + len(self.changes) + len(self.transactions) + len(self.traces)
+
+    # Queue the new state of a bin and its changed sensors
+    def update(self, bin_id, data, changes, timestamp):
+        with self.lock:
+            self.states[bin_id] = (bin_id, data.get("rfid"), data.get("lid_sensor"), data.get("compactor_sensor"),
+                                   data.get("waste_level_sensor"), data.get("scale"))
+            self.changes.extend((bin_id, sensor_name, new_value, timestamp)
+                                for sensor_name, new_value in changes.items())
+            full = self.pending_rows() >= self.max_rows
+        if full:
+            self.flush()
+
+    # Queue a completed RFID transaction
+    def transaction(self, row):
+        with self.lock:
+            self.transactions.append(row)
+            full = self.pending_rows() >= self.max_rows
+        if full:
+            self.flush()
+
+    # Queue the trace of a message, its commit time is set when the batch is committed. dropped gives why
+    # a message was not stored
+    def trace(self, data, ingest_ts, committed, dropped=None):
+        row = [data["bin_id"], data["seq"], data.get("sample_ts"), data.get("ts"), ingest_ts, None, dropped]
+        with self.lock:
+            self.traces.append((row, committed))
+            full = self.pending_rows() >= self.max_rows
+        if full:
+            self.flush()
+
+    # Write the pending rows, unless a failed write is waiting for its retry. With final, try until written
+    # or WRITE_FINAL_ATTEMPTS attempts
+    def flush(self, final=False):
+        for attempt in range(WRITE_FINAL_ATTEMPTS if final else 1):
+            if final and attempt > 0:
+                time.sleep(max(0.0, self.retry_at - time.monotonic()))
+            elif not final and time.monotonic() < self.retry_at:
+                return
+            if self.write():
+                return
+        if final:
+            print(f"{self.pending_rows()} rows not written to the database")
+
+    # Write the pending rows, False when they were queued again
+    def write(self):
+        with self.flush_lock:
+            with self.lock:
+                states, changes, traces = list(self.states.values()), self.changes, self.traces
+                transactions = self.transactions
+                self.states, self.changes, self.transactions, self.traces = {}, [], [], []
+            if not states and not changes and not transactions and not traces:
+                return True
+            data_written = False
+            try:
+                with database.connection() as db:
+                    cursor = db.cursor()
+                    if states:
+                        cursor.execute(database.sql(upsert_current_state_sql(len(states))),
+                                       [value for row in states for value in row])
+                    if changes:
+                        cursor.execute(database.sql(insert_rows_sql("bins_change_log", CHANGE_LOG_COLUMNS,
+                                                                    len(changes))),
+                                       [value for row in changes for value in row])
+                        timeseries.write_rollups(cursor, database, changes)
+                    if transactions:
+                        cursor.execute(database.sql(insert_rows_sql("bins_rfid_transactions", TRANSACTION_COLUMNS,
+                                                                    len(transactions))),
+                                       [value for row in transactions for value in row])
+                    db.commit()
+                    data_written = True
+                    if traces:
+                        commit_ts = now_ms()
+                        for row, committed in traces:
+                            row[5] = commit_ts if committed else None
+                        cursor.execute(database.sql(insert_rows_sql("bins_message_trace", TRACE_COLUMNS,
+                                                                    len(traces))),
+                                       [value for row, _ in traces for value in row])
+                        db.commit()
+            except Exception as db_error:
+                print(f"Database error writing {len(states)} states, {len(changes)} changes, "
+                      f"{len(transactions)} transactions and {len(traces)} traces: {db_error}")
+                self.requeue([] if data_written else states, [] if data_written else changes,
+                             [] if data_written else transactions, traces)
+                return False
+            self.failures = 0
+            self.retry_at = 0.0
+            return True
+
+    # Queue the rows of a failed write before the ones queued since, a state only when the bin has no newer one
+    def requeue(self, states, changes, transactions, traces):
+        with self.lock:
+            for row in states:
+                self.states.setdefault(row[0], row)
+            self.changes = changes + self.changes
+            self.transactions = transactions + self.transactions
+            self.traces = traces + self.traces
+        self.failures += 1
+        self.retry_at = time.monotonic() + min(WRITE_RETRY_MAX_DELAY, self.max_delay * 2 ** self.failures)
+        ingest_stats["write_retries"] += 1
+
+    # Commit the rows of slow message streams
+    def run(self):
+        while True:
+            time.sleep(self.max_delay)
+            self.flush()
+
+write_buffer = None
+
+# Hash of a bin_id, choosing the instance of the bin and then its worker
+def bin_hash(bin_id):
+    return zlib.crc32(str(bin_id).encode())
+
+BIN_ID_PATTERN = re.compile(rb'"bin_id"\s*:\s*"([^"\\]*)"')
+
+# bin_id of an update, found without parsing the JSON: the MQTT thread only routes the updates
+def update_bin_id(payload):
+    match = BIN_ID_PATTERN.search(payload)
+    return match.group(1).decode() if match else None
 
 # Handle incoming MQTT messages
 def on_message(client, userdata, msg):
-    print(f"Received message on topic {msg.topic}: {msg.payload.decode()}")
+    ingest_ts = now_ms()
+    if msg.topic == UPDATES_TOPIC:
+        bin_id = update_bin_id(msg.payload)
+        # Updates of the bins of other instances
+        if shard_count > 1 and bin_hash(bin_id) % shard_count != shard_index:
+            return
+    if verbose:
+        print(f"Received message on topic {msg.topic}: {msg.payload.decode()}")
     try:
+        # Handle sensor updates, parsed in the worker of the bin when there are workers
+        if msg.topic == UPDATES_TOPIC and ingest_workers:
+            ingest_workers.dispatch(bin_id, msg.payload, ingest_ts)
+            return
+
         # Parse JSON payload
         data = json.loads(msg.payload.decode())
 
-        # Handle configuration requests
+        # Handle configuration requests, answered by the first instance
         if msg.topic == CONFIG_REQUEST_TOPIC:
-            handle_config_request_message(client, data)
+            if shard_index == 0:
+                handle_config_request_message(client, data)
             return
 
         # Handle sensor updates
         if msg.topic == UPDATES_TOPIC:
-            handle_sensor_update(data)
+            process_update(data, ingest_ts)
             return
 
         print(f"Unhandled message on topic {msg.topic}.")
     except Exception as e:
+        ingest_stats["errors"] += 1
         print(f"Error processing message: {e}")
 
+# Store an update, unless it is older than the last one of its bin. Both are traced, in arrival order
+def process_update(data, ingest_ts):
+    ingest_stats["processed"] += 1
+    bin_id, seq = data.get("bin_id"), data.get("seq")
+    # Messages of collectors without sequence numbers are neither checked nor traced
+    traced = bin_id is not None and isinstance(seq, int)
+    if traced:
+        dropped = bins_sequence.check(bin_id, seq)
+        if dropped:
+            ingest_stats["duplicates" if dropped == DUPLICATE else "stale"] += 1
+            write_buffer.trace(data, ingest_ts, False, dropped)
+            return
+
+    committed = handle_sensor_update(data)
+    if traced:
+        write_buffer.trace(data, ingest_ts, committed)
+
+# Create the missing tables, indexes and columns, once before the workers connect
+def create_tables(sqlite_path):
+    global database
+    database = Database(sqlite_path, 1)
+    create_trace_table()
+    timeseries.create_tables(database)
+
+# Database and write-behind buffer of the process storing the updates
+def setup_storage(args):
+    global database, write_buffer
+    database = Database(args.sqlite, args.pool_size)
+    write_buffer = WriteBehindBuffer(args.batch_rows, args.batch_interval)
+    threading.Thread(target=write_buffer.run, daemon=True).start()
+
+WORKER_STATS = ["processed", "errors", "stale", "duplicates", "write_retries"]
+
+class IngestWorkers:
+    """Worker processes parsing and storing the bin updates. The MQTT thread only finds the bin_id of the
+    messages and queues every update to the worker of its bin, chosen by a hash of the bin_id so that the
+    updates of a bin stay in order and a slow commit only delays the bins of one worker. Each worker has its
+    own state, database connections and write-behind buffer."""
+
+    def __init__(self, count, args):
+        self.queues = [multiprocessing.Queue(max(1, INGEST_QUEUE_SIZE // DISPATCH_BATCH)) for _ in range(count)]
+        # Updates not sent yet, per worker. A queue transfer costs more than storing an update, so they are
+        # sent in batches
+        self.pending = [[] for _ in range(count)]
+        self.lock = threading.Lock()
+        # Counters of the workers, each one writing only its own slots
+        self.stats = multiprocessing.Array("q", count * len(WORKER_STATS), lock=False)
+        self.processes = [multiprocessing.Process(target=run_ingest_worker, args=(index, queue, args, self.stats),
+                                                  daemon=True)
+                          for index, queue in enumerate(self.queues)]
+        for process in self.processes:
+            process.start()
+        threading.Thread(target=self.run, daemon=True).start()
+
+    def dispatch(self, bin_id, payload, ingest_ts):
+        worker = bin_hash(bin_id) // shard_count % len(self.queues)
+        with self.lock:
+            self.pending[worker].append((payload, ingest_ts))
+            if len(self.pending[worker]) >= DISPATCH_BATCH:
+                self.send(worker)
+
+    # Called with the lock held, so that the batches of a worker are queued in order
+    def send(self, worker):
+        if self.pending[worker]:
+            self.queues[worker].put(self.pending[worker])
+            self.pending[worker] = []
+
+    # Send the partial batches of slow message streams
+    def run(self):
+        while True:
+            time.sleep(DISPATCH_INTERVAL)
+            with self.lock:
+                for worker in range(len(self.queues)):
+                    self.send(worker)
+
+    def totals(self):
+        return {name: sum(self.stats[worker * len(WORKER_STATS) + index] for worker in range(len(self.queues)))
+                for index, name in enumerate(WORKER_STATS)}
+
+    # Let the workers store the queued updates and stop
+    def stop(self):
+        with self.lock:
+            for worker, queue in enumerate(self.queues):
+                self.send(worker)
+                queue.put(None)
+        for process in self.processes:
+            process.join()
+
+def run_ingest_worker(index, queue, args, stats):
+    global verbose
+    # The main process stops the workers after Ctrl-C, once the MQTT receive has stopped
+    signal.signal(signal.SIGINT, signal.SIG_IGN)
+    verbose = not args.quiet
+    setup_storage(args)
+    slots = range(index * len(WORKER_STATS), (index + 1) * len(WORKER_STATS))
+    while True:
+        batch = queue.get()
+        if batch is None:
+            break
+        for payload, ingest_ts in batch:
+            try:
+                process_update(json.loads(payload.decode()), ingest_ts)
+            except Exception as e:
+                ingest_stats["errors"] += 1
+                print(f"Error processing update: {e}")
+        for slot, name in zip(slots, WORKER_STATS):
+            stats[slot] = ingest_stats[name]
+    write_buffer.flush(final=True)
+
+ingest_workers = None
+
+# Counters of the ingest, including the ones of the workers
+def current_ingest_stats():
+    stats = dict(ingest_stats)
+    if ingest_workers:
+        for name, value in ingest_workers.totals().items():
+            stats[name] += value
+    return stats
+
+# Periodically publish the number of processed updates
+def publish_ingest_stats(client):
+    while True:
+        time.sleep(INGEST_STATS_INTERVAL)
+        client.publish(INGEST_STATS_TOPIC, json.dumps({**current_ingest_stats(), "shard": shard_index,
+                                                       "timestamp": datetime.now().isoformat()}))
+
 
 # Handle configuration request messages
 def handle_config_request_message(client, data):
@@ -130,12 +562,12 @@ def normalize_decimal(value):
         return value.replace(",", ".")
     return value
 
-# Track the start and end times of lid open/close states
+# Track the start and end times of lid open/close states, returns whether the database is updated
 def handle_sensor_update(data):
     bin_id = data.get("bin_id")
     if not bin_id:
         print("No bin_id found in update message. Skipping...")
-        return
+        return False
 
     rfid = data.get("rfid")
     scale_weight = normalize_decimal(data.get("scale"))
@@ -160,148 +592,138 @@ def handle_sensor_update(data):
             changes[sensor] = value
 
     # Update the database and in-memory state if changes are detected
-    if changes or bin_id not in bins_state:
-        try:
-            # Connect to MySQL
-            db = connect_to_db()
-            cursor = db.cursor()
-
-            # Update the current state and log changes
-            update_current_state(cursor, bin_id, data)
-            log_changes(cursor, bin_id, changes)
-
-            # Commit changes to the database
-            db.commit()
-        except Exception as db_error:
-            print(f"Database error: {db_error}")
-        finally:
-            db.close()
+    updated = bool(changes) or bin_id not in bins_state
+    if updated:
+        timestamp = datetime.now()
+        # Queue the current state and the changes, committed with the next batch
+        write_buffer.update(bin_id, data, changes, timestamp)
 
         # Update in-memory state
-        bins_state[bin_id] = {**sensors, "timestamp": datetime.now()}
-
-        print(f"Database updated for bin {bin_id}. Changes: {changes}")
-
-    # If lid closes, process transaction
-    if prev_lid_state == "open" and sensors["lid_sensor"] == "closed":
-        handle_transaction_complete(bin_id, db)
+        bins_state[bin_id] = {**sensors, "timestamp": timestamp}
+        track_transaction(bin_id, prev_lid_state, changes, timestamp)
 
-    else:
+        if verbose:
+            print(f"Database updated for bin {bin_id}. Changes: {changes}")
+    elif verbose:
         print(f"No changes detected for bin {bin_id}. Skipping database update.")
 
-# Create transaction record in the database
-def handle_transaction_complete(bin_id, db):
-    try:
-        # Connect to MySQL
-        db = connect_to_db()
-        cursor = db.cursor()
-
-        # Get the most recent lid open time from the database for the bin
-        lid_open_query = """
-                SELECT change_timestamp
-                FROM bins_change_log
-                WHERE bin_id = %s AND sensor_name = 'lid_sensor' AND new_value = 'open'
-                ORDER BY change_timestamp DESC
-                LIMIT 1;
-            """
-        cursor.execute(lid_open_query, (bin_id,))
-        lid_open_record = cursor.fetchone()
-
-        # Get the most recent lid close time from the database for the bin
-        lid_closed_query = """
-                SELECT change_timestamp
-                FROM bins_change_log
-                WHERE bin_id = %s AND sensor_name = 'lid_sensor' AND new_value = 'closed'
-                ORDER BY change_timestamp DESC
-                LIMIT 1;
-            """
-        cursor.execute(lid_closed_query, (bin_id,))
-        lid_closed_record = cursor.fetchone()
-
-        # If both lid open and lid close records are found
-        if lid_open_record and lid_closed_record:
-            lid_open_time = lid_open_record[0]
-            lid_close_time = lid_closed_record[0]
-
-            # Get the weight just before the lid opened
-            weight_before_query = """
-                    SELECT new_value, change_timestamp
-                    FROM bins_change_log
-                    WHERE bin_id = %s AND sensor_name = 'scale' AND change_timestamp < %s
-                    ORDER BY change_timestamp DESC
-                    LIMIT 1;
-                """
-            cursor.execute(weight_before_query, (bin_id, lid_open_time))
-            weight_before = cursor.fetchone()
-            
-            # If weight record is found
-            if weight_before:
-                start_weight = float(weight_before[0])  # Weight just before the lid opened
-                start_time = weight_before[1]
-
-                # Query the latest weight just before the lid was closed
-                weight_after_query = """
-                        SELECT new_value, change_timestamp
-                        FROM bins_change_log
-                        WHERE bin_id = %s AND sensor_name = 'scale' AND change_timestamp <= %s
-                        ORDER BY change_timestamp DESC
-                        LIMIT 1;
-                    """
-                cursor.execute(weight_after_query, (bin_id, lid_close_time))
-                weight_after = cursor.fetchone()
-
-                # If last weight record is found
-                if weight_after:
-                    end_weight = float(weight_after[0])  # Weight when the lid closed
-                    end_time = weight_after[1]
-                    print(f"End weight for bin {bin_id}: {end_weight} at {end_time}")
-
-                    # Calculate weight difference
-                    weight_diff = end_weight - start_weight
-
-                    # get last RFID value to identify the user
-                    rfid_query = """
-                            SELECT new_value
-                            FROM bins_change_log
-                            WHERE bin_id = %s AND sensor_name = 'rfid' AND new_value <> 'No value'
-                            ORDER BY change_timestamp DESC
-                            LIMIT 1;
-                        """
-
-                    cursor.execute(rfid_query, (bin_id,))
-                    rfid = cursor.fetchone()[0]
-
-                    # Insert transaction record
-                    transaction_query = """
-                            INSERT INTO bins_rfid_transactions (rfid, bin_id, weight_diff, start_time, end_time)
-                            VALUES (%s, %s, %s, %s, %s);
-                        """
-                    cursor.execute(transaction_query, (rfid, bin_id, weight_diff, start_time, end_time))
-                    db.commit()
+    return updated
 
-                    print(
-                        f"RFID transaction recorded for bin {bin_id} (RFID: {rfid}). Weight difference: {weight_diff}")
-                else:
-                    print(f"No weight record found when the lid closed for bin {bin_id}.")
-            else:
+# Weight of a scale reading, None if it is not a number
+def parse_weight(value):
+    try:
+        return float(value)
+    except (TypeError, ValueError):
+        return None
+
+# Follow the RFID transaction of a bin from its changes, without reading back the change log: a transaction
+# starts when the lid opens, from the last weight read before, and is recorded when the lid closes with the
+# last weight read and the last RFID badge seen on the bin
+def track_transaction(bin_id, prev_lid_state, changes, timestamp):
+    tracker = bins_transactions.setdefault(bin_id, {"weight": None, "weight_time": None, "rfid": None, "start": None})
+    lid_state = changes.get("lid_sensor")
+
+    # The weight read together with the lid opening is already part of the transaction
+    if lid_state == "open" and prev_lid_state != "open":
+        tracker["start"] = (tracker["weight"], tracker["weight_time"]) if tracker["weight"] is not None else None
+
+    if "scale" in changes and parse_weight(changes["scale"]) is not None:
+        tracker["weight"], tracker["weight_time"] = parse_weight(changes["scale"]), timestamp
+    if "rfid" in changes and changes["rfid"] != "No value":
+        tracker["rfid"] = changes["rfid"]
+
+    if lid_state == "closed" and prev_lid_state == "open":
+        start, tracker["start"] = tracker["start"], None
+        if start is None:
+            if verbose:
                 print(f"No weight record found before lid open time for bin {bin_id}.")
+        elif tracker["rfid"] is None:
+            if verbose:
+                print(f"No RFID read for bin {bin_id}, transaction not recorded.")
         else:
-            print(f"No lid open record found for bin {bin_id}.")
-
-    except Exception as query_error:
-        print(f"Error processing weight records: {query_error}")
-    finally:
-        db.close()
+            start_weight, start_time = start
+            weight_diff = tracker["weight"] - start_weight
+            write_buffer.transaction((tracker["rfid"], bin_id, weight_diff, start_time, tracker["weight_time"]))
+            if verbose:
+                print(f"RFID transaction recorded for bin {bin_id} (RFID: {tracker['rfid']}). "
+                      f"Weight difference: {weight_diff}")
+
+# Retention of the change log and the rollups, with its own connection as the updates may be stored by workers.
+# Run by the first instance only: the partitions and the rollups are shared by the shards
+def run_maintenance(args):
+    maintenance_database = Database(args.sqlite, 1)
+    while True:
+        try:
+            timeseries.maintain(maintenance_database, raw_retention_months=args.raw_retention_months)
+        except Exception as e:
+            print(f"Error maintaining the change log: {e}")
+        time.sleep(timeseries.MAINTENANCE_INTERVAL)
+
+# --shard INDEX/COUNT
+def parse_shard(value):
+    index, _, count = value.partition("/")
+    if not index.isdigit() or not count.isdigit() or int(index) >= int(count):
+        raise argparse.ArgumentTypeError("expected INDEX/COUNT, e.g. 0/2")
+    return int(index), int(count)
 
 def main():
+    global ingest_workers, verbose, shard_index, shard_count
+    parser = argparse.ArgumentParser(description="Cloud ingest of the bin updates")
+    parser.add_argument("--sqlite", help="write to this SQLite file instead of MySQL, to benchmark offline")
+    parser.add_argument("--pool-size", type=int, default=DB_POOL_SIZE, help="MySQL connections in the pool")
+    parser.add_argument("--batch-rows", type=int, default=WRITE_BATCH_ROWS, help="rows written per commit")
+    parser.add_argument("--batch-interval", type=float, default=WRITE_BATCH_INTERVAL,
+                        help="seconds before pending rows are committed")
+    parser.add_argument("--workers", type=int, default=INGEST_WORKERS,
+                        help="processes storing the updates, 0 to store them in the MQTT thread")
+    parser.add_argument("--shard", type=parse_shard, default=(0, 1), metavar="INDEX/COUNT",
+                        help="store only the bins of this shard, to split the fleet between COUNT instances")
+    parser.add_argument("--quiet", action="store_true", help="do not print every message")
+    parser.add_argument("--raw-retention-months", type=int, default=timeseries.RAW_RETENTION_MONTHS,
+                        help="months of raw sensor changes kept besides the current one")
+    parser.add_argument("--migrate-change-log", action="store_true",
+                        help="partition the change log and rebuild the rollups from it, then exit")
+    args = parser.parse_args()
+    verbose = not args.quiet
+    shard_index, shard_count = args.shard
+
+    if args.migrate_change_log:
+        timeseries.migrate(Database(args.sqlite, 1))
+        return
+
     load_config_from_xml("config.xml")  # Load configuration from the XML file
-    
-    # Connect to the MQTT broker
+    create_tables(args.sqlite)
+    if args.workers > 0:
+        ingest_workers = IngestWorkers(args.workers, args)
+    else:
+        setup_storage(args)
+
+    # Connect to the MQTT broker. The instances of a sharded ingest all subscribe to the updates and keep
+    # the ones of their bins, so that a bin has one instance and its updates, transactions and seq stay in
+    # order there. A shared subscription would spread the updates of a bin over the instances. Receiving and
+    # routing an update of another shard costs about 20 us, a fifth of a core per instance at 10k msg/s.
+    topics = [UPDATES_TOPIC, CONFIG_REQUEST_TOPIC]
     client = mqtt.Client()
-    client.on_connect = lambda c, u, f, rc: client.subscribe([(UPDATES_TOPIC, 0), (CONFIG_REQUEST_TOPIC, 0)])
+    # The updates at QoS 1: the broker delivers at the lower QoS of the publisher and the subscriber, so the
+    # messages of the collectors publishing at QoS 1 are not downgraded on the last hop
+    client.on_connect = lambda c, u, f, rc: client.subscribe([(topic, 1 if topic == UPDATES_TOPIC else 0)
+                                                               for topic in topics])
     client.on_message = on_message
     client.connect(BROKER_ADDRESS, BROKER_PORT, 60)
-    client.loop_forever()
+    threading.Thread(target=publish_ingest_stats, args=(client,), daemon=True).start()
+    if shard_index == 0:
+        threading.Thread(target=run_maintenance, args=(args,), daemon=True).start()
+    # Stop as on Ctrl-C when terminated, storing the queued updates
+    signal.signal(signal.SIGTERM, lambda signum, frame: client.disconnect())
+    try:
+        client.loop_forever()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if ingest_workers:
+            ingest_workers.stop()
+        else:
+            write_buffer.flush(final=True)
 
 if __name__ == "__main__":
     main()
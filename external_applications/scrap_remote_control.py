@@ -1,9 +1,20 @@
-from flask import Flask, render_template, jsonify, request
+from flask import Flask, Response, render_template, jsonify, request
 import mysql.connector
-from apscheduler.schedulers.background import BackgroundScheduler
+import mysql.connector.pooling
+import paho.mqtt.client as mqtt
+import json
 import logging
-from coapthon.client.helperclient import HelperClient
-import xml.etree.ElementTree as ET
+import queue
+import threading
+import time
+from concurrent.futures import wait
+from datetime import datetime, timedelta
+from resource_directory import ResourceDirectory, start_resource_directory, has_resource_type
+from rule_engine import RuleEngine
+from sequence_filter import SequenceFilter
+from live_state import EventBroadcaster, LiveBins
+from coap_control import BinConfig, CoapControl
+import timeseries
 
 # Configuration
 DATABASE_CONFIG = {
@@ -13,26 +24,63 @@ DATABASE_CONFIG = {
     'database': 'scrap'
 }
 
+DB_POOL_SIZE = 8
+
 WASTE_LEVEL_THRESHOLD = 80.0  # Waste level threshold in percentage
-POLLING_INTERVAL = 1  # Polling interval in seconds
-
-# Parse the config.xml file to get CoAP server addresses
-def parse_config_xml():
-    tree = ET.parse('config.xml')
-    root = tree.getroot()
-    bins = {}
-    for bin in root.findall('bin'):
-        bin_id = bin.get('id')
-        bins[bin_id] = {
-            'collector_address': bin.find('collector_address').text,
-            'lid_sensor_address': bin.find('lid_sensor_address').text,
-            'lid_actuator_address': bin.find('lid_actuator_address').text,
-            'compactor_sensor_address': bin.find('compactor_sensor_address').text,
-            'scale_sensor_address': bin.find('scale_sensor_address').text,
-            'waste_level_sensor_address': bin.find('waste_level_sensor_address').text,
-            'compactor_actuator_address': bin.find('compactor_actuator_address').text,
-        }
-    return bins
+
+# Dashboard: pages of the transaction and alarm APIs, pushed events
+PAGE_SIZE = 50
+MAX_PAGE_SIZE = 500
+TRANSACTION_POLL_INTERVAL = 1  # seconds between the checks for new transactions, for all the dashboards
+SSE_HEARTBEAT_INTERVAL = 15  # seconds
+
+# Telemetry of the bins, evaluated by the rule engine as it arrives
+BROKER_ADDRESS = "localhost"
+BROKER_PORT = 1883
+UPDATES_TOPIC = "bins"
+
+# Run-time parameters of the collectors: updates go to PARAMS_TOPIC/<bin_id>, each collector answers on
+# PARAMS_TOPIC with the parameters in effect, {"bin_id": ..., "params": {"version": ..., "status": ..., ...}}
+PARAMS_TOPIC = "config/params"
+bin_params = {}
+
+# Configuration of the bins, reloaded when config.xml changes. Node addresses are optional,
+# the nodes that are not listed are found through the resource directory
+bin_config = BinConfig('config.xml', on_change=lambda bin_ids: handle_config_change(bin_ids))
+
+# Resource types announced by the nodes and the configuration entry they provide
+RESOURCE_TYPE_ADDRESSES = {
+    'lid_sensor': 'lid_sensor_address',
+    'compactor_active': 'compactor_sensor_address',
+    'scale_sensor': 'scale_sensor_address',
+    'waste_level_sensor': 'waste_level_sensor_address',
+    'lid_command': 'lid_actuator_address',
+    'compactor_command': 'compactor_actuator_address',
+}
+
+# Find the bin of a node that registered without a sector, using the addresses in config.xml
+def resolve_node_bin(endpoint_name):
+    return bin_config.bin_of(endpoint_name)
+
+# Configuration of a bin: config.xml completed with the nodes registered in the resource directory
+def get_bin_config(bin_id):
+    bin_data = dict(bin_config.get(bin_id) or {})
+    for address, path, attributes in resource_directory.lookup(sector=bin_id):
+        for resource_type, key in RESOURCE_TYPE_ADDRESSES.items():
+            if has_resource_type(attributes, resource_type):
+                bin_data[key] = address
+    return bin_data
+
+# Address of a node of a bin registered in the resource directory, preferred to the one in config.xml
+def resolve_registered_address(bin_id, key):
+    for resource_type, address_key in RESOURCE_TYPE_ADDRESSES.items():
+        if address_key == key:
+            for address, path, attributes in resource_directory.lookup(resource_type, sector=bin_id):
+                return address
+    return None
+
+# CoAP requests to the nodes, over long-lived clients
+coap_control = CoapControl(bin_config, resolve_address=resolve_registered_address)
 
 # Initialize Flask app
 app = Flask(__name__)
@@ -40,10 +88,18 @@ app = Flask(__name__)
 # Initialize logging
 logging.basicConfig(level=logging.INFO, format='%(asctime)s - %(message)s')
 
+# Database connections, shared by the requests
+db_pool = mysql.connector.pooling.MySQLConnectionPool(pool_name="scrap_remote_control", pool_size=DB_POOL_SIZE,
+                                                      **DATABASE_CONFIG)
+
+# Current state of the bins and events pushed to the dashboards
+broadcaster = EventBroadcaster()
+live_bins = LiveBins(broadcaster)
+
 # Function to fetch the current state from the database
 def fetch_bin_data():
     try:
-        connection = mysql.connector.connect(**DATABASE_CONFIG)
+        connection = db_pool.get_connection()
         cursor = connection.cursor(dictionary=True)
         cursor.execute("SELECT * FROM bins_current_state")
         bins = cursor.fetchall()
@@ -54,12 +110,17 @@ def fetch_bin_data():
         logging.error(f"Database error: {err}")
         return []
 
-# Function to fetch transaction data from the database
-def fetch_transaction_data():
+# Function to fetch a page of transactions from the database, newest first. Pages are keyed by the last
+# transaction ID of the previous page, so that any page costs the same as the first one
+def fetch_transaction_data(before_id=None, limit=PAGE_SIZE):
     try:
-        connection = mysql.connector.connect(**DATABASE_CONFIG)
+        connection = db_pool.get_connection()
         cursor = connection.cursor(dictionary=True)
-        cursor.execute("SELECT * FROM bins_rfid_transactions ORDER BY end_time DESC")
+        if before_id is None:
+            cursor.execute("SELECT * FROM bins_rfid_transactions ORDER BY transaction_id DESC LIMIT %s", (limit,))
+        else:
+            cursor.execute("SELECT * FROM bins_rfid_transactions WHERE transaction_id < %s "
+                           "ORDER BY transaction_id DESC LIMIT %s", (before_id, limit))
         transactions = cursor.fetchall()
         cursor.close()
         connection.close()
@@ -68,129 +129,222 @@ def fetch_transaction_data():
         logging.error(f"Database error: {err}")
         return []
 
-# Function to send CoAP PUT requests
+# Function to send CoAP PUT requests, returns whether the node answered
 def send_coap_put_request(bin_id, path, payload):
-    bins = parse_config_xml()
-    if bin_id not in bins:
-        logging.error(f"Bin ID {bin_id} not found in config.xml")
-        return False
-
-    # Get CoAP server address based on the path
-    coap_sensor_address = None
-    if path.startswith('/compactor/config') or path.startswith('/compactor/command'):
-        coap_sensor_address = (bins[bin_id]['compactor_actuator_address'], 5683)
-    elif path.startswith('/lid/config') or path.startswith('/lid/command'):
-        coap_sensor_address = (bins[bin_id]['lid_actuator_address'], 5683)
-    elif path.startswith('/compactor'):
-        coap_sensor_address = (bins[bin_id]['compactor_sensor_address'], 5683)
-    elif path.startswith('/lid'):
-        coap_sensor_address = (bins[bin_id]['lid_sensor_address'], 5683)
-    elif path.startswith('/scale'):
-        coap_sensor_address = (bins[bin_id]['scale_sensor_address'], 5683)
-    elif path.startswith('/waste'):
-        coap_sensor_address = (bins[bin_id]['waste_level_sensor_address'], 5683)
-
-    if not coap_sensor_address:
-        logging.error(f"No CoAP server address found for path {path}")
-        return False
+    return coap_control.put(bin_id, path, payload)
 
-    try:
-        # replace fe80:: with fd00:: for local testing
-        coap_sensor_address = (coap_sensor_address[0].replace('fe80::', 'fd00::'), coap_sensor_address[1])
-        client = HelperClient(server=coap_sensor_address)
-        response = client.put(path, payload)
-        client.stop()
-        logging.info(f"CoAP PUT request sent to {path}. Response: {response.payload}")
-        return True
-    except Exception as e:
-        logging.error(f"CoAP request failed: {e}")
-        return False
-
-# Function to insert an alarm into the database
+# Function to insert an alarm into the database, returns the alarm ID
 def insert_alarm(bin_id, message):
     try:
-        connection = mysql.connector.connect(**DATABASE_CONFIG)
+        connection = db_pool.get_connection()
         cursor = connection.cursor()
         cursor.execute("INSERT INTO alarms (bin_id, time, message, acknowledged) VALUES (%s, NOW(), %s, FALSE)", (bin_id, message))
         connection.commit()
+        alarm_id = cursor.lastrowid
+        cursor.close()
+        connection.close()
+        broadcaster.publish("alarm", {"alarm_id": alarm_id, "time": datetime.now().replace(microsecond=0),
+                                      "bin_id": bin_id, "message": message, "acknowledged": False})
+        return alarm_id
+    except mysql.connector.Error as err:
+        logging.error(f"Database error: {err}")
+        return None
+
+# Function to fetch the alarms not acknowledged yet, as (alarm_id, bin_id)
+def fetch_unacknowledged_alarms():
+    try:
+        connection = db_pool.get_connection()
+        cursor = connection.cursor()
+        cursor.execute("SELECT alarm_id, bin_id FROM alarms WHERE acknowledged = FALSE")
+        alarms = cursor.fetchall()
         cursor.close()
         connection.close()
+        return alarms
     except mysql.connector.Error as err:
         logging.error(f"Database error: {err}")
+        return []
 
-# Dictionary to store the compactor state for each bin, used to determine if an alarm should be inserted
-compactor_states = {}
-
-# Function to check the waste level of each bin and activate the compactor if the waste level exceeds the threshold
-# Also inserts an alarm into the database if the compactor is turned off while the waste level exceeds the threshold
-def check_waste_level():
-    bins = fetch_bin_data()
-    global compactor_states
-    
-    for bin in bins:
-        if bin['bin_id'] not in compactor_states:
-            compactor_states[bin['bin_id']] = bin['compactor_state']
-        
-        # Check if waste level exceeds the threshold
-        if bin['waste_level'] > WASTE_LEVEL_THRESHOLD:
-            if bin['compactor_state'] == "off" and compactor_states[bin['bin_id']] == "on": # compactor just turned off
-                # check if there is an alarm for this bin already, if not insert one
-                alarms = fetch_alarm_data()
-                alarm_exists = False
-                for alarm in alarms:
-                    if alarm['bin_id'] == bin['bin_id'] and not alarm['acknowledged']:
-                        alarm_exists = True
-                        break
-                if not alarm_exists:
-                    insert_alarm(bin['bin_id'], f"Waste level exceeded in bin {bin['bin_id']}: {bin['waste_level']}%")
-                    logging.warning(f"Compactor turned off while waste level exceeded in bin {bin['bin_id']}. Alarm inserted into database.")
-                    
-            if bin['compactor_state'] != 'on':  # Check if compactor is not already active
-                logging.warning(f"Waste level exceeded in bin {bin['bin_id']}: {bin['waste_level']}%")
-                # Send CoAP PUT request to activate compactor
-                send_coap_put_request(bin['bin_id'], "/compactor/command", "turn on")
-            else:
-                logging.info(f"Compactor is already active for bin {bin['bin_id']}. Skipping CoAP request.")
-        
-        # Update compactor state
-        compactor_states[bin['bin_id']] = bin['compactor_state']
-
-# send configuration over coap to compactor actuator and lid actuator (FOR SIMULATION PURPOSES ONLY)
+# Activate the compactor of a bin whose waste level exceeds the threshold
+def activate_compactor(bin_id):
+    send_coap_put_request(bin_id, "/compactor/command", "turn on")
+
+# Rule engine activating the compactors and raising the alarms from the telemetry stream
+rule_engine = RuleEngine(WASTE_LEVEL_THRESHOLD, activate_compactor, insert_alarm)
+
+# Sequence numbers of the bin messages, checked once for the live state and the rule engine
+bin_sequence = SequenceFilter()
+
+# Feed the live state and the rule engine with the telemetry of the bins. The late and duplicate messages, e.g.
+# QoS 1 messages sent again after a reconnection, are skipped: they would roll the dashboard and the rules back
+def start_rule_engine():
+    rule_engine.load_alarms(fetch_unacknowledged_alarms())
+
+    def on_message(client, userdata, msg):
+        try:
+            data = json.loads(msg.payload.decode())
+            if msg.topic == PARAMS_TOPIC:
+                bin_params[data['bin_id']] = data['params']
+                return
+            seq = data.get('seq')
+            if isinstance(seq, int) and data.get('bin_id') and bin_sequence.check(data['bin_id'], seq):
+                return
+            live_bins.update(data)
+            rule_engine.on_update(data)
+        except Exception as e:
+            logging.error(f"Error evaluating rules on message: {e}")
+
+    client = mqtt.Client()
+    client.on_connect = lambda c, u, f, rc: client.subscribe([(UPDATES_TOPIC, 0), (PARAMS_TOPIC, 0)])
+    client.on_message = on_message
+    client.connect(BROKER_ADDRESS, BROKER_PORT, 60)
+    client.loop_start()
+    return client
+
+# send configuration over coap to compactor actuator and lid actuator of a bin (FOR SIMULATION PURPOSES ONLY),
+# returns the futures of the requests
+def send_bin_configuration_over_coap(bin_id, bin_data):
+    return coap_control.provision_bin(bin_id, bin_data)
+
+# send configuration over coap to the actuators of the bins fully described in config.xml, all the bins at once
 def send_configuration_over_coap():
-    bins = parse_config_xml()
-    for bin_id, bin_data in bins.items():
-        # Send configuration to compactor actuator
-        send_coap_put_request(bin_id, "/compactor/config", f"{bin_data['compactor_sensor_address']}")
-        # Send configuration to lid actuator
-        send_coap_put_request(bin_id, "/lid/config", f"{bin_data['lid_sensor_address']}")
-        
-# Send configuration to actuators on startup
+    futures = [future for bin_id, bin_data in bin_config.current().items()
+               for future in send_bin_configuration_over_coap(bin_id, bin_data)]
+    wait(futures)
+    delivered = sum(future.result() for future in futures)
+    logging.info(f"Configuration sent to {delivered} of {len(futures)} actuators")
+
+# Provision again the bins added or changed in config.xml
+def handle_config_change(bin_ids):
+    for bin_id in bin_ids:
+        send_bin_configuration_over_coap(bin_id, get_bin_config(bin_id))
+
+# Provision the actuators of a bin when one of its nodes appears or changes address in the resource directory
+def handle_node_registration(endpoint_name, registration):
+    bin_id = registration['sector']
+    if not bin_id:
+        logging.warning(f"Node {endpoint_name} does not belong to any bin. Skipping provisioning.")
+        return
+    send_bin_configuration_over_coap(bin_id, get_bin_config(bin_id))
+
+# Resource directory where the nodes register, so that new nodes are provisioned without editing config.xml
+resource_directory = ResourceDirectory(resolve_sector=resolve_node_bin, on_change=handle_node_registration)
+start_resource_directory(resource_directory)
+
+# Send configuration to actuators on startup, then follow the changes of config.xml
 send_configuration_over_coap()
+bin_config.watch()
+
+# Function to fetch the transactions recorded after the given ID, oldest first
+def fetch_new_transactions(after_id):
+    try:
+        connection = db_pool.get_connection()
+        cursor = connection.cursor(dictionary=True)
+        if after_id is None:
+            cursor.execute("SELECT MAX(transaction_id) AS transaction_id FROM bins_rfid_transactions")
+        else:
+            cursor.execute("SELECT * FROM bins_rfid_transactions WHERE transaction_id > %s "
+                           "ORDER BY transaction_id LIMIT %s", (after_id, MAX_PAGE_SIZE))
+        transactions = cursor.fetchall()
+        cursor.close()
+        connection.close()
+        return transactions
+    except mysql.connector.Error as err:
+        logging.error(f"Database error: {err}")
+        return []
+
+# Push the new transactions to the dashboards: one indexed query per interval, whatever the number of viewers.
+# The transactions are recorded by scrap_cloud.py, so they are not seen as they happen.
+def follow_transactions():
+    last_id = None
+    while True:
+        transactions = fetch_new_transactions(last_id)
+        if last_id is None:
+            if transactions:
+                last_id = transactions[0]['transaction_id'] or 0
+        else:
+            for transaction in transactions:
+                broadcaster.publish("transaction", transaction)
+                last_id = transaction['transaction_id']
+        time.sleep(TRANSACTION_POLL_INTERVAL)
 
-# Scheduled task for polling
-scheduler = BackgroundScheduler()
-scheduler.add_job(check_waste_level, 'interval', seconds=POLLING_INTERVAL)
-scheduler.start()
+# Evaluate the rules on the telemetry as it arrives, starting from the state stored in the database
+live_bins.load(fetch_bin_data())
+mqtt_client = start_rule_engine()
+threading.Thread(target=follow_transactions, daemon=True).start()
 
 # Flask route to display the page
 @app.route('/')
 def index():
-    bins = fetch_bin_data()
+    bins = live_bins.snapshot()
     return render_template('index.html', bins=bins)
 
 
 # Flask route to fetch current bin data
 @app.route('/api/bins')
 def get_bins():
-    bins = fetch_bin_data()
-    return jsonify(bins)
+    return jsonify(live_bins.snapshot())
+
+# Page size and key of the paginated APIs: ?limit=<n>&before_id=<last ID of the previous page>
+def page_arguments():
+    limit = max(1, min(request.args.get('limit', default=PAGE_SIZE, type=int), MAX_PAGE_SIZE))
+    return request.args.get('before_id', type=int), limit
 
 # Function to fetch transactions from the database
 @app.route('/api/transactions')
 def get_transactions():
-    transactions = fetch_transaction_data()
+    transactions = fetch_transaction_data(*page_arguments())
     return jsonify(transactions)
 
+# Function to fetch the history of a sensor of a bin from the rollups, at the resolution fitting the duration
+def fetch_sensor_history(bin_id, sensor_name, duration):
+    resolution = timeseries.resolution_for(duration)
+    try:
+        connection = db_pool.get_connection()
+        cursor = connection.cursor(dictionary=True)
+        cursor.execute(timeseries.select_rollup_sql(resolution), (bin_id, sensor_name, datetime.now() - duration))
+        buckets = cursor.fetchall()
+        cursor.close()
+        connection.close()
+        return resolution, buckets
+    except mysql.connector.Error as err:
+        logging.error(f"Database error: {err}")
+        return resolution, []
+
+# History of a numeric sensor: /api/history/<bin_id>/<sensor>?hours=<n>, by minute, hour or day
+@app.route('/api/history/<bin_id>/<sensor_name>')
+def get_sensor_history(bin_id, sensor_name):
+    if sensor_name not in timeseries.ROLLUP_SENSORS:
+        return jsonify({'message': f"No history for {sensor_name}"}), 404
+    hours = max(1.0, request.args.get('hours', default=24.0, type=float))
+    resolution, buckets = fetch_sensor_history(bin_id, sensor_name, timedelta(hours=hours))
+    return jsonify({'resolution': resolution, 'buckets': buckets})
+
+# Server-sent events of the dashboard: a "snapshot" of all the bins, then "bin" updates, new "transaction"s,
+# new "alarm"s and "alarm_acknowledged"
+@app.route('/api/events')
+def stream_events():
+    subscriber = broadcaster.subscribe()
+
+    def event(name, data):
+        return f"event: {name}\ndata: {app.json.dumps(data)}\n\n"
+
+    def events():
+        try:
+            yield event("snapshot", live_bins.snapshot())
+            while True:
+                try:
+                    name, data = subscriber.get(timeout=SSE_HEARTBEAT_INTERVAL)
+                except queue.Empty:
+                    if not broadcaster.is_subscribed(subscriber):
+                        return
+                    yield ": heartbeat\n\n"
+                    continue
+                yield event(name, data)
+        finally:
+            broadcaster.unsubscribe(subscriber)
+
+    return Response(events(), mimetype='text/event-stream', headers={'Cache-Control': 'no-cache'})
+
 # Flask route to send CoAP requests from the UI
 @app.route('/coap', methods=['POST'])
 def handle_coap_request():
@@ -207,13 +361,40 @@ def handle_coap_request():
     else:
         return jsonify({'message': 'CoAP request failed'}), 500
 
+# Flask route to read the parameters reported by the collectors, by bin
+@app.route('/api/params')
+def get_params():
+    return jsonify(bin_params)
+
+# Flask route to tune the collectors of some bins, e.g. {"bin_ids": ["bin01"], "params": {"poll_ms": 2000}}.
+# An update is applied whole or not at all, the outcome comes with the next report of each collector
+@app.route('/api/params', methods=['POST'])
+def update_params():
+    data = request.json or {}
+    bin_ids = data.get('bin_ids')
+    params = data.get('params')
+
+    if not bin_ids or not isinstance(params, dict) or not params:
+        return jsonify({'message': 'Bin IDs and parameters are required'}), 400
+    if not all(isinstance(value, int) and not isinstance(value, bool) for value in params.values()):
+        return jsonify({'message': 'Parameter values must be integers'}), 400
+
+    payload = json.dumps(params, separators=(',', ':'))
+    for bin_id in bin_ids:
+        mqtt_client.publish(f"{PARAMS_TOPIC}/{bin_id}", payload, qos=1)
+    return jsonify({'message': f'Parameters sent to {len(bin_ids)} bins'}), 200
+
 
-# Function to fetch alarms from the database
-def fetch_alarm_data():
+# Function to fetch a page of alarms from the database, newest first, keyed as the transactions
+def fetch_alarm_data(before_id=None, limit=PAGE_SIZE):
     try:
-        connection = mysql.connector.connect(**DATABASE_CONFIG)
+        connection = db_pool.get_connection()
         cursor = connection.cursor(dictionary=True)
-        cursor.execute("SELECT * FROM alarms ORDER BY time DESC")
+        if before_id is None:
+            cursor.execute("SELECT * FROM alarms ORDER BY alarm_id DESC LIMIT %s", (limit,))
+        else:
+            cursor.execute("SELECT * FROM alarms WHERE alarm_id < %s ORDER BY alarm_id DESC LIMIT %s",
+                           (before_id, limit))
         alarms = cursor.fetchall()
         cursor.close()
         connection.close()
@@ -225,7 +406,7 @@ def fetch_alarm_data():
 # Flask route to serve alarm data as JSON
 @app.route('/api/alarms')
 def get_alarms():
-    alarms = fetch_alarm_data()
+    alarms = fetch_alarm_data(*page_arguments())
     return jsonify(alarms)
 
 # Flask route to acknowledge an alarm
@@ -238,12 +419,14 @@ def acknowledge_alarm():
         return jsonify({'message': 'Alarm ID is required'}), 400
 
     try:
-        connection = mysql.connector.connect(**DATABASE_CONFIG)
+        connection = db_pool.get_connection()
         cursor = connection.cursor()
         cursor.execute("UPDATE alarms SET acknowledged = TRUE WHERE alarm_id = %s", (alarm_id,))
         connection.commit()
         cursor.close()
         connection.close()
+        rule_engine.acknowledge(int(alarm_id))
+        broadcaster.publish("alarm_acknowledged", {"alarm_id": int(alarm_id)})
         return jsonify({'message': 'Alarm acknowledged successfully'}), 200
     except mysql.connector.Error as err:
         logging.error(f"Database error: {err}")
@@ -0,0 +1,38 @@
+# Sequence numbers of the bin messages: every collector numbers its aggregated messages, so that the
+# consumers of the "bins" stream (scrap_cloud.py, the dashboard and its rule engine) skip the late and duplicate ones.
+# A message up to STALE_SEQ_WINDOW sequence numbers behind the last one of its bin is a late or duplicate
+# message, a larger step back or a sequence number of 1 is a restart of the collector.
+STALE_SEQ_WINDOW = 1000
+# Of those, the ones received already are counted as duplicates, e.g. QoS 1 messages sent again by a collector
+# that did not get the PUBACK, as far as DUPLICATE_SEQ_WINDOW sequence numbers back
+DUPLICATE_SEQ_WINDOW = 64
+
+STALE = "stale"
+DUPLICATE = "duplicate"
+
+
+class SequenceFilter:
+    def __init__(self):
+        self.last = {}
+        self.seen = {}  # bit i set when the sequence number last - i was received
+
+    def clear(self):
+        self.last.clear()
+        self.seen.clear()
+
+    # STALE or DUPLICATE for a message behind the last one of its bin, None for a message to process
+    def check(self, bin_id, seq):
+        last_seq = self.last.get(bin_id)
+        if last_seq is not None and seq != 1 and last_seq - STALE_SEQ_WINDOW < seq <= last_seq:
+            behind = last_seq - seq
+            if behind < DUPLICATE_SEQ_WINDOW and self.seen[bin_id] >> behind & 1:
+                return DUPLICATE
+            if behind < DUPLICATE_SEQ_WINDOW:
+                self.seen[bin_id] |= 1 << behind
+            return STALE
+        if last_seq is None or seq <= last_seq:
+            self.seen[bin_id] = 1
+        else:
+            self.seen[bin_id] = (self.seen[bin_id] << (seq - last_seq) | 1) & ((1 << DUPLICATE_SEQ_WINDOW) - 1)
+        self.last[bin_id] = seq
+        return None
@@ -0,0 +1,317 @@
+from datetime import datetime, timedelta
+
+# Time-series storage of the sensor changes written by scrap_cloud.py:
+#   - bins_change_log keeps the raw changes, indexed by (bin_id, sensor_name, change_timestamp). On MySQL it
+#     is partitioned by month, so the expired months are dropped as whole partitions instead of deleted.
+#   - bins_rollup_minute, bins_rollup_hour and bins_rollup_day aggregate the numeric sensors per bucket
+#     (samples, min, max, sum for the average, last value). They are upserted with every batch of changes,
+#     in the same transaction, and are what the dashboards and reports read: a range of buckets of one
+#     sensor is a range of the primary key, whatever the months of history behind it.
+# The rollups aggregate the changes: a bucket without changes has no row, the value is the last one of the
+# buckets before. The index and the rollup tables are created at startup. The partitioning of an existing
+# change log and the backfill of the rollups are done once with scrap_cloud.py --migrate-change-log, the
+# ingest stopped.
+
+RAW_RETENTION_MONTHS = 6  # months of raw changes kept, besides the current one
+# Days of rollups kept per resolution, None to keep them forever
+ROLLUP_RETENTION_DAYS = {"minute": 14, "hour": 730, "day": None}
+PARTITIONS_AHEAD = 2  # monthly partitions created in advance
+MAINTENANCE_INTERVAL = 3600  # seconds
+DELETE_CHUNK_ROWS = 10000
+BACKFILL_CHUNK_ROWS = 10000
+
+ROLLUP_SENSORS = ("waste_level_sensor", "scale")
+RESOLUTIONS = ("minute", "hour", "day")
+ROLLUP_COLUMNS = ["bin_id", "sensor_name", "bucket_start", "samples", "min_value", "max_value", "sum_value",
+                  "last_value", "last_time"]
+
+# Rollup tables, for MySQL (the SQLite stand-in creates them with SQLITE_SCHEMA)
+ROLLUP_TABLE_MYSQL = """
+    CREATE TABLE IF NOT EXISTS bins_rollup_{resolution} (
+        bin_id VARCHAR(64) NOT NULL,
+        sensor_name VARCHAR(32) NOT NULL,
+        bucket_start DATETIME NOT NULL,
+        samples INT UNSIGNED NOT NULL,
+        min_value DOUBLE NOT NULL,
+        max_value DOUBLE NOT NULL,
+        sum_value DOUBLE NOT NULL,
+        last_value DOUBLE NOT NULL,
+        last_time DATETIME(3) NOT NULL,
+        PRIMARY KEY (bin_id, sensor_name, bucket_start),
+        INDEX (bucket_start)
+    );
+"""
+
+SQLITE_SCHEMA = """
+    CREATE INDEX IF NOT EXISTS bins_change_log_sensor ON bins_change_log (bin_id, sensor_name, change_timestamp);
+    CREATE INDEX IF NOT EXISTS bins_change_log_time ON bins_change_log (change_timestamp);
+""" + "".join(f"""
+    CREATE TABLE IF NOT EXISTS bins_rollup_{resolution} (
+        bin_id TEXT NOT NULL,
+        sensor_name TEXT NOT NULL,
+        bucket_start TIMESTAMP NOT NULL,
+        samples INTEGER NOT NULL,
+        min_value REAL NOT NULL,
+        max_value REAL NOT NULL,
+        sum_value REAL NOT NULL,
+        last_value REAL NOT NULL,
+        last_time TIMESTAMP NOT NULL,
+        PRIMARY KEY (bin_id, sensor_name, bucket_start)
+    );
+    CREATE INDEX IF NOT EXISTS bins_rollup_{resolution}_time ON bins_rollup_{resolution} (bucket_start);
+""" for resolution in RESOLUTIONS)
+
+
+def bucket_start(timestamp, resolution):
+    if resolution == "minute":
+        return timestamp.replace(second=0, microsecond=0)
+    if resolution == "hour":
+        return timestamp.replace(minute=0, second=0, microsecond=0)
+    return timestamp.replace(hour=0, minute=0, second=0, microsecond=0)
+
+
+def parse_value(value):
+    try:
+        return float(value)
+    except (TypeError, ValueError):
+        return None
+
+
+# Rollup rows of a batch of change log rows (bin_id, sensor_name, new_value, change_timestamp), per resolution.
+# The changes of a bin are in time order, as queued by its ingest worker.
+def rollup_rows(changes):
+    buckets = {resolution: {} for resolution in RESOLUTIONS}
+    for bin_id, sensor_name, new_value, timestamp in changes:
+        value = parse_value(new_value) if sensor_name in ROLLUP_SENSORS else None
+        if value is None:
+            continue
+        for resolution in RESOLUTIONS:
+            key = (bin_id, sensor_name, bucket_start(timestamp, resolution))
+            bucket = buckets[resolution].get(key)
+            if bucket is None:
+                buckets[resolution][key] = [1, value, value, value, value, timestamp]
+            else:
+                bucket[0] += 1
+                bucket[1] = min(bucket[1], value)
+                bucket[2] = max(bucket[2], value)
+                bucket[3] += value
+                bucket[4], bucket[5] = value, timestamp
+    return {resolution: [key + tuple(bucket) for key, bucket in rows.items()]
+            for resolution, rows in buckets.items() if rows}
+
+
+# Upsert merging the rollups of a batch into the stored buckets. MySQL applies the assignments in order, so
+# last_value is chosen before last_time is updated.
+def upsert_rollup_sql(resolution, count, sqlite):
+    row = "(" + ", ".join(["%s"] * len(ROLLUP_COLUMNS)) + ")"
+    insert = (f"INSERT INTO bins_rollup_{resolution} ({', '.join(ROLLUP_COLUMNS)}) "
+              f"VALUES {', '.join([row] * count)}")
+    if sqlite:
+        return insert + """ ON CONFLICT (bin_id, sensor_name, bucket_start) DO UPDATE SET
+            samples = samples + excluded.samples,
+            min_value = min(min_value, excluded.min_value),
+            max_value = max(max_value, excluded.max_value),
+            sum_value = sum_value + excluded.sum_value,
+            last_value = CASE WHEN excluded.last_time >= last_time THEN excluded.last_value ELSE last_value END,
+            last_time = max(last_time, excluded.last_time)"""
+    return insert + """ ON DUPLICATE KEY UPDATE
+        samples = samples + VALUES(samples),
+        min_value = LEAST(min_value, VALUES(min_value)),
+        max_value = GREATEST(max_value, VALUES(max_value)),
+        sum_value = sum_value + VALUES(sum_value),
+        last_value = IF(VALUES(last_time) >= last_time, VALUES(last_value), last_value),
+        last_time = GREATEST(last_time, VALUES(last_time))"""
+
+
+# Merge the rollups of a batch of changes, with the cursor of the transaction writing the changes
+def write_rollups(cursor, database, changes):
+    for resolution, rows in rollup_rows(changes).items():
+        cursor.execute(database.sql(upsert_rollup_sql(resolution, len(rows), database.sqlite)),
+                       [value for row in rows for value in row])
+
+
+# Resolution of the rollups to read for a time range, a few hundred buckets at most
+def resolution_for(duration):
+    if duration <= timedelta(hours=6):
+        return "minute"
+    if duration <= timedelta(days=14):
+        return "hour"
+    return "day"
+
+
+# Buckets of a sensor of a bin since the given time, oldest first
+SELECT_ROLLUP_SQL = """
+    SELECT bucket_start, samples, min_value, max_value, sum_value / samples AS avg_value, last_value
+    FROM bins_rollup_{resolution}
+    WHERE bin_id = %s AND sensor_name = %s AND bucket_start >= %s
+    ORDER BY bucket_start
+"""
+
+
+def select_rollup_sql(resolution):
+    return SELECT_ROLLUP_SQL.format(resolution=resolution)
+
+
+# Create the rollup tables and the index of the range queries on the change log, when missing
+def create_tables(database):
+    if database.sqlite:
+        return
+    with database.connection() as db:
+        cursor = db.cursor()
+        for resolution in RESOLUTIONS:
+            cursor.execute(ROLLUP_TABLE_MYSQL.format(resolution=resolution))
+        cursor.execute("SHOW INDEX FROM bins_change_log WHERE Key_name = 'bins_change_log_sensor'")
+        if not cursor.fetchall():
+            print("Adding the index bins_change_log_sensor to bins_change_log...")
+            cursor.execute("ALTER TABLE bins_change_log "
+                           "ADD INDEX bins_change_log_sensor (bin_id, sensor_name, change_timestamp)")
+        db.commit()
+
+
+def month_start(timestamp):
+    return datetime(timestamp.year, timestamp.month, 1)
+
+
+def add_months(start, months):
+    index = start.year * 12 + start.month - 1 + months
+    return datetime(index // 12, index % 12 + 1, 1)
+
+
+# Month starts from first to last included
+def months_between(first, last):
+    months = []
+    while first <= last:
+        months.append(first)
+        first = add_months(first, 1)
+    return months
+
+
+def partition_definition(start):
+    return (f"PARTITION p{start:%Y%m} VALUES LESS THAN "
+            f"(UNIX_TIMESTAMP('{add_months(start, 1):%Y-%m-%d %H:%M:%S}'))")
+
+
+# Monthly partitions of the change log as {month start: name}, None when the table is not partitioned
+def change_log_partitions(cursor):
+    cursor.execute("SELECT PARTITION_NAME FROM information_schema.PARTITIONS "
+                   "WHERE TABLE_SCHEMA = DATABASE() AND TABLE_NAME = 'bins_change_log'")
+    names = [row[0] for row in cursor.fetchall()]
+    if not names or names == [None]:
+        return None
+    return {datetime.strptime(name[1:], "%Y%m"): name for name in names if name != "pmax"}
+
+
+# Create the coming partitions and drop the expired data: the change log months older than raw_retention_months
+# and the rollups older than their retention
+def maintain(database, now=None, raw_retention_months=RAW_RETENTION_MONTHS,
+             rollup_retention_days=ROLLUP_RETENTION_DAYS):
+    now = now or datetime.now()
+    raw_cutoff = add_months(month_start(now), -raw_retention_months)
+    with database.connection() as db:
+        cursor = db.cursor()
+        if database.sqlite:
+            cursor.execute(database.sql("DELETE FROM bins_change_log WHERE change_timestamp < %s"), (raw_cutoff,))
+        else:
+            partitions = change_log_partitions(cursor)
+            if partitions is None:
+                print("bins_change_log is not partitioned, run scrap_cloud.py --migrate-change-log to enable "
+                      "its retention.")
+            else:
+                coming = months_between(add_months(max(partitions), 1), add_months(month_start(now), PARTITIONS_AHEAD))
+                if coming:
+                    definitions = ", ".join(partition_definition(start) for start in coming)
+                    cursor.execute(f"ALTER TABLE bins_change_log REORGANIZE PARTITION pmax INTO "
+                                   f"({definitions}, PARTITION pmax VALUES LESS THAN MAXVALUE)")
+                expired = [name for start, name in sorted(partitions.items()) if start < raw_cutoff]
+                if expired:
+                    cursor.execute(f"ALTER TABLE bins_change_log DROP PARTITION {', '.join(expired)}")
+                    print(f"Dropped the change log partitions {', '.join(expired)}")
+
+        for resolution, days in rollup_retention_days.items():
+            if days is None:
+                continue
+            cutoff = bucket_start(now - timedelta(days=days), "day")
+            if database.sqlite:
+                cursor.execute(database.sql(f"DELETE FROM bins_rollup_{resolution} WHERE bucket_start < %s"), (cutoff,))
+                continue
+            while True:
+                cursor.execute(f"DELETE FROM bins_rollup_{resolution} WHERE bucket_start < %s LIMIT %s",
+                               (cutoff, DELETE_CHUNK_ROWS))
+                db.commit()
+                if cursor.rowcount < DELETE_CHUNK_ROWS:
+                    break
+        db.commit()
+
+
+# The partitions are ranges of UNIX_TIMESTAMP(change_timestamp), which MySQL only accepts on a TIMESTAMP
+# column. A DATETIME column is converted, its values read back the same in the session time zone, when they
+# are all in the TIMESTAMP range. Returns the reason the column can not be partitioned, None when it can
+def prepare_change_timestamp(cursor):
+    cursor.execute("SELECT DATA_TYPE FROM information_schema.COLUMNS WHERE TABLE_SCHEMA = DATABASE() "
+                   "AND TABLE_NAME = 'bins_change_log' AND COLUMN_NAME = 'change_timestamp'")
+    row = cursor.fetchone()
+    data_type = str(row[0]).lower() if row else None
+    if data_type == "timestamp":
+        return None
+    if data_type != "datetime":
+        return f"change_timestamp is {data_type or 'missing'}, not a TIMESTAMP or DATETIME"
+    cursor.execute("SELECT COUNT(*) FROM bins_change_log WHERE change_timestamp < '1970-01-02' "
+                   "OR change_timestamp >= '2038-01-18'")
+    outside = cursor.fetchone()[0]
+    if outside:
+        return f"change_timestamp is a DATETIME with {outside} values out of the TIMESTAMP range"
+    print("Converting bins_change_log.change_timestamp from DATETIME to TIMESTAMP...")
+    cursor.execute("ALTER TABLE bins_change_log MODIFY change_timestamp TIMESTAMP NULL DEFAULT NULL")
+    return None
+
+
+# Partition the change log by month and rebuild the rollups from it. The primary key of a partitioned table
+# must contain the partitioning column, it becomes (id, change_timestamp).
+def migrate(database, now=None):
+    now = now or datetime.now()
+    create_tables(database)
+    with database.connection() as db:
+        cursor = db.cursor()
+        if not database.sqlite:
+            if change_log_partitions(cursor) is not None:
+                print("bins_change_log is already partitioned.")
+            else:
+                reason = prepare_change_timestamp(cursor)
+                if reason:
+                    raise SystemExit(f"Can not partition bins_change_log: {reason}. Convert the column to "
+                                     f"TIMESTAMP and run --migrate-change-log again.")
+                cursor.execute("SELECT MIN(change_timestamp) FROM bins_change_log")
+                first = month_start(cursor.fetchone()[0] or now)
+                months = months_between(first, add_months(month_start(now), PARTITIONS_AHEAD))
+                print(f"Partitioning bins_change_log into {len(months)} months...")
+                cursor.execute("ALTER TABLE bins_change_log DROP PRIMARY KEY, ADD PRIMARY KEY (id, change_timestamp)")
+                cursor.execute(f"ALTER TABLE bins_change_log PARTITION BY RANGE (UNIX_TIMESTAMP(change_timestamp)) "
+                               f"({', '.join(partition_definition(start) for start in months)}, "
+                               f"PARTITION pmax VALUES LESS THAN MAXVALUE)")
+
+        # The rollups are additive, they are rebuilt from scratch
+        for resolution in RESOLUTIONS:
+            cursor.execute(f"DELETE FROM bins_rollup_{resolution}")
+        db.commit()
+        sensors = ", ".join(["%s"] * len(ROLLUP_SENSORS))
+        last_id, changes = 0, 0
+        while True:
+            cursor.execute(database.sql(f"SELECT id, bin_id, sensor_name, new_value, change_timestamp "
+                                        f"FROM bins_change_log WHERE id > %s AND sensor_name IN ({sensors}) "
+                                        f"ORDER BY id LIMIT %s"),
+                           (last_id, *ROLLUP_SENSORS, BACKFILL_CHUNK_ROWS))
+            rows = cursor.fetchall()
+            if not rows:
+                break
+            last_id = rows[-1][0]
+            chunk = [(bin_id, sensor_name, new_value, parse_timestamp(timestamp))
+                     for _, bin_id, sensor_name, new_value, timestamp in rows]
+            write_rollups(cursor, database, chunk)
+            db.commit()
+            changes += len(rows)
+        print(f"Rebuilt the rollups from {changes} changes.")
+
+
+# Timestamps come back as datetime from MySQL and as text from the SQLite stand-in
+def parse_timestamp(value):
+    return datetime.fromisoformat(value) if isinstance(value, str) else value
@@ -0,0 +1,103 @@
+// Native microbenchmark: json_extract against the jsmn path used by the collector
+// (full tokenization into 16 tokens, then a linear search for the key).
+// Every corpus file is run through both parsers, the results are printed side by side
+// so that differences are visible, then both are timed on the same payload.
+#include "jsmn.h"
+#include "json_extract.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define ITERATIONS 1000000
+#define MAX_PAYLOAD 1024
+
+static const char *paths[] = {"*.value", "bin_id", "command"};
+
+// Current collector approach: tokenize, then take the value of the first token equal to the last key
+static int jsmn_lookup(const char *json, size_t len, const char *path, const char **value, size_t *value_len) {
+    const char *key = strrchr(path, '.') ? strrchr(path, '.') + 1 : path;
+    jsmn_parser parser;
+    jsmntok_t tokens[16];
+    jsmn_init(&parser);
+    int token_count = jsmn_parse(&parser, json, len, tokens, 16);
+
+    if (token_count < 1 || tokens[0].type != JSMN_OBJECT) {
+        return -1;
+    }
+    for (int i = 1; i < token_count - 1; i++) {
+        if (tokens[i].type == JSMN_STRING && (int)strlen(key) == tokens[i].end - tokens[i].start &&
+            strncmp(json + tokens[i].start, key, tokens[i].end - tokens[i].start) == 0) {
+            *value = json + tokens[i + 1].start;
+            *value_len = tokens[i + 1].end - tokens[i + 1].start;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static double elapsed_ns(struct timespec *start, struct timespec *stop) {
+    return (stop->tv_sec - start->tv_sec) * 1e9 + (stop->tv_nsec - start->tv_nsec);
+}
+
+static double time_parser(int (*parser)(const char *, size_t, const char *, const char **, size_t *),
+                          const char *json, size_t len, const char *path) {
+    struct timespec start, stop;
+    const char *value;
+    size_t value_len;
+    volatile size_t sink = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < ITERATIONS; i++) {
+        if (parser(json, len, path, &value, &value_len) == 0) {
+            sink += value_len;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    (void)sink;
+    return elapsed_ns(&start, &stop) / ITERATIONS;
+}
+
+static void print_result(const char *name, int ret, const char *value, size_t value_len) {
+    if (ret == 0) {
+        printf("  %-13s \"%.*s\"\n", name, (int)value_len, value);
+    } else {
+        printf("  %-13s not found\n", name);
+    }
+}
+
+int main(int argc, char **argv) {
+    char json[MAX_PAYLOAD];
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <corpus file>...\n", argv[0]);
+        return 1;
+    }
+
+    for (int f = 1; f < argc; f++) {
+        FILE *file = fopen(argv[f], "rb");
+        if (file == NULL) {
+            perror(argv[f]);
+            continue;
+        }
+        size_t len = fread(json, 1, sizeof(json), file);
+        fclose(file);
+
+        for (size_t p = 0; p < sizeof(paths) / sizeof(paths[0]); p++) {
+            const char *jsmn_value = NULL, *extract_value = NULL;
+            size_t jsmn_len = 0, extract_len = 0;
+            int jsmn_ret = jsmn_lookup(json, len, paths[p], &jsmn_value, &jsmn_len);
+            int extract_ret = json_extract(json, len, paths[p], &extract_value, &extract_len);
+
+            if (jsmn_ret != 0 && extract_ret != 0) {
+                continue;
+            }
+
+            printf("%s %s\n", argv[f], paths[p]);
+            print_result("jsmn", jsmn_ret, jsmn_value, jsmn_len);
+            print_result("json_extract", extract_ret, extract_value, extract_len);
+            printf("  %-13s %.1f ns/op\n", "jsmn", time_parser(jsmn_lookup, json, len, paths[p]));
+            printf("  %-13s %.1f ns/op\n", "json_extract", time_parser(json_extract, json, len, paths[p]));
+        }
+    }
+    return 0;
+}
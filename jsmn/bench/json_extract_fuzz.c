@@ -0,0 +1,81 @@
+// Fuzz target of json_extract and json_next_member, for libFuzzer (make fuzz, needs clang) or AFL and corpus
+// replays (make fuzz-replay, any compiler, built with AddressSanitizer). The input is copied to a buffer of
+// its exact size, so that a read past the length is caught. Besides the memory errors, it checks that every
+// span returned lies within the input and that the member iteration moves forward.
+#include "json_extract.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_INPUT 65536
+
+static const char *paths[] = {"bin_id", "*.value", "*", "sensors.0", "sensors.*.name", "a.b.c.d.e.f.g.h"};
+
+static void check_span(const char *json, size_t len, const char *span, size_t span_len) {
+    if (span < json || span_len > len || (size_t)(span - json) > len - span_len) {
+        abort();
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    char *json = malloc(size > 0 ? size : 1);
+    const char *key;
+    const char *value;
+    size_t key_len;
+    size_t value_len;
+    size_t offset = 0;
+    size_t previous;
+    int member;
+
+    memcpy(json, data, size);
+    for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+        if (json_extract(json, size, paths[i], &value, &value_len) == 0) {
+            check_span(json, size, value, value_len);
+            json_span_equals(value, value_len, "value");
+        }
+    }
+
+    do {
+        previous = offset;
+        member = json_next_member(json, size, &offset, &key, &key_len, &value, &value_len);
+        if (member == 1) {
+            check_span(json, size, key, key_len);
+            check_span(json, size, value, value_len);
+            if (offset <= previous || offset > size) {
+                abort();
+            }
+        }
+    } while (member == 1);
+
+    free(json);
+    return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+// Run the files given as arguments, or the standard input as AFL does
+static void run_file(FILE *file) {
+    static uint8_t input[MAX_INPUT];
+    size_t size = fread(input, 1, sizeof(input), file);
+
+    LLVMFuzzerTestOneInput(input, size);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        run_file(stdin);
+        return 0;
+    }
+    for (int i = 1; i < argc; i++) {
+        FILE *file = fopen(argv[i], "rb");
+        if (file == NULL) {
+            perror(argv[i]);
+            return 1;
+        }
+        run_file(file);
+        fclose(file);
+    }
+    printf("%d inputs passed\n", argc - 1);
+    return 0;
+}
+#endif
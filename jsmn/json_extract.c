@@ -0,0 +1,276 @@
+#include "json_extract.h"
+#include <string.h>
+
+static const char *skip_whitespace(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+        p++;
+    }
+    return p;
+}
+
+// p is on the opening quote, returns the position after the closing quote
+static const char *skip_string(const char *p, const char *end) {
+    for (p++; p < end; p++) {
+        if (*p == '\\') {
+            p++;
+        } else if (*p == '"') {
+            return p + 1;
+        }
+    }
+    return NULL;
+}
+
+// Skip any value, returns the position after it or NULL if it is malformed
+static const char *skip_value(const char *p, const char *end) {
+    int depth = 0;
+
+    if (p >= end) {
+        return NULL;
+    }
+
+    if (*p != '{' && *p != '[') {
+        if (*p == '"') {
+            return skip_string(p, end);
+        }
+        // Primitive: number, true, false or null
+        const char *start = p;
+        while (p < end && *p != ',' && *p != '}' && *p != ']' &&
+               *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') {
+            p++;
+        }
+        return p > start ? p : NULL;
+    }
+
+    // Object or array, only the nesting depth needs to be tracked
+    while (p < end) {
+        if (*p == '"') {
+            p = skip_string(p, end);
+            if (p == NULL) {
+                return NULL;
+            }
+            continue;
+        }
+        if (*p == '{' || *p == '[') {
+            depth++;
+        } else if (*p == '}' || *p == ']') {
+            if (--depth == 0) {
+                return p + 1;
+            }
+        }
+        p++;
+    }
+    return NULL;
+}
+
+static const char *extract_from_object(const char *p, const char *end, const char *path,
+                                       const char **value, size_t *value_len, int *found);
+
+// Report the value at p, or descend into it for the rest of the path. Returns the position after the
+// value, NULL if the JSON is malformed
+static const char *extract_value(const char *p, const char *end, const char *rest,
+                                 const char **value, size_t *value_len, int *found);
+
+// Scan the array starting at p for the element at the index of the first segment of the path, same
+// results as extract_from_object
+static const char *extract_from_array(const char *p, const char *end, const char *path,
+                                      const char **value, size_t *value_len, int *found) {
+    const char *segment_end = strchr(path, '.');
+    size_t segment_len = segment_end ? (size_t)(segment_end - path) : strlen(path);
+    size_t index = 0;
+
+    // Only an index matches an element
+    if (segment_len == 0) {
+        return skip_value(p, end);
+    }
+    for (size_t i = 0; i < segment_len; i++) {
+        if (path[i] < '0' || path[i] > '9') {
+            return skip_value(p, end);
+        }
+        index = index * 10 + (size_t)(path[i] - '0');
+    }
+
+    p = skip_whitespace(p + 1, end);
+    if (p < end && *p == ']') {
+        return p + 1;
+    }
+
+    for (size_t i = 0; p < end; i++) {
+        const char *value_end;
+        if (i == index) {
+            value_end = extract_value(p, end, segment_end ? segment_end + 1 : NULL, value, value_len, found);
+            if (value_end == NULL || *found) {
+                return value_end;
+            }
+        } else {
+            value_end = skip_value(p, end);
+        }
+        if (value_end == NULL) {
+            return NULL;
+        }
+
+        p = skip_whitespace(value_end, end);
+        if (p < end && *p == ',') {
+            p = skip_whitespace(p + 1, end);
+        } else if (p < end && *p == ']') {
+            return p + 1;
+        } else {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+static const char *extract_value(const char *p, const char *end, const char *rest,
+                                 const char **value, size_t *value_len, int *found) {
+    const char *value_end;
+
+    if (rest != NULL) {
+        if (*p == '{') {
+            return extract_from_object(p, end, rest, value, value_len, found);
+        }
+        if (*p == '[') {
+            return extract_from_array(p, end, rest, value, value_len, found);
+        }
+        return skip_value(p, end);
+    }
+
+    value_end = skip_value(p, end);
+    if (value_end == NULL) {
+        return NULL;
+    }
+    if (*p == '"') {
+        *value = p + 1;
+        *value_len = (size_t)(value_end - p - 2);
+    } else {
+        *value = p;
+        *value_len = (size_t)(value_end - p);
+    }
+    *found = 1;
+    return value_end;
+}
+
+// Scan the object starting at p for the path. Returns the position after the object (or after the
+// value when found), NULL if the JSON is malformed. The value is reported through found/value/value_len
+static const char *extract_from_object(const char *p, const char *end, const char *path,
+                                       const char **value, size_t *value_len, int *found) {
+    const char *segment_end = strchr(path, '.');
+    size_t segment_len = segment_end ? (size_t)(segment_end - path) : strlen(path);
+    int wildcard = segment_len == 1 && path[0] == '*';
+
+    p = skip_whitespace(p + 1, end);
+    if (p < end && *p == '}') {
+        return p + 1;
+    }
+
+    while (p < end) {
+        // Key
+        if (*p != '"') {
+            return NULL;
+        }
+        const char *key = p + 1;
+        p = skip_string(p, end);
+        if (p == NULL) {
+            return NULL;
+        }
+        size_t key_len = (size_t)(p - 1 - key);
+
+        p = skip_whitespace(p, end);
+        if (p >= end || *p != ':') {
+            return NULL;
+        }
+        p = skip_whitespace(p + 1, end);
+        if (p >= end) {
+            return NULL;
+        }
+
+        // Value: either the result, an object or array to descend into, or something to skip
+        const char *value_end;
+        if (wildcard || (key_len == segment_len && memcmp(key, path, segment_len) == 0)) {
+            value_end = extract_value(p, end, segment_end ? segment_end + 1 : NULL, value, value_len, found);
+            if (value_end == NULL || *found) {
+                return value_end;
+            }
+        } else {
+            value_end = skip_value(p, end);
+        }
+        if (value_end == NULL) {
+            return NULL;
+        }
+
+        // Separator or end of the object
+        p = skip_whitespace(value_end, end);
+        if (p < end && *p == ',') {
+            p = skip_whitespace(p + 1, end);
+        } else if (p < end && *p == '}') {
+            return p + 1;
+        } else {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+int json_extract(const char *json, size_t len, const char *path, const char **value, size_t *value_len) {
+    const char *end = json + len;
+    const char *p = skip_whitespace(json, end);
+    int found = 0;
+
+    if (p >= end || *p != '{') {
+        return -1;
+    }
+    if (extract_from_object(p, end, path, value, value_len, &found) == NULL || !found) {
+        return -1;
+    }
+    return 0;
+}
+
+int json_next_member(const char *json, size_t len, size_t *offset, const char **key, size_t *key_len,
+                     const char **value, size_t *value_len) {
+    const char *end = json + len;
+    const char *p = skip_whitespace(json + *offset, end);
+    int found = 0;
+
+    // Opening brace of the object, or the separator after the previous member
+    if (*offset == 0) {
+        if (p >= end || *p != '{') {
+            return -1;
+        }
+        p = skip_whitespace(p + 1, end);
+        if (p < end && *p == '}') {
+            *offset = (size_t)(p + 1 - json);
+            return 0;
+        }
+    } else if (p < end && *p == ',') {
+        p = skip_whitespace(p + 1, end);
+    } else if (p < end && *p == '}') {
+        return 0;
+    } else {
+        return -1;
+    }
+
+    if (p >= end || *p != '"') {
+        return -1;
+    }
+    *key = p + 1;
+    p = skip_string(p, end);
+    if (p == NULL) {
+        return -1;
+    }
+    *key_len = (size_t)(p - 1 - *key);
+
+    p = skip_whitespace(p, end);
+    if (p >= end || *p != ':') {
+        return -1;
+    }
+    p = skip_whitespace(p + 1, end);
+    p = extract_value(p, end, NULL, value, value_len, &found);
+    if (p == NULL) {
+        return -1;
+    }
+    *offset = (size_t)(p - json);
+    return 1;
+}
+
+int json_span_equals(const char *value, size_t value_len, const char *str) {
+    return strlen(str) == value_len && memcmp(value, str, value_len) == 0;
+}
@@ -0,0 +1,24 @@
+#ifndef JSON_EXTRACT_H
+#define JSON_EXTRACT_H
+
+#include <stddef.h>
+
+// Allocation-free, single-pass extraction of one field from a JSON object.
+// The buffer is length-bounded and does not need to be NUL-terminated, so CoAP and MQTT
+// payloads can be used in place. The path is a list of keys separated by dots, where "*"
+// matches any key and a number indexes an array, e.g. "bin_id", "*.value" or "sensors.0".
+//
+// On success returns 0 and sets value/value_len to the span of the value inside the buffer:
+// the contents of a string without the quotes, or the raw text of any other value.
+// Returns -1 if the path is not found or the JSON is malformed.
+int json_extract(const char *json, size_t len, const char *path, const char **value, size_t *value_len);
+
+// Iterate over the members of the top-level object, *offset starts at 0. Returns 1 with the key and the value
+// of the next member (spans as with json_extract), 0 after the last one, -1 if the JSON is malformed
+int json_next_member(const char *json, size_t len, size_t *offset, const char **key, size_t *key_len,
+                     const char **value, size_t *value_len);
+
+// Check if a span returned by json_extract is equal to a NUL-terminated string
+int json_span_equals(const char *value, size_t value_len, const char *str);
+
+#endif // JSON_EXTRACT_H
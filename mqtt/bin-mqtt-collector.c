@@ -1,7 +1,12 @@
 #include "contiki.h"
 #include "coap-engine.h"
 #include "coap-blocking-api.h"
+#include "coap-callback-api.h"
+#if COLLECTOR_CONF_MQTT_SN
+#include "mqtt_sn.h"
+#else
 #include "mqtt.h"
+#endif
 #include "net/routing/routing.h"
 #include "net/ipv6/uip.h"
 #include "net/ipv6/uiplib.h"
@@ -9,11 +14,18 @@
 #include "sys/etimer.h"
 #include "sys/ctimer.h"
 #include "dev/leds.h"
-#include "jsmn.h"
+#include "json_extract.h"
+#include "cbor_utils.h"
+#include "rd_client.h"
+#include "endpoint_registry.h"
+#include "sample_scheduler.h"
+#include "publish_queue.h"
+#include "payload_writer.h"
+#include "sensor_table.h"
+#include "param_store.h"
+#include "ringlog.h"
 #include <string.h>
-#include <stdio.h>
 #include <stdlib.h>
-#include <locale.h>
 
 #define LOG_MODULE "CoAP-to-MQTT"
 #define LOG_LEVEL LOG_LEVEL_DBG
@@ -21,28 +33,136 @@
 // MQTT broker configuration
 #define MQTT_CLIENT_BROKER_IP_ADDR "fd00::1"
 #define DEFAULT_BROKER_PORT 1883
+#define UPDATES_TOPIC "bins"
 #define CONFIG_REQUEST_TOPIC "config/request"
 #define CONFIG_RESPONSE_TOPIC "config/response"
-static char pub_msg[1024];
-static char client_id[64];
+// Parameter updates come on PARAMS_TOPIC/<bin_id>, the parameters in effect are reported on PARAMS_TOPIC
+#define PARAMS_TOPIC "config/params"
+
+// Period of the sensor polling cycle, benchmarks build the collector with a shorter one. Collectors are
+// spread over the period by a phase derived from their link-layer address. The default of the poll_ms
+// parameter
+#ifdef COLLECTOR_CONF_POLL_INTERVAL_MS
+#define COLLECTOR_POLL_INTERVAL_MS COLLECTOR_CONF_POLL_INTERVAL_MS
+#else
+#define COLLECTOR_POLL_INTERVAL_MS 1000
+#endif
+
+// Transport to the broker: MQTT over TCP, or with `make MQTT_SN=1` MQTT-SN over UDP through a gateway next to
+// the broker (tools/mqtt_sn_gateway.py), which spares the mesh the TCP handshakes, acknowledgements and
+// head-of-line blocking
+#ifdef COLLECTOR_CONF_MQTT_SN
+#define COLLECTOR_MQTT_SN COLLECTOR_CONF_MQTT_SN
+#else
+#define COLLECTOR_MQTT_SN 0
+#endif
+
+#ifdef COLLECTOR_CONF_MQTT_SN_GATEWAY_PORT
+#define COLLECTOR_MQTT_SN_GATEWAY_PORT COLLECTOR_CONF_MQTT_SN_GATEWAY_PORT
+#else
+#define COLLECTOR_MQTT_SN_GATEWAY_PORT 10000
+#endif
+
+// QoS of the aggregated messages. At QoS 1 a message stays in its slot until the broker acknowledges it,
+// and the messages not acknowledged when the connection drops are sent again after reconnecting
+#ifdef COLLECTOR_CONF_MQTT_QOS
+#define COLLECTOR_MQTT_QOS COLLECTOR_CONF_MQTT_QOS
+#else
+#define COLLECTOR_MQTT_QOS 0
+#endif
+
+// Aggregated messages encoded ahead of the client: the next one is encoded while the previous ones are sent
+#ifdef COLLECTOR_CONF_PUBLISH_SLOTS
+#define COLLECTOR_PUBLISH_SLOTS COLLECTOR_CONF_PUBLISH_SLOTS
+#else
+#define COLLECTOR_PUBLISH_SLOTS 3
+#endif
+
+// Messages sent and waiting for their PUBACK, the default of the publish_window parameter
+#ifdef COLLECTOR_CONF_PUBLISH_WINDOW
+#define COLLECTOR_PUBLISH_WINDOW COLLECTOR_CONF_PUBLISH_WINDOW
+#else
+#define COLLECTOR_PUBLISH_WINDOW 2
+#endif
+
+// A PUBACK missing for this long means a stalled connection: it is dropped, and the message is sent again
+// on the next one, as MQTT 3.1.1 only retransmits on a new connection. Over MQTT-SN the message is simply
+// sent again with the DUP flag, there is no stream to unblock. The default of the puback_ms parameter
+#ifdef COLLECTOR_CONF_PUBACK_TIMEOUT
+#define COLLECTOR_PUBACK_TIMEOUT COLLECTOR_CONF_PUBACK_TIMEOUT
+#elif COLLECTOR_MQTT_SN
+#define COLLECTOR_PUBACK_TIMEOUT (CLOCK_SECOND * 3)
+#else
+#define COLLECTOR_PUBACK_TIMEOUT (CLOCK_SECOND * 10)
+#endif
+
+// The client takes one message at a time and does not tell when it is done with a QoS 0 one: the queue is
+// retried at this interval while messages are pending
+#define COLLECTOR_PUBLISH_RETRY (CLOCK_SECOND / 32)
+
+// Sensors of the bin, described by the configuration
+#ifdef COLLECTOR_CONF_MAX_SENSORS
+#define COLLECTOR_MAX_SENSORS COLLECTOR_CONF_MAX_SENSORS
+#else
+#define COLLECTOR_MAX_SENSORS 6
+#endif
+
+// Distinct sensor nodes polled, each tracked by the endpoint registry
+#define MAX_SENSOR_NODES ENDPOINT_REGISTRY_SIZE
+
+// Sizes of the text kept in RAM. The largest message is the aggregated one, derived from the limits of the
+// sensor table so that any configuration it accepts fits: a bin ID of BIN_ID_MAX_LEN characters,
+// COLLECTOR_MAX_SENSORS sensors with a field of SENSOR_NAME_MAX_LEN characters and a reading of
+// SENSOR_TEXT_MAX_LEN (a label or a number is shorter), the health of MAX_SENSOR_NODES nodes and the counters
+// at their largest. About 670 bytes by default. Only a text reading with characters to escape can make it
+// longer, that message is dropped
+#define BIN_ID_MAX_LEN 31
+#define PUBLISH_TS_WIDTH 13 // digits of the ms since the epoch, until 2286
+#define SENSOR_MEMBER_MAX_LEN (sizeof(",\"\":\"\"") - 1 + SENSOR_NAME_MAX_LEN + SENSOR_TEXT_MAX_LEN)
+#define NODE_HEALTH_MAX_LEN (sizeof(",\"\":{\"up\":false,\"rtt\":65535,\"fail\":255}") - 1 + SENSOR_NAME_MAX_LEN)
+#define PUB_MSG_SIZE (sizeof("{\"bin_id\":\"\",\"nodes\":{},\"overruns\":4294967295,\"lag_ms\":4294967295," \
+                             "\"seq\":4294967295,\"sample_ts\":,\"ts\":}") + BIN_ID_MAX_LEN + 2 * PUBLISH_TS_WIDTH + \
+                      COLLECTOR_MAX_SENSORS * SENSOR_MEMBER_MAX_LEN + MAX_SENSOR_NODES * NODE_HEALTH_MAX_LEN)
+
+// Interval of the clock synchronization once configured: a configuration request of which only the clock
+// fields of the response are used, to follow the drift of the local clock
+#ifdef COLLECTOR_CONF_CLOCK_SYNC_INTERVAL
+#define COLLECTOR_CLOCK_SYNC_INTERVAL COLLECTOR_CONF_CLOCK_SYNC_INTERVAL
+#else
+#define COLLECTOR_CLOCK_SYNC_INTERVAL (CLOCK_SECOND * 600)
+#endif
+
+// Largest configuration response, kept as received until the process applies it. A bin with
+// COLLECTOR_MAX_SENSORS sensors of the longest names and fields, with their addresses, takes about 900 bytes
+#ifdef COLLECTOR_CONF_CONFIG_SIZE
+#define COLLECTOR_CONFIG_SIZE COLLECTOR_CONF_CONFIG_SIZE
+#else
+#define COLLECTOR_CONFIG_SIZE 1024
+#endif
+#define RD_QUERY_SIZE (sizeof("rt=&d=") + SENSOR_NAME_MAX_LEN + BIN_ID_MAX_LEN)
+
+static char config_msg[sizeof("{\"collector_address\":\"\",\"request_ts\":}") + UIPLIB_IPV6_MAX_STR_LEN + 20];
+static char params_msg[sizeof("{\"bin_id\":\"\",\"params\":}") + BIN_ID_MAX_LEN + PARAM_STORE_TEXT_SIZE];
+static char client_id[sizeof("coap_to_mqtt_") + 4];
+#if COLLECTOR_MQTT_SN
+static uint8_t mqtt_sn_packet[PUB_MSG_SIZE + 9]; // PUBLISH header with a 3-byte length
+#else
 static struct mqtt_connection conn;
+#endif
 
-// CoAP endpoints for all sensors that the collector will interact with
-static coap_endpoint_t lid_sensor_endpoint;
-static coap_endpoint_t compactor_sensor_endpoint;
-static coap_endpoint_t scale_sensor_endpoint;
-static coap_endpoint_t waste_level_sensor_endpoint;
-
-static char compactor_sensor_uri[64] = {0};
-static char lid_sensor_uri[64] = {0};
-static char waste_level_sensor_uri[64] = {0};
-static char scale_sensor_uri[64] = {0};
+// Aggregated messages waiting to be published or acknowledged
+static char publish_buffers[COLLECTOR_PUBLISH_SLOTS][PUB_MSG_SIZE];
+static publish_slot_t publish_slots[COLLECTOR_PUBLISH_SLOTS];
+static publish_queue_t publish_queue;
+static publish_slot_t *publishing; // QoS 0 message handed to the client, until it takes the next one
+static struct etimer publish_timer;
+static process_event_t publish_event; // posted by the MQTT events that let the queue move on
 
 static coap_message_t request[1];
 
 // Variables to store the bin ID and local IPv6 address
-static char bin_id[64] = "unknown";
-static char local_ipv6_address[64];
+static char bin_id[BIN_ID_MAX_LEN + 1] = "unknown";
+static char local_ipv6_address[UIPLIB_IPV6_MAX_STR_LEN];
 
 // State machine
 static uint8_t state;
@@ -53,211 +173,677 @@ static uint8_t state;
 #define STATE_CONNECTING 4
 #define STATE_CONNECTED 5
 #define STATE_DISCONNECTED 6
+#define STATE_DISCOVERY 7
 
-// Timer for the main process loop
+// Timer for the main process loop, on the absolute deadlines of the scheduler
 static struct etimer periodic_timer;
+static sample_scheduler_t scheduler;
+static bool scheduled_cycle;
 static struct etimer advertise_timer;
 
-// Structs to save sensor data
-typedef struct {
-    char value[64];
-} sensor_data_t;
-
+// Parameters tuned at run time, through the params resource or the topic of the bin
+static int32_t poll_interval_ms = COLLECTOR_POLL_INTERVAL_MS;
+static int32_t puback_timeout_ms = (int32_t)((uint32_t)COLLECTOR_PUBACK_TIMEOUT * 1000 / CLOCK_SECOND);
+static int32_t publish_window = COLLECTOR_PUBLISH_WINDOW;
+static int32_t fail_threshold = ENDPOINT_REGISTRY_FAILURE_THRESHOLD;
+static const param_t params[] = {
+    { "poll_ms", &poll_interval_ms, 10, 3600000 },
+    { "puback_ms", &puback_timeout_ms, 100, 120000 },
+    { "publish_window", &publish_window, 1, COLLECTOR_PUBLISH_SLOTS },
+    { "fail_threshold", &fail_threshold, 1, 10 },
+};
+static char params_topic[sizeof(PARAMS_TOPIC "/") + BIN_ID_MAX_LEN];
+static bool params_subscribed; // on the current connection
+static bool params_report_pending;
+
+// Sensors of the bin and their latest readings, in the order of the aggregated message. The poll cycle,
+// the discovery and the message encoder all go through this table
+static sensor_t sensors[COLLECTOR_MAX_SENSORS];
+static sensor_table_t sensor_table;
+
+// Sensors of a configuration without a "sensors" array, the bin the cloud knew before the table: the
+// node addresses come under one key per sensor
+static const char default_sensors[] = "{\"sensors\":["
+    "{\"name\":\"rfid_reader\",\"field\":\"rfid\",\"type\":\"text\",\"poll\":0},"
+    "{\"name\":\"lid_sensor\",\"type\":\"bool\",\"true\":\"open\",\"false\":\"closed\"},"
+    "{\"name\":\"compactor_active\",\"field\":\"compactor_sensor\",\"type\":\"bool\",\"true\":\"on\",\"false\":\"off\"},"
+    "{\"name\":\"scale_sensor\",\"field\":\"scale\",\"type\":\"number\",\"decimals\":2},"
+    "{\"name\":\"waste_level_sensor\",\"type\":\"number\",\"min\":0,\"max\":100}]}";
+
+static const struct {
+    const char *config_key;
+    const char *sensor;
+} default_addresses[] = {
+    {"lid_sensor_address", "lid_sensor"},
+    {"compactor_sensor_address", "compactor_active"},
+    {"scale_sensor_address", "scale_sensor"},
+    {"waste_level_sensor_address", "waste_level_sensor"}
+};
+
+// Sensors without an address are looked up in the resource directory, by their name as resource type
+static uint8_t discovery_index;
+static coap_endpoint_t rd_endpoint;
+static char rd_query[RD_QUERY_SIZE];
+
+// The configuration response is staged by the MQTT callback and applied by the process between two cycles:
+// the callback runs whenever the client reads, also while a cycle or the discovery waits on a CoAP request
+static char staged_config[COLLECTOR_CONFIG_SIZE];
+static uint16_t staged_config_len; // 0 when none is waiting
+
+// Distinct sensor nodes. A node is named after the first sensor it hosts in the health reported with the
+// telemetry
+static endpoint_entry_t *sensor_nodes[MAX_SENSOR_NODES];
+static const char *sensor_node_names[MAX_SENSOR_NODES];
+static uint8_t sensor_node_count;
+
+// Requests of the poll cycle, one per node and resource: the sensors read through the same resource,
+// e.g. the node state, share a single request, made at the fastest poll class among them
 typedef struct {
-    sensor_data_t lid_sensor;
-    sensor_data_t compactor_sensor;
-    sensor_data_t waste_level_sensor;
-    sensor_data_t scale;
-    sensor_data_t rfid;
-} collector_data_t;
-
-static collector_data_t collector_data;
+    uint8_t node; // index in sensor_nodes
+    uint8_t poll;
+    const char *path;
+} poll_target_t;
+
+static poll_target_t poll_targets[COLLECTOR_MAX_SENSORS];
+static uint8_t poll_target_count;
+static uint8_t poll_target_index;
+static bool node_responded;
+static clock_time_t request_start;
+
+// Nodes that are down are probed in the background, one at a time, so that the poll cycle does not
+// wait for their retransmissions
+static coap_callback_request_state_t probe_state;
+static coap_message_t probe_request[1];
+static endpoint_entry_t *probe_node; // NULL once the outcome of the probe no longer matters
+static bool probe_in_flight; // probe_state is in use until the request finishes
+static clock_time_t probe_start;
+
+// Latency tracing: every aggregated message carries a sequence number, the time the poll cycle
+// sampled the sensors and the publish time, in milliseconds on the cloud clock. The publish time is
+// the hand-off to the client, written into the blank space left at the end of the queued message. The
+// offset to the cloud clock is estimated from the server_time of the configuration response, taken as
+// the middle of the request/response exchange. The response echoes the request_ts of the request it
+// answers, so that the answer to a repeated request is paired with its own send time.
+static uint32_t message_seq;
+static uint64_t clock_offset_ms;
+static bool clock_synced;
+static clock_time_t next_clock_sync;
+static uint64_t cycle_start_ms;
 
 
 PROCESS(mqtt_collector_process, "MQTT Collector Process");
 AUTOSTART_PROCESSES(&mqtt_collector_process);
 
-// Helper Function: Check if a token is equal to a string
-static int jsmn_token_equals(const char *json, const jsmntok_t *tok, const char *key)
-{
-  return (tok->type == JSMN_STRING &&
-          (int)strlen(key) == tok->end - tok->start &&
-          strncmp(json + tok->start, key, tok->end - tok->start) == 0);
+// Rebuild the sensor nodes and the requests of the poll cycle after a configuration update, the registry
+// deduplicates the sensors hosted on the same node. The nodes of the previous configuration are released and
+// found again by their endpoint, so that the ones kept keep their health
+static void update_sensor_nodes(void) {
+    for (uint8_t i = 0; i < sensor_node_count; i++) {
+        endpoint_registry_release(sensor_nodes[i]);
+    }
+    // A probe in flight still finishes on probe_state, no other starts before it does. Its node may be gone
+    probe_node = NULL;
+    sensor_node_count = 0;
+    poll_target_count = 0;
+    for (uint8_t i = 0; i < sensor_table.count; i++) {
+        sensor_t *sensor = &sensors[i];
+        uint8_t node = 0;
+        uint8_t target = 0;
+
+        if (sensor->poll == 0 || !sensor->located) {
+            continue;
+        }
+        while (node < sensor_node_count && !coap_endpoint_cmp(&sensor_nodes[node]->endpoint, &sensor->endpoint)) {
+            node++;
+        }
+        if (node == sensor_node_count) {
+            // Every registry entry is held by a node in use
+            if (sensor_node_count == MAX_SENSOR_NODES) {
+                RINGLOG_WARN_STR(sensor->name, strlen(sensor->name), RL_COLLECTOR_NODES_FULL, MAX_SENSOR_NODES);
+                continue;
+            }
+            sensor_node_names[sensor_node_count] = sensor->name;
+            sensor_nodes[sensor_node_count] = endpoint_registry_add(&sensor->endpoint);
+            endpoint_registry_hold(sensor_nodes[sensor_node_count++]);
+        }
+
+        while (target < poll_target_count &&
+               (poll_targets[target].node != node || strcmp(poll_targets[target].path, sensor->path) != 0)) {
+            target++;
+        }
+        if (target == poll_target_count) {
+            poll_targets[poll_target_count].node = node;
+            poll_targets[poll_target_count].poll = sensor->poll;
+            poll_targets[poll_target_count++].path = sensor->path;
+        } else if (sensor->poll < poll_targets[target].poll) {
+            poll_targets[target].poll = sensor->poll;
+        }
+    }
+    RINGLOG_INFO(RL_COLLECTOR_POLLING_NODES, sensor_node_count);
+}
+
+// Milliseconds since boot
+static uint64_t local_time_ms(void) {
+    return (uint64_t)clock_time() * 1000 / CLOCK_SECOND;
+}
+
+// Milliseconds since the epoch on the cloud clock, only meaningful once clock_synced is set
+static uint64_t synced_time_ms(void) {
+    return local_time_ms() + clock_offset_ms;
+}
+
+// Parse an unsigned decimal number, as found in the raw text of a JSON number
+static bool parse_uint64(const char *str, size_t len, uint64_t *value) {
+    if (len == 0) {
+        return false;
+    }
+    *value = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (str[i] < '0' || str[i] > '9') {
+            return false;
+        }
+        *value = *value * 10 + (uint64_t)(str[i] - '0');
+    }
+    return true;
+}
+
+// Sensors polled on a node of their own, whose endpoint is not known yet
+static uint8_t missing_sensors(void) {
+    uint8_t missing = 0;
+
+    for (uint8_t i = 0; i < sensor_table.count; i++) {
+        missing += sensors[i].poll > 0 && !sensors[i].located;
+    }
+    return missing;
+}
+
+// Callback for the resource directory lookups. The answer is in link format, e.g.
+// <coap://[fd00::202:2:2:2]:5683/lid/open>;rt="Boolean lid_sensor";d="bin01"
+// and only the node address of the first link is needed
+static void discovery_callback(coap_message_t *response) {
+    sensor_t *sensor = &sensors[discovery_index];
+    const uint8_t *payload;
+    uint32_t block_num = 0;
+
+    if (response == NULL) {
+        RINGLOG_WARN_STR(sensor->name, strlen(sensor->name), RL_COLLECTOR_LOOKUP_TIMEOUT);
+        return;
+    }
+
+    // The address is always in the first block of a block-wise answer
+    coap_get_header_block2(response, &block_num, NULL, NULL, NULL);
+    if (block_num > 0) {
+        return;
+    }
+
+    size_t len = coap_get_payload(response, &payload);
+    const char *link = memchr(payload, '<', len);
+    const char *host_end = link ? memchr(link, ']', len - (link - (const char *)payload)) : NULL;
+
+    if (host_end == NULL) {
+        RINGLOG_WARN_STR(sensor->name, strlen(sensor->name), RL_COLLECTOR_NOT_FOUND);
+        return;
+    }
+
+    // Include the optional port, up to the start of the path
+    const char *end = host_end + 1;
+    while (end < (const char *)payload + len && *end != '/' && *end != '>') {
+        end++;
+    }
+
+    if (coap_endpoint_parse(link + 1, end - (link + 1), &sensor->endpoint)) {
+        sensor->located = true;
+        RINGLOG_INFO_STR(sensor->name, strlen(sensor->name), RL_COLLECTOR_DISCOVERED);
+    }
+}
+
+static clock_time_t ms_to_ticks(int32_t ms) {
+    return (clock_time_t)((uint64_t)ms * CLOCK_SECOND / 1000);
+}
+
+// Copy the parameters to the modules that use them, the new poll period takes effect from the next deadline
+static void params_applied(void) {
+    scheduler.period = ms_to_ticks(poll_interval_ms);
+    publish_queue.window = (uint8_t)publish_window;
+    publish_queue.ack_timeout = ms_to_ticks(puback_timeout_ms);
+    endpoint_registry_set_failure_threshold((uint8_t)fail_threshold);
+    params_report_pending = true;
+}
+
+// Clock offset from the server_time of a configuration response and the send time of the request it answers
+static void sync_clock(const char *chunk, size_t chunk_len) {
+    const char *value;
+    size_t len;
+    uint64_t server_ms;
+    uint64_t request_ms;
+    uint64_t now_ms = local_time_ms();
+
+    if (json_extract(chunk, chunk_len, "server_time", &value, &len) != 0 || !parse_uint64(value, len, &server_ms) ||
+        json_extract(chunk, chunk_len, "request_ts", &value, &len) != 0 || !parse_uint64(value, len, &request_ms) ||
+        request_ms > now_ms) {
+        return;
+    }
+    clock_offset_ms = server_ms - (request_ms + now_ms) / 2;
+    clock_synced = true;
+    RINGLOG_DBG(RL_COLLECTOR_CLOCK_SYNCED, (int32_t)(now_ms - request_ms));
 }
 
 // Handler for configuration response
 static void configuration_received_handler(const char *topic, uint16_t topic_len, const uint8_t *chunk, uint16_t chunk_len) {
-    printf("Pub Handler: topic='%s' (len=%u), chunk_len=%u\n", topic, topic_len, chunk_len);
+    RINGLOG_DBG_STR(topic, topic_len, RL_COLLECTOR_MQTT_MESSAGE, chunk_len);
+
+    // A parameter update is answered with the report, rejected or not
+    if (strcmp(topic, params_topic) == 0) {
+        param_store_update((const char *)chunk, chunk_len);
+        params_report_pending = true;
+        process_post(&mqtt_collector_process, publish_event, NULL);
+        return;
+    }
 
     // Check if the topic is the configuration response topic
     if (strcmp(topic, CONFIG_RESPONSE_TOPIC) != 0) {
         return;
     }
 
-    // variables to store the received addresses
-    char received_collector_address[64] = {0};
-    char received_bin_id[64] = {0};
-    char lid_sensor_address[64] = {0};
-    char compactor_sensor_address[64] = {0};
-    char scale_sensor_address[64] = {0};
-    char waste_level_sensor_address[64] = {0};
-
-    // Mapping between JSON keys and variables
-    struct {
-        char *key;
-        char *buffer;
-        size_t size;
-    } config_mappings[] = {
-        {"collector_address", received_collector_address, sizeof(received_collector_address)},
-        {"bin_id", received_bin_id, sizeof(received_bin_id)},
-        {"lid_sensor_address", lid_sensor_address, sizeof(lid_sensor_address)},
-        {"compactor_sensor_address", compactor_sensor_address, sizeof(compactor_sensor_address)},
-        {"scale_sensor_address", scale_sensor_address, sizeof(scale_sensor_address)},
-        {"waste_level_sensor_address", waste_level_sensor_address, sizeof(waste_level_sensor_address)}
-    };
-
-    // Parse the JSON response using JSMN
-    jsmn_parser parser;
-    jsmntok_t tokens[32];
-    jsmn_init(&parser);
-    int token_count = jsmn_parse(&parser, (const char *)chunk, chunk_len, tokens, sizeof(tokens) / sizeof(tokens[0]));
-
-    if (token_count < 1 || tokens[0].type != JSMN_OBJECT) {
-        printf("Invalid JSON format\n");
+    const char *value;
+    size_t len;
+
+    // Only the response to this collector is applied
+    if (json_extract((const char *)chunk, chunk_len, "collector_address", &value, &len) != 0 ||
+        len != strlen(local_ipv6_address) || memcmp(value, local_ipv6_address, len) != 0) {
+        RINGLOG_DBG(RL_COLLECTOR_CONFIG_IGNORED);
+        return;
+    }
+
+    sync_clock((const char *)chunk, chunk_len);
+
+    // The request is published again every cycle until it is answered: only the first response is taken, the
+    // later ones answer the repeated requests or the clock synchronization
+    if (state != STATE_CONFIG_REQUEST || staged_config_len > 0) {
+        RINGLOG_DBG(RL_COLLECTOR_CONFIG_REPEATED);
+        return;
+    }
+    if (chunk_len > sizeof(staged_config)) {
+        RINGLOG_WARN(RL_COLLECTOR_CONFIG_TOO_LARGE, chunk_len, COLLECTOR_CONFIG_SIZE);
         return;
     }
+    memcpy(staged_config, chunk, chunk_len);
+    staged_config_len = chunk_len;
+    process_poll(&mqtt_collector_process);
+}
+
+// Apply the staged configuration, from the process. The fields are used in place in the staged text
+static void apply_configuration(void) {
+    const char *chunk = staged_config;
+    size_t chunk_len = staged_config_len;
+    const char *value;
+    size_t len;
+
+    if (json_extract(chunk, chunk_len, "bin_id", &value, &len) == 0) {
+        payload_writer_t writer;
+        payload_writer_init(&writer, bin_id, sizeof(bin_id));
+        payload_write_len(&writer, value, len);
+        if (writer.overflow) {
+            RINGLOG_WARN(RL_COLLECTOR_BIN_ID_TRUNCATED, BIN_ID_MAX_LEN);
+        }
+    }
 
-    for (int i = 1; i < token_count - 1; i++) {
-        for (size_t j = 0; j < sizeof(config_mappings) / sizeof(config_mappings[0]); j++) {
-          // if the token is equal to the key, copy the value to the buffer
-            if (jsmn_token_equals((const char *)chunk, &tokens[i], config_mappings[j].key)) {
-                size_t len = tokens[i + 1].end - tokens[i + 1].start;
-                len = len < config_mappings[j].size ? len : config_mappings[j].size - 1;
-                // Copy the value to the buffer
-                strncpy(config_mappings[j].buffer, (const char *)chunk + tokens[i + 1].start, len);
-                config_mappings[j].buffer[len] = '\0';
-                i++; // Skip the value token
-                break;
+    // The sensors listed by the configuration, or the default ones. Addresses left out of the configuration,
+    // or empty, are discovered through the resource directory
+    int listed = sensor_table_load(&sensor_table, chunk, chunk_len);
+    if (listed < 0) {
+        sensor_table_load(&sensor_table, default_sensors, sizeof(default_sensors) - 1);
+        for (size_t i = 0; i < sizeof(default_addresses) / sizeof(default_addresses[0]); i++) {
+            sensor_t *sensor = sensor_table_find(&sensor_table, default_addresses[i].sensor,
+                                                 strlen(default_addresses[i].sensor));
+            if (sensor != NULL && json_extract(chunk, chunk_len, default_addresses[i].config_key,
+                                               &value, &len) == 0 && len > 0) {
+                sensor->located = coap_endpoint_parse(value, len, &sensor->endpoint);
             }
         }
+    } else if (listed > sensor_table.count) {
+        RINGLOG_WARN(RL_COLLECTOR_SENSORS_LEFT_OUT, listed - sensor_table.count, COLLECTOR_MAX_SENSORS);
     }
+    uint8_t missing = missing_sensors();
+    RINGLOG_INFO_STR(bin_id, strlen(bin_id), RL_COLLECTOR_CONFIG_RECEIVED, missing);
 
-    // if the message is for this collector, update the configuration
-    if (strcmp(received_collector_address, local_ipv6_address) == 0) {
-        printf("Received configuration for Bin ID: %s\n", received_bin_id);
-        printf("Lid Sensor Address: %s\n", lid_sensor_address);
-        printf("Compactor Sensor Address: %s\n", compactor_sensor_address);
-        printf("Scale Sensor Address: %s\n", scale_sensor_address);
-        printf("Waste Level Sensor Address: %s\n", waste_level_sensor_address);
+    staged_config_len = 0;
+    if (missing == 0) {
+        update_sensor_nodes();
+        state = STATE_CONFIG_RECEIVED;
+    } else {
+        state = STATE_DISCOVERY;
+    }
+}
 
-        strncpy(bin_id, received_bin_id, sizeof(bin_id));
+// Broker connection, over the transport selected at build time. The MQTT-SN topics are pre-defined IDs,
+// the gateway maps them back to the names, except the one of the bin parameters: it is subscribed by name and
+// its ID comes with the SUBACK
+#if COLLECTOR_MQTT_SN
+static const struct {
+    const char *name;
+    uint16_t id;
+} topic_ids[] = {
+    { UPDATES_TOPIC, 1 },
+    { CONFIG_REQUEST_TOPIC, 2 },
+    { CONFIG_RESPONSE_TOPIC, 3 },
+    { PARAMS_TOPIC, 4 },
+};
+
+static const char *named_topic;
+static uint16_t named_topic_mid; // of its SUBSCRIBE
+static uint16_t named_topic_id;
+
+static uint16_t topic_id(const char *name) {
+    for (size_t i = 0; i < sizeof(topic_ids) / sizeof(topic_ids[0]); i++) {
+        if (strcmp(topic_ids[i].name, name) == 0) {
+            return topic_ids[i].id;
+        }
+    }
+    return 0;
+}
 
-        coap_endpoint_parse(lid_sensor_address, strlen(lid_sensor_address), &lid_sensor_endpoint);
-        coap_endpoint_parse(compactor_sensor_address, strlen(compactor_sensor_address), &compactor_sensor_endpoint);
-        coap_endpoint_parse(scale_sensor_address, strlen(scale_sensor_address), &scale_sensor_endpoint);
-        coap_endpoint_parse(waste_level_sensor_address, strlen(waste_level_sensor_address), &waste_level_sensor_endpoint);
+static const char *topic_name(uint16_t id) {
+    if (named_topic != NULL && named_topic_id != 0 && id == named_topic_id) {
+        return named_topic;
+    }
+    for (size_t i = 0; i < sizeof(topic_ids) / sizeof(topic_ids[0]); i++) {
+        if (topic_ids[i].id == id) {
+            return topic_ids[i].name;
+        }
+    }
+    return NULL;
+}
+#endif
+
+static void broker_connect(void) {
+#if COLLECTOR_MQTT_SN
+    uip_ipaddr_t gateway;
+    uiplib_ipaddrconv(MQTT_CLIENT_BROKER_IP_ADDR, &gateway);
+    mqtt_sn_connect(&gateway, COLLECTOR_MQTT_SN_GATEWAY_PORT, 30);
+#else
+    mqtt_connect(&conn, MQTT_CLIENT_BROKER_IP_ADDR, DEFAULT_BROKER_PORT, (30 * CLOCK_SECOND), MQTT_CLEAN_SESSION_ON);
+#endif
+}
 
-        strncpy(compactor_sensor_uri, compactor_sensor_address, sizeof(compactor_sensor_uri));
-        strncpy(lid_sensor_uri, lid_sensor_address, sizeof(lid_sensor_uri));
-        strncpy(scale_sensor_uri, scale_sensor_address, sizeof(scale_sensor_uri));
-        strncpy(waste_level_sensor_uri, waste_level_sensor_address, sizeof(waste_level_sensor_uri));
+// Ready to take a message
+static bool broker_ready(void) {
+#if COLLECTOR_MQTT_SN
+    return mqtt_sn_connected();
+#else
+    return mqtt_ready(&conn);
+#endif
+}
 
-        state = STATE_CONFIG_RECEIVED;
-    } else {
-        printf("Response is not for this collector. Ignored.\n");
+static bool broker_connected(void) {
+#if COLLECTOR_MQTT_SN
+    return mqtt_sn_connected();
+#else
+    return mqtt_connected(&conn);
+#endif
+}
+
+// 0 when the message is handed to the client, else the client status (an mqtt_status_t over TCP). A
+// retransmission (dup) keeps its MQTT-SN message ID in *mid; the MQTT client numbers every message anew, its
+// retransmissions go on a new connection
+static int broker_publish(const char *topic, const char *payload, uint16_t length, uint8_t qos, bool dup,
+                          uint16_t *mid) {
+#if COLLECTOR_MQTT_SN
+    return mqtt_sn_publish(topic_id(topic), (const uint8_t *)payload, length, qos, dup, mid) ? 0 : 1;
+#else
+    return mqtt_publish(&conn, mid, (char *)topic, (uint8_t *)payload, length, (mqtt_qos_level_t)qos,
+                        MQTT_RETAIN_OFF);
+#endif
+}
+
+static bool broker_subscribe(const char *topic) {
+#if COLLECTOR_MQTT_SN
+    uint16_t id = topic_id(topic);
+
+    if (id != 0) {
+        return mqtt_sn_subscribe(id, 0, NULL);
+    }
+    named_topic = topic;
+    named_topic_id = 0;
+    return mqtt_sn_subscribe_topic(topic, 0, &named_topic_mid);
+#else
+    return mqtt_subscribe(&conn, NULL, (char *)topic, MQTT_QOS_LEVEL_0) == MQTT_STATUS_OK;
+#endif
+}
+
+// Events of both transports
+static void broker_up(void) {
+    RINGLOG_INFO(RL_COLLECTOR_MQTT_CONNECTED);
+    state = STATE_CONNECTED;
+}
+
+static void broker_down(int32_t reason) {
+    RINGLOG_WARN(RL_COLLECTOR_MQTT_DISCONNECTED, reason);
+    state = STATE_DISCONNECTED;
+    params_subscribed = false;
+#if COLLECTOR_MQTT_QOS > 0
+    uint8_t requeued = publish_queue_requeue(&publish_queue);
+    if (requeued > 0) {
+        RINGLOG_INFO(RL_COLLECTOR_PUBLISH_REQUEUED, requeued);
+    }
+#endif
+    process_poll(&mqtt_collector_process);
+}
+
+static void broker_puback(uint16_t mid) {
+    publish_slot_t *slot = publish_queue_find(&publish_queue, mid);
+
+    RINGLOG_DBG(RL_COLLECTOR_MQTT_PUBACK);
+    if (slot != NULL) {
+        publish_queue_ack(&publish_queue, slot);
     }
+    // The timers of the collector only run in its own process
+    process_post(&mqtt_collector_process, publish_event, NULL);
 }
 
+#if COLLECTOR_MQTT_SN
+// Handler for MQTT-SN events
+static void mqtt_sn_event(mqtt_sn_event_t event, const void *data)
+{
+  switch(event) {
+    case MQTT_SN_EVENT_CONNECTED:
+      broker_up();
+      break;
+
+    case MQTT_SN_EVENT_DISCONNECTED:
+      broker_down(*((const uint8_t *)data));
+      break;
+
+    case MQTT_SN_EVENT_PUBLISH:
+      {
+        const mqtt_sn_message_t *msg = data;
+        const char *topic = topic_name(msg->topic_id);
+        if (topic != NULL) {
+          configuration_received_handler(topic, strlen(topic), msg->payload, msg->length);
+        }
+      }
+      break;
+
+    case MQTT_SN_EVENT_SUBACK:
+      {
+        const mqtt_sn_suback_t *suback = data;
+        if (suback->msg_id == named_topic_mid) {
+          named_topic_id = suback->topic_id;
+        }
+        RINGLOG_DBG(RL_COLLECTOR_MQTT_SUBACK);
+      }
+      break;
+
+    case MQTT_SN_EVENT_PUBACK:
+      broker_puback(*((const uint16_t *)data));
+      break;
+  }
+}
+#else
 // Handler for MQTT events
 static void mqtt_event(struct mqtt_connection *m, mqtt_event_t event, void *data)
 {
   switch(event) {
     case MQTT_EVENT_CONNECTED:
-      printf("Application has a MQTT connection\n");
-      state = STATE_CONNECTED;
+      broker_up();
       break;
 
     case MQTT_EVENT_DISCONNECTED:
-      printf("MQTT Disconnect. Reason %u\n", *((mqtt_event_t *)data));
-      state = STATE_DISCONNECTED;
-      process_poll(&mqtt_collector_process);
+      broker_down(*((mqtt_event_t *)data));
       break;
 
     case MQTT_EVENT_PUBLISH:
       {
-      	printf("Received MQTT message\n");
         struct mqtt_message *msg = data;
         configuration_received_handler(msg->topic, strlen(msg->topic), msg->payload_chunk, msg->payload_length);
       }
       break;
 
     case MQTT_EVENT_SUBACK:
-      printf("Subscribed to topic successfully\n");
+      RINGLOG_DBG(RL_COLLECTOR_MQTT_SUBACK);
       break;
 
     case MQTT_EVENT_UNSUBACK:
-      printf("Unsubscribed from topic successfully\n");
+      RINGLOG_DBG(RL_COLLECTOR_MQTT_UNSUBACK);
       break;
 
     case MQTT_EVENT_PUBACK:
-      printf("Publishing complete.\n");
+      if (data != NULL) {
+        broker_puback(*((uint16_t *)data));
+      }
       break;
 
     default:
-      printf("Unhandled MQTT event: %i\n", event);
+      RINGLOG_DBG(RL_COLLECTOR_MQTT_UNHANDLED, event);
       break;
   }
 }
+#endif
 
-// Helper function to parse the JSON payload for sensor data received from CoAP
-static void parse_sensor_read_payload(const uint8_t *payload, const char *sensor_name, sensor_data_t *sensor_data) {
-    jsmn_parser parser;
-    jsmntok_t tokens[16];
-    jsmn_init(&parser);
-    int token_count = jsmn_parse(&parser, (const char *)payload, strlen((char *)payload), tokens, 16);
-
-    if (token_count > 0 && tokens[0].type == JSMN_OBJECT) {
-        for (int i = 1; i < token_count; i++) {
-            if (jsmn_token_equals((char *)payload, &tokens[i], "value")) {
-                snprintf(sensor_data->value, sizeof(sensor_data->value), "%.*s",
-                         tokens[i + 1].end - tokens[i + 1].start,
-                         (char *)payload + tokens[i + 1].start);
-                printf("%s updated to: %s\n", sensor_name, sensor_data->value);
-                break;
-            }
-        }
-    } else {
-        printf("Failed to parse JSON payload for %s.\n", sensor_name);
+// Store a sensor value reported by a node, identified by its sensor name. Values that do not parse leave the
+// previous reading
+static void update_sensor_value(const char *name, size_t name_len, const char *value, size_t value_len) {
+    sensor_t *sensor = sensor_table_find(&sensor_table, name, name_len);
+
+    if (sensor == NULL) {
+        return;
     }
+    switch (sensor_store(sensor, value, value_len)) {
+    case SENSOR_INVALID:
+        RINGLOG_WARN_STR(value, value_len, RL_COLLECTOR_INVALID_READING, (int32_t)(sensor - sensors));
+        return;
+    case SENSOR_TRUNCATED:
+        RINGLOG_WARN_STR(sensor->name, strlen(sensor->name), RL_COLLECTOR_READING_TRUNCATED, SENSOR_TEXT_MAX_LEN);
+        break;
+    default:
+        break;
+    }
+    RINGLOG_DBG_STR(value, value_len, RL_COLLECTOR_SENSOR_UPDATED, (int32_t)(sensor - sensors));
 }
 
-// Callback functions for CoAP client requests
-static void client_callback(coap_message_t *response, sensor_data_t *sensor, const char *sensor_name) {
-    if (response) {
-        parse_sensor_read_payload(response->payload, sensor_name, sensor);
-    } else {
-        printf("CoAP request for %s timed out.\n", sensor_name);
+// Helper function to decode the CBOR node state payload, a map of sensor names to text values
+static void parse_node_state_cbor(const uint8_t *payload, size_t payload_len) {
+    cbor_reader_t reader;
+    size_t pairs;
+    const char *name, *value;
+    size_t name_len, value_len;
+
+    cbor_reader_init(&reader, payload, payload_len);
+    if (!cbor_read_map(&reader, &pairs)) {
+        RINGLOG_WARN(RL_COLLECTOR_STATE_DECODE_FAILED);
+        return;
+    }
+
+    while (pairs-- > 0) {
+        if (!cbor_read_text(&reader, &name, &name_len) || !cbor_read_text(&reader, &value, &value_len)) {
+            RINGLOG_WARN(RL_COLLECTOR_STATE_DECODE_FAILED);
+            return;
+        }
+        update_sensor_value(name, name_len, value, value_len);
     }
 }
 
-static void lid_sensor_callback(coap_message_t *response) {
-    client_callback(response, &collector_data.lid_sensor, "Lid Sensor");
+// Helper function to parse the JSON node state payload {"<name>":"<value>",...}, or the one of a single
+// sensor resource {"<name>":{"value":"<value>"}}, kept for nodes that answer without honoring the Accept option
+static void parse_node_state_json(const uint8_t *payload, size_t payload_len) {
+    const char *value;
+    size_t value_len;
+
+    for (uint8_t i = 0; i < sensor_table.count; i++) {
+        if (json_extract((const char *)payload, payload_len, sensors[i].name, &value, &value_len) != 0) {
+            continue;
+        }
+        if (value_len > 0 && value[0] == '{' && json_extract(value, value_len, "value", &value, &value_len) != 0) {
+            continue;
+        }
+        update_sensor_value(sensors[i].name, strlen(sensors[i].name), value, value_len);
+    }
 }
 
-static void compactor_sensor_callback(coap_message_t *response) {
-    client_callback(response, &collector_data.compactor_sensor, "Compactor Sensor");
+// Decode the answer of a node state request
+static void parse_node_state(coap_message_t *response) {
+    const uint8_t *payload;
+    unsigned int content_format = TEXT_PLAIN;
+
+    size_t len = coap_get_payload(response, &payload);
+    coap_get_header_content_format(response, &content_format);
+
+    if (content_format == APPLICATION_CBOR) {
+        parse_node_state_cbor(payload, len);
+    } else {
+        parse_node_state_json(payload, len);
+    }
 }
 
-static void scale_sensor_callback(coap_message_t *response) {
-    client_callback(response, &collector_data.scale, "Scale Sensor");
+// Callback function for the node state requests of the poll cycle
+static void node_state_callback(coap_message_t *response) {
+    const char *name = sensor_node_names[poll_targets[poll_target_index].node];
+
+    if (response == NULL) {
+        RINGLOG_WARN_STR(name, strlen(name), RL_COLLECTOR_NODE_TIMEOUT);
+        return;
+    }
+    node_responded = true;
+    parse_node_state(response);
 }
 
-static void waste_level_sensor_callback(coap_message_t *response) {
-    client_callback(response, &collector_data.waste_level_sensor, "Waste Level Sensor");
+// Callback function for the probes of the nodes that are down
+static void probe_callback(coap_callback_request_state_t *callback_state) {
+    switch (callback_state->state.status) {
+    case COAP_REQUEST_STATUS_RESPONSE:
+        if (probe_node != NULL) {
+            endpoint_registry_success(probe_node, clock_time() - probe_start);
+            parse_node_state(callback_state->state.response);
+            probe_node = NULL;
+        }
+        break;
+    case COAP_REQUEST_STATUS_TIMEOUT:
+    case COAP_REQUEST_STATUS_BLOCK_ERROR:
+        if (probe_node != NULL) {
+            endpoint_registry_failure(probe_node);
+            probe_node = NULL;
+        }
+        probe_in_flight = false;
+        break;
+    case COAP_REQUEST_STATUS_FINISHED:
+        probe_node = NULL;
+        probe_in_flight = false;
+        break;
+    default:
+        break;
+    }
 }
 
-static void rfid_callback(coap_message_t *response) {
-    client_callback(response, &collector_data.rfid, "RFID");
+static void probe_sensor_node(endpoint_entry_t *node, const char *path) {
+    probe_node = node;
+    probe_start = clock_time();
+    coap_init_message(probe_request, COAP_TYPE_CON, COAP_GET, 0);
+    coap_set_header_uri_path(probe_request, path);
+    coap_set_header_accept(probe_request, APPLICATION_CBOR);
+    probe_in_flight = coap_send_request(&probe_state, &node->endpoint, probe_request, probe_callback) != 0;
+    if (!probe_in_flight) {
+        probe_node = NULL;
+    }
 }
 
 // Helper function to check if the collector has network connectivity
@@ -265,27 +851,208 @@ static bool have_connectivity(void) {
   return uip_ds6_get_global(ADDR_PREFERRED) != NULL && uip_ds6_defrt_choose() != NULL;
 }
 
-// Publish Aggregated MQTT Message with all sensor data
+// Subscribe to the parameter updates of the bin, once its ID is known
+static void subscribe_params(void) {
+    payload_writer_t writer;
+
+    payload_writer_init(&writer, params_topic, sizeof(params_topic));
+    payload_write_str(&writer, PARAMS_TOPIC "/");
+    payload_write_str(&writer, bin_id);
+    if (broker_subscribe(params_topic)) {
+        RINGLOG_INFO_STR(params_topic, writer.length, RL_COLLECTOR_SUBSCRIBED);
+        params_subscribed = true;
+        params_report_pending = true;
+    } else {
+        RINGLOG_WARN_STR(params_topic, writer.length, RL_COLLECTOR_SUBSCRIBE_FAILED);
+    }
+}
+
+// Report the parameters in effect, {"bin_id":"<bin>","params":<report of the parameter store>}. Left
+// pending while the client is busy
+static void publish_params_report(void) {
+    payload_writer_t writer;
+
+    payload_writer_init(&writer, params_msg, sizeof(params_msg));
+    payload_write_char(&writer, '{');
+    payload_write_string_field(&writer, "bin_id", bin_id);
+    payload_write_key(&writer, "params");
+    param_store_write(&writer);
+    payload_write_char(&writer, '}');
+    if (writer.overflow) {
+        RINGLOG_ERR(RL_COLLECTOR_MESSAGE_TOO_LARGE);
+        params_report_pending = false;
+        return;
+    }
+    if (broker_publish(PARAMS_TOPIC, params_msg, writer.length, 0, false, NULL) == 0) {
+        params_report_pending = false;
+    }
+}
+
+// Write the publish time into the blank space left at the end of a message encoded with the clock synchronized
+static void stamp_publish_time(publish_slot_t *slot) {
+    char digits[21];
+    payload_writer_t writer;
+    char *field = slot->buffer + slot->length - 1 - PUBLISH_TS_WIDTH;
+
+    if (slot->length < sizeof("\"ts\":}") + PUBLISH_TS_WIDTH ||
+        memcmp(field - (sizeof("\"ts\":") - 1), "\"ts\":", sizeof("\"ts\":") - 1) != 0) {
+        return;
+    }
+    payload_writer_init(&writer, digits, sizeof(digits));
+    payload_write_uint64(&writer, synced_time_ms());
+    if (writer.length <= PUBLISH_TS_WIDTH) {
+        memset(field, ' ', PUBLISH_TS_WIDTH);
+        memcpy(field + PUBLISH_TS_WIDTH - writer.length, digits, writer.length);
+    }
+}
+
+// Hand the queued aggregated messages to the client, oldest first, as far as it takes them
+static void publish_pending(void) {
+    publish_slot_t *slot;
+    uint16_t mid;
+
+    // The client is ready again once it has written the previous QoS 0 message out
+    if (publishing != NULL && broker_ready()) {
+        publish_queue_ack(&publish_queue, publishing);
+        publishing = NULL;
+    }
+#if COLLECTOR_MQTT_QOS > 0
+    slot = publish_queue_expired(&publish_queue);
+    if (slot != NULL && broker_connected()) {
+#if COLLECTOR_MQTT_SN
+        RINGLOG_WARN(RL_COLLECTOR_PUBACK_RETRY, (int32_t)slot->id);
+        publish_queue_requeue(&publish_queue);
+#else
+        RINGLOG_WARN(RL_COLLECTOR_PUBACK_TIMEOUT, (int32_t)slot->id);
+        mqtt_disconnect(&conn);
+        return;
+#endif
+    }
+#endif
+
+    while (publishing == NULL && broker_ready() && (slot = publish_queue_next(&publish_queue)) != NULL) {
+        mid = slot->mid;
+        // The retransmissions keep the time of the first hand-off
+        if (slot->attempts == 0) {
+            stamp_publish_time(slot);
+        }
+        if (broker_publish(UPDATES_TOPIC, slot->buffer, slot->length, COLLECTOR_MQTT_QOS, slot->attempts > 0,
+                           &mid) != 0) {
+            break;
+        }
+        publish_queue_sent(&publish_queue, slot, mid);
+        if (slot->attempts == 1) {
+            RINGLOG_INFO(RL_COLLECTOR_PUBLISHED, (int32_t)slot->id, (int32_t)slot->length);
+        } else {
+            RINGLOG_INFO(RL_COLLECTOR_PUBLISH_RETRANSMITTED, (int32_t)slot->id, (int32_t)slot->attempts);
+        }
+#if COLLECTOR_MQTT_QOS == 0
+        publishing = slot;
+#endif
+    }
+
+    if (params_report_pending && params_subscribed && publishing == NULL && broker_ready()) {
+        publish_params_report();
+    }
+
+    // Messages waiting for the client are retried shortly, the ones waiting for their PUBACK at the timeout
+    if (publishing != NULL || (publish_queue_next(&publish_queue) != NULL && broker_connected())) {
+        etimer_set(&publish_timer, COLLECTOR_PUBLISH_RETRY);
+    } else if (publish_queue_pending(&publish_queue) > 0) {
+        etimer_set(&publish_timer, publish_queue.ack_timeout);
+    }
+}
+
+// Aggregated message with all sensor data
+static void write_aggregated_message(payload_writer_t *writer, uint32_t lag_ms, uint32_t seq) {
+    payload_write_char(writer, '{');
+    payload_write_string_field(writer, "bin_id", bin_id);
+    sensor_table_write(&sensor_table, writer);
+    // Health of the sensor nodes: {"<first sensor>":{"up":true,"rtt":<smoothed ms>,"fail":<failed requests in a row>}}
+    payload_write_key(writer, "nodes");
+    payload_write_char(writer, '{');
+    for (uint8_t i = 0; i < sensor_node_count; i++) {
+        payload_write_key(writer, sensor_node_names[i]);
+        payload_write_char(writer, '{');
+        payload_write_key(writer, "up");
+        payload_write_str(writer, endpoint_registry_is_up(sensor_nodes[i]) ? "true" : "false");
+        payload_write_int_field(writer, "rtt", sensor_nodes[i]->srtt_ms);
+        payload_write_int_field(writer, "fail", sensor_nodes[i]->failures);
+        payload_write_char(writer, '}');
+    }
+    payload_write_char(writer, '}');
+    // Cycles that ran past the next deadline since boot, largest delay of a cycle start since the last message
+    payload_write_key(writer, "overruns");
+    payload_write_uint64(writer, scheduler.overruns);
+    payload_write_key(writer, "lag_ms");
+    payload_write_uint64(writer, lag_ms);
+    payload_write_key(writer, "seq");
+    payload_write_uint64(writer, seq);
+    // "ts" stays the last member: its digits are written when the message is handed to the client
+    if (clock_synced) {
+        payload_write_key(writer, "sample_ts");
+        payload_write_uint64(writer, cycle_start_ms);
+        payload_write_key(writer, "ts");
+        for (uint8_t i = 0; i < PUBLISH_TS_WIDTH; i++) {
+            payload_write_char(writer, ' ');
+        }
+    }
+    payload_write_char(writer, '}');
+}
+
+// Queue the aggregated message for publishing
 static void send_aggregated_mqtt_message(void) {
-    setlocale(LC_NUMERIC, "C");
+    payload_writer_t writer;
+    uint32_t lag_ms = sample_scheduler_take_max_lag_ms(&scheduler);
+    publish_slot_t *slot = publish_queue_reserve(&publish_queue);
+
+    // Messages dropped here still use a sequence number, so that the cloud sees the gap
+    message_seq++;
+    // Every slot is in use: the message replaces the oldest queued one, once it is known to fit
+    if (slot == NULL) {
+        payload_writer_init(&writer, NULL, publish_queue.size);
+        write_aggregated_message(&writer, lag_ms, message_seq);
+        if (writer.overflow) {
+            RINGLOG_ERR(RL_COLLECTOR_MESSAGE_TOO_LARGE);
+            return;
+        }
+        slot = publish_queue_replace(&publish_queue);
+    }
+    // Every slot is still waiting for the broker: this cycle is lost
+    if (slot == NULL) {
+        RINGLOG_WARN(RL_COLLECTOR_PUBLISH_DROPPED, (int32_t)message_seq);
+        return;
+    }
 
-    snprintf(pub_msg, sizeof(pub_msg),
-         "{\"bin_id\":\"%s\","
-         "\"rfid\":\"%s\","
-         "\"lid_sensor\":\"%s\","
-         "\"compactor_sensor\":\"%s\","
-         "\"scale\":\"%s\","
-         "\"waste_level_sensor\":\"%s\"}",
-         bin_id,
-         collector_data.rfid.value,
-         strcmp(collector_data.lid_sensor.value, "true") == 0 ? "open" : "closed",
-         strcmp(collector_data.compactor_sensor.value, "true") == 0 ? "on" : "off",
-         collector_data.scale.value,
-         collector_data.waste_level_sensor.value);
+    payload_writer_init(&writer, slot->buffer, publish_queue.size);
+    write_aggregated_message(&writer, lag_ms, message_seq);
+    // The slot is left free: a queued message is only replaced by one measured to fit
+    if (writer.overflow) {
+        RINGLOG_ERR(RL_COLLECTOR_MESSAGE_TOO_LARGE);
+        return;
+    }
 
+    publish_queue_commit(&publish_queue, slot, writer.length, message_seq);
+    publish_pending();
+}
 
-    mqtt_publish(&conn, NULL, "bins", (uint8_t *)pub_msg, strlen(pub_msg), MQTT_QOS_LEVEL_0, MQTT_RETAIN_OFF);
-    printf("Published aggregated data to MQTT: %s\n", pub_msg);
+// Publish the configuration request, {"collector_address":"<address>","request_ts":<ms since boot>}
+static void request_configuration(void) {
+    payload_writer_t writer;
+    int status;
+
+    next_clock_sync = clock_time() + COLLECTOR_CLOCK_SYNC_INTERVAL;
+    payload_writer_init(&writer, config_msg, sizeof(config_msg));
+    payload_write_char(&writer, '{');
+    payload_write_string_field(&writer, "collector_address", local_ipv6_address);
+    payload_write_key(&writer, "request_ts");
+    payload_write_uint64(&writer, local_time_ms());
+    payload_write_char(&writer, '}');
+
+    status = broker_publish(CONFIG_REQUEST_TOPIC, config_msg, writer.length, 0, false, NULL);
+    if (status != 0) {
+        RINGLOG_WARN(RL_COLLECTOR_CONFIG_REQUEST_FAILED, status);
+    }
 }
 
 // Helper Function to get the local IPv6 address
@@ -302,7 +1069,9 @@ static void get_local_ipv6_address(char *buffer, size_t buffer_size) {
     }
 
     // If no link-local address is found, set to "unknown"
-    snprintf(buffer, buffer_size, "unknown");
+    payload_writer_t writer;
+    payload_writer_init(&writer, buffer, buffer_size);
+    payload_write_str(&writer, "unknown");
 }
 
 // Main process
@@ -310,12 +1079,30 @@ PROCESS_THREAD(mqtt_collector_process, ev, data)
 {
   PROCESS_BEGIN();
 
+  ringlog_start();
+  param_store_init(params, sizeof(params) / sizeof(params[0]), params_applied);
+
   // Inizialize the MQTT connection
-  snprintf(client_id, sizeof(client_id), "coap_to_mqtt_%02x%02x",
-           linkaddr_node_addr.u8[6], linkaddr_node_addr.u8[7]);
+  static payload_writer_t writer;
+  payload_writer_init(&writer, client_id, sizeof(client_id));
+  payload_write_str(&writer, "coap_to_mqtt_");
+  payload_write_hex8(&writer, linkaddr_node_addr.u8[6]);
+  payload_write_hex8(&writer, linkaddr_node_addr.u8[7]);
+#if COLLECTOR_MQTT_SN
+  mqtt_sn_init(mqtt_sn_packet, sizeof(mqtt_sn_packet), client_id, mqtt_sn_event);
+#else
   mqtt_register(&conn, &mqtt_collector_process, client_id, mqtt_event, 128);
+#endif
+  publish_queue_init(&publish_queue, publish_slots, &publish_buffers[0][0], COLLECTOR_PUBLISH_SLOTS, PUB_MSG_SIZE,
+                     (uint8_t)publish_window, ms_to_ticks(puback_timeout_ms));
+  publish_event = process_alloc_event();
+  sensor_table_init(&sensor_table, sensors, COLLECTOR_MAX_SENSORS);
   state = STATE_INIT;
-  etimer_set(&periodic_timer, CLOCK_SECOND);
+  sample_scheduler_init(&scheduler, &periodic_timer, ms_to_ticks(poll_interval_ms),
+                        sample_scheduler_phase(linkaddr_node_addr.u8, LINKADDR_SIZE, ms_to_ticks(poll_interval_ms)));
+  endpoint_registry_set_failure_threshold((uint8_t)fail_threshold);
+
+  coap_endpoint_parse(RD_CLIENT_SERVER_EP, strlen(RD_CLIENT_SERVER_EP), &rd_endpoint);
 
   // Get the local IPv6 address, it will be used to request the configuration for this device
   get_local_ipv6_address(local_ipv6_address, sizeof(local_ipv6_address));
@@ -324,77 +1111,126 @@ PROCESS_THREAD(mqtt_collector_process, ev, data)
   while(1) {
     PROCESS_YIELD();
 
+    // The blocking CoAP requests of a cycle swallow the events meant for the queue: it is also
+    // retried after every cycle
+    if (ev == publish_event || (ev == PROCESS_EVENT_TIMER && data == &publish_timer)) {
+      publish_pending();
+      continue;
+    }
+
     if((ev == PROCESS_EVENT_TIMER && data == &periodic_timer) || ev == PROCESS_EVENT_POLL) {
+      // Poll events run the state machine in between, without touching the schedule
+      scheduled_cycle = ev == PROCESS_EVENT_TIMER;
+      if (scheduled_cycle) {
+        sample_scheduler_begin(&scheduler);
+      }
+
       if (state == STATE_INIT && have_connectivity()) {
         state = STATE_NET_OK;
       }
 
       if (state == STATE_NET_OK) {
-        printf("Connecting to MQTT broker...\n");
-        mqtt_connect(&conn, MQTT_CLIENT_BROKER_IP_ADDR, DEFAULT_BROKER_PORT, (30 * CLOCK_SECOND), MQTT_CLEAN_SESSION_ON);
+        RINGLOG_INFO(RL_COLLECTOR_CONNECTING);
+        broker_connect();
         state = STATE_CONNECTING;
       }
 
       if (state == STATE_CONNECTED) {
-		if (mqtt_subscribe(&conn, NULL, CONFIG_RESPONSE_TOPIC, MQTT_QOS_LEVEL_0) == MQTT_STATUS_OK) {
-    		printf("Subscribed to topic: %s\n", CONFIG_RESPONSE_TOPIC);
+		if (broker_subscribe(CONFIG_RESPONSE_TOPIC)) {
+    		RINGLOG_INFO_STR(CONFIG_RESPONSE_TOPIC, strlen(CONFIG_RESPONSE_TOPIC), RL_COLLECTOR_SUBSCRIBED);
     		state = STATE_CONFIG_REQUEST;
   		} else {
-    		printf("Failed to subscribe to topic: %s\n", CONFIG_RESPONSE_TOPIC);
+    		RINGLOG_WARN_STR(CONFIG_RESPONSE_TOPIC, strlen(CONFIG_RESPONSE_TOPIC), RL_COLLECTOR_SUBSCRIBE_FAILED);
   		}
       }
 
+      if (state == STATE_CONFIG_REQUEST && staged_config_len > 0) {
+        apply_configuration();
+      }
+
       // Request the configuration via MQTT
       if (state == STATE_CONFIG_REQUEST) {
-        printf("Requesting CoAP server configuration...\n");
+        RINGLOG_INFO(RL_COLLECTOR_CONFIG_REQUEST);
+        request_configuration();
+      }
+
+      // Synchronize the clock again, the configuration in the response is left aside
+      if (state == STATE_CONFIG_RECEIVED && !CLOCK_LT(clock_time(), next_clock_sync)) {
+        request_configuration();
+      }
 
-  		// Publish configuration request message
- 		 snprintf(pub_msg, sizeof(pub_msg), "{\"collector_address\":\"%s\"}", local_ipv6_address);
+      // Look up the missing sensors in the resource directory, by resource type within this bin
+      if (state == STATE_DISCOVERY) {
+        for (discovery_index = 0; discovery_index < sensor_table.count; discovery_index++) {
+          if (sensors[discovery_index].poll > 0 && !sensors[discovery_index].located) {
+            payload_writer_init(&writer, rd_query, sizeof(rd_query));
+            payload_write_str(&writer, "rt=");
+            payload_write_str(&writer, sensors[discovery_index].name);
+            payload_write_str(&writer, "&d=");
+            payload_write_str(&writer, bin_id);
+            coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
+            coap_set_header_uri_path(request, "rd-lookup/res");
+            coap_set_header_uri_query(request, rd_query);
+            COAP_BLOCKING_REQUEST(&rd_endpoint, request, discovery_callback);
+          }
+        }
 
- 		 mqtt_status_t status = mqtt_publish(&conn, NULL, CONFIG_REQUEST_TOPIC,
-                                      (uint8_t *)pub_msg, strlen(pub_msg),
-                                      MQTT_QOS_LEVEL_0, MQTT_RETAIN_OFF);
+        if (missing_sensors() == 0) {
+          update_sensor_nodes();
+          state = STATE_CONFIG_RECEIVED;
+        }
+      }
 
-  		if (status == MQTT_STATUS_OK) {
-  		  printf("Published to topic %s: %s\n", CONFIG_REQUEST_TOPIC, pub_msg);
-  		} else {
-   			 printf("Failed to publish. MQTT status: %d\n", status);
-  		}
+      // The client takes one subscription at a time: retried every cycle until it is taken
+      if (state == STATE_CONFIG_RECEIVED && !params_subscribed) {
+        subscribe_params();
       }
 
 	  if (state == STATE_CONFIG_RECEIVED) {
         // Read data from all the sensors
-        printf("Fetching sensor states...\n");
-
-        coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
-        coap_set_header_uri_path(request, "/compactor/active");
-        COAP_BLOCKING_REQUEST(&compactor_sensor_endpoint, request, compactor_sensor_callback);
-
-        coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
-        coap_set_header_uri_path(request, "/lid/open");
-        COAP_BLOCKING_REQUEST(&lid_sensor_endpoint, request, lid_sensor_callback);
-
-        coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
-        coap_set_header_uri_path(request, "/rfid/value");
-        COAP_BLOCKING_REQUEST(&lid_sensor_endpoint, request, rfid_callback);
-
-        coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
-        coap_set_header_uri_path(request, "/scale/value");
-        COAP_BLOCKING_REQUEST(&scale_sensor_endpoint, request, scale_sensor_callback);
-
-        coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
-        coap_set_header_uri_path(request, "/waste/level");
-        COAP_BLOCKING_REQUEST(&waste_level_sensor_endpoint, request, waste_level_sensor_callback);
+        RINGLOG_INFO(RL_COLLECTOR_FETCHING, (int32_t)scheduler.cycles);
+        cycle_start_ms = synced_time_ms();
+
+        // One request per node and resource, e.g. the node state resource reports all the sensors of its
+        // node at once, in the cycles of its poll class. Nodes that are down are left out of the cycle, it
+        // only waits for the retransmissions of the request that finds a node down
+        for (poll_target_index = 0; poll_target_index < poll_target_count; poll_target_index++) {
+          static endpoint_entry_t *node;
+          node = sensor_nodes[poll_targets[poll_target_index].node];
+          if (scheduler.cycles % poll_targets[poll_target_index].poll != 0) {
+            continue;
+          }
+          if (!endpoint_registry_is_up(node)) {
+            if (!probe_in_flight && endpoint_registry_allow(node)) {
+              probe_sensor_node(node, poll_targets[poll_target_index].path);
+            }
+            continue;
+          }
+          node_responded = false;
+          request_start = clock_time();
+          coap_init_message(request, COAP_TYPE_CON, COAP_GET, 0);
+          coap_set_header_uri_path(request, poll_targets[poll_target_index].path);
+          coap_set_header_accept(request, APPLICATION_CBOR);
+          COAP_BLOCKING_REQUEST(&node->endpoint, request, node_state_callback);
+          if (node_responded) {
+            endpoint_registry_success(node, clock_time() - request_start);
+          } else {
+            endpoint_registry_failure(node);
+          }
+        }
 
         send_aggregated_mqtt_message();
       }
 
       if (state == STATE_DISCONNECTED) {
-        printf("Disconnected. Retrying...\n");
+        RINGLOG_INFO(RL_COLLECTOR_RECONNECTING);
         state = STATE_INIT;
       }
 
-      etimer_reset(&periodic_timer);
+      if (scheduled_cycle) {
+        sample_scheduler_end(&scheduler, &periodic_timer);
+      }
+      publish_pending();
     }
   }
 
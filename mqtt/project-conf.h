@@ -3,8 +3,12 @@
 #ifndef PROJECT_CONF_H_
 #define PROJECT_CONF_H_
 /*---------------------------------------------------------------------------*/
-/* Enable TCP */
+/* Enable TCP for the MQTT client, the MQTT-SN build only uses UDP */
+#if COLLECTOR_CONF_MQTT_SN
+#define UIP_CONF_TCP 0
+#else
 #define UIP_CONF_TCP 1
+#endif
 
 //#define LOG_CONF_LEVEL_IPV6                        LOG_LEVEL_DBG
 //#define LOG_CONF_LEVEL_RPL                         LOG_LEVEL_DBG
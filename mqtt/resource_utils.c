@@ -1,6 +1,7 @@
 #include "resource_utils.h"
 #include "coap-engine.h"
 #include "conversion_utils.h"
+#include "payload_writer.h"
 #include <stdio.h>
 #include <string.h>
 #include "time_utils.h"
@@ -14,13 +15,17 @@ void generic_get_handler(coap_message_t *request, coap_message_t *response,
     // Convert the sensor state to a string
     sensor->to_string(state_buffer, sizeof(state_buffer), sensor->state);
 
-    // Format the response payload
-    snprintf((char *)buffer, preferred_size,
-             "{\"%s\":{\"value\":\"%s\"}}",
-             sensor->name, state_buffer);
+    // Format the response payload: {"<name>":{"value":"<value>"}}
+    payload_writer_t writer;
+    payload_writer_init(&writer, (char *)buffer, preferred_size);
+    payload_write_char(&writer, '{');
+    payload_write_key(&writer, sensor->name);
+    payload_write_char(&writer, '{');
+    payload_write_string_field(&writer, "value", state_buffer);
+    payload_write_str(&writer, "}}");
 
     // Set the CoAP response payload
-    coap_set_payload(response, buffer, strlen((char *)buffer));
+    coap_set_payload(response, buffer, writer.length);
 }
 
 // Generic PUT Handler
@@ -1,6 +1,7 @@
 #include "contiki.h"
 #include "coap-engine.h"
 #include "resource_utils.h"
+#include "payload_writer.h"
 #include "dev/leds.h" // Include LEDs header
 #include <stdio.h>
 #include <string.h>
@@ -10,7 +11,9 @@ static int lid_state = 0; // 0: closed, 1: open
 
 // Conversion functions for the lid sensor state
 static void lid_state_to_string(char *buffer, size_t size, void *state) {
-  snprintf(buffer, size, "%s", (*(int *)state) ? "open" : "closed");
+  payload_writer_t writer;
+  payload_writer_init(&writer, buffer, size);
+  payload_write_str(&writer, (*(int *)state) ? "open" : "closed");
 }
 
 static void lid_state_update_state(const char *payload, void *state) {
@@ -2,6 +2,7 @@
 #include "coap-engine.h"
 #include "resource_utils.h"
 #include "conversion_utils.h"
+#include "payload_writer.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -10,7 +11,9 @@ static float scale_value = 32.0; // Initial weight value
 
 // Conversion functions for the scale sensor
 static void scale_value_to_string(char *buffer, size_t size, void *state) {
-  snprintf(buffer, size, "%.2f", *(float *)state); // Format as a decimal number with 2 decimal places
+  payload_writer_t writer;
+  payload_writer_init(&writer, buffer, size);
+  payload_write_fixed(&writer, payload_round_fixed(*(float *)state, 2), 2);
 }
 
 static void scale_value_update_state(const char *payload, void *state) {
@@ -2,6 +2,7 @@
 #include "coap-engine.h"
 #include "resource_utils.h"
 #include "conversion_utils.h"
+#include "payload_writer.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -10,7 +11,9 @@ static float waste_level = 0.0; // Initial waste level (percentage)
 
 // Conversion functions for the waste level sensor
 static void waste_level_to_string(char *buffer, size_t size, void *state) {
-    snprintf(buffer, size, "%.2f", *(float *)state); // Format as a percentage with 2 decimal places
+    payload_writer_t writer;
+    payload_writer_init(&writer, buffer, size);
+    payload_write_fixed(&writer, payload_round_fixed(*(float *)state, 2), 2);
 }
 
 static void waste_level_update_state(const char *payload, void *state) {
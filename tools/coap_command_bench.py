@@ -0,0 +1,195 @@
+import argparse
+import asyncio
+import multiprocessing
+import os
+import random
+import resource
+import statistics
+import sys
+import tempfile
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.dirname(os.path.abspath(__file__))), "external_applications"))
+
+from coapthon.client.helperclient import HelperClient
+
+import coap_control
+from sensor_emulator import CHANGED, NOT_FOUND, PUT, TYPE_ACK, TYPE_CON, CoapMessage, decode_message, encode_message
+
+# Throughput of the CoAP commands of scrap_remote_control.py for many bins. The compactor and lid actuators
+# of every bin are emulated in a child process, each on its own UDP port, answering the PUTs of the firmwares.
+# Two ways of sending are compared, each with the provisioning sweep of every bin, then commands to random bins:
+#   per-request  as before coap_control.py: config.xml parsed and a client created for every PUT, one at a time
+#   pooled       coap_control.py: configuration parsed once, pooled clients, COAP_WORKERS requests at a time
+# The per-request way is slow, it only sends --baseline-commands commands and provisions --baseline-bins bins.
+# Example: python3 coap_command_bench.py --bins 1000 --commands 5000
+
+ACTUATOR_PATHS = {
+    "compactor": ("compactor/command", "compactor/config"),
+    "lid": ("lid/command", "lid/config"),
+}
+COMMANDS = [("/compactor/command", "turn on"), ("/compactor/command", "turn off"),
+            ("/lid/command", "open"), ("/lid/command", "close")]
+
+
+class ActuatorNode(asyncio.DatagramProtocol):
+    """Answers the confirmable PUTs on the resources of an actuator firmware."""
+
+    def __init__(self, paths, latency, served):
+        self.paths = paths
+        self.latency = latency
+        self.served = served
+        self.transport = None
+
+    def connection_made(self, transport):
+        self.transport = transport
+
+    def datagram_received(self, data, address):
+        message = decode_message(data)
+        if message is None or message.type != TYPE_CON:
+            return
+        code = CHANGED if message.code == PUT and message.path() in self.paths else NOT_FOUND
+        response = encode_message(CoapMessage(TYPE_ACK, code, message.mid, message.token))
+        self.served.value += 1
+        if self.latency:
+            asyncio.get_running_loop().call_later(self.latency, self.transport.sendto, response, address)
+        else:
+            self.transport.sendto(response, address)
+
+
+def run_actuators(address, base_port, bins, latency, served, ready):
+    async def serve():
+        loop = asyncio.get_running_loop()
+        port = base_port
+        for _ in range(bins):
+            for paths in ACTUATOR_PATHS.values():
+                await loop.create_datagram_endpoint(lambda paths=paths: ActuatorNode(paths, latency, served),
+                                                    local_addr=(address, port))
+                port += 1
+        ready.set()
+        await asyncio.Event().wait()
+
+    asyncio.run(serve())
+
+
+# config.xml of the emulated bins: the actuators on consecutive ports, sensors at placeholder addresses
+def write_config(path, address, base_port, bins):
+    with open(path, "w") as config:
+        config.write("<bins>\n")
+        for index in range(bins):
+            port = base_port + 2 * index
+            config.write(f"""    <bin id="bench{index + 1:04d}">
+        <compactor_actuator_address>coap://[{address}]:{port}</compactor_actuator_address>
+        <lid_actuator_address>coap://[{address}]:{port + 1}</lid_actuator_address>
+        <compactor_sensor_address>fd00::c:{index + 1:x}</compactor_sensor_address>
+        <lid_sensor_address>fd00::1:{index + 1:x}</lid_sensor_address>
+    </bin>
+""")
+        config.write("</bins>\n")
+
+
+# The sending of scrap_remote_control.py before the configuration cache and the client pool
+def put_per_request(config_path, bin_id, path, payload):
+    bins = coap_control.parse_config_xml(config_path)
+    address = bins[bin_id][coap_control.path_address_key(path)]
+    client = HelperClient(server=coap_control.coap_endpoint(address))
+    try:
+        return client.put(path, payload, timeout=coap_control.COAP_TIMEOUT) is not None
+    finally:
+        client.stop()
+
+
+def timed(send, *args):
+    started = time.perf_counter()
+    delivered = send(*args)
+    return delivered, time.perf_counter() - started
+
+
+def report(name, results, elapsed):
+    latencies = sorted(latency for _, latency in results)
+    delivered = sum(1 for ok, _ in results if ok)
+    print(f"{name:<24}{len(results):>8}{delivered:>10}{len(results) / elapsed:>10.0f}"
+          f"{statistics.median(latencies) * 1000:>9.1f}{latencies[int(0.99 * (len(latencies) - 1))] * 1000:>9.1f}")
+
+
+def run_per_request(config_path, bin_ids, provision_bins, commands):
+    bins = coap_control.parse_config_xml(config_path)
+    started = time.perf_counter()
+    results = []
+    for bin_id in bin_ids[:provision_bins]:
+        results.append(timed(put_per_request, config_path, bin_id, "/compactor/config",
+                             bins[bin_id]["compactor_sensor_address"]))
+        results.append(timed(put_per_request, config_path, bin_id, "/lid/config", bins[bin_id]["lid_sensor_address"]))
+    report("per-request provision", results, time.perf_counter() - started)
+
+    started = time.perf_counter()
+    results = [timed(put_per_request, config_path, bin_id, path, payload) for bin_id, path, payload in commands]
+    report("per-request commands", results, time.perf_counter() - started)
+
+
+def run_pooled(config_path, commands, workers, max_idle):
+    control = coap_control.CoapControl(coap_control.BinConfig(config_path), workers=workers,
+                                       pool=coap_control.CoapClientPool(max_idle=max_idle))
+
+    # Provisioning as send_configuration_over_coap() does it, timed per request
+    started = time.perf_counter()
+    futures = [control.executor.submit(timed, control.put, bin_id, path, payload)
+               for bin_id, bin_data in control.bin_config.current().items()
+               for path, payload in (("/compactor/config", bin_data["compactor_sensor_address"]),
+                                     ("/lid/config", bin_data["lid_sensor_address"]))]
+    results = [future.result() for future in futures]
+    report("pooled provision", results, time.perf_counter() - started)
+    requests = len(results)
+
+    started = time.perf_counter()
+    futures = [control.executor.submit(timed, control.put, bin_id, path, payload) for bin_id, path, payload in commands]
+    results = [future.result() for future in futures]
+    report("pooled commands", results, time.perf_counter() - started)
+    print(f"{control.pool.created} clients created for {requests + len(results)} requests")
+    control.pool.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Throughput of the CoAP commands of scrap_remote_control.py")
+    parser.add_argument("--bins", type=int, default=1000, help="emulated bins, two actuators each")
+    parser.add_argument("--commands", type=int, default=5000, help="commands to random bins")
+    parser.add_argument("--baseline-commands", type=int, default=300, help="commands sent the per-request way")
+    parser.add_argument("--baseline-bins", type=int, default=100, help="bins provisioned the per-request way")
+    parser.add_argument("--workers", type=int, default=coap_control.COAP_WORKERS, help="concurrent requests")
+    parser.add_argument("--max-idle", type=int, default=coap_control.MAX_IDLE_CLIENTS, help="idle clients kept")
+    parser.add_argument("--latency-ms", type=float, default=0.0, help="response delay of the actuators")
+    parser.add_argument("--address", default="::1", help="address of the emulated actuators")
+    parser.add_argument("--base-port", type=int, default=21000, help="UDP port of the first actuator")
+    parser.add_argument("--seed", type=int, default=1, help="seed of the command targets")
+    parser.add_argument("--skip-baseline", action="store_true", help="only run the pooled way")
+    args = parser.parse_args()
+
+    # Two sockets per bin in the emulator, up to a client per actuator here
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    resource.setrlimit(resource.RLIMIT_NOFILE, (hard, hard))
+
+    served = multiprocessing.Value("q", 0, lock=False)
+    ready = multiprocessing.Event()
+    emulator = multiprocessing.Process(target=run_actuators, daemon=True,
+                                       args=(args.address, args.base_port, args.bins, args.latency_ms / 1000,
+                                             served, ready))
+    emulator.start()
+    ready.wait()
+
+    config_path = os.path.join(tempfile.mkdtemp(), "config.xml")
+    write_config(config_path, args.address, args.base_port, args.bins)
+    rng = random.Random(args.seed)
+    bin_ids = list(coap_control.parse_config_xml(config_path))
+    commands = [(rng.choice(bin_ids), *rng.choice(COMMANDS)) for _ in range(args.commands)]
+
+    print(f"{args.bins} bins, {2 * args.bins} actuators, {args.workers} workers")
+    print(f"{'':<24}{'requests':>8}{'delivered':>10}{'req/s':>10}{'p50 ms':>9}{'p99 ms':>9}")
+    if not args.skip_baseline:
+        run_per_request(config_path, bin_ids, args.baseline_bins, commands[:args.baseline_commands])
+    run_pooled(config_path, commands, args.workers, args.max_idle)
+    print(f"{served.value} requests served by the actuators")
+    emulator.terminate()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,389 @@
+import argparse
+import asyncio
+import json
+import os
+import shutil
+import socket
+import statistics
+import subprocess
+import tempfile
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+from sensor_emulator import Emulator, LinkModel
+
+# Benchmark of the collector firmware built for the native target (make -C tools native).
+# The collector runs as a Linux process: the native platform brings up tun0 with the host at fd00::1,
+# which is where the firmware expects the MQTT broker. The sensors of its bin are emulated on this
+# host, and this script answers the configuration request with their addresses, then measures:
+#   - poll-cycle latency: first sensor request of a cycle -> aggregated publish received by the broker
+#   - publishes per second on the "bins" topic
+#   - CPU time of the collector per cycle (user + system, from /proc)
+#   - peak RAM of the collector process (VmHWM) and the static RAM/ROM of the binary
+#   - delivery: aggregated messages received / sequence numbers published, and duplicates
+#   - publish latency: last sensor request of a cycle -> aggregated publish received by the broker
+#   - packets and bytes per publish of the broker transport on tun0, both directions, IPv6 headers included
+# --transport mqtt-sn benches the collector built with MQTT_SN=1 through mqtt_sn_gateway.py, started here.
+# --broker-loss and --broker-delay-ms degrade the broker (or gateway) to collector direction of the transport
+# with netem on tun0 (PUBACKs and TCP acknowledgements), leaving the CoAP traffic of the sensors alone.
+# The native platform needs CAP_NET_ADMIN to create tun0, so run it with sudo.
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+GATEWAY = os.path.join(os.path.dirname(os.path.abspath(__file__)), "mqtt_sn_gateway.py")
+DEFAULT_COLLECTOR = os.path.join(ROOT, "mqtt", "bin-mqtt-collector.native")
+CLOCK_TICKS = os.sysconf("SC_CLK_TCK")
+BENCH_BIN_ID = "bench_bin"
+
+
+class Measurements:
+    """Timestamps collected from the emulated sensors and the broker, on the same monotonic clock."""
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.requests = []
+        self.publishes = []
+        self.seqs = []
+
+    def sensor_request(self, node, path):
+        with self.lock:
+            self.requests.append(time.monotonic())
+
+    def publish(self, seq):
+        with self.lock:
+            self.publishes.append(time.monotonic())
+            if seq is not None:
+                self.seqs.append(seq)
+
+    # Last sensor request of each cycle -> publish, the part of the cycle after the sensors answered
+    def publish_latencies(self):
+        latencies = []
+        previous = 0.0
+        request_index = 0
+        for published in self.publishes:
+            last_request = None
+            while request_index < len(self.requests) and self.requests[request_index] <= published:
+                if self.requests[request_index] > previous:
+                    last_request = self.requests[request_index]
+                request_index += 1
+            if last_request is not None:
+                latencies.append(published - last_request)
+            previous = published
+        return latencies
+
+    # Distinct sequence numbers received, sequence numbers published in their range, duplicates
+    def delivery(self):
+        distinct = set(self.seqs)
+        if not distinct:
+            return 0, 0, 0
+        return len(distinct), max(distinct) - min(distinct) + 1, len(self.seqs) - len(distinct)
+
+    # A cycle starts with the first sensor request after the previous publish
+    def cycle_latencies(self):
+        latencies = []
+        previous = 0.0
+        request_index = 0
+        for published in self.publishes:
+            while request_index < len(self.requests) and self.requests[request_index] <= previous:
+                request_index += 1
+            if request_index < len(self.requests) and self.requests[request_index] <= published:
+                latencies.append(published - self.requests[request_index])
+            previous = published
+        return latencies
+
+
+class TransportCounter(threading.Thread):
+    """Packets and bytes of the broker transport on tun0, captured with a packet socket (needs CAP_NET_RAW).
+    tun0 carries bare IPv6 packets: TCP or UDP segments from or to the transport port are counted."""
+
+    def __init__(self, protocol, port):
+        super().__init__(daemon=True)
+        self.protocol = protocol
+        self.port = port
+        self.packets = 0
+        self.bytes = 0
+        self.publishes = 0  # received while counting
+        self.running = True
+        self.sock = socket.socket(socket.AF_PACKET, socket.SOCK_RAW, socket.htons(0x0003))  # ETH_P_ALL
+        self.sock.bind(("tun0", 0))
+        self.sock.settimeout(0.2)
+
+    def run(self):
+        while self.running:
+            try:
+                packet = self.sock.recv(65535)
+            except socket.timeout:
+                continue
+            if len(packet) < 44 or packet[0] >> 4 != 6 or packet[6] != self.protocol:
+                continue
+            source_port, destination_port = int.from_bytes(packet[40:42], "big"), int.from_bytes(packet[42:44], "big")
+            if self.port in (source_port, destination_port):
+                self.packets += 1
+                self.bytes += 40 + int.from_bytes(packet[4:6], "big")
+
+    def stop(self):
+        self.running = False
+        self.join()
+        self.sock.close()
+
+
+def transport_port(args):
+    return args.gateway_port if args.transport == "mqtt-sn" else args.broker_port
+
+
+# CPU time (seconds) and memory (kB) of a process, from /proc
+def process_usage(pid):
+    with open(f"/proc/{pid}/stat") as stat_file:
+        fields = stat_file.read().rsplit(")", 1)[1].split()
+    cpu = (int(fields[11]) + int(fields[12])) / CLOCK_TICKS
+    memory = {}
+    with open(f"/proc/{pid}/status") as status_file:
+        for line in status_file:
+            key, _, value = line.partition(":")
+            if key in ("VmHWM", "VmRSS"):
+                memory[key] = int(value.split()[0])
+    return cpu, memory
+
+
+# text/data/bss of the firmware binary
+def binary_size(path):
+    output = subprocess.run(["size", path], capture_output=True, text=True, check=True).stdout
+    text, data, bss = output.splitlines()[1].split()[:3]
+    return {"text": int(text), "data": int(data), "bss": int(bss)}
+
+
+# Loss and delay on the MQTT traffic from the broker port to the collector: a prio qdisc with a band more
+# than the default priority map uses, so that only the filtered packets go through netem
+def degrade_broker_link(args):
+    netem = ["netem"]
+    if args.broker_loss:
+        netem += ["loss", f"{args.broker_loss * 100}%"]
+    if args.broker_delay_ms:
+        netem += ["delay", f"{args.broker_delay_ms}ms"]
+    commands = [
+        ["tc", "qdisc", "add", "dev", "tun0", "root", "handle", "1:", "prio", "bands", "4"],
+        ["tc", "qdisc", "add", "dev", "tun0", "parent", "1:4", "handle", "40:"] + netem,
+        ["tc", "filter", "add", "dev", "tun0", "parent", "1:0", "protocol", "ipv6", "u32",
+         "match", "ip6", "sport", str(transport_port(args)), "0xffff", "flowid", "1:4"],
+    ]
+    for command in commands:
+        subprocess.run(command, check=True)
+
+
+def restore_broker_link():
+    subprocess.run(["tc", "qdisc", "del", "dev", "tun0", "root"], stderr=subprocess.DEVNULL)
+
+
+def start_gateway(args):
+    return subprocess.Popen(["python3", GATEWAY, "--port", str(args.gateway_port), "--broker", args.broker,
+                             "--broker-port", str(args.broker_port)],
+                            stdout=subprocess.DEVNULL, stderr=None if args.verbose else subprocess.DEVNULL)
+
+
+def start_broker(port):
+    config = tempfile.NamedTemporaryFile("w", suffix=".conf", delete=False)
+    config.write(f"listener {port} ::\nallow_anonymous true\n")
+    config.close()
+    return subprocess.Popen(["mosquitto", "-c", config.name], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+
+# MQTT side of the bench: answers the configuration request of the collector and timestamps the publishes
+def start_mqtt(args, measurements, configuration):
+    client = mqtt.Client()
+
+    def on_connect(client, userdata, flags, rc):
+        # bins at QoS 1, so that the messages published at QoS 1 are not lost on the way to the bench
+        client.subscribe([("bins", 1), ("config/request", 0)])
+
+    def on_message(client, userdata, msg):
+        if msg.topic == "bins":
+            try:
+                seq = json.loads(msg.payload.decode()).get("seq")
+            except ValueError:
+                seq = None
+            measurements.publish(seq)
+            return
+        request = json.loads(msg.payload.decode())
+        response = {"collector_address": request.get("collector_address"), "bin_id": BENCH_BIN_ID,
+                    "server_time": int(time.time() * 1000), "request_ts": request.get("request_ts")}
+        response.update(configuration)
+        client.publish("config/response", json.dumps(response))
+
+    client.on_connect = on_connect
+    client.on_message = on_message
+    client.connect(args.broker, args.broker_port)
+    client.loop_start()
+    return client
+
+
+def percentile(values, fraction):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+def report(args, measurements, collector_usage, traffic):
+    latencies = measurements.cycle_latencies()
+    publish_latencies = measurements.publish_latencies()
+    publishes = measurements.publishes
+    results = {"firmware": binary_size(args.collector), "transport": args.transport, "publishes": len(publishes)}
+
+    if len(publishes) > 1:
+        results["publishes_per_second"] = (len(publishes) - 1) / (publishes[-1] - publishes[0])
+    delivered, expected, duplicates = measurements.delivery()
+    if expected:
+        results["delivery"] = {"delivered": delivered, "expected": expected, "ratio": delivered / expected,
+                               "duplicates": duplicates}
+    if latencies:
+        results["poll_cycle_ms"] = {
+            "mean": statistics.mean(latencies) * 1000,
+            "p50": percentile(latencies, 0.5) * 1000,
+            "p95": percentile(latencies, 0.95) * 1000,
+            "max": max(latencies) * 1000,
+        }
+    if publish_latencies:
+        results["publish_ms"] = {
+            "mean": statistics.mean(publish_latencies) * 1000,
+            "p50": percentile(publish_latencies, 0.5) * 1000,
+            "p95": percentile(publish_latencies, 0.95) * 1000,
+        }
+    if traffic and traffic.publishes:
+        results["traffic"] = {"packets": traffic.packets, "bytes": traffic.bytes,
+                              "packets_per_publish": traffic.packets / traffic.publishes,
+                              "bytes_per_publish": traffic.bytes / traffic.publishes}
+    if collector_usage and publishes:
+        cpu, memory = collector_usage
+        results["cpu_ms_per_cycle"] = cpu * 1000 / len(publishes)
+        results["peak_ram_kb"] = memory.get("VmHWM")
+
+    if args.json:
+        print(json.dumps(results, indent=2))
+        return
+
+    firmware = results["firmware"]
+    print(f"Firmware: text {firmware['text']} B, data {firmware['data']} B, bss {firmware['bss']} B")
+    print(f"Publishes ({results['transport']}): {results['publishes']}, {results.get('publishes_per_second', 0):.2f}/s")
+    if "delivery" in results:
+        delivery = results["delivery"]
+        print(f"Delivery: {delivery['delivered']}/{delivery['expected']} ({delivery['ratio'] * 100:.2f}%), "
+              f"{delivery['duplicates']} duplicates")
+    if "poll_cycle_ms" in results:
+        cycle = results["poll_cycle_ms"]
+        print(f"Poll cycle: mean {cycle['mean']:.2f} ms, p50 {cycle['p50']:.2f} ms, "
+              f"p95 {cycle['p95']:.2f} ms, max {cycle['max']:.2f} ms")
+    if "publish_ms" in results:
+        publish = results["publish_ms"]
+        print(f"Publish: mean {publish['mean']:.2f} ms, p50 {publish['p50']:.2f} ms, p95 {publish['p95']:.2f} ms")
+    if "traffic" in results:
+        traffic = results["traffic"]
+        print(f"Transport: {traffic['packets_per_publish']:.2f} packets, {traffic['bytes_per_publish']:.1f} B per publish "
+              f"({traffic['packets']} packets, {traffic['bytes']} B)")
+    if "cpu_ms_per_cycle" in results:
+        print(f"CPU per cycle: {results['cpu_ms_per_cycle']:.3f} ms, peak RAM: {results['peak_ram_kb']} kB")
+
+
+async def run(args):
+    measurements = Measurements()
+    emulator = Emulator(1, args.layout, args.sensor_address, args.base_port,
+                        LinkModel(args.latency_ms, args.jitter_ms, args.loss), args.dynamics,
+                        on_request=measurements.sensor_request)
+    await emulator.start()
+    values_task = asyncio.create_task(emulator.run_dynamics(args.update_interval))
+    client = start_mqtt(args, measurements, emulator.bin_configuration(0, args.host_address))
+    gateway = start_gateway(args) if args.transport == "mqtt-sn" else None
+
+    collector = subprocess.Popen([args.collector], stdout=subprocess.DEVNULL if not args.verbose else None)
+    collector_usage = None
+    traffic = None
+    degraded = args.broker_loss > 0 or args.broker_delay_ms > 0
+    try:
+        # Measure only once the collector is configured and publishing
+        deadline = time.monotonic() + args.startup_timeout
+        while not measurements.publishes and time.monotonic() < deadline:
+            await asyncio.sleep(0.1)
+        if not measurements.publishes:
+            print("The collector did not publish anything, check the broker and tun0")
+            return
+        if degraded:
+            degrade_broker_link(args)
+
+        traffic = TransportCounter(socket.IPPROTO_UDP if args.transport == "mqtt-sn" else socket.IPPROTO_TCP,
+                                   transport_port(args))
+        traffic.start()
+        start_cpu, _ = process_usage(collector.pid)
+        with measurements.lock:
+            measurements.publishes.clear()
+            measurements.requests.clear()
+            measurements.seqs.clear()
+        await asyncio.sleep(args.duration)
+        end_cpu, memory = process_usage(collector.pid)
+        collector_usage = (end_cpu - start_cpu, memory)
+        traffic.stop()
+        traffic.publishes = len(measurements.publishes)
+        # Messages still queued in the collector when the link recovers
+        if degraded:
+            restore_broker_link()
+            degraded = False
+            await asyncio.sleep(args.drain)
+    finally:
+        if degraded:
+            restore_broker_link()
+        if traffic and traffic.running:
+            traffic.stop()
+        collector.terminate()
+        collector.wait()
+        if gateway:
+            gateway.terminate()
+            gateway.wait()
+        client.loop_stop()
+        values_task.cancel()
+        emulator.close()
+
+    report(args, measurements, collector_usage, traffic)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark the native collector against emulated sensors")
+    parser.add_argument("--collector", default=DEFAULT_COLLECTOR, help="native collector binary")
+    parser.add_argument("--duration", type=float, default=30.0, help="seconds to measure")
+    parser.add_argument("--startup-timeout", type=float, default=60.0, help="seconds to wait for the first publish")
+    parser.add_argument("--broker", default="localhost", help="MQTT broker address")
+    parser.add_argument("--broker-port", type=int, default=1883)
+    parser.add_argument("--start-broker", action="store_true", help="run a local mosquitto for the bench")
+    parser.add_argument("--transport", choices=["mqtt", "mqtt-sn"], default="mqtt",
+                        help="transport the collector was built with, mqtt-sn for MQTT_SN=1")
+    parser.add_argument("--gateway-port", type=int, default=10000, help="UDP port of the MQTT-SN gateway")
+    parser.add_argument("--sensor-address", default="::", help="address the emulated sensors bind to")
+    parser.add_argument("--host-address", default="fd00::1", help="address of this host as seen by the collector")
+    parser.add_argument("--base-port", type=int, default=5701, help="UDP port of the first emulated node")
+    parser.add_argument("--layout", default="split", help="sensor firmwares of the bin, see sensor_emulator.py")
+    parser.add_argument("--latency-ms", type=float, default=0.0, help="one-way latency of the emulated links")
+    parser.add_argument("--jitter-ms", type=float, default=0.0, help="latency standard deviation")
+    parser.add_argument("--loss", type=float, default=0.0, help="datagram loss probability of the emulated links")
+    parser.add_argument("--broker-loss", type=float, default=0.0,
+                        help="packet loss probability from the broker to the collector")
+    parser.add_argument("--broker-delay-ms", type=float, default=0.0,
+                        help="delay of the packets from the broker to the collector")
+    parser.add_argument("--drain", type=float, default=5.0,
+                        help="seconds to wait for the queued messages once the broker link is restored")
+    parser.add_argument("--dynamics", default="random", help="sensor value model, see sensor_emulator.py")
+    parser.add_argument("--update-interval", type=float, default=0.5, help="seconds between sensor value changes")
+    parser.add_argument("--json", action="store_true", help="print the results as JSON")
+    parser.add_argument("--verbose", action="store_true", help="show the collector output")
+    args = parser.parse_args()
+
+    broker = None
+    if args.start_broker:
+        if shutil.which("mosquitto") is None:
+            parser.error("mosquitto is not installed")
+        broker = start_broker(args.broker_port)
+        time.sleep(0.5)
+    try:
+        asyncio.run(run(args))
+    finally:
+        if broker:
+            broker.terminate()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,250 @@
+import argparse
+import ipaddress
+import json
+import math
+import os
+import xml.etree.ElementTree as ET
+from xml.sax.saxutils import escape
+
+# Generator of the Cooja scale scenario: an RPL border router (mote 1, bridged to the host with
+# tunslip6 through a serial socket) and N bins, each with a collector, four sensor motes and two
+# actuators. Next to the .csc it writes the config.xml answered to the collectors and motes.json,
+# the role and addresses of every mote used by parse_logs.py.
+
+ROOT = os.path.dirname(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+
+# Firmwares of a bin, in mote ID order: (role, project directory, firmware, config.xml key)
+BIN_MOTES = [
+    ("collector", "mqtt", "bin-mqtt-collector", "collector_address"),
+    ("lid_sensor", "coap-sensors", "lid-sensor", "lid_sensor_address"),
+    ("compactor_sensor", "coap-sensors", "compactor-active-sensor", "compactor_sensor_address"),
+    ("scale_sensor", "coap-sensors", "scale", "scale_sensor_address"),
+    ("waste_level_sensor", "coap-sensors", "waste-level-sensor", "waste_level_sensor_address"),
+    ("lid_actuator", "coap-actuators", "lid-actuator", "lid_actuator_address"),
+    ("compactor_actuator", "coap-actuators", "compactor-actuator", "compactor_actuator_address"),
+]
+
+# Interfaces of the Cooja motes, as in the Contiki-NG examples
+MOTE_INTERFACES = [
+    "org.contikios.cooja.interfaces.Position",
+    "org.contikios.cooja.interfaces.Battery",
+    "org.contikios.cooja.contikimote.interfaces.ContikiVib",
+    "org.contikios.cooja.contikimote.interfaces.ContikiMoteID",
+    "org.contikios.cooja.contikimote.interfaces.ContikiRS232",
+    "org.contikios.cooja.contikimote.interfaces.ContikiBeeper",
+    "org.contikios.cooja.interfaces.IPAddress",
+    "org.contikios.cooja.contikimote.interfaces.ContikiRadio",
+    "org.contikios.cooja.contikimote.interfaces.ContikiButton",
+    "org.contikios.cooja.contikimote.interfaces.ContikiPIR",
+    "org.contikios.cooja.contikimote.interfaces.ContikiClock",
+    "org.contikios.cooja.contikimote.interfaces.ContikiLED",
+    "org.contikios.cooja.contikimote.interfaces.ContikiCFS",
+    "org.contikios.cooja.contikimote.interfaces.ContikiEEPROM",
+    "org.contikios.cooja.interfaces.Mote2MoteRelations",
+    "org.contikios.cooja.interfaces.MoteAttributes",
+]
+
+# Log levels of the simulated firmwares: the CSMA tx reports give the MAC retransmissions
+SIMULATION_DEFINES = "LOG_CONF_LEVEL_MAC=LOG_LEVEL_INFO"
+
+SERIAL_SOCKET_PORT = 60001
+
+# Logs every mote output line with the simulated and the wall-clock time, and every radio
+# transmission with its sender, receivers and interfered motes. The simulation runs in real time
+# so that the motes can talk to the broker on the host.
+SCRIPT = """
+TIMEOUT(%(timeout)d, log.testOK());
+sim.setSpeedLimit(1.0);
+
+function wall() {
+  return java.lang.System.currentTimeMillis();
+}
+
+function ids(radios) {
+  var result = [];
+  for (var i = 0; i < radios.length; i++) {
+    result.push(radios[i].getMote().getID());
+  }
+  return result.join(",");
+}
+
+var medium = sim.getRadioMedium();
+var lastConnection = null;
+function radioEvent() {
+  var connection = medium.getLastConnection();
+  if (connection == null || connection == lastConnection) {
+    return;
+  }
+  lastConnection = connection;
+  log.log(sim.getSimulationTime() + "\\t" + wall() + "\\tRADIO\\t" + connection.getSource().getMote().getID() +
+          "\\t" + ids(connection.getDestinations()) + "\\t" + ids(connection.getInterfered()) + "\\n");
+}
+try {
+  medium.getRadioTransmissionTriggers().addTrigger(sim, function(event, radio) { radioEvent(); });
+} catch (e) {
+  medium.addRadioTransmissionObserver(new java.util.Observer(function(observable, argument) { radioEvent(); }));
+}
+
+while (true) {
+  YIELD();
+  log.log(time + "\\t" + wall() + "\\t" + id + "\\t" + msg + "\\n");
+}
+"""
+
+
+# Global and link-local address of a Cooja mote: the link-layer address repeats the 16-bit mote ID
+def mote_addresses(mote_id):
+    interface_id = (((mote_id >> 8) ^ 0x02) << 56 | (mote_id & 0xFF) << 48 |
+                    mote_id << 32 | mote_id << 16 | mote_id)
+    return (str(ipaddress.IPv6Address(0xFD00 << 112 | interface_id)),
+            str(ipaddress.IPv6Address(0xFE80 << 112 | interface_id)))
+
+
+# Bins on a square grid around the border router, the motes of a bin on a small circle
+def layout_motes(bins, bin_spacing, bin_radius):
+    columns = math.ceil(math.sqrt(bins))
+    motes = [{"id": 1, "role": "border_router", "bin": None, "x": 0.0, "y": 0.0}]
+    for bin_index in range(bins):
+        center_x = (bin_index % columns - (columns - 1) / 2) * bin_spacing
+        center_y = (bin_index // columns + 1) * bin_spacing
+        for offset, (role, _, _, _) in enumerate(BIN_MOTES):
+            angle = 2 * math.pi * offset / len(BIN_MOTES)
+            motes.append({
+                "id": 2 + bin_index * len(BIN_MOTES) + offset,
+                "role": role,
+                "bin": f"bin{bin_index + 1:03d}",
+                "x": round(center_x + bin_radius * math.cos(angle), 2),
+                "y": round(center_y + bin_radius * math.sin(angle), 2),
+            })
+    for mote in motes:
+        mote["address"], mote["link_local"] = mote_addresses(mote["id"])
+    return motes
+
+
+def mote_type_xml(description, source, target, contiki, motes):
+    commands = f"$(MAKE) -j$(CPUS) {target}.cooja TARGET=cooja DEFINES={SIMULATION_DEFINES}"
+    if contiki:
+        commands += f" CONTIKI={contiki}"
+    lines = [
+        "    <motetype>",
+        "      org.contikios.cooja.contikimote.ContikiMoteType",
+        f"      <description>{escape(description)}</description>",
+        f"      <source>{escape(source)}</source>",
+        f"      <commands>{escape(commands)}</commands>",
+    ]
+    lines += [f"      <moteinterface>{interface}</moteinterface>" for interface in MOTE_INTERFACES]
+    for mote in motes:
+        lines += [
+            "      <mote>",
+            "        <interface_config>",
+            "          org.contikios.cooja.interfaces.Position",
+            f"          <pos x=\"{mote['x']}\" y=\"{mote['y']}\" />",
+            "        </interface_config>",
+            "        <interface_config>",
+            "          org.contikios.cooja.contikimote.interfaces.ContikiMoteID",
+            f"          <id>{mote['id']}</id>",
+            "        </interface_config>",
+            "      </mote>",
+        ]
+    lines.append("    </motetype>")
+    return "\n".join(lines)
+
+
+def simulation_xml(args, motes):
+    contiki = os.path.abspath(args.contiki) if args.contiki else None
+    border_router_source = os.path.join(contiki or "[CONTIKI_DIR]", "examples", "rpl-border-router", "border-router.c")
+    mote_types = [mote_type_xml("RPL border router", border_router_source, "border-router", contiki,
+                                [motes[0]])]
+    for role, directory, firmware, _ in BIN_MOTES:
+        mote_types.append(mote_type_xml(role, os.path.join(ROOT, directory, f"{firmware}.c"), firmware, contiki,
+                                        [mote for mote in motes if mote["role"] == role]))
+
+    script = SCRIPT % {"timeout": int(args.duration * 1000)}
+    return f"""<?xml version="1.0" encoding="UTF-8"?>
+<simconf version="2023090101">
+  <simulation>
+    <title>Scale scenario, {args.bins} bins</title>
+    <randomseed>{args.seed}</randomseed>
+    <motedelay_us>1000000</motedelay_us>
+    <radiomedium>
+      org.contikios.cooja.radiomediums.UDGM
+      <transmitting_range>{args.tx_range}</transmitting_range>
+      <interference_range>{args.interference_range}</interference_range>
+      <success_ratio_tx>{args.success_ratio_tx}</success_ratio_tx>
+      <success_ratio_rx>{args.success_ratio_rx}</success_ratio_rx>
+    </radiomedium>
+    <events>
+      <logoutput>40000</logoutput>
+    </events>
+{chr(10).join(mote_types)}
+  </simulation>
+  <plugin>
+    org.contikios.cooja.serialsocket.SerialSocketServer
+    <mote_arg>0</mote_arg>
+    <plugin_config>
+      <port>{SERIAL_SOCKET_PORT}</port>
+      <bound>true</bound>
+    </plugin_config>
+  </plugin>
+  <plugin>
+    org.contikios.cooja.plugins.ScriptRunner
+    <plugin_config>
+      <script>{escape(script)}</script>
+      <active>true</active>
+    </plugin_config>
+  </plugin>
+</simconf>
+"""
+
+
+# Configuration of the bins in the format of external_applications/config.xml. The collector is
+# identified by its link-local address, the nodes are reached through their global address.
+def config_xml(motes):
+    root = ET.Element("bins")
+    bins = {}
+    keys = {role: key for role, _, _, key in BIN_MOTES}
+    for mote in motes[1:]:
+        if mote["bin"] not in bins:
+            bins[mote["bin"]] = ET.SubElement(root, "bin", id=mote["bin"])
+        value = mote["link_local"] if mote["role"] == "collector" else f"coap://[{mote['address']}]:5683"
+        ET.SubElement(bins[mote["bin"]], keys[mote["role"]]).text = value
+    ET.indent(root, space="    ")
+    return ET.tostring(root, encoding="unicode") + "\n"
+
+
+def generate(args):
+    os.makedirs(args.out, exist_ok=True)
+    motes = layout_motes(args.bins, args.bin_spacing, args.bin_radius)
+    with open(os.path.join(args.out, "scenario.csc"), "w") as csc_file:
+        csc_file.write(simulation_xml(args, motes))
+    with open(os.path.join(args.out, "config.xml"), "w") as config_file:
+        config_file.write(config_xml(motes))
+    with open(os.path.join(args.out, "motes.json"), "w") as motes_file:
+        json.dump(motes, motes_file, indent=1)
+    return motes
+
+
+def add_arguments(parser):
+    parser.add_argument("--bins", type=int, default=10, help="number of bins")
+    parser.add_argument("--out", default="scenario", help="output directory")
+    parser.add_argument("--contiki", help="Contiki-NG tree, when the projects are not checked out inside it")
+    parser.add_argument("--duration", type=float, default=600.0, help="simulated seconds")
+    parser.add_argument("--seed", type=int, default=123456, help="simulation random seed")
+    parser.add_argument("--bin-spacing", type=float, default=30.0, help="meters between bins")
+    parser.add_argument("--bin-radius", type=float, default=5.0, help="meters between a bin center and its motes")
+    parser.add_argument("--tx-range", type=float, default=50.0, help="UDGM transmission range in meters")
+    parser.add_argument("--interference-range", type=float, default=100.0, help="UDGM interference range")
+    parser.add_argument("--success-ratio-tx", type=float, default=1.0, help="UDGM transmission success ratio")
+    parser.add_argument("--success-ratio-rx", type=float, default=1.0, help="UDGM reception success ratio")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate the Cooja scale scenario")
+    add_arguments(parser)
+    args = parser.parse_args()
+    motes = generate(args)
+    print(f"Generated {len(motes)} motes for {args.bins} bins in {args.out}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,228 @@
+import argparse
+import csv
+import json
+import os
+import re
+import statistics
+import sys
+from collections import defaultdict
+
+sys.path.insert(0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+
+import ringlog_decode
+
+# Metrics of a scale scenario run, from the Cooja test log written by the scenario script
+# (simulated time, wall-clock time, mote ID or RADIO, message) and, when available, the MQTT
+# arrivals recorded on the host by run_scenario.py:
+#   - end-to-end telemetry latency: collector poll cycle start -> message received by the broker
+#   - radio packets sent, received and interfered per mote
+#   - CSMA frames, retransmissions and failures per mote
+#   - publish rate of the collectors
+# The collector events are records of the ring log (tools/ringlog_decode.py), drained to the console after
+# they happen: their time is the time of the line minus their age at the drain. The scenario runs at the
+# speed of the wall clock, the same age is taken off both times.
+
+CSMA_TX = re.compile(r"CSMA.*tx to .* seqno \d+, status (\d+), tx (\d+), coll (\d+)")
+CYCLE_START = "RL_COLLECTOR_FETCHING"
+PUBLISHED = "RL_COLLECTOR_PUBLISHED"
+
+
+class NodeMetrics:
+    def __init__(self):
+        self.radio_tx = 0
+        self.radio_rx = 0
+        self.radio_interfered = 0
+        self.mac_frames = 0
+        self.mac_retransmissions = 0
+        self.mac_failures = 0
+        self.publishes = 0
+
+
+def percentile(values, fraction):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+def summarize(values, scale=1.0):
+    if not values:
+        return None
+    return {
+        "count": len(values),
+        "mean": statistics.mean(values) * scale,
+        "p50": percentile(values, 0.5) * scale,
+        "p95": percentile(values, 0.95) * scale,
+        "max": max(values) * scale,
+    }
+
+
+def parse_log(path, nodes, cycle_starts, publishes):
+    formats = ringlog_decode.load_formats()
+    first_time = last_time = None
+    with open(path, errors="replace") as log_file:
+        for line in log_file:
+            fields = line.rstrip("\n").split("\t")
+            if len(fields) < 4 or not fields[0].isdigit():
+                continue
+            sim_time, wall_time = int(fields[0]), int(fields[1])
+            first_time = sim_time if first_time is None else first_time
+            last_time = sim_time
+
+            if fields[2] == "RADIO":
+                nodes[int(fields[3])].radio_tx += 1
+                for field, attribute in ((4, "radio_rx"), (5, "radio_interfered")):
+                    if len(fields) > field and fields[field]:
+                        for mote_id in fields[field].split(","):
+                            setattr(nodes[int(mote_id)], attribute, getattr(nodes[int(mote_id)], attribute) + 1)
+                continue
+
+            mote_id, message = int(fields[2]), "\t".join(fields[3:])
+            match = CSMA_TX.search(message)
+            if match:
+                status, transmissions, _ = (int(group) for group in match.groups())
+                nodes[mote_id].mac_frames += 1
+                nodes[mote_id].mac_retransmissions += max(0, transmissions - 1)
+                nodes[mote_id].mac_failures += status != 0
+                continue
+
+            decoded = ringlog_decode.decode_line(message, formats)
+            if decoded is None:
+                continue
+            chunk = decoded[1]
+            for record in chunk.records:
+                age_ms = (chunk.drain_ms - record.time_ms) & 0xFFFFFFFF
+                if record.name == CYCLE_START:
+                    cycle_starts[mote_id].append((sim_time - age_ms * 1000, wall_time - age_ms))
+                elif record.name == PUBLISHED:
+                    nodes[mote_id].publishes += 1
+                    publishes.append((mote_id, sim_time - age_ms * 1000))
+    return first_time, last_time
+
+
+# Broker arrivals of the "bins" messages: (wall time in ms, bin ID)
+def parse_arrivals(path):
+    arrivals = []
+    with open(path, newline="") as arrivals_file:
+        for row in csv.DictReader(arrivals_file):
+            if row["topic"] != "bins":
+                continue
+            try:
+                arrivals.append((int(row["wall_ms"]), json.loads(row["payload"]).get("bin_id")))
+            except ValueError:
+                continue
+    return arrivals
+
+
+# Each message received by the broker is matched with the last poll cycle its collector started before
+def end_to_end_latencies(arrivals, cycle_starts, collectors_by_bin):
+    latencies = []
+    for wall_time, bin_id in arrivals:
+        starts = cycle_starts.get(collectors_by_bin.get(bin_id), [])
+        previous = [start_wall for _, start_wall in starts if start_wall <= wall_time]
+        if previous:
+            latencies.append((wall_time - previous[-1]) / 1000)
+    return latencies
+
+
+def analyze(log_path, motes, arrivals_path=None):
+    nodes = defaultdict(NodeMetrics)
+    cycle_starts = defaultdict(list)
+    publishes = []
+    first_time, last_time = parse_log(log_path, nodes, cycle_starts, publishes)
+    duration = (last_time - first_time) / 1e6 if first_time is not None and last_time > first_time else 0
+
+    roles = {mote["id"]: mote for mote in motes}
+    collectors = [mote["id"] for mote in motes if mote["role"] == "collector"]
+    results = {
+        "simulated_seconds": duration,
+        "bins": len(collectors),
+        "publishes": len(publishes),
+        "publishes_per_second": len(publishes) / duration if duration else 0,
+        "publishes_per_collector_per_minute": (len(publishes) / len(collectors) * 60 / duration
+                                               if duration and collectors else 0),
+        "collectors_publishing": len({mote_id for mote_id, _ in publishes}),
+    }
+
+    # Collector cycle time inside the simulation: cycle start -> publish of the same collector
+    cycle_times = []
+    for mote_id, published in publishes:
+        starts = [start for start, _ in cycle_starts[mote_id] if start <= published]
+        if starts:
+            cycle_times.append((published - starts[-1]) / 1e6)
+    results["poll_cycle_ms"] = summarize(cycle_times, 1000)
+
+    if arrivals_path:
+        collectors_by_bin = {roles[mote_id]["bin"]: mote_id for mote_id in collectors}
+        results["end_to_end_ms"] = summarize(
+            end_to_end_latencies(parse_arrivals(arrivals_path), cycle_starts, collectors_by_bin), 1000)
+
+    per_role = defaultdict(lambda: defaultdict(int))
+    for mote_id, metrics in nodes.items():
+        role = roles.get(mote_id, {}).get("role", "unknown")
+        for field, value in vars(metrics).items():
+            per_role[role][field] += value
+        per_role[role]["motes"] = sum(1 for mote in motes if mote["role"] == role)
+    results["per_role"] = {role: dict(values) for role, values in per_role.items()}
+
+    totals = {field: sum(getattr(metrics, field) for metrics in nodes.values()) for field in vars(NodeMetrics())}
+    results["totals"] = totals
+    if totals["mac_frames"]:
+        results["mac_retransmission_ratio"] = totals["mac_retransmissions"] / totals["mac_frames"]
+    return results, nodes
+
+
+def write_nodes_csv(path, nodes, motes):
+    roles = {mote["id"]: mote for mote in motes}
+    fields = list(vars(NodeMetrics()))
+    with open(path, "w", newline="") as nodes_file:
+        writer = csv.writer(nodes_file)
+        writer.writerow(["mote_id", "role", "bin"] + fields)
+        for mote_id in sorted(nodes):
+            mote = roles.get(mote_id, {})
+            writer.writerow([mote_id, mote.get("role"), mote.get("bin")] +
+                            [getattr(nodes[mote_id], field) for field in fields])
+
+
+def print_summary(results):
+    print(f"{results['bins']} bins, {results['simulated_seconds']:.0f} s simulated")
+    print(f"Publishes: {results['publishes']} ({results['publishes_per_second']:.2f}/s, "
+          f"{results['publishes_per_collector_per_minute']:.1f}/min per collector, "
+          f"{results['collectors_publishing']} collectors publishing)")
+    for name in ("poll_cycle_ms", "end_to_end_ms"):
+        summary = results.get(name)
+        if summary:
+            print(f"{name}: mean {summary['mean']:.1f}, p50 {summary['p50']:.1f}, p95 {summary['p95']:.1f}, "
+                  f"max {summary['max']:.1f} (n={summary['count']})")
+    totals = results["totals"]
+    print(f"Radio: {totals['radio_tx']} packets sent, {totals['radio_rx']} received, "
+          f"{totals['radio_interfered']} interfered")
+    print(f"MAC: {totals['mac_frames']} frames, {totals['mac_retransmissions']} retransmissions, "
+          f"{totals['mac_failures']} failures")
+    print(f"{'role':<20}{'motes':>6}{'tx/mote':>10}{'rx/mote':>10}{'retx/mote':>11}")
+    for role, values in sorted(results["per_role"].items()):
+        motes = max(1, values.get("motes", 1))
+        print(f"{role:<20}{motes:>6}{values['radio_tx'] / motes:>10.1f}{values['radio_rx'] / motes:>10.1f}"
+              f"{values['mac_retransmissions'] / motes:>11.1f}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Extract the metrics of a Cooja scale scenario run")
+    parser.add_argument("log", help="Cooja test log (COOJA.testlog)")
+    parser.add_argument("--motes", required=True, help="motes.json written by generate_scenario.py")
+    parser.add_argument("--arrivals", help="MQTT arrivals CSV written by run_scenario.py")
+    parser.add_argument("--json", help="write the results to this JSON file")
+    parser.add_argument("--nodes-csv", help="write the per-mote counters to this CSV file")
+    args = parser.parse_args()
+
+    with open(args.motes) as motes_file:
+        motes = json.load(motes_file)
+    results, nodes = analyze(args.log, motes, args.arrivals)
+    print_summary(results)
+    if args.json:
+        with open(args.json, "w") as json_file:
+            json.dump(results, json_file, indent=2)
+    if args.nodes_csv:
+        write_nodes_csv(args.nodes_csv, nodes, motes)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,154 @@
+import argparse
+import csv
+import json
+import os
+import shutil
+import subprocess
+import sys
+import threading
+import time
+import xml.etree.ElementTree as ET
+
+import paho.mqtt.client as mqtt
+
+import generate_scenario
+import parse_logs
+
+# Headless run of the scale scenario:
+#   1. generate the .csc, config.xml and motes.json for the requested number of bins
+#   2. start a local mosquitto and an MQTT recorder that timestamps every message of the bins and
+#      answers the configuration requests of the collectors from the generated config.xml
+#   3. run Cooja without GUI and bridge the border router to the host with tunslip6 (needs sudo)
+#   4. extract the metrics from the Cooja log and the recorded arrivals
+# Example: sudo python3 run_scenario.py --bins 50 --contiki ~/contiki-ng --out runs/50
+
+TUNSLIP_PREFIX = "fd00::1/64"
+
+
+def load_bins_config(path):
+    bins = {}
+    for bin_element in ET.parse(path).getroot().findall("bin"):
+        bins[bin_element.findtext("collector_address")] = {
+            "bin_id": bin_element.get("id"),
+            **{child.tag: child.text for child in bin_element if child.tag != "collector_address"},
+        }
+    return bins
+
+
+class MqttRecorder:
+    """Records the time of arrival of every message and answers the configuration requests."""
+
+    def __init__(self, broker, port, arrivals_path, bins_config):
+        self.bins_config = bins_config
+        self.lock = threading.Lock()
+        self.arrivals_file = open(arrivals_path, "w", newline="")
+        self.writer = csv.writer(self.arrivals_file)
+        self.writer.writerow(["wall_ms", "topic", "payload"])
+        self.client = mqtt.Client()
+        self.client.on_connect = lambda client, userdata, flags, rc: client.subscribe("#")
+        self.client.on_message = self.on_message
+        self.client.connect(broker, port)
+        self.client.loop_start()
+
+    def on_message(self, client, userdata, msg):
+        payload = msg.payload.decode(errors="replace")
+        with self.lock:
+            self.writer.writerow([int(time.time() * 1000), msg.topic, payload])
+        if msg.topic == "config/request" and self.bins_config is not None:
+            request = json.loads(payload)
+            collector_address = request.get("collector_address")
+            config = self.bins_config.get(collector_address)
+            if config:
+                client.publish("config/response", json.dumps({"collector_address": collector_address, **config,
+                                                              "server_time": int(time.time() * 1000),
+                                                              "request_ts": request.get("request_ts")}))
+
+    def close(self):
+        self.client.loop_stop()
+        self.client.disconnect()
+        with self.lock:
+            self.arrivals_file.close()
+
+
+def start_broker(port, out):
+    config_path = os.path.join(out, "mosquitto.conf")
+    with open(config_path, "w") as config_file:
+        config_file.write(f"listener {port} ::\nallow_anonymous true\n")
+    return subprocess.Popen(["mosquitto", "-c", config_path], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+
+def cooja_command(args, csc_path):
+    if args.cooja_cmd:
+        return args.cooja_cmd.split() + [csc_path]
+    cooja = os.path.join(os.path.abspath(args.contiki), "tools", "cooja")
+    return [os.path.join(cooja, "gradlew"), "--no-watch-fs", "--quiet", "-p", cooja, "run",
+            f"--args=--contiki={os.path.abspath(args.contiki)} --no-gui --logdir={os.path.abspath(args.out)} "
+            f"{csc_path}"]
+
+
+# tunslip6 exits when the serial socket is not open yet, so it is retried until Cooja is up
+def run_tunslip(args, cooja):
+    tunslip = args.tunslip or os.path.join(os.path.abspath(args.contiki), "tools", "serial-io", "tunslip6")
+    while cooja.poll() is None:
+        process = subprocess.Popen(["sudo", tunslip, "-a", "127.0.0.1", "-p",
+                                    str(generate_scenario.SERIAL_SOCKET_PORT), TUNSLIP_PREFIX],
+                                   stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        while process.poll() is None and cooja.poll() is None:
+            time.sleep(1)
+        if process.poll() is None:
+            process.terminate()
+            return
+        time.sleep(2)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Run the Cooja scale scenario headless and extract its metrics")
+    generate_scenario.add_arguments(parser)
+    parser.add_argument("--cooja-cmd", help="command running Cooja headless, the .csc path is appended")
+    parser.add_argument("--tunslip", help="tunslip6 binary, by default the one of the Contiki-NG tree")
+    parser.add_argument("--broker", default="localhost", help="MQTT broker address")
+    parser.add_argument("--broker-port", type=int, default=1883)
+    parser.add_argument("--no-broker", action="store_true", help="use an already running broker")
+    parser.add_argument("--no-config-responder", action="store_true",
+                        help="do not answer configuration requests (scrap_cloud.py is running)")
+    args = parser.parse_args()
+    if not args.contiki and not (args.cooja_cmd and args.tunslip):
+        parser.error("--contiki is required unless --cooja-cmd and --tunslip are given")
+
+    generate_scenario.generate(args)
+    csc_path = os.path.abspath(os.path.join(args.out, "scenario.csc"))
+    arrivals_path = os.path.join(args.out, "mqtt_arrivals.csv")
+
+    broker = None
+    if not args.no_broker:
+        if shutil.which("mosquitto") is None:
+            parser.error("mosquitto is not installed, start a broker and use --no-broker")
+        broker = start_broker(args.broker_port, args.out)
+        time.sleep(0.5)
+
+    bins_config = None if args.no_config_responder else load_bins_config(os.path.join(args.out, "config.xml"))
+    recorder = MqttRecorder(args.broker, args.broker_port, arrivals_path, bins_config)
+    try:
+        cooja = subprocess.Popen(cooja_command(args, csc_path))
+        tunslip = threading.Thread(target=run_tunslip, args=(args, cooja), daemon=True)
+        tunslip.start()
+        cooja.wait()
+    finally:
+        recorder.close()
+        if broker:
+            broker.terminate()
+
+    log_path = os.path.join(args.out, "COOJA.testlog")
+    if not os.path.exists(log_path):
+        sys.exit(f"No Cooja log in {args.out}")
+    with open(os.path.join(args.out, "motes.json")) as motes_file:
+        motes = json.load(motes_file)
+    results, nodes = parse_logs.analyze(log_path, motes, arrivals_path)
+    parse_logs.print_summary(results)
+    with open(os.path.join(args.out, "results.json"), "w") as results_file:
+        json.dump(results, results_file, indent=2)
+    parse_logs.write_nodes_csv(os.path.join(args.out, "nodes.csv"), nodes, motes)
+
+
+if __name__ == "__main__":
+    main()
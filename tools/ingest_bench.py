@@ -0,0 +1,180 @@
+import argparse
+import contextlib
+import io
+import json
+import os
+import random
+import sys
+import tempfile
+import threading
+import time
+from types import SimpleNamespace
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.dirname(os.path.abspath(__file__))), "external_applications"))
+
+import scrap_cloud
+import telemetry_replay
+
+# Offline benchmark of the database path of scrap_cloud.py: the bin messages of a recording (see
+# telemetry_replay.py) or synthetic ones are fed straight into its message handler, without broker,
+# and written to a SQLite stand-in (or to the local MySQL with --mysql) once per batch size.
+# A batch of 1 row commits every write, as the ingest did before the write-behind buffer.
+# With --workers the updates are stored by that many worker processes, as scrap_cloud.py --workers does.
+# --write-recording saves the synthetic messages as a recording, to load a broker with telemetry_replay.py.
+# Example: python3 ingest_bench.py --bins 200 --messages 20000 --batch-rows 1 50 500
+
+
+# Messages of bins polled in turn: the lid opens now and then, the weight and waste level grow while it is open
+def synthetic_messages(bins, count, seed):
+    rng = random.Random(seed)
+    states = [{"bin_id": f"bench{index + 1:04d}", "rfid": "No value", "lid_sensor": "closed",
+               "compactor_sensor": "off", "scale": 10.0, "waste_level_sensor": 5, "seq": 0} for index in range(bins)]
+    for index in range(count):
+        state = states[index % bins]
+        state["seq"] += 1
+        if state["lid_sensor"] == "closed" and rng.random() < 0.05:
+            state["lid_sensor"], state["rfid"] = "open", f"{rng.randrange(1 << 32):08X}"
+        elif state["lid_sensor"] == "open":
+            state["scale"] = round(state["scale"] + rng.uniform(0, 2), 2)
+            state["waste_level_sensor"] = min(100, state["waste_level_sensor"] + rng.randrange(3))
+            if rng.random() < 0.3:
+                state["lid_sensor"] = "closed"
+        yield json.dumps({**state, "scale": f"{state['scale']:.2f}", "waste_level_sensor": str(state["waste_level_sensor"]),
+                          "ts": int(time.time() * 1000)}).encode()
+
+
+def recorded_messages(path):
+    return [payload for _, topic, payload in telemetry_replay.read_recording(path) if topic == scrap_cloud.UPDATES_TOPIC]
+
+
+def run(payloads, args, batch_rows):
+    if args.workers:
+        return run_workers(payloads, args, batch_rows)
+    if args.mysql:
+        scrap_cloud.create_tables(None)
+        scrap_cloud.database = scrap_cloud.Database(pool_size=args.pool_size)
+        database_file = None
+    else:
+        database_file = tempfile.NamedTemporaryFile(suffix=".sqlite", delete=False).name
+        scrap_cloud.database = scrap_cloud.Database(database_file)
+    scrap_cloud.write_buffer = scrap_cloud.WriteBehindBuffer(batch_rows, args.batch_interval)
+    scrap_cloud.bins_state.clear()
+    scrap_cloud.bins_transactions.clear()
+    scrap_cloud.bins_sequence.clear()
+    commits = count_commits()
+    threading.Thread(target=scrap_cloud.write_buffer.run, daemon=True).start()
+
+    started = time.perf_counter()
+    with contextlib.redirect_stdout(io.StringIO()) as output:
+        for payload in payloads:
+            scrap_cloud.on_message(None, None, SimpleNamespace(topic=scrap_cloud.UPDATES_TOPIC, payload=payload))
+            output.seek(0)
+            output.truncate()
+        scrap_cloud.write_buffer.flush(final=True)
+    elapsed = time.perf_counter() - started
+
+    if database_file:
+        scrap_cloud.database.sqlite_connection.close()
+        for suffix in ("", "-wal", "-shm"):
+            if os.path.exists(database_file + suffix):
+                os.unlink(database_file + suffix)
+    return len(payloads) / elapsed, commits[0]
+
+
+# Same run through the worker processes, until the workers report every update processed. The commits
+# happen in the workers and are not counted.
+def run_workers(payloads, args, batch_rows):
+    database_file = None if args.mysql else tempfile.NamedTemporaryFile(suffix=".sqlite", delete=False).name
+    worker_args = SimpleNamespace(sqlite=database_file, pool_size=args.pool_size, batch_rows=batch_rows,
+                                  batch_interval=args.batch_interval, quiet=True)
+    scrap_cloud.verbose = False
+    scrap_cloud.create_tables(database_file)
+    scrap_cloud.ingest_workers = scrap_cloud.IngestWorkers(args.workers, worker_args)
+    time.sleep(1.0)
+
+    started = time.perf_counter()
+    for payload in payloads:
+        scrap_cloud.on_message(None, None, SimpleNamespace(topic=scrap_cloud.UPDATES_TOPIC, payload=payload))
+    while scrap_cloud.current_ingest_stats()["processed"] < len(payloads):
+        time.sleep(0.01)
+    elapsed = time.perf_counter() - started
+
+    scrap_cloud.ingest_workers.stop()
+    scrap_cloud.ingest_workers = None
+    scrap_cloud.verbose = True
+    if database_file:
+        for suffix in ("", "-wal", "-shm"):
+            if os.path.exists(database_file + suffix):
+                os.unlink(database_file + suffix)
+    return len(payloads) / elapsed, None
+
+
+def write_recording(path, payloads):
+    writer = telemetry_replay.RecordingWriter(path)
+    for index, payload in enumerate(payloads):
+        writer.write(index / 1000, scrap_cloud.UPDATES_TOPIC, payload)
+    writer.close()
+    print(f"Wrote {len(payloads)} messages to {path}")
+
+
+# Count the commits of the connections handed out by the database, to show the batching
+def count_commits():
+    commits = [0]
+    connection = scrap_cloud.database.connection
+
+    @contextlib.contextmanager
+    def counting_connection():
+        with connection() as db:
+            yield CountingConnection(db, commits)
+
+    scrap_cloud.database.connection = counting_connection
+    return commits
+
+
+class CountingConnection:
+    def __init__(self, db, commits):
+        self.db = db
+        self.commits = commits
+
+    def commit(self):
+        self.commits[0] += 1
+        self.db.commit()
+
+    def __getattr__(self, name):
+        return getattr(self.db, name)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Offline benchmark of the scrap_cloud.py database writes")
+    parser.add_argument("--recording", help="telemetry recording to replay, synthetic messages otherwise")
+    parser.add_argument("--bins", type=int, default=100, help="synthetic bins")
+    parser.add_argument("--messages", type=int, default=10000, help="synthetic messages")
+    parser.add_argument("--seed", type=int, default=1, help="seed of the synthetic messages")
+    parser.add_argument("--batch-rows", type=int, nargs="+", default=[1, scrap_cloud.WRITE_BATCH_ROWS],
+                        help="batch sizes to compare")
+    parser.add_argument("--batch-interval", type=float, default=scrap_cloud.WRITE_BATCH_INTERVAL,
+                        help="seconds before pending rows are committed")
+    parser.add_argument("--mysql", action="store_true", help="write to the MySQL database of scrap_cloud.py")
+    parser.add_argument("--pool-size", type=int, default=scrap_cloud.DB_POOL_SIZE, help="MySQL connections")
+    parser.add_argument("--workers", type=int, default=0, help="worker processes, 0 to store in the caller")
+    parser.add_argument("--write-recording", help="only write the messages to this recording file")
+    args = parser.parse_args()
+
+    payloads = (recorded_messages(args.recording) if args.recording
+                else list(synthetic_messages(args.bins, args.messages, args.seed)))
+    if args.write_recording:
+        write_recording(args.write_recording, payloads)
+        return
+    print(f"{len(payloads)} messages into {'MySQL' if args.mysql else 'SQLite'}"
+          f"{f' by {args.workers} workers' if args.workers else ''}")
+    print(f"{'batch rows':>10}{'msg/s':>10}{'commits':>9}{'msg/commit':>12}")
+    for batch_rows in args.batch_rows:
+        rate, commits = run(payloads, args, batch_rows)
+        if commits is None:
+            print(f"{batch_rows:>10}{rate:>10.0f}{'-':>9}{'-':>12}")
+        else:
+            print(f"{batch_rows:>10}{rate:>10.0f}{commits:>9}{len(payloads) / max(1, commits):>12.1f}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,142 @@
+import argparse
+import statistics
+import time
+from collections import defaultdict
+
+import mysql.connector
+
+# Latency report of the bin messages, from the bins_message_trace table written by scrap_cloud.py.
+# All the timestamps are in ms on the cloud clock (the collectors synchronize to it with the
+# server_time of the configuration response, at startup and every 10 minutes), per hop:
+#   sensor -> collector   publish_ts - sample_ts   poll cycle and publish queue, from the sensor requests to
+#                                                  the hand-off of the message to the MQTT client
+#   collector -> broker   ingest_ts - publish_ts   MQTT delivery, retransmissions included, up to the
+#                                                  reception by scrap_cloud.py
+#   broker -> DB          commit_ts - ingest_ts    processing and commit, only for messages changing the state
+#   end to end            commit_ts - sample_ts    how stale a bins_current_state row is
+# The sequence numbers of every bin, in arrival order, give the messages lost, reordered or duplicated.
+# The late and duplicate messages are traced too, with dropped set, although the ingest did not store them.
+# The clock offset is estimated as half the configuration exchange, so the hops are accurate to the
+# asymmetry of that exchange (a few ms on a quiet network).
+
+HOPS = [
+    ("sensor -> collector", "sample_ts", "publish_ts"),
+    ("collector -> broker", "publish_ts", "ingest_ts"),
+    ("broker -> DB", "ingest_ts", "commit_ts"),
+    ("end to end", "sample_ts", "commit_ts"),
+]
+
+
+def percentile(values, fraction):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+def load_traces(args):
+    db = mysql.connector.connect(host=args.host, user=args.user, password=args.password, database=args.database)
+    try:
+        cursor = db.cursor(dictionary=True)
+        query = "SELECT bin_id, seq, sample_ts, publish_ts, ingest_ts, commit_ts, dropped FROM bins_message_trace"
+        if args.minutes:
+            cursor.execute(query + " WHERE ingest_ts >= %s ORDER BY id", (int((time.time() - args.minutes * 60) * 1000),))
+        else:
+            cursor.execute(query + " ORDER BY id")
+        return cursor.fetchall()
+    finally:
+        db.close()
+
+
+def hop_latencies(traces):
+    latencies = {}
+    for name, start, end in HOPS:
+        latencies[name] = [trace[end] - trace[start] for trace in traces
+                           if trace[start] is not None and trace[end] is not None]
+    return latencies
+
+
+class SequenceStats:
+    def __init__(self):
+        self.received = 0
+        self.lost = 0
+        self.reordered = 0
+        self.duplicates = 0
+        self.restarts = 0
+
+
+# A sequence number lower than the highest one seen is a late message filling a gap, a duplicate,
+# or, when it restarts from 1, a reboot of the collector
+def sequence_stats(traces):
+    stats = defaultdict(SequenceStats)
+    seen = {}
+    highest = {}
+    for trace in traces:
+        bin_id, seq = trace["bin_id"], trace["seq"]
+        bin_stats = stats[bin_id]
+        bin_stats.received += 1
+        if bin_id not in highest or (seq == 1 and highest[bin_id] > 1):
+            if bin_id in highest:
+                bin_stats.restarts += 1
+            highest[bin_id] = seq
+            seen[bin_id] = {seq}
+        elif seq in seen[bin_id]:
+            bin_stats.duplicates += 1
+        elif seq > highest[bin_id]:
+            bin_stats.lost += seq - highest[bin_id] - 1
+            highest[bin_id] = seq
+            seen[bin_id].add(seq)
+        else:
+            bin_stats.reordered += 1
+            bin_stats.lost -= 1
+            seen[bin_id].add(seq)
+    return stats
+
+
+def print_report(traces, top):
+    dropped = [trace["dropped"] for trace in traces if trace["dropped"]]
+    print(f"{len(traces)} messages from {len({trace['bin_id'] for trace in traces})} bins, dropped by the ingest: "
+          f"{dropped.count('stale')} stale, {dropped.count('duplicate')} duplicates")
+    print(f"{'hop':<22}{'n':>8}{'mean':>9}{'p50':>9}{'p95':>9}{'p99':>9}{'max':>9}  (ms)")
+    for name, values in hop_latencies(traces).items():
+        if not values:
+            print(f"{name:<22}{0:>8}")
+            continue
+        print(f"{name:<22}{len(values):>8}{statistics.fmean(values):>9.1f}{percentile(values, 0.5):>9}"
+              f"{percentile(values, 0.95):>9}{percentile(values, 0.99):>9}{max(values):>9}")
+
+    stats = sequence_stats(traces)
+    totals = SequenceStats()
+    for bin_stats in stats.values():
+        for field, value in vars(bin_stats).items():
+            setattr(totals, field, getattr(totals, field) + value)
+    expected = totals.received - totals.duplicates + totals.lost
+    print(f"Sequence: {totals.lost} lost ({totals.lost / expected * 100 if expected else 0:.2f}%), "
+          f"{totals.reordered} reordered, {totals.duplicates} duplicates, {totals.restarts} collector restarts")
+
+    worst = sorted(stats.items(), key=lambda item: (item[1].lost, item[1].reordered), reverse=True)[:top]
+    worst = [(bin_id, bin_stats) for bin_id, bin_stats in worst if bin_stats.lost or bin_stats.reordered]
+    if worst:
+        print(f"{'bin':<16}{'received':>10}{'lost':>8}{'reordered':>11}{'duplicates':>12}{'restarts':>10}")
+        for bin_id, bin_stats in worst:
+            print(f"{bin_id:<16}{bin_stats.received:>10}{bin_stats.lost:>8}{bin_stats.reordered:>11}"
+                  f"{bin_stats.duplicates:>12}{bin_stats.restarts:>10}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Per-hop latency and sequence gaps of the bin messages")
+    parser.add_argument("--host", default="localhost", help="MySQL host")
+    parser.add_argument("--user", default="iot-project", help="MySQL user")
+    parser.add_argument("--password", default="iot-password", help="MySQL password")
+    parser.add_argument("--database", default="scrap", help="MySQL database")
+    parser.add_argument("--minutes", type=float, help="only the messages received in the last minutes")
+    parser.add_argument("--top", type=int, default=10, help="bins with the most lost messages to list")
+    args = parser.parse_args()
+
+    traces = load_traces(args)
+    if not traces:
+        print("No traced messages, are the collectors publishing a seq field?")
+        return
+    print_report(traces, args.top)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,302 @@
+import argparse
+import glob
+import json
+import os
+import re
+import subprocess
+import sys
+from collections import defaultdict
+
+# RAM/ROM budget of the firmwares, per module, and their worst-case stack depth. Run by `make budget` after a
+# build with STACK_USAGE=1, which adds -fstack-usage so that gcc writes the frame size of every function to a
+# .su file next to its object file.
+#   - RAM and ROM: the symbols of the firmware (nm), attributed to the object file that defines them. ROM is
+#     code, constants and initialized data, RAM is initialized and zeroed data. Symbols found in no object file
+#     are counted as (libraries).
+#   - Stack: the frame sizes of the .su files summed along the direct calls of the disassembly (objdump). Calls
+#     through function pointers are not followed, so the process threads are taken as entry points, entered
+#     from main through call_process(). Recursion and frames of dynamic size are flagged in the report.
+# The totals and modules are compared with a baseline (--save-baseline records it) to catch regressions.
+# Example: python3 memory_budget.py --firmware ../mqtt/bin-mqtt-collector.native --build-dir ../mqtt/build
+
+ROM_TYPES = set("tTwWrRvV")
+RAM_TYPES = set("bBcCsS")
+DATA_TYPES = set("dDgG")  # initialized data: in ROM and copied to RAM
+CALL_MNEMONICS = {"call", "callq", "calla", "jmp", "jmpq", "bl", "blx", "b", "b.w", "b.n", "br", "bra", "jal", "j"}
+INDIRECT_CALL = re.compile(r"^(call|callq|calla|blx|jalr)\s+(\*|%|r\d|a\d)")
+FUNCTION_HEADER = re.compile(r"^([0-9a-f]+) <([^>]+)>:$")
+INSTRUCTION = re.compile(r"^\s*[0-9a-f]+:\s+(\S+)\s+(.*)$")
+TARGET = re.compile(r"<([^>+]+)(\+0x[0-9a-f]+)?>")
+LOCAL_SUFFIX = re.compile(r"\.(constprop|isra|part|cold|lto_priv)?\.?\d+$")
+DISPATCHER = "call_process"
+
+
+def run(tool, *args):
+    return subprocess.run([tool, *args], check=True, capture_output=True, text=True).stdout
+
+
+def base_name(symbol):
+    return LOCAL_SUFFIX.sub("", symbol.split("@")[0])
+
+
+# Defined symbols of an object or executable: [(name, size, type)]
+def symbols(nm, path):
+    result = []
+    for line in run(nm, "-S", "--defined-only", path).splitlines():
+        fields = line.split()
+        if len(fields) == 4:
+            result.append((fields[3], int(fields[1], 16), fields[2]))
+    return result
+
+
+def module_of(path):
+    return os.path.splitext(os.path.basename(path))[0]
+
+
+class ObjectIndex:
+    """Module (object file) defining each symbol, globals by name and locals by name and size"""
+
+    def __init__(self, nm, objects):
+        self.globals = {}
+        self.locals = defaultdict(set)
+        for path in objects:
+            module = module_of(path)
+            for name, size, kind in symbols(nm, path):
+                if kind.isupper():
+                    self.globals[name] = module
+                else:
+                    self.locals[(base_name(name), size)].add(module)
+                    self.locals[(base_name(name), None)].add(module)
+
+    def module(self, name, size, kind):
+        if kind.isupper() and name in self.globals:
+            return self.globals[name]
+        for key in ((base_name(name), size), (base_name(name), None)):
+            modules = self.locals.get(key)
+            if modules and len(modules) == 1:
+                return next(iter(modules))
+        return "(libraries)" if kind.isupper() else "(unattributed)"
+
+
+def memory_by_module(nm, firmware, index):
+    modules = defaultdict(lambda: {"ram": 0, "rom": 0})
+    for name, size, kind in symbols(nm, firmware):
+        usage = modules[index.module(name, size, kind)]
+        if kind in ROM_TYPES:
+            usage["rom"] += size
+        elif kind in RAM_TYPES:
+            usage["ram"] += size
+        elif kind in DATA_TYPES:
+            usage["rom"] += size
+            usage["ram"] += size
+    return modules
+
+
+# Frame sizes from the .su files: {function: (bytes, qualifier, module)}. Static functions of the same name in
+# several modules keep the largest frame
+def frame_sizes(su_files):
+    frames = {}
+    for path in su_files:
+        with open(path) as su:
+            for line in su:
+                location, size, qualifier = line.rstrip("\n").split("\t")
+                function = base_name(location.rsplit(":", 1)[-1])
+                if function not in frames or int(size) > frames[function][0]:
+                    frames[function] = (int(size), qualifier, module_of(path))
+    return frames
+
+
+# Direct calls of every function of the firmware, and the functions making indirect calls
+def call_graph(objdump, firmware):
+    calls = defaultdict(set)
+    indirect = set()
+    function = None
+    for line in run(objdump, "-d", "--no-show-raw-insn", firmware).splitlines():
+        header = FUNCTION_HEADER.match(line)
+        if header:
+            function = base_name(header.group(2))
+            continue
+        instruction = INSTRUCTION.match(line)
+        if function is None or instruction is None:
+            continue
+        mnemonic, operands = instruction.groups()
+        if INDIRECT_CALL.match(f"{mnemonic} {operands}"):
+            indirect.add(function)
+        elif mnemonic in CALL_MNEMONICS:
+            target = TARGET.search(operands)
+            # Jumps inside the function carry an offset, calls and tail calls do not. A jump to itself
+            # without offset is a PLT stub pointing at the symbol it resolves
+            if target and not target.group(2) and (mnemonic.startswith(("call", "bl", "jal"))
+                                                    or base_name(target.group(1)) != function):
+                calls[function].add(base_name(target.group(1)))
+    return calls, indirect
+
+
+class StackAnalysis:
+    def __init__(self, frames, calls, indirect):
+        self.frames = frames
+        self.calls = calls
+        self.indirect = indirect
+        self.depths = {}
+        self.recursive = set()
+        self.active = set()
+
+    # Deepest stack from the entry of a function: (bytes, call path)
+    def depth(self, function):
+        if function in self.depths:
+            return self.depths[function]
+        if function in self.active:
+            self.recursive.add(function)
+            return 0, []
+        self.active.add(function)
+        deepest = (0, [])
+        for callee in self.calls.get(function, ()):
+            deepest = max(deepest, self.depth(callee), key=lambda result: result[0])
+        self.active.discard(function)
+        frame = self.frames.get(function, (0, "", ""))[0]
+        self.depths[function] = frame + deepest[0], [function] + deepest[1]
+        return self.depths[function]
+
+    # Stack used on the way from main to a function: the frames of the path, without the function itself
+    def path_to(self, root, function, seen=None):
+        if root == function:
+            return 0, []
+        seen = seen if seen is not None else set()
+        seen.add(root)
+        best = None
+        for callee in self.calls.get(root, ()):
+            if callee not in seen:
+                found = self.path_to(callee, function, seen)
+                if found is not None and (best is None or found[0] > best[0]):
+                    best = found
+        if best is None:
+            return None
+        return self.frames.get(root, (0, "", ""))[0] + best[0], [root] + best[1]
+
+    # Worst case of the firmware: main, and every process thread entered through the dispatcher
+    def worst_case(self):
+        worst = self.depth("main")
+        dispatch = self.path_to("main", DISPATCHER) if "main" in self.calls else None
+        if dispatch is not None:
+            dispatcher_frame = self.frames.get(DISPATCHER, (0, "", ""))[0]
+            for function in self.calls.keys() | self.frames.keys():
+                if function.startswith("process_thread_"):
+                    depth, path = self.depth(function)
+                    total = dispatch[0] + dispatcher_frame + depth
+                    if total > worst[0]:
+                        worst = total, dispatch[1] + [DISPATCHER] + path
+        return worst
+
+    def worst_by_module(self):
+        modules = defaultdict(lambda: (0, []))
+        for function, (_, _, module) in self.frames.items():
+            depth = self.depth(function)
+            if depth[0] > modules[module][0]:
+                modules[module] = depth
+        return modules
+
+
+def analyze(firmware, build_dirs, nm, objdump):
+    objects = sorted({path for build_dir in build_dirs for path in glob.glob(f"{build_dir}/**/*.o", recursive=True)})
+    su_files = sorted({path for build_dir in build_dirs for path in glob.glob(f"{build_dir}/**/*.su", recursive=True)})
+    modules = memory_by_module(nm, firmware, ObjectIndex(nm, objects))
+
+    frames = frame_sizes(su_files)
+    calls, indirect = call_graph(objdump, firmware)
+    stack = StackAnalysis(frames, calls, indirect)
+    worst, path = stack.worst_case()
+    for module, (depth, _) in stack.worst_by_module().items():
+        modules[module]["stack"] = depth
+
+    dynamic = sorted(function for function in path if "dynamic" in frames.get(function, (0, "", ""))[1])
+    return {
+        "ram": sum(usage["ram"] for usage in modules.values()),
+        "rom": sum(usage["rom"] for usage in modules.values()),
+        "stack": worst,
+        "stack_path": path,
+        "recursive": sorted(stack.recursive),
+        "dynamic": dynamic,
+        "has_stack_usage": bool(su_files),
+        "modules": {module: {"ram": usage["ram"], "rom": usage["rom"], "stack": usage.get("stack", 0)}
+                    for module, usage in modules.items()},
+    }
+
+
+def print_report(name, result, top):
+    print(f"{name}: RAM {result['ram']} B, ROM {result['rom']} B, worst-case stack {result['stack']} B")
+    if not result["has_stack_usage"]:
+        print("  no .su files found, build with STACK_USAGE=1 for the stack depths")
+    elif result["stack_path"]:
+        print(f"  deepest path: {' > '.join(result['stack_path'])}")
+    if result["recursive"]:
+        print(f"  recursive, not bounded: {', '.join(result['recursive'])}")
+    if result["dynamic"]:
+        print(f"  frames of dynamic size on the deepest path: {', '.join(result['dynamic'])}")
+
+    modules = sorted(result["modules"].items(), key=lambda item: (item[1]["ram"] + item[1]["rom"], item[0]),
+                     reverse=True)
+    shown, rest = (modules[:top], modules[top:]) if top else (modules, [])
+    print(f"  {'module':<32}{'RAM':>8}{'ROM':>9}{'stack':>8}")
+    for module, usage in shown:
+        print(f"  {module:<32}{usage['ram']:>8}{usage['rom']:>9}{usage['stack']:>8}")
+    if rest:
+        print(f"  {f'({len(rest)} other modules)':<32}{sum(usage['ram'] for _, usage in rest):>8}"
+              f"{sum(usage['rom'] for _, usage in rest):>9}")
+    print()
+
+
+# Growth beyond the tolerance, of the totals of the firmwares and of their modules
+def regressions(results, baseline, tolerance):
+    found = []
+    for name, result in results.items():
+        previous = baseline.get(name)
+        if previous is None:
+            continue
+        entries = [(name, result, previous)]
+        entries += [(f"{name} {module}", usage, previous.get("modules", {}).get(module))
+                    for module, usage in result["modules"].items()]
+        for label, current, before in entries:
+            if before is None:
+                continue
+            for key in ("ram", "rom", "stack"):
+                if current[key] > before.get(key, 0) + tolerance:
+                    found.append(f"{label}: {key.upper()} {before.get(key, 0)} -> {current[key]} B")
+    return found
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Per-module RAM/ROM and worst-case stack of the firmwares")
+    parser.add_argument("--firmware", nargs="+", required=True, help="linked firmware executables")
+    parser.add_argument("--build-dir", nargs="+", required=True,
+                        help="build directories holding the object and .su files of the firmwares")
+    parser.add_argument("--tool-prefix", default="", help="toolchain prefix, e.g. arm-none-eabi-")
+    parser.add_argument("--top", type=int, default=15, help="modules listed per firmware, 0 for all")
+    parser.add_argument("--baseline", help="JSON budget to compare with, when the file exists")
+    parser.add_argument("--save-baseline", action="store_true", help="record the results as the baseline")
+    parser.add_argument("--tolerance", type=int, default=0, help="growth in bytes accepted over the baseline")
+    args = parser.parse_args()
+
+    nm, objdump = f"{args.tool_prefix}nm", f"{args.tool_prefix}objdump"
+    results = {}
+    for firmware in args.firmware:
+        name = os.path.basename(firmware)
+        results[name] = analyze(firmware, args.build_dir, nm, objdump)
+        print_report(name, results[name], args.top)
+
+    if args.baseline and args.save_baseline:
+        with open(args.baseline, "w") as baseline:
+            json.dump({name: {key: result[key] for key in ("ram", "rom", "stack", "modules")}
+                       for name, result in results.items()}, baseline, indent=1, sort_keys=True)
+        print(f"Baseline saved to {args.baseline}")
+    elif args.baseline and os.path.exists(args.baseline):
+        with open(args.baseline) as baseline:
+            found = regressions(results, json.load(baseline), args.tolerance)
+        for regression in found:
+            print(f"over budget: {regression}")
+        if found:
+            sys.exit(1)
+        print(f"Within the budget of {args.baseline}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,294 @@
+import argparse
+import asyncio
+import logging
+import struct
+import time
+from collections import OrderedDict
+
+import paho.mqtt.client as mqtt
+
+# Stand-in for an MQTT-SN 1.2 gateway in front of the MQTT broker, for the collector built with MQTT_SN=1
+# (utils/mqtt_sn.c). It is a transparent gateway: every MQTT-SN client gets its own MQTT connection to the
+# broker, under its client ID. Only what the collector uses is implemented: pre-defined topic IDs (TOPIC_IDS,
+# the same as in bin-mqtt-collector.c), QoS 0 and 1, SUBSCRIBE to a pre-defined ID or to a topic name (given an
+# ID of the session, e.g. config/params/<bin_id>), PINGREQ and DISCONNECT. A QoS 1 PUBLISH is
+# acknowledged once the broker has acknowledged it, so the PUBACK the collector waits for is end to end.
+#   python3 mqtt_sn_gateway.py --broker localhost --port 10000
+
+TOPIC_IDS = {1: "bins", 2: "config/request", 3: "config/response", 4: "config/params"}
+TOPIC_NAMES = {name: topic_id for topic_id, name in TOPIC_IDS.items()}
+# IDs of the topics subscribed by name, past the pre-defined ones
+FIRST_SESSION_TOPIC_ID = 0x100
+
+# Message types
+CONNECT, CONNACK = 0x04, 0x05
+PUBLISH, PUBACK = 0x0C, 0x0D
+SUBSCRIBE, SUBACK = 0x12, 0x13
+PINGREQ, PINGRESP = 0x16, 0x17
+DISCONNECT = 0x18
+
+FLAG_DUP = 0x80
+FLAG_TOPIC_NORMAL = 0x00
+FLAG_TOPIC_PREDEFINED = 0x01
+TOPIC_ID_TYPE_MASK = 0x03
+
+# Return codes
+ACCEPTED = 0x00
+REJECTED_INVALID_TOPIC = 0x02
+REJECTED_NOT_SUPPORTED = 0x03
+
+# A client silent for this many keep-alive periods is gone (MQTT-SN 1.2, section 6.14)
+KEEP_ALIVE_TOLERANCE = 1.5
+MAX_RECENT_IDS = 64
+
+
+def encode(message_type, body=b""):
+    length = len(body) + 2
+    if length < 256:
+        return bytes([length, message_type]) + body
+    return b"\x01" + struct.pack(">H", length + 2) + bytes([message_type]) + body
+
+
+# (type, body) of a datagram, None when it is not a whole message
+def decode(data):
+    if len(data) >= 4 and data[0] == 0x01:
+        length, header = struct.unpack_from(">H", data, 1)[0], 4
+    elif len(data) >= 2:
+        length, header = data[0], 2
+    else:
+        return None
+    if length < header or length > len(data):
+        return None
+    return data[header - 1], data[header:length]
+
+
+def qos_of(flags):
+    return (flags >> 5) & 0x03
+
+
+class GatewayStats:
+    def __init__(self):
+        self.received = 0
+        self.received_bytes = 0
+        self.sent = 0
+        self.sent_bytes = 0
+        self.published = 0
+        self.duplicates = 0
+
+
+class Session:
+    """One MQTT-SN client and its MQTT connection to the broker."""
+
+    def __init__(self, gateway, address, client_id, keep_alive):
+        self.gateway = gateway
+        self.address = address
+        self.client_id = client_id
+        self.keep_alive = keep_alive
+        self.last_seen = time.monotonic()
+        # MQTT message ID -> MQTT-SN (message ID, topic ID) of the PUBLISH or SUBSCRIBE waiting for the broker
+        self.pending_publishes = {}
+        self.pending_subscribes = {}
+        # MQTT-SN message IDs already forwarded at QoS 1, answered again without publishing twice
+        self.recent_ids = OrderedDict()
+        # Topic name -> ID of the topics subscribed by name
+        self.session_topics = {}
+
+        # The paho callbacks run on its network thread, the replies are sent from the event loop
+        loop = asyncio.get_running_loop()
+        self.client = mqtt.Client(client_id=client_id, clean_session=True)
+        self.client.on_connect = lambda c, u, f, rc: loop.call_soon_threadsafe(self.connected, rc)
+        self.client.on_publish = lambda c, u, mid: loop.call_soon_threadsafe(self.published, mid)
+        self.client.on_subscribe = lambda c, u, mid, granted: loop.call_soon_threadsafe(self.subscribed, mid, granted)
+        self.client.on_message = lambda c, u, msg: loop.call_soon_threadsafe(self.message, msg.topic, msg.payload)
+
+    def start(self, broker, port):
+        self.client.connect_async(broker, port, max(self.keep_alive, 10))
+        self.client.loop_start()
+
+    def stop(self):
+        self.client.disconnect()
+        self.client.loop_stop()
+
+    def send(self, message_type, body=b""):
+        self.gateway.send(encode(message_type, body), self.address)
+
+    def connected(self, rc):
+        self.send(CONNACK, bytes([ACCEPTED if rc == 0 else REJECTED_NOT_SUPPORTED]))
+
+    def published(self, mid):
+        pending = self.pending_publishes.pop(mid, None)
+        if pending is not None:
+            msg_id, topic_id = pending
+            self.send(PUBACK, struct.pack(">HHB", topic_id, msg_id, ACCEPTED))
+
+    def subscribed(self, mid, granted):
+        pending = self.pending_subscribes.pop(mid, None)
+        if pending is not None:
+            msg_id, topic_id = pending
+            qos = granted[0] if granted and granted[0] < 0x80 else 0
+            self.send(SUBACK, struct.pack(">BHHB", qos << 5, topic_id, msg_id, ACCEPTED))
+
+    # Messages of the broker go to the client at QoS 0: the collector only subscribes to its configuration and
+    # its parameter updates
+    def message(self, topic, payload):
+        topic_id = TOPIC_NAMES.get(topic)
+        if topic_id is not None:
+            self.send(PUBLISH, struct.pack(">BHH", FLAG_TOPIC_PREDEFINED, topic_id, 0) + payload)
+        elif topic in self.session_topics:
+            self.send(PUBLISH, struct.pack(">BHH", FLAG_TOPIC_NORMAL, self.session_topics[topic], 0) + payload)
+
+    # Topic and ID of a SUBSCRIBE, None when the topic is not supported
+    def subscription(self, flags, body):
+        if flags & TOPIC_ID_TYPE_MASK == FLAG_TOPIC_PREDEFINED:
+            topic_id = struct.unpack_from(">H", body, 3)[0]
+            topic = TOPIC_IDS.get(topic_id)
+            return (topic, topic_id) if topic is not None else (None, topic_id)
+        if flags & TOPIC_ID_TYPE_MASK != FLAG_TOPIC_NORMAL:
+            return None, 0
+        topic = body[3:].decode(errors="replace")
+        if not topic or "+" in topic or "#" in topic:
+            return None, 0
+        topic_id = self.session_topics.setdefault(topic, FIRST_SESSION_TOPIC_ID + len(self.session_topics))
+        return topic, topic_id
+
+    def handle(self, message_type, body):
+        self.last_seen = time.monotonic()
+        if message_type == PUBLISH and len(body) >= 5:
+            flags, topic_id, msg_id = struct.unpack_from(">BHH", body)
+            self.handle_publish(flags, topic_id, msg_id, body[5:])
+        elif message_type == SUBSCRIBE and len(body) >= 4:
+            flags, msg_id = struct.unpack_from(">BH", body)
+            topic, topic_id = self.subscription(flags, body) if len(body) >= 5 else (None, 0)
+            if topic is None:
+                self.send(SUBACK, struct.pack(">BHHB", 0, topic_id, msg_id, REJECTED_INVALID_TOPIC))
+                return
+            _, mid = self.client.subscribe(topic, min(qos_of(flags), 1))
+            self.pending_subscribes[mid] = (msg_id, topic_id)
+        elif message_type == PINGREQ:
+            self.send(PINGRESP)
+
+    def handle_publish(self, flags, topic_id, msg_id, payload):
+        qos = qos_of(flags)
+        topic = TOPIC_IDS.get(topic_id) if flags & TOPIC_ID_TYPE_MASK == FLAG_TOPIC_PREDEFINED else None
+        if topic is None:
+            self.send(PUBACK, struct.pack(">HHB", topic_id, msg_id, REJECTED_INVALID_TOPIC))
+            return
+        if qos == 0:
+            self.client.publish(topic, payload, 0)
+            self.gateway.stats.published += 1
+            return
+
+        # A retransmission waits for the PUBACK of the first transmission when the broker has not acknowledged
+        # it yet, and gets a PUBACK of its own when it has
+        if flags & FLAG_DUP and (msg_id, topic_id) in self.pending_publishes.values():
+            self.gateway.stats.duplicates += 1
+            return
+        if flags & FLAG_DUP and msg_id in self.recent_ids:
+            self.gateway.stats.duplicates += 1
+            self.send(PUBACK, struct.pack(">HHB", topic_id, msg_id, ACCEPTED))
+            return
+        info = self.client.publish(topic, payload, 1)
+        self.pending_publishes[info.mid] = (msg_id, topic_id)
+        self.gateway.stats.published += 1
+        self.recent_ids[msg_id] = None
+        if len(self.recent_ids) > MAX_RECENT_IDS:
+            self.recent_ids.popitem(last=False)
+
+
+class Gateway(asyncio.DatagramProtocol):
+    def __init__(self, broker, broker_port):
+        self.broker = broker
+        self.broker_port = broker_port
+        self.sessions = {}
+        self.stats = GatewayStats()
+        self.transport = None
+
+    def connection_made(self, transport):
+        self.transport = transport
+
+    def send(self, data, address):
+        self.stats.sent += 1
+        self.stats.sent_bytes += len(data)
+        self.transport.sendto(data, address)
+
+    def datagram_received(self, data, address):
+        self.stats.received += 1
+        self.stats.received_bytes += len(data)
+        message = decode(data)
+        if message is None:
+            return
+        message_type, body = message
+
+        if message_type == CONNECT:
+            if len(body) < 4:
+                return
+            _, _, keep_alive = struct.unpack_from(">BBH", body)
+            client_id = body[4:].decode(errors="replace")
+            self.close(address)
+            session = Session(self, address, client_id, keep_alive)
+            self.sessions[address] = session
+            session.start(self.broker, self.broker_port)
+            logging.info(f"{client_id} connected from [{address[0]}]:{address[1]}")
+            return
+
+        session = self.sessions.get(address)
+        if message_type == DISCONNECT:
+            self.send(encode(DISCONNECT), address)
+            self.close(address)
+        elif session is not None:
+            session.handle(message_type, body)
+        else:
+            # Unknown or expired client: a DISCONNECT makes it connect again
+            self.send(encode(DISCONNECT), address)
+
+    def close(self, address):
+        session = self.sessions.pop(address, None)
+        if session is not None:
+            session.stop()
+            logging.info(f"{session.client_id} disconnected")
+
+    def expire(self):
+        now = time.monotonic()
+        for address, session in list(self.sessions.items()):
+            if session.keep_alive and now - session.last_seen > KEEP_ALIVE_TOLERANCE * session.keep_alive:
+                self.close(address)
+
+
+# Traffic reports, and the expiry of the silent clients at the same pace
+async def report_stats(gateway, interval):
+    while True:
+        await asyncio.sleep(interval)
+        gateway.expire()
+        stats = gateway.stats
+        logging.info(f"{len(gateway.sessions)} clients, received {stats.received} datagrams ({stats.received_bytes} B), "
+                     f"sent {stats.sent} ({stats.sent_bytes} B), published {stats.published}, "
+                     f"{stats.duplicates} duplicates")
+
+
+async def main():
+    parser = argparse.ArgumentParser(description="MQTT-SN gateway stand-in bridging to an MQTT broker")
+    parser.add_argument("--address", default="::", help="address to bind the gateway to")
+    parser.add_argument("--port", type=int, default=10000, help="UDP port of the gateway")
+    parser.add_argument("--broker", default="localhost", help="MQTT broker address")
+    parser.add_argument("--broker-port", type=int, default=1883)
+    parser.add_argument("--stats-interval", type=float, default=10.0, help="seconds between traffic reports")
+    args = parser.parse_args()
+
+    logging.basicConfig(level=logging.INFO, format="%(asctime)s %(message)s")
+    gateway = Gateway(args.broker, args.broker_port)
+    loop = asyncio.get_running_loop()
+    transport, _ = await loop.create_datagram_endpoint(lambda: gateway, local_addr=(args.address, args.port))
+    logging.info(f"MQTT-SN gateway on UDP port {args.port}, broker {args.broker}:{args.broker_port}")
+    try:
+        await report_stats(gateway, args.stats_interval)
+    finally:
+        for address in list(gateway.sessions):
+            gateway.close(address)
+        transport.close()
+
+
+if __name__ == "__main__":
+    try:
+        asyncio.run(main())
+    except KeyboardInterrupt:
+        pass
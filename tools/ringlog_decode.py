@@ -0,0 +1,131 @@
+import argparse
+import ipaddress
+import os
+import re
+import struct
+import sys
+from collections import namedtuple
+
+# Decoder of the ring log of the firmwares (utils/ringlog.h). The records only carry the ID of their format,
+# the texts are read from utils/ringlog_formats.h, so the decoder must use the formats of the firmware that
+# wrote the log. Input is either the console, where the firmware drains the log as "RL:<hex chunk>" lines
+# (anything before "RL:", e.g. the Cooja mote ID, is kept as the prefix of the decoded lines and the other
+# lines are passed through), or with --binary the payloads of GET /log saved to files:
+#   python3 ringlog_decode.py < console.log
+#   coap-client -m get coap://[fd00::202:2:2:2]/log -o log.bin && python3 ringlog_decode.py --binary log.bin
+
+DEFAULT_FORMATS = os.path.join(os.path.dirname(os.path.dirname(os.path.abspath(__file__))), "utils", "ringlog_formats.h")
+FORMAT_LINE = re.compile(r'^\s*RINGLOG_FORMAT\((\w+),\s*"((?:[^"\\]|\\.)*)"\)')
+CONVERSION = re.compile(r"%(%|[-+ #0]*\d*(?:\.\d+)?(?:hh|h|ll|l|z)?([diuxXsa]))")
+CHUNK_LINE = re.compile(r"RL:([0-9a-fA-F]+)")
+LEVELS = {1: "ERR", 2: "WARN", 3: "INFO", 4: "DBG"}
+
+CHUNK_HEADER = struct.Struct("<II")  # dropped records, drain time in ms
+RECORD_HEADER = struct.Struct("<BBI")  # format, flags, time in ms
+FLAG_STRING = 0x40
+
+Format = namedtuple("Format", "name text")
+Record = namedtuple("Record", "time_ms level name text")
+Chunk = namedtuple("Chunk", "dropped drain_ms records")
+
+
+def load_formats(path=DEFAULT_FORMATS):
+    formats = []
+    with open(path) as formats_file:
+        for line in formats_file:
+            match = FORMAT_LINE.match(line)
+            if match:
+                formats.append(Format(match.group(1), bytes(match.group(2), "utf-8").decode("unicode_escape")))
+    return formats
+
+
+def render(text, args, string):
+    values = iter(args)
+
+    def conversion(match):
+        if match.group(1) == "%":
+            return "%"
+        kind = match.group(2)
+        if kind == "s":
+            return string.decode("utf-8", errors="replace")
+        if kind == "a":
+            return str(ipaddress.IPv6Address(string)) if len(string) == 16 else string.hex()
+        value = next(values, None)
+        if value is None:
+            return "?"
+        spec = re.sub(r"(hh|h|ll|l|z)", "", match.group(1))
+        if kind in "uxX":
+            value &= 0xFFFFFFFF
+            spec = spec.replace("u", "d")
+        return ("%" + spec) % value
+
+    return CONVERSION.sub(conversion, text)
+
+
+def decode_chunk(data, formats):
+    dropped, drain_ms = CHUNK_HEADER.unpack_from(data)
+    records = []
+    offset = CHUNK_HEADER.size
+    while offset + RECORD_HEADER.size <= len(data):
+        format_id, flags, time_ms = RECORD_HEADER.unpack_from(data, offset)
+        offset += RECORD_HEADER.size
+        argc = (flags >> 3) & 0x07
+        args = struct.unpack_from(f"<{argc}i", data, offset)
+        offset += 4 * argc
+        string = b""
+        if flags & FLAG_STRING:
+            string = data[offset + 1:offset + 1 + data[offset]]
+            offset += 1 + data[offset]
+        level = LEVELS.get(flags & 0x07, str(flags & 0x07))
+        if format_id < len(formats):
+            name, text = formats[format_id].name, render(formats[format_id].text, args, string)
+        else:
+            name, text = str(format_id), f"unknown format {format_id}: {list(args)} {string!r}"
+        records.append(Record(time_ms, level, name, text))
+    return Chunk(dropped, drain_ms, records)
+
+
+# Chunk of a console line and the text before it, None for the other lines
+def decode_line(line, formats):
+    match = CHUNK_LINE.search(line)
+    if match is None:
+        return None
+    return line[:match.start()], decode_chunk(bytes.fromhex(match.group(1)), formats)
+
+
+def format_chunk(prefix, chunk):
+    lines = []
+    if chunk.dropped:
+        lines.append(f"{prefix}{chunk.drain_ms / 1000:10.3f} WARN  {chunk.dropped} records dropped")
+    for record in chunk.records:
+        lines.append(f"{prefix}{record.time_ms / 1000:10.3f} {record.level:<5} {record.text}")
+    return lines
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode the ring log of the firmwares")
+    parser.add_argument("files", nargs="*", help="console logs, standard input when none")
+    parser.add_argument("--binary", action="store_true", help="the files are payloads of GET /log")
+    parser.add_argument("--formats", default=DEFAULT_FORMATS, help="ringlog_formats.h of the firmware")
+    args = parser.parse_args()
+
+    formats = load_formats(args.formats)
+    if args.binary:
+        for path in args.files:
+            with open(path, "rb") as chunk_file:
+                data = chunk_file.read()
+            if data:
+                print("\n".join(format_chunk("", decode_chunk(data, formats))))
+        return
+
+    for path in args.files or ["-"]:
+        log_file = sys.stdin if path == "-" else open(path, errors="replace")
+        with log_file:
+            for line in log_file:
+                line = line.rstrip("\n")
+                decoded = decode_line(line, formats)
+                print(line if decoded is None else "\n".join(format_chunk(*decoded)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,621 @@
+import argparse
+import asyncio
+import json
+import logging
+import random
+import struct
+import time
+from collections import OrderedDict
+
+# Host-side stand-in for the sensor motes. Every emulated node is a CoAP server on its own UDP port
+# with the resources and payloads of the coap-sensors firmwares, so that one process can emulate the
+# sensors of hundreds of bins for the collector, with configurable link latency, loss and value dynamics.
+# CoAP is implemented here directly on asyncio datagrams (RFC 7252 subset, plus Observe from RFC 7641)
+# so that loss and latency apply to single datagrams, like on the radio.
+
+APPLICATION_LINK_FORMAT = 40
+APPLICATION_JSON = 50
+APPLICATION_CBOR = 60
+
+# Message types and codes
+TYPE_CON, TYPE_NON, TYPE_ACK, TYPE_RST = 0, 1, 2, 3
+GET, POST, PUT, DELETE = 1, 2, 3, 4
+CONTENT = 0x45
+CHANGED = 0x44
+BAD_REQUEST = 0x80
+NOT_FOUND = 0x84
+METHOD_NOT_ALLOWED = 0x85
+NOT_ACCEPTABLE = 0x86
+
+# Option numbers
+OPTION_OBSERVE = 6
+OPTION_URI_PATH = 11
+OPTION_CONTENT_FORMAT = 12
+OPTION_ACCEPT = 17
+
+# Same resources, links and sensor names as the firmwares: (path, link attributes, sensors)
+SENSOR_RESOURCES = {
+    "lid_sensor": ("lid/open", 'title="Lid Sensor";rt="Boolean lid_sensor"'),
+    "rfid_reader": ("rfid/value", 'title="String Sensor";rt="String rfid_reader"'),
+    "compactor_active": ("compactor/active", 'title="Compactor Active";rt="Boolean compactor_active"'),
+    "scale_sensor": ("scale/value", 'title="Scale Sensor";rt="Numeric scale_sensor"'),
+    "waste_level_sensor": ("waste/level", 'title="Waste Level Sensor";rt="Numeric waste_level_sensor"'),
+}
+COLLECTOR_CONFIG_LINK = ("config/collector", 'title="Collector Config";rt="Text collector_config"')
+NODE_STATE_LINK = ("state", 'title="Node State";rt="State node_state"')
+
+# Firmwares of a bin: sensors hosted and whether the collector configuration resource is active.
+# "split" is the deployment with one mote per firmware, "all-in-one" hosts every sensor on one mote.
+NODE_LAYOUTS = {
+    "split": {
+        "lid": (["lid_sensor", "rfid_reader"], False),
+        "compactor": (["compactor_active"], True),
+        "scale": (["scale_sensor"], True),
+        "waste_level": (["waste_level_sensor"], True),
+    },
+    "all-in-one": {
+        "all_in_one": (["lid_sensor", "rfid_reader", "compactor_active", "scale_sensor", "waste_level_sensor"], True),
+    },
+}
+
+# Collector configuration key of the node hosting each sensor
+CONFIG_KEYS = {
+    "lid_sensor": "lid_sensor_address",
+    "compactor_active": "compactor_sensor_address",
+    "scale_sensor": "scale_sensor_address",
+    "waste_level_sensor": "waste_level_sensor_address",
+}
+
+RFID_VALUES = ["ABC123", "DEF456", "GHI789", "JKL012", "MNO345"]
+COMPACTOR_ACTIVE_DURATION = 10.0  # seconds, as in res-compactor-active-sensor.c
+MAX_RECENT_MESSAGES = 32
+
+
+class CoapMessage:
+    def __init__(self, type, code, mid, token=b"", options=None, payload=b""):
+        self.type = type
+        self.code = code
+        self.mid = mid
+        self.token = token
+        self.options = options or []
+        self.payload = payload
+
+    def option(self, number):
+        for option_number, value in self.options:
+            if option_number == number:
+                return value
+        return None
+
+    def uint_option(self, number):
+        value = self.option(number)
+        return None if value is None else int.from_bytes(value, "big")
+
+    def path(self):
+        return "/".join(value.decode() for number, value in self.options if number == OPTION_URI_PATH)
+
+
+def uint_bytes(value):
+    return value.to_bytes((value.bit_length() + 7) // 8, "big")
+
+
+def option_field(value):
+    if value < 13:
+        return value, b""
+    if value < 269:
+        return 13, bytes([value - 13])
+    return 14, struct.pack("!H", value - 269)
+
+
+def encode_message(message):
+    data = bytearray([0x40 | message.type << 4 | len(message.token), message.code])
+    data += struct.pack("!H", message.mid) + message.token
+    previous = 0
+    for number, value in sorted(message.options, key=lambda option: option[0]):
+        delta, delta_ext = option_field(number - previous)
+        length, length_ext = option_field(len(value))
+        data += bytes([delta << 4 | length]) + delta_ext + length_ext + value
+        previous = number
+    if message.payload:
+        data += b"\xff" + message.payload
+    return bytes(data)
+
+
+def decode_message(data):
+    if len(data) < 4 or data[0] >> 6 != 1:
+        return None
+    token_length = data[0] & 0x0F
+    message = CoapMessage((data[0] >> 4) & 0x03, data[1], struct.unpack("!H", data[2:4])[0],
+                          data[4:4 + token_length])
+    position = 4 + token_length
+    number = 0
+    while position < len(data):
+        if data[position] == 0xFF:
+            message.payload = data[position + 1:]
+            break
+        delta, length = data[position] >> 4, data[position] & 0x0F
+        position += 1
+        fields = []
+        for field in (delta, length):
+            if field == 13:
+                field = data[position] + 13
+                position += 1
+            elif field == 14:
+                field = struct.unpack("!H", data[position:position + 2])[0] + 269
+                position += 2
+            elif field == 15:
+                return None
+            fields.append(field)
+        number += fields[0]
+        message.options.append((number, bytes(data[position:position + fields[1]])))
+        position += fields[1]
+    return message
+
+
+# Minimal CBOR encoder for the text maps sent by the sensors
+def cbor_head(major_type, length):
+    if length < 24:
+        return bytes([major_type << 5 | length])
+    if length < 0x100:
+        return bytes([major_type << 5 | 24, length])
+    return bytes([major_type << 5 | 25]) + length.to_bytes(2, "big")
+
+
+def cbor_text(value):
+    data = value.encode()
+    return cbor_head(3, len(data)) + data
+
+
+def cbor_map(values):
+    encoded = cbor_head(5, len(values))
+    for key, value in values.items():
+        encoded += cbor_text(key) + cbor_text(value)
+    return encoded
+
+
+# Single precision, as the float readings of the firmware
+def to_float32(value):
+    return struct.unpack("<f", struct.pack("<f", value))[0]
+
+
+# Fixed-point value of a float reading as payload_round_fixed computes it: scaled in single precision and
+# rounded half away from zero, e.g. (32.499, 2) -> 3250
+def round_fixed(value, decimals):
+    value = to_float32(value)
+    for _ in range(decimals):
+        value = to_float32(value * 10)
+    return int(to_float32(value - 0.5 if value < 0 else value + 0.5))
+
+
+class LinkModel:
+    """Latency and loss applied to every datagram exchanged with a node."""
+
+    # Without a random source of its own, the link draws from the one of the emulator it is given to
+    def __init__(self, latency_ms=0.0, jitter_ms=0.0, loss=0.0, rng=None):
+        self.latency = latency_ms / 1000
+        self.jitter = jitter_ms / 1000
+        self.loss = loss
+        self.rng = rng
+
+    def dropped(self):
+        return self.rng.random() < self.loss
+
+    # One-way delay of a datagram
+    def delay(self):
+        return max(0.0, self.rng.gauss(self.latency, self.jitter) if self.jitter else self.latency)
+
+
+class NodeStats:
+    def __init__(self):
+        self.requests = 0
+        self.responses = 0
+        self.dropped = 0
+        self.duplicates = 0
+        self.notifications = 0
+
+
+class EmulatedNode(asyncio.DatagramProtocol):
+    """One sensor mote: its sensor values, resources and observers."""
+
+    def __init__(self, bin_index, name, sensors, collector_config, port, link, on_request=None, rng=random):
+        self.bin_index = bin_index
+        self.name = name
+        self.port = port
+        self.link = link
+        # on_request(node, path) is called for every request served, e.g. to timestamp poll cycles
+        self.on_request = on_request
+        self.stats = NodeStats()
+        self.transport = None
+        # Random source of the emulator, so that a seeded run is repeatable
+        self.rng = rng
+        self.next_mid = rng.getrandbits(16)
+        self.observe_sequence = 0
+        # (address, token) -> (path, content format, message id of the last notification)
+        self.observers = {}
+        # (address, message id) -> encoded response, to answer retransmissions without handling them twice
+        self.recent = OrderedDict()
+        self.compactor_timer = None
+
+        self.values = {}
+        for sensor in sensors:
+            self.values[sensor] = {
+                "lid_sensor": False,
+                "rfid_reader": "No data",
+                "compactor_active": False,
+                "scale_sensor": 0.0,
+                "waste_level_sensor": 0,
+            }[sensor]
+        self.collector_address = "" if collector_config else None
+
+    # Sensor value formatted like the firmware to_string functions
+    def format_value(self, sensor):
+        value = self.values[sensor]
+        if isinstance(value, bool):
+            return "true" if value else "false"
+        if isinstance(value, float):
+            hundredths = round_fixed(value, 2)
+            return f"{'-' if hundredths < 0 else ''}{abs(hundredths) // 100}.{abs(hundredths) % 100:02d}"
+        return str(value)
+
+    def links(self):
+        links = [SENSOR_RESOURCES[sensor] for sensor in self.values]
+        if self.collector_address is not None:
+            links.append(COLLECTOR_CONFIG_LINK)
+        links.append(NODE_STATE_LINK)
+        return ",".join(f"</{path}>;{attributes}" for path, attributes in links)
+
+    # Sensors whose value is reported by a resource
+    def resource_sensors(self, path):
+        if path == NODE_STATE_LINK[0]:
+            return list(self.values)
+        for sensor in self.values:
+            if SENSOR_RESOURCES[sensor][0] == path:
+                return [sensor]
+        return None
+
+    def connection_made(self, transport):
+        self.transport = transport
+
+    def datagram_received(self, data, address):
+        if self.link.dropped():
+            self.stats.dropped += 1
+            return
+        asyncio.get_running_loop().call_later(self.link.delay(), self.handle_datagram, data, address)
+
+    def transmit(self, data, address):
+        if self.link.dropped():
+            self.stats.dropped += 1
+            return
+        asyncio.get_running_loop().call_later(self.link.delay(), self.deliver, data, address)
+
+    def deliver(self, data, address):
+        if not self.transport.is_closing():
+            self.transport.sendto(data, address)
+
+    def send(self, message, address):
+        data = encode_message(message)
+        self.transmit(data, address)
+        return data
+
+    def handle_datagram(self, data, address):
+        message = decode_message(data)
+        if message is None:
+            return
+        if message.type == TYPE_RST:
+            # A reset to a notification cancels the observation
+            self.observers = {key: value for key, value in self.observers.items() if key[0] != address or
+                              value[2] != message.mid}
+            return
+        if message.type == TYPE_ACK or message.code == 0 or message.code >> 5 != 0:
+            return
+
+        key = (address, message.mid)
+        if key in self.recent:
+            self.stats.duplicates += 1
+            self.transmit(self.recent[key], address)
+            return
+
+        self.stats.requests += 1
+        path = message.path()
+        if self.on_request:
+            self.on_request(self, path)
+
+        code, content_format, payload, observe = self.handle_request(message, path, address)
+        options = []
+        if observe is not None:
+            options.append((OPTION_OBSERVE, uint_bytes(observe)))
+        if content_format is not None:
+            options.append((OPTION_CONTENT_FORMAT, uint_bytes(content_format)))
+
+        if message.type == TYPE_CON:
+            response = CoapMessage(TYPE_ACK, code, message.mid, message.token, options, payload)
+        else:
+            response = CoapMessage(TYPE_NON, code, self.new_mid(), message.token, options, payload)
+        self.stats.responses += 1
+        self.recent[key] = self.send(response, address)
+        if len(self.recent) > MAX_RECENT_MESSAGES:
+            self.recent.popitem(last=False)
+
+    def new_mid(self):
+        self.next_mid = (self.next_mid + 1) & 0xFFFF
+        return self.next_mid
+
+    # Returns (code, content format, payload, observe sequence)
+    def handle_request(self, message, path, address):
+        if path == ".well-known/core":
+            if message.code != GET:
+                return METHOD_NOT_ALLOWED, None, b"", None
+            return CONTENT, APPLICATION_LINK_FORMAT, self.links().encode(), None
+
+        if path == COLLECTOR_CONFIG_LINK[0] and self.collector_address is not None:
+            return self.handle_collector_config(message)
+
+        sensors = self.resource_sensors(path)
+        if sensors is None:
+            return NOT_FOUND, None, b"", None
+        if message.code == PUT and path != NODE_STATE_LINK[0]:
+            return self.handle_put(sensors[0], message.payload.decode(errors="replace"))
+        if message.code != GET:
+            return METHOD_NOT_ALLOWED, None, b"", None
+
+        accept = message.uint_option(OPTION_ACCEPT)
+        content_format = APPLICATION_JSON if accept is None else accept
+        if content_format not in (APPLICATION_JSON, APPLICATION_CBOR):
+            return NOT_ACCEPTABLE, None, b"", None
+
+        observe = None
+        registration = message.uint_option(OPTION_OBSERVE)
+        if registration == 0:
+            self.observers[(address, message.token)] = (path, content_format, None)
+            observe = self.observe_sequence
+        elif registration == 1:
+            self.observers.pop((address, message.token), None)
+        return CONTENT, content_format, self.payload(path, sensors, content_format), observe
+
+    def payload(self, path, sensors, content_format):
+        values = {sensor: self.format_value(sensor) for sensor in sensors}
+        if content_format == APPLICATION_CBOR:
+            return cbor_map(values)
+        if path == NODE_STATE_LINK[0]:
+            return json.dumps(values, separators=(",", ":")).encode()
+        return json.dumps({name: {"value": value} for name, value in values.items()}, separators=(",", ":")).encode()
+
+    def handle_collector_config(self, message):
+        if message.code == GET:
+            payload = json.dumps({"collector_address": self.collector_address}, separators=(",", ":"))
+            return CONTENT, APPLICATION_JSON, payload.encode(), None
+        if message.code == PUT:
+            if 0 < len(message.payload) < 64:
+                self.collector_address = message.payload.decode(errors="replace")
+                return CHANGED, None, b"", None
+            return BAD_REQUEST, None, b"", None
+        return METHOD_NOT_ALLOWED, None, b"", None
+
+    # PUT on a sensor, with the simulation semantics of the firmwares
+    def handle_put(self, sensor, payload):
+        if sensor == "rfid_reader" or not payload:
+            return METHOD_NOT_ALLOWED if sensor == "rfid_reader" else BAD_REQUEST, None, b"", None
+        if sensor == "lid_sensor":
+            if payload in ("true", "false"):
+                self.set_lid(payload == "true")
+        elif sensor == "compactor_active":
+            if payload in ("true", "false"):
+                self.set_compactor(payload == "true")
+        elif sensor == "scale_sensor":
+            self.set_value(sensor, max(0.0, self.values[sensor] + parse_number(payload, float)))
+        else:
+            self.set_value(sensor, min(100, max(0, self.values[sensor] + parse_number(payload, int))))
+        return CHANGED, None, b"", None
+
+    def set_lid(self, is_open):
+        self.set_value("lid_sensor", is_open)
+        if "rfid_reader" in self.values:
+            self.set_value("rfid_reader", self.rng.choice(RFID_VALUES) if is_open else "No value")
+
+    # The compactor turns itself off after COMPACTOR_ACTIVE_DURATION
+    def set_compactor(self, active):
+        if active and self.compactor_timer is None:
+            self.compactor_timer = asyncio.get_running_loop().call_later(COMPACTOR_ACTIVE_DURATION,
+                                                                         self.set_compactor, False)
+        elif not active and self.compactor_timer is not None:
+            self.compactor_timer.cancel()
+            self.compactor_timer = None
+        self.set_value("compactor_active", active)
+
+    def set_value(self, sensor, value):
+        if self.values[sensor] == value:
+            return
+        self.values[sensor] = value
+        self.notify(sensor)
+
+    # Send a notification to the observers of the resources reporting the sensor
+    def notify(self, sensor):
+        if not self.observers:
+            return
+        self.observe_sequence = (self.observe_sequence + 1) & 0xFFFFFF
+        for (address, token), (path, content_format, _) in list(self.observers.items()):
+            sensors = self.resource_sensors(path)
+            if sensor not in sensors:
+                continue
+            mid = self.new_mid()
+            options = [(OPTION_OBSERVE, uint_bytes(self.observe_sequence)),
+                       (OPTION_CONTENT_FORMAT, uint_bytes(content_format))]
+            self.send(CoapMessage(TYPE_NON, CONTENT, mid, token, options,
+                                  self.payload(path, sensors, content_format)), address)
+            self.observers[(address, token)] = (path, content_format, mid)
+            self.stats.notifications += 1
+
+
+def parse_number(payload, number_type):
+    try:
+        return number_type(float(payload))
+    except ValueError:
+        return number_type(0)
+
+
+class BinDynamics:
+    """Value model of one bin: users open the lid and drop waste, the compactor runs when the bin is
+    almost full, and the bin is emptied when it is full."""
+
+    def __init__(self, nodes, rng, open_probability):
+        self.sensors = {sensor: node for node in nodes for sensor in node.values}
+        self.rng = rng
+        self.open_probability = open_probability
+
+    def node(self, sensor):
+        return self.sensors[sensor]
+
+    def value(self, sensor):
+        return self.node(sensor).values[sensor]
+
+    def step(self):
+        lid = self.node("lid_sensor")
+        if self.value("lid_sensor"):
+            # Waste is dropped when the lid closes
+            lid.set_lid(False)
+            self.node("scale_sensor").set_value("scale_sensor", self.value("scale_sensor") + self.rng.uniform(0.1, 2.0))
+            self.node("waste_level_sensor").set_value("waste_level_sensor",
+                                                      min(100, self.value("waste_level_sensor") + self.rng.randint(1, 5)))
+        elif self.rng.random() < self.open_probability:
+            lid.set_lid(True)
+
+        level = self.value("waste_level_sensor")
+        if level >= 100:
+            self.node("scale_sensor").set_value("scale_sensor", 0.0)
+            self.node("waste_level_sensor").set_value("waste_level_sensor", 0)
+        elif level >= 90 and not self.value("compactor_active"):
+            self.node("compactor_active").set_compactor(True)
+            self.node("waste_level_sensor").set_value("waste_level_sensor", level - 30)
+
+
+class RandomDynamics:
+    """Every value changes at every step, the worst case for change-driven traffic."""
+
+    def __init__(self, nodes, rng):
+        self.nodes = nodes
+        self.rng = rng
+
+    def step(self):
+        for node in self.nodes:
+            for sensor in node.values:
+                if sensor in ("lid_sensor", "compactor_active"):
+                    value = self.rng.random() < 0.5
+                elif sensor == "rfid_reader":
+                    value = self.rng.choice(RFID_VALUES)
+                elif sensor == "scale_sensor":
+                    value = self.rng.uniform(0, 100)
+                else:
+                    value = self.rng.randint(0, 100)
+                node.set_value(sensor, value)
+
+
+class Emulator:
+    """The sensor nodes of a number of bins, on consecutive UDP ports."""
+
+    def __init__(self, bins=1, layout="split", address="::", base_port=5701, link=None, dynamics="bin",
+                 open_probability=0.1, seed=None, on_request=None):
+        self.rng = random.Random(seed)
+        self.link = link or LinkModel()
+        if self.link.rng is None:
+            self.link.rng = self.rng
+        self.address = address
+        self.bins = []
+        port = base_port
+        for bin_index in range(bins):
+            nodes = []
+            for name, (sensors, collector_config) in NODE_LAYOUTS[layout].items():
+                nodes.append(EmulatedNode(bin_index, name, sensors, collector_config, port, self.link, on_request,
+                                          self.rng))
+                port += 1
+            self.bins.append(nodes)
+        self.nodes = [node for nodes in self.bins for node in nodes]
+
+        if dynamics == "bin":
+            self.dynamics = [BinDynamics(nodes, self.rng, open_probability) for nodes in self.bins]
+        elif dynamics == "random":
+            self.dynamics = [RandomDynamics(nodes, self.rng) for nodes in self.bins]
+        else:
+            self.dynamics = []
+
+    async def start(self):
+        loop = asyncio.get_running_loop()
+        for node in self.nodes:
+            await loop.create_datagram_endpoint(lambda node=node: node, local_addr=(self.address, node.port))
+
+    def close(self):
+        for node in self.nodes:
+            if node.transport:
+                node.transport.close()
+
+    # Update the values of every bin once per interval
+    async def run_dynamics(self, interval):
+        while True:
+            for dynamics in self.dynamics:
+                dynamics.step()
+            await asyncio.sleep(interval)
+
+    # Sensor addresses of a bin, in the format of the configuration response sent to the collector
+    def bin_configuration(self, bin_index, host_address):
+        configuration = {}
+        for node in self.bins[bin_index]:
+            for sensor in node.values:
+                if sensor in CONFIG_KEYS:
+                    configuration[CONFIG_KEYS[sensor]] = f"coap://[{host_address}]:{node.port}"
+        return configuration
+
+    def total_stats(self):
+        total = NodeStats()
+        for node in self.nodes:
+            for field in vars(total):
+                setattr(total, field, getattr(total, field) + getattr(node.stats, field))
+        return total
+
+
+async def report_stats(emulator, interval):
+    previous = vars(emulator.total_stats()).copy()
+    started = time.monotonic()
+    while True:
+        await asyncio.sleep(interval)
+        current = vars(emulator.total_stats())
+        rates = ", ".join(f"{field} {(current[field] - previous[field]) / interval:.1f}/s" for field in current)
+        logging.info(f"[{time.monotonic() - started:.0f}s] {rates}, observers "
+                     f"{sum(len(node.observers) for node in emulator.nodes)}")
+        previous = current.copy()
+
+
+async def main():
+    parser = argparse.ArgumentParser(description="Emulate the sensor nodes of many bins over CoAP")
+    parser.add_argument("--bins", type=int, default=1, help="number of bins to emulate")
+    parser.add_argument("--layout", choices=NODE_LAYOUTS, default="split", help="firmwares of each bin")
+    parser.add_argument("--address", default="::", help="address to bind the nodes to")
+    parser.add_argument("--base-port", type=int, default=5701, help="UDP port of the first node")
+    parser.add_argument("--host-address", default="fd00::1", help="address of this host as seen by the collectors")
+    parser.add_argument("--latency-ms", type=float, default=0.0, help="mean one-way latency of a datagram")
+    parser.add_argument("--jitter-ms", type=float, default=0.0, help="standard deviation of the latency")
+    parser.add_argument("--loss", type=float, default=0.0, help="probability that a datagram is lost")
+    parser.add_argument("--dynamics", choices=["bin", "random", "static"], default="bin", help="value model")
+    parser.add_argument("--open-probability", type=float, default=0.1, help="chance per step that a lid opens")
+    parser.add_argument("--update-interval", type=float, default=1.0, help="seconds between value updates")
+    parser.add_argument("--seed", type=int, help="seed of the value and link models")
+    parser.add_argument("--config-out", help="write the sensor addresses of every bin to this JSON file")
+    parser.add_argument("--stats-interval", type=float, default=10.0, help="seconds between traffic reports")
+    args = parser.parse_args()
+
+    logging.basicConfig(level=logging.INFO, format="%(asctime)s %(message)s")
+    emulator = Emulator(args.bins, args.layout, args.address, args.base_port,
+                        LinkModel(args.latency_ms, args.jitter_ms, args.loss), args.dynamics,
+                        args.open_probability, args.seed)
+    await emulator.start()
+
+    configuration = {f"bin_{index + 1}": emulator.bin_configuration(index, args.host_address)
+                     for index in range(args.bins)}
+    if args.config_out:
+        with open(args.config_out, "w") as config_file:
+            json.dump(configuration, config_file, indent=2)
+    logging.info(f"Emulating {len(emulator.nodes)} nodes for {args.bins} bins on UDP ports "
+                 f"{args.base_port}-{args.base_port + len(emulator.nodes) - 1}")
+
+    await asyncio.gather(emulator.run_dynamics(args.update_interval), report_stats(emulator, args.stats_interval))
+
+
+if __name__ == "__main__":
+    asyncio.run(main())
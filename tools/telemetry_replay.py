@@ -0,0 +1,306 @@
+import argparse
+import gzip
+import heapq
+import json
+import random
+import signal
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+# Record and replay of the MQTT telemetry, the standard load for benchmarking the cloud path.
+#
+#   record: capture the topics (by default "bins" and "config/request") into a recording file
+#   replay: publish a recording into a broker at real time, N times faster, at a fixed rate or as fast as possible,
+#           optionally multiplied into thousands of synthetic bins, and report the ingest progress
+#           published by scrap_cloud.py on "ingest/stats" (messages processed, so throughput and backlog)
+#
+# Recording format: the magic "MQTTREC1", then records starting with a type byte.
+#   0x00 topic definition:  topic id (varint), length (varint), UTF-8 topic
+#   0x01 message:           time since the previous message in microseconds (varint), topic id (varint),
+#                           payload length (varint), payload
+# Files ending in .gz are gzip compressed, which shrinks the repeated JSON keys of the bin messages.
+
+MAGIC = b"MQTTREC1"
+RECORD_TOPIC = 0x00
+RECORD_MESSAGE = 0x01
+DEFAULT_TOPICS = ["bins", "config/request"]
+INGEST_STATS_TOPIC = "ingest/stats"
+# Only the bin updates are counted by the ingest stats, the backlog leaves the other topics out
+UPDATES_TOPIC = "bins"
+
+
+def open_recording(path, mode):
+    return gzip.open(path, mode) if path.endswith(".gz") else open(path, mode)
+
+
+def write_varint(output, value):
+    data = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            data.append(byte | 0x80)
+        else:
+            data.append(byte)
+            output.write(data)
+            return
+
+
+def read_varint(source):
+    value = shift = 0
+    while True:
+        byte = source.read(1)
+        if not byte:
+            raise EOFError
+        value |= (byte[0] & 0x7F) << shift
+        if not byte[0] & 0x80:
+            return value
+        shift += 7
+
+
+class RecordingWriter:
+    def __init__(self, path):
+        self.output = open_recording(path, "wb")
+        self.output.write(MAGIC)
+        self.topics = {}
+        self.previous = None
+        self.count = 0
+
+    def write(self, timestamp, topic, payload):
+        if topic not in self.topics:
+            self.topics[topic] = len(self.topics)
+            encoded = topic.encode()
+            self.output.write(bytes([RECORD_TOPIC]))
+            write_varint(self.output, self.topics[topic])
+            write_varint(self.output, len(encoded))
+            self.output.write(encoded)
+        delta = 0 if self.previous is None else max(0, int((timestamp - self.previous) * 1e6))
+        self.previous = timestamp
+        self.output.write(bytes([RECORD_MESSAGE]))
+        write_varint(self.output, delta)
+        write_varint(self.output, self.topics[topic])
+        write_varint(self.output, len(payload))
+        self.output.write(payload)
+        self.count += 1
+
+    def close(self):
+        self.output.close()
+
+
+# Messages of a recording as (seconds since the first message, topic, payload)
+def read_recording(path):
+    with open_recording(path, "rb") as source:
+        if source.read(len(MAGIC)) != MAGIC:
+            raise ValueError(f"{path} is not a telemetry recording")
+        topics = {}
+        offset = 0.0
+        while True:
+            try:
+                record_type = source.read(1)
+                if not record_type:
+                    return
+                if record_type[0] == RECORD_TOPIC:
+                    topic_id = read_varint(source)
+                    topics[topic_id] = source.read(read_varint(source)).decode()
+                elif record_type[0] == RECORD_MESSAGE:
+                    offset += read_varint(source) / 1e6
+                    topic = topics[read_varint(source)]
+                    yield offset, topic, source.read(read_varint(source))
+                else:
+                    raise ValueError(f"Unknown record type {record_type[0]} in {path}")
+            except EOFError:
+                return
+
+
+def record(args):
+    writer = RecordingWriter(args.file)
+    lock = threading.Lock()
+    stop = threading.Event()
+
+    def on_message(client, userdata, msg):
+        with lock:
+            writer.write(time.time(), msg.topic, msg.payload)
+
+    client = mqtt.Client()
+    client.on_connect = lambda client, userdata, flags, rc: client.subscribe([(topic, 0) for topic in args.topics])
+    client.on_message = on_message
+    client.connect(args.broker, args.port)
+    client.loop_start()
+    signal.signal(signal.SIGINT, lambda signum, frame: stop.set())
+    signal.signal(signal.SIGTERM, lambda signum, frame: stop.set())
+
+    started = time.time()
+    while not stop.wait(1.0) and (not args.duration or time.time() - started < args.duration):
+        with lock:
+            print(f"\rRecorded {writer.count} messages", end="", flush=True)
+    client.loop_stop()
+    with lock:
+        writer.close()
+    print(f"\rRecorded {writer.count} messages in {time.time() - started:.0f} s to {args.file}")
+
+
+# Messages to publish, as (offset, topic, payload). Every synthetic bin replays the messages of one
+# recorded bin under its own bin_id, shifted by a random phase so that the bins do not publish in bursts.
+def build_schedule(messages, args):
+    if not args.bins:
+        return [(offset, topic, payload) for offset, topic, payload in messages
+                if topic != "config/request" or args.include_config]
+
+    streams = {}
+    for offset, topic, payload in messages:
+        if topic != UPDATES_TOPIC:
+            continue
+        try:
+            data = json.loads(payload)
+        except ValueError:
+            continue
+        streams.setdefault(data.get("bin_id"), []).append((offset, data))
+    if not streams:
+        raise ValueError("The recording has no bin messages to use as template")
+
+    rng = random.Random(args.seed)
+    templates = list(streams.values())
+    period = max(stream[-1][0] for stream in templates) / max(1, max(len(stream) for stream in templates))
+    schedules = []
+    for index in range(args.bins):
+        stream = templates[index % len(templates)]
+        phase = rng.uniform(0, period) - stream[0][0]
+        bin_id = f"{args.bin_prefix}{index + 1:05d}"
+        schedules.append([(offset + phase, UPDATES_TOPIC, json.dumps({**data, "bin_id": bin_id}, separators=(",", ":")).encode())
+                          for offset, data in stream])
+    return list(heapq.merge(*schedules, key=lambda message: message[0]))
+
+
+class IngestMonitor:
+    """Follows the ingest/stats messages of scrap_cloud.py, counting from the start of the replay. The
+    instances of a sharded ingest are added up."""
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.baselines = {}
+        self.shards = {}
+        self.updated = None
+
+    @property
+    def processed(self):
+        return sum(self.shards.values())
+
+    def on_stats(self, payload):
+        stats = json.loads(payload)
+        shard = stats.get("shard", 0)
+        with self.lock:
+            baseline = self.baselines.setdefault(shard, stats["processed"])
+            self.shards[shard] = stats["processed"] - baseline
+            self.updated = time.monotonic()
+
+
+def replay(args):
+    messages = list(read_recording(args.file))
+    schedule = build_schedule(messages, args)
+    if not schedule:
+        print("Nothing to replay")
+        return
+
+    monitor = IngestMonitor()
+    client = mqtt.Client()
+    client.on_connect = lambda client, userdata, flags, rc: client.subscribe(INGEST_STATS_TOPIC)
+    client.on_message = lambda client, userdata, msg: monitor.on_stats(msg.payload)
+    client.max_queued_messages_set(0)
+    client.connect(args.broker, args.port)
+    client.loop_start()
+    time.sleep(args.warmup)
+
+    speed = args.speed
+    pace = f"{args.rate:.0f} msg/s" if args.rate else f"{speed}x" if speed else "max speed"
+    print(f"Replaying {len(schedule)} messages ({schedule[-1][0] - schedule[0][0]:.0f} s recorded) at {pace}")
+    first_offset = schedule[0][0]
+    started = time.monotonic()
+    next_report = started + args.report_interval
+    last_report = (started, 0, 0)
+    published = 0
+    updates = 0
+    for offset, topic, payload in schedule:
+        if args.rate or speed:
+            target = published / args.rate if args.rate else (offset - first_offset) / speed
+            delay = target - (time.monotonic() - started)
+            if delay > 0:
+                time.sleep(delay)
+        client.publish(topic, payload, qos=args.qos)
+        published += 1
+        updates += topic == UPDATES_TOPIC
+        if time.monotonic() >= next_report:
+            last_report = report_progress(monitor, updates, last_report)
+            next_report += args.report_interval
+
+    elapsed = time.monotonic() - started
+    print(f"Published {published} messages in {elapsed:.1f} s ({published / elapsed:.0f} msg/s), "
+          f"{updates} bin updates")
+
+    # Wait for the ingest to drain the backlog, as long as it makes progress
+    deadline = time.monotonic() + args.drain_timeout
+    while time.monotonic() < deadline:
+        with monitor.lock:
+            processed = monitor.processed
+        if monitor.updated is None or processed >= updates:
+            break
+        time.sleep(args.report_interval)
+        last_report = report_progress(monitor, updates, last_report)
+
+    with monitor.lock:
+        if monitor.updated is None:
+            print(f"No {INGEST_STATS_TOPIC} received, is scrap_cloud.py running?")
+        else:
+            total = time.monotonic() - started
+            print(f"Ingest processed {monitor.processed} messages in {total:.1f} s "
+                  f"({monitor.processed / total:.0f} msg/s), backlog {updates - monitor.processed}")
+    client.loop_stop()
+
+
+# Rates and backlog of the bin updates
+def report_progress(monitor, updates, last_report):
+    now = time.monotonic()
+    with monitor.lock:
+        processed = monitor.processed
+    last_time, last_updates, last_processed = last_report
+    interval = now - last_time
+    print(f"published {(updates - last_updates) / interval:.0f} msg/s, "
+          f"ingested {(processed - last_processed) / interval:.0f} msg/s, backlog {updates - processed}")
+    return now, updates, processed
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Record and replay the MQTT telemetry of the bins")
+    parser.add_argument("--broker", default="localhost", help="MQTT broker address")
+    parser.add_argument("--port", type=int, default=1883, help="MQTT broker port")
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    record_parser = commands.add_parser("record", help="capture the telemetry into a recording")
+    record_parser.add_argument("file", help="recording file, compressed if it ends in .gz")
+    record_parser.add_argument("--topics", nargs="+", default=DEFAULT_TOPICS, help="topics to record")
+    record_parser.add_argument("--duration", type=float, help="seconds to record, until Ctrl-C by default")
+
+    replay_parser = commands.add_parser("replay", help="publish a recording into the broker")
+    replay_parser.add_argument("file", help="recording file")
+    replay_parser.add_argument("--speed", type=float, default=1.0, help="replay speed factor, 0 for max speed")
+    replay_parser.add_argument("--rate", type=float, help="publish at this many messages per second instead")
+    replay_parser.add_argument("--bins", type=int, help="synthesize this many bins from the recorded ones")
+    replay_parser.add_argument("--bin-prefix", default="sim", help="bin_id prefix of the synthetic bins")
+    replay_parser.add_argument("--seed", type=int, default=1, help="seed of the synthetic bin phases")
+    replay_parser.add_argument("--include-config", action="store_true", help="also replay the configuration requests")
+    replay_parser.add_argument("--qos", type=int, default=0, choices=[0, 1], help="QoS of the replayed messages")
+    replay_parser.add_argument("--report-interval", type=float, default=1.0, help="seconds between progress reports")
+    replay_parser.add_argument("--warmup", type=float, default=1.0, help="seconds to wait for the ingest stats")
+    replay_parser.add_argument("--drain-timeout", type=float, default=60.0,
+                               help="seconds to wait for the ingest to catch up after the replay")
+    args = parser.parse_args()
+
+    if args.command == "record":
+        record(args)
+    else:
+        replay(args)
+
+
+if __name__ == "__main__":
+    main()
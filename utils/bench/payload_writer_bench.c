@@ -0,0 +1,101 @@
+// Native microbenchmark: payload_writer against the snprintf formatting it replaced,
+// on the payloads built most often by the motes (sensor GET, node state, aggregated MQTT message).
+// Both outputs are printed first so that differences are visible, then both are timed.
+#include "payload_writer.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define ITERATIONS 2000000
+
+static char output[256];
+
+static size_t snprintf_sensor_get(void) {
+    return snprintf(output, sizeof(output), "{\"%s\":{\"value\":\"%s\"}}", "scale_sensor", "32.50");
+}
+
+static size_t writer_sensor_get(void) {
+    payload_writer_t writer;
+    payload_writer_init(&writer, output, sizeof(output));
+    payload_write_char(&writer, '{');
+    payload_write_key(&writer, "scale_sensor");
+    payload_write_char(&writer, '{');
+    payload_write_string_field(&writer, "value", "32.50");
+    payload_write_str(&writer, "}}");
+    return writer.length;
+}
+
+static size_t snprintf_scale_value(void) {
+    float value = 32.5f;
+    int integer_part = (int)value;
+    int decimal_part = (int)((value - integer_part) * 100);
+    return snprintf(output, sizeof(output), "%d.%02d", integer_part, decimal_part);
+}
+
+static size_t writer_scale_value(void) {
+    float value = 32.5f;
+    payload_writer_t writer;
+    payload_writer_init(&writer, output, sizeof(output));
+    payload_write_fixed(&writer, payload_round_fixed(value, 2), 2);
+    return writer.length;
+}
+
+static size_t snprintf_aggregated(void) {
+    return snprintf(output, sizeof(output),
+                    "{\"bin_id\":\"%s\",\"rfid\":\"%s\",\"lid_sensor\":\"%s\",\"compactor_sensor\":\"%s\","
+                    "\"scale\":\"%s\",\"waste_level_sensor\":\"%s\"}",
+                    "bin_1", "A1B2C3D4", "closed", "off", "32.50", "75");
+}
+
+static size_t writer_aggregated(void) {
+    payload_writer_t writer;
+    payload_writer_init(&writer, output, sizeof(output));
+    payload_write_char(&writer, '{');
+    payload_write_string_field(&writer, "bin_id", "bin_1");
+    payload_write_string_field(&writer, "rfid", "A1B2C3D4");
+    payload_write_string_field(&writer, "lid_sensor", "closed");
+    payload_write_string_field(&writer, "compactor_sensor", "off");
+    payload_write_string_field(&writer, "scale", "32.50");
+    payload_write_string_field(&writer, "waste_level_sensor", "75");
+    payload_write_char(&writer, '}');
+    return writer.length;
+}
+
+static double elapsed_ns(struct timespec *start, struct timespec *stop) {
+    return (stop->tv_sec - start->tv_sec) * 1e9 + (stop->tv_nsec - start->tv_nsec);
+}
+
+static double time_builder(size_t (*builder)(void)) {
+    struct timespec start, stop;
+    volatile size_t sink = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < ITERATIONS; i++) {
+        sink += builder();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    (void)sink;
+    return elapsed_ns(&start, &stop) / ITERATIONS;
+}
+
+static void compare(const char *name, size_t (*reference)(void), size_t (*builder)(void)) {
+    char expected[sizeof(output)];
+
+    reference();
+    strcpy(expected, output);
+    builder();
+    printf("%s\n  snprintf: %s\n  writer:   %s%s\n", name, expected, output,
+           strcmp(expected, output) == 0 ? "" : "  (DIFFERENT)");
+
+    double reference_ns = time_builder(reference);
+    double builder_ns = time_builder(builder);
+    printf("  snprintf %.1f ns, writer %.1f ns, speedup %.2fx\n\n", reference_ns, builder_ns,
+           reference_ns / builder_ns);
+}
+
+int main(void) {
+    compare("sensor GET", snprintf_sensor_get, writer_sensor_get);
+    compare("scale value", snprintf_scale_value, writer_scale_value);
+    compare("aggregated message", snprintf_aggregated, writer_aggregated);
+    return 0;
+}
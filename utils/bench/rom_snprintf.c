@@ -0,0 +1,12 @@
+// Aggregated message built with snprintf, linked alone to measure its code size (make rom)
+#include <stdio.h>
+
+char output[256];
+volatile const char *value = "32.50";
+
+int main(void) {
+    return snprintf(output, sizeof(output),
+                    "{\"bin_id\":\"%s\",\"rfid\":\"%s\",\"lid_sensor\":\"%s\",\"compactor_sensor\":\"%s\","
+                    "\"scale\":\"%s\",\"waste_level_sensor\":\"%s\"}",
+                    value, value, value, value, value, value);
+}
@@ -0,0 +1,19 @@
+// Aggregated message built with payload_writer, linked alone to measure its code size (make rom)
+#include "payload_writer.h"
+
+char output[256];
+volatile const char *value = "32.50";
+
+int main(void) {
+    payload_writer_t writer;
+    payload_writer_init(&writer, output, sizeof(output));
+    payload_write_char(&writer, '{');
+    payload_write_string_field(&writer, "bin_id", (const char *)value);
+    payload_write_string_field(&writer, "rfid", (const char *)value);
+    payload_write_string_field(&writer, "lid_sensor", (const char *)value);
+    payload_write_string_field(&writer, "compactor_sensor", (const char *)value);
+    payload_write_string_field(&writer, "scale", (const char *)value);
+    payload_write_string_field(&writer, "waste_level_sensor", (const char *)value);
+    payload_write_char(&writer, '}');
+    return (int)writer.length;
+}
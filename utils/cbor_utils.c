@@ -0,0 +1,115 @@
+#include "cbor_utils.h"
+#include <string.h>
+
+#define CBOR_MAJOR_TEXT 3
+#define CBOR_MAJOR_MAP 5
+
+// Write the initial byte of a data item with its argument, using the shortest encoding
+static void cbor_write_head(cbor_writer_t *writer, uint8_t major, size_t value) {
+    uint8_t head[5];
+    size_t head_length;
+
+    if (value < 24) {
+        head[0] = (major << 5) | value;
+        head_length = 1;
+    } else if (value <= 0xff) {
+        head[0] = (major << 5) | 24;
+        head[1] = value;
+        head_length = 2;
+    } else if (value <= 0xffff) {
+        head[0] = (major << 5) | 25;
+        head[1] = value >> 8;
+        head[2] = value;
+        head_length = 3;
+    } else {
+        head[0] = (major << 5) | 26;
+        head[1] = value >> 24;
+        head[2] = value >> 16;
+        head[3] = value >> 8;
+        head[4] = value;
+        head_length = 5;
+    }
+
+    if (writer->overflow || writer->length + head_length > writer->size) {
+        writer->overflow = true;
+        return;
+    }
+    memcpy(writer->buffer + writer->length, head, head_length);
+    writer->length += head_length;
+}
+
+void cbor_writer_init(cbor_writer_t *writer, uint8_t *buffer, size_t size) {
+    writer->buffer = buffer;
+    writer->size = size;
+    writer->length = 0;
+    writer->overflow = false;
+}
+
+void cbor_write_map(cbor_writer_t *writer, size_t pairs) {
+    cbor_write_head(writer, CBOR_MAJOR_MAP, pairs);
+}
+
+void cbor_write_text(cbor_writer_t *writer, const char *text, size_t length) {
+    cbor_write_head(writer, CBOR_MAJOR_TEXT, length);
+
+    if (writer->overflow || writer->length + length > writer->size) {
+        writer->overflow = true;
+        return;
+    }
+    memcpy(writer->buffer + writer->length, text, length);
+    writer->length += length;
+}
+
+// Read the initial byte of a data item, checking its major type. Indefinite lengths are not supported
+static bool cbor_read_head(cbor_reader_t *reader, uint8_t major, size_t *value) {
+    if (reader->position >= reader->length || (reader->data[reader->position] >> 5) != major) {
+        return false;
+    }
+
+    uint8_t info = reader->data[reader->position++] & 0x1f;
+    size_t extra_bytes;
+
+    if (info < 24) {
+        *value = info;
+        return true;
+    } else if (info == 24) {
+        extra_bytes = 1;
+    } else if (info == 25) {
+        extra_bytes = 2;
+    } else if (info == 26) {
+        extra_bytes = 4;
+    } else {
+        return false;
+    }
+
+    if (reader->position + extra_bytes > reader->length) {
+        return false;
+    }
+
+    *value = 0;
+    while (extra_bytes-- > 0) {
+        *value = (*value << 8) | reader->data[reader->position++];
+    }
+    return true;
+}
+
+void cbor_reader_init(cbor_reader_t *reader, const uint8_t *data, size_t length) {
+    reader->data = data;
+    reader->length = length;
+    reader->position = 0;
+}
+
+bool cbor_read_map(cbor_reader_t *reader, size_t *pairs) {
+    return cbor_read_head(reader, CBOR_MAJOR_MAP, pairs);
+}
+
+bool cbor_read_text(cbor_reader_t *reader, const char **text, size_t *length) {
+    if (!cbor_read_head(reader, CBOR_MAJOR_TEXT, length) ||
+        *length > reader->length - reader->position) {
+        return false;
+    }
+
+    *text = (const char *)reader->data + reader->position;
+    reader->position += *length;
+    return true;
+}
@@ -0,0 +1,36 @@
+#ifndef CBOR_UTILS_H
+#define CBOR_UTILS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Minimal CBOR (RFC 8949) support for the binary representation of sensor readings:
+// only maps with text string keys and text string values are needed.
+
+// Writer over a bounded buffer, overflow is sticky and checked once at the end
+typedef struct {
+    uint8_t *buffer;
+    size_t size;
+    size_t length;
+    bool overflow;
+} cbor_writer_t;
+
+// Reader over a received payload
+typedef struct {
+    const uint8_t *data;
+    size_t length;
+    size_t position;
+} cbor_reader_t;
+
+// Encoding Function Prototypes
+void cbor_writer_init(cbor_writer_t *writer, uint8_t *buffer, size_t size);
+void cbor_write_map(cbor_writer_t *writer, size_t pairs);
+void cbor_write_text(cbor_writer_t *writer, const char *text, size_t length);
+
+// Decoding Function Prototypes, they return false on malformed or unexpected input
+void cbor_reader_init(cbor_reader_t *reader, const uint8_t *data, size_t length);
+bool cbor_read_map(cbor_reader_t *reader, size_t *pairs);
+bool cbor_read_text(cbor_reader_t *reader, const char **text, size_t *length);
+
+#endif // CBOR_UTILS_H
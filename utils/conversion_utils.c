@@ -1,5 +1,5 @@
 #include "conversion_utils.h"
-#include <stdio.h>
+#include "payload_writer.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -7,7 +7,9 @@
 // Boolean Conversion
 void boolean_to_string(char *buffer, size_t size, void *state) {
     bool value = *(bool *)state;
-    snprintf(buffer, size, "%s", value ? "true" : "false");
+    payload_writer_t writer;
+    payload_writer_init(&writer, buffer, size);
+    payload_write_str(&writer, value ? "true" : "false");
 }
 
 void boolean_update_state(const char *payload, void *state) {
@@ -16,7 +18,9 @@ void boolean_update_state(const char *payload, void *state) {
 
 // Integer Conversion
 void integer_to_string(char *buffer, size_t size, void *state) {
-    snprintf(buffer, size, "%d", *(int *)state);
+    payload_writer_t writer;
+    payload_writer_init(&writer, buffer, size);
+    payload_write_int(&writer, *(int *)state);
 }
 
 void integer_update_state(const char *payload, void *state) {
@@ -0,0 +1,114 @@
+#include "endpoint_registry.h"
+#include "ringlog.h"
+#include <string.h>
+
+static endpoint_entry_t entries[ENDPOINT_REGISTRY_SIZE];
+static uint8_t failure_threshold = ENDPOINT_REGISTRY_FAILURE_THRESHOLD;
+
+void endpoint_registry_reset(void) {
+    memset(entries, 0, sizeof(entries));
+}
+
+void endpoint_registry_set_failure_threshold(uint8_t threshold) {
+    failure_threshold = threshold > 0 ? threshold : 1;
+}
+
+endpoint_entry_t *endpoint_registry_add(const coap_endpoint_t *endpoint) {
+    endpoint_entry_t *entry = NULL;
+
+    for (size_t i = 0; i < ENDPOINT_REGISTRY_SIZE; i++) {
+        if (entries[i].used && coap_endpoint_cmp(&entries[i].endpoint, endpoint)) {
+            return &entries[i];
+        }
+    }
+
+    // A free entry, or else the one not held that responded least recently (never is oldest)
+    for (size_t i = 0; i < ENDPOINT_REGISTRY_SIZE; i++) {
+        if (!entries[i].used) {
+            entry = &entries[i];
+            break;
+        }
+        if (entries[i].holds == 0 && (entry == NULL || !entries[i].seen ||
+                                      (entry->seen && CLOCK_LT(entries[i].last_seen, entry->last_seen)))) {
+            entry = &entries[i];
+        }
+    }
+    if (entry == NULL) {
+        RINGLOG_WARN(RL_NODE_REGISTRY_FULL, ENDPOINT_REGISTRY_SIZE);
+        return NULL;
+    }
+
+    memset(entry, 0, sizeof(*entry));
+    coap_endpoint_copy(&entry->endpoint, endpoint);
+    entry->used = true;
+    // The later records of the node only carry its index
+    RINGLOG_INFO_STR((const char *)entry->endpoint.ipaddr.u8, sizeof(entry->endpoint.ipaddr.u8), RL_NODE_ADDED,
+                     (int32_t)(entry - entries), uip_ntohs(entry->endpoint.port));
+    return entry;
+}
+
+endpoint_entry_t *endpoint_registry_parse(const char *text, size_t len) {
+    coap_endpoint_t endpoint;
+
+    if (len == 0 || !coap_endpoint_parse(text, len, &endpoint)) {
+        return NULL;
+    }
+    return endpoint_registry_add(&endpoint);
+}
+
+void endpoint_registry_hold(endpoint_entry_t *entry) {
+    if (entry != NULL && entry->holds < UINT8_MAX) {
+        entry->holds++;
+    }
+}
+
+void endpoint_registry_release(endpoint_entry_t *entry) {
+    if (entry != NULL && entry->holds > 0) {
+        entry->holds--;
+    }
+}
+
+bool endpoint_registry_is_up(const endpoint_entry_t *entry) {
+    return entry->failures < failure_threshold;
+}
+
+bool endpoint_registry_allow(const endpoint_entry_t *entry) {
+    return endpoint_registry_is_up(entry) || !CLOCK_LT(clock_time(), entry->next_probe);
+}
+
+void endpoint_registry_success(endpoint_entry_t *entry, clock_time_t elapsed) {
+    uint32_t sample_ms = (uint32_t)elapsed * 1000 / CLOCK_SECOND;
+
+    if (sample_ms > UINT16_MAX) {
+        sample_ms = UINT16_MAX;
+    }
+    // Exponentially weighted, 1/8 of the new sample as for the RTT estimate of TCP
+    entry->srtt_ms = entry->seen ? (uint16_t)((7 * (uint32_t)entry->srtt_ms + sample_ms) / 8) : (uint16_t)sample_ms;
+    if (!endpoint_registry_is_up(entry)) {
+        RINGLOG_INFO(RL_NODE_BACK, (int32_t)(entry - entries), entry->failures);
+    }
+    entry->failures = 0;
+    entry->seen = true;
+    entry->last_seen = clock_time();
+}
+
+void endpoint_registry_failure(endpoint_entry_t *entry) {
+    clock_time_t backoff = ENDPOINT_REGISTRY_PROBE_MIN;
+
+    if (entry->failures < UINT8_MAX) {
+        entry->failures++;
+    }
+    if (endpoint_registry_is_up(entry)) {
+        return;
+    }
+
+    for (uint8_t i = failure_threshold; i < entry->failures && backoff < ENDPOINT_REGISTRY_PROBE_MAX; i++) {
+        backoff *= 2;
+    }
+    if (backoff > ENDPOINT_REGISTRY_PROBE_MAX) {
+        backoff = ENDPOINT_REGISTRY_PROBE_MAX;
+    }
+    entry->next_probe = clock_time() + backoff;
+
+    RINGLOG_WARN(RL_NODE_DOWN, (int32_t)(entry - entries), entry->failures, (int32_t)(backoff / CLOCK_SECOND));
+}
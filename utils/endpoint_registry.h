@@ -0,0 +1,77 @@
+#ifndef ENDPOINT_REGISTRY_H
+#define ENDPOINT_REGISTRY_H
+
+#include "contiki.h"
+#include "coap-engine.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Registry of the CoAP nodes a firmware sends requests to, with their health. Endpoints are parsed once,
+// when they are configured, and every exchange is reported back to the registry.
+// A node failing ENDPOINT_REGISTRY_FAILURE_THRESHOLD exchanges in a row is taken as down (circuit open):
+// requests to it are skipped, except for a probe after a backoff that doubles with every failed probe,
+// from ENDPOINT_REGISTRY_PROBE_MIN up to ENDPOINT_REGISTRY_PROBE_MAX. A response closes the circuit.
+
+// Nodes tracked, when full the node that responded least recently and is not held is replaced
+#ifdef ENDPOINT_REGISTRY_CONF_SIZE
+#define ENDPOINT_REGISTRY_SIZE ENDPOINT_REGISTRY_CONF_SIZE
+#else
+#define ENDPOINT_REGISTRY_SIZE 4
+#endif
+
+// A failed confirmable exchange has already gone through all the CoAP retransmissions. The default of
+// endpoint_registry_set_failure_threshold
+#ifdef ENDPOINT_REGISTRY_CONF_FAILURE_THRESHOLD
+#define ENDPOINT_REGISTRY_FAILURE_THRESHOLD ENDPOINT_REGISTRY_CONF_FAILURE_THRESHOLD
+#else
+#define ENDPOINT_REGISTRY_FAILURE_THRESHOLD 1
+#endif
+
+#ifdef ENDPOINT_REGISTRY_CONF_PROBE_MIN
+#define ENDPOINT_REGISTRY_PROBE_MIN ENDPOINT_REGISTRY_CONF_PROBE_MIN
+#else
+#define ENDPOINT_REGISTRY_PROBE_MIN (CLOCK_SECOND * 5)
+#endif
+
+#ifdef ENDPOINT_REGISTRY_CONF_PROBE_MAX
+#define ENDPOINT_REGISTRY_PROBE_MAX ENDPOINT_REGISTRY_CONF_PROBE_MAX
+#else
+#define ENDPOINT_REGISTRY_PROBE_MAX (CLOCK_SECOND * 300)
+#endif
+
+typedef struct {
+    coap_endpoint_t endpoint;
+    clock_time_t last_seen; // time of the last response, when seen is set
+    clock_time_t next_probe; // while the circuit is open, time the next request is let through
+    uint16_t srtt_ms; // smoothed response time, over about the last 8 exchanges
+    uint8_t failures; // consecutive exchanges without response
+    uint8_t holds; // pointers kept by the firmware, the entry is not replaced while held
+    bool seen;
+    bool used;
+} endpoint_entry_t;
+
+void endpoint_registry_reset(void);
+
+// Failed exchanges in a row that take a node down, at least 1. Applies to the nodes already tracked
+void endpoint_registry_set_failure_threshold(uint8_t threshold);
+
+// Entry of a node, added when it is not tracked yet. NULL when every entry is held
+endpoint_entry_t *endpoint_registry_add(const coap_endpoint_t *endpoint);
+// Same from the text of an endpoint, e.g. coap://[fd00::202:2:2:2], NULL when it does not parse
+endpoint_entry_t *endpoint_registry_parse(const char *text, size_t len);
+
+// A firmware keeping the pointer to an entry beyond the current call holds it, and releases it when it
+// keeps another. Either accepts NULL
+void endpoint_registry_hold(endpoint_entry_t *entry);
+void endpoint_registry_release(endpoint_entry_t *entry);
+
+// Whether a request can be sent: the circuit is closed, or open and the probe is due
+bool endpoint_registry_allow(const endpoint_entry_t *entry);
+bool endpoint_registry_is_up(const endpoint_entry_t *entry);
+
+// Outcome of an exchange, the elapsed time is measured from the first transmission
+void endpoint_registry_success(endpoint_entry_t *entry, clock_time_t elapsed);
+void endpoint_registry_failure(endpoint_entry_t *entry);
+
+#endif // ENDPOINT_REGISTRY_H
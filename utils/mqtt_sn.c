@@ -0,0 +1,343 @@
+#include "mqtt_sn.h"
+#include "net/ipv6/simple-udp.h"
+#include "sys/ctimer.h"
+#include "ringlog.h"
+#include <string.h>
+
+// Message types (MQTT-SN 1.2, section 5.2.2)
+#define MSG_CONNECT 0x04
+#define MSG_CONNACK 0x05
+#define MSG_PUBLISH 0x0C
+#define MSG_PUBACK 0x0D
+#define MSG_SUBSCRIBE 0x12
+#define MSG_SUBACK 0x13
+#define MSG_PINGREQ 0x16
+#define MSG_PINGRESP 0x17
+#define MSG_DISCONNECT 0x18
+
+#define FLAG_DUP 0x80
+#define FLAG_QOS_SHIFT 5
+#define FLAG_CLEAN_SESSION 0x04
+#define FLAG_TOPIC_NORMAL 0x00
+#define FLAG_TOPIC_PREDEFINED 0x01
+#define PROTOCOL_ID 0x01
+#define RC_ACCEPTED 0x00
+
+#define STATE_DISCONNECTED 0
+#define STATE_CONNECTING 1
+#define STATE_CONNECTED 2
+
+static struct simple_udp_connection udp;
+static uint8_t *packet;
+static uint16_t packet_size;
+static const char *client_id;
+static mqtt_sn_callback_t callback;
+
+static uip_ipaddr_t gateway_addr;
+static uint16_t gateway_port;
+static clock_time_t keep_alive;
+static uint8_t state;
+static uint16_t last_msg_id;
+
+// One timer for the CONNECT retries and the keep-alive
+static struct ctimer timer;
+static clock_time_t last_sent;
+static bool ping_pending;
+static uint8_t retries;
+
+static void receive(struct simple_udp_connection *c, const uip_ipaddr_t *source_addr, uint16_t source_port,
+                    const uip_ipaddr_t *dest_addr, uint16_t dest_port, const uint8_t *data, uint16_t length);
+
+void mqtt_sn_init(uint8_t *buffer, uint16_t size, const char *id, mqtt_sn_callback_t event_callback) {
+    packet = buffer;
+    packet_size = size;
+    client_id = id;
+    callback = event_callback;
+    state = STATE_DISCONNECTED;
+    simple_udp_register(&udp, MQTT_SN_LOCAL_PORT, NULL, 0, receive);
+}
+
+// Header of a message with body_length bytes after the type: the length takes 3 bytes from 256 on.
+// Returns the offset of the body
+static uint16_t write_header(uint8_t type, uint16_t body_length) {
+    uint16_t length = body_length + 2;
+
+    if (length < 256) {
+        packet[0] = (uint8_t)length;
+        packet[1] = type;
+        return 2;
+    }
+    length += 2;
+    packet[0] = 0x01;
+    packet[1] = (uint8_t)(length >> 8);
+    packet[2] = (uint8_t)length;
+    packet[3] = type;
+    return 4;
+}
+
+static void put_u16(uint8_t *at, uint16_t value) {
+    at[0] = (uint8_t)(value >> 8);
+    at[1] = (uint8_t)value;
+}
+
+static uint16_t get_u16(const uint8_t *at) {
+    return (uint16_t)(at[0] << 8 | at[1]);
+}
+
+static void send_packet(uint16_t length) {
+    simple_udp_sendto_port(&udp, packet, length, &gateway_addr, gateway_port);
+    last_sent = clock_time();
+}
+
+static void send_empty(uint8_t type) {
+    send_packet(write_header(type, 0));
+}
+
+static void send_connect(void) {
+    size_t id_length = strlen(client_id);
+    uint16_t offset = write_header(MSG_CONNECT, 4 + id_length);
+
+    packet[offset] = FLAG_CLEAN_SESSION;
+    packet[offset + 1] = PROTOCOL_ID;
+    put_u16(&packet[offset + 2], (uint16_t)(keep_alive / CLOCK_SECOND));
+    memcpy(&packet[offset + 4], client_id, id_length);
+    send_packet(offset + 4 + id_length);
+}
+
+static uint16_t next_msg_id(void) {
+    if (++last_msg_id == 0) {
+        last_msg_id = 1;
+    }
+    return last_msg_id;
+}
+
+static void connection_lost(uint8_t reason) {
+    state = STATE_DISCONNECTED;
+    ctimer_stop(&timer);
+    callback(MQTT_SN_EVENT_DISCONNECTED, &reason);
+}
+
+static void timer_expired(void *ptr) {
+    clock_time_t idle;
+
+    if (state == STATE_DISCONNECTED) {
+        return;
+    }
+    if (state == STATE_CONNECTING || ping_pending) {
+        if (++retries > MQTT_SN_MAX_RETRIES) {
+            RINGLOG_WARN(RL_MQTT_SN_GATEWAY_LOST, MQTT_SN_MAX_RETRIES);
+            connection_lost(MQTT_SN_REASON_TIMEOUT);
+            return;
+        }
+        if (state == STATE_CONNECTING) {
+            send_connect();
+        } else {
+            send_empty(MSG_PINGREQ);
+        }
+        ctimer_set(&timer, MQTT_SN_RETRY_INTERVAL, timer_expired, NULL);
+        return;
+    }
+
+    // Any message keeps the connection alive at the gateway: ping only after a silent period
+    idle = clock_time() - last_sent;
+    if (idle < keep_alive) {
+        ctimer_set(&timer, keep_alive - idle, timer_expired, NULL);
+        return;
+    }
+    ping_pending = true;
+    retries = 0;
+    send_empty(MSG_PINGREQ);
+    ctimer_set(&timer, MQTT_SN_RETRY_INTERVAL, timer_expired, NULL);
+}
+
+void mqtt_sn_connect(const uip_ipaddr_t *gateway, uint16_t port, uint16_t keep_alive_s) {
+    uip_ipaddr_copy(&gateway_addr, gateway);
+    gateway_port = port;
+    keep_alive = (clock_time_t)keep_alive_s * CLOCK_SECOND;
+    state = STATE_CONNECTING;
+    ping_pending = false;
+    retries = 0;
+    send_connect();
+    ctimer_set(&timer, MQTT_SN_RETRY_INTERVAL, timer_expired, NULL);
+}
+
+bool mqtt_sn_connected(void) {
+    return state == STATE_CONNECTED;
+}
+
+void mqtt_sn_disconnect(void) {
+    if (state == STATE_DISCONNECTED) {
+        return;
+    }
+    send_empty(MSG_DISCONNECT);
+    connection_lost(MQTT_SN_REASON_LOCAL);
+}
+
+bool mqtt_sn_publish(uint16_t topic_id, const uint8_t *payload, uint16_t length, uint8_t qos, bool dup,
+                     uint16_t *msg_id) {
+    uint16_t id = 0;
+    uint16_t offset;
+
+    if (state != STATE_CONNECTED || length + 9 > packet_size) {
+        return false;
+    }
+    if (qos > 0) {
+        id = dup && msg_id != NULL ? *msg_id : next_msg_id();
+    }
+    offset = write_header(MSG_PUBLISH, 5 + length);
+    packet[offset] = (dup ? FLAG_DUP : 0) | (uint8_t)(qos << FLAG_QOS_SHIFT) | FLAG_TOPIC_PREDEFINED;
+    put_u16(&packet[offset + 1], topic_id);
+    put_u16(&packet[offset + 3], id);
+    memcpy(&packet[offset + 5], payload, length);
+    send_packet(offset + 5 + length);
+    if (msg_id != NULL) {
+        *msg_id = id;
+    }
+    return true;
+}
+
+bool mqtt_sn_subscribe(uint16_t topic_id, uint8_t qos, uint16_t *msg_id) {
+    uint16_t id = next_msg_id();
+    uint16_t offset;
+
+    if (state != STATE_CONNECTED) {
+        return false;
+    }
+    offset = write_header(MSG_SUBSCRIBE, 5);
+    packet[offset] = (uint8_t)(qos << FLAG_QOS_SHIFT) | FLAG_TOPIC_PREDEFINED;
+    put_u16(&packet[offset + 1], id);
+    put_u16(&packet[offset + 3], topic_id);
+    send_packet(offset + 5);
+    if (msg_id != NULL) {
+        *msg_id = id;
+    }
+    return true;
+}
+
+bool mqtt_sn_subscribe_topic(const char *name, uint8_t qos, uint16_t *msg_id) {
+    size_t name_length = strlen(name);
+    uint16_t id;
+    uint16_t offset;
+
+    if (state != STATE_CONNECTED || name_length + 7 > packet_size) {
+        return false;
+    }
+    id = next_msg_id();
+    offset = write_header(MSG_SUBSCRIBE, 3 + name_length);
+    packet[offset] = (uint8_t)(qos << FLAG_QOS_SHIFT) | FLAG_TOPIC_NORMAL;
+    put_u16(&packet[offset + 1], id);
+    memcpy(&packet[offset + 3], name, name_length);
+    send_packet(offset + 3 + name_length);
+    if (msg_id != NULL) {
+        *msg_id = id;
+    }
+    return true;
+}
+
+// QoS 1 messages from the gateway are acknowledged, a retransmission is delivered again
+static void receive_publish(const uint8_t *body, uint16_t length) {
+    mqtt_sn_message_t message;
+    uint16_t offset;
+
+    if (length < 5) {
+        return;
+    }
+    message.topic_id = get_u16(&body[1]);
+    message.payload = &body[5];
+    message.length = length - 5;
+    callback(MQTT_SN_EVENT_PUBLISH, &message);
+
+    if (((body[0] >> FLAG_QOS_SHIFT) & 0x03) == 1) {
+        offset = write_header(MSG_PUBACK, 5);
+        memcpy(&packet[offset], &body[1], 4); // topic ID and message ID
+        packet[offset + 4] = RC_ACCEPTED;
+        send_packet(offset + 5);
+    }
+}
+
+static void receive(struct simple_udp_connection *c, const uip_ipaddr_t *source_addr, uint16_t source_port,
+                    const uip_ipaddr_t *dest_addr, uint16_t dest_port, const uint8_t *data, uint16_t length) {
+    uint16_t message_length;
+    uint16_t msg_id;
+    mqtt_sn_suback_t suback;
+    uint8_t header;
+
+    if (state == STATE_DISCONNECTED || source_port != gateway_port || !uip_ipaddr_cmp(source_addr, &gateway_addr)) {
+        return;
+    }
+    header = length > 0 && data[0] == 0x01 ? 4 : 2;
+    if (length < header) {
+        return;
+    }
+    message_length = header == 4 ? get_u16(&data[1]) : data[0];
+    if (message_length < header || message_length > length) {
+        return;
+    }
+    length = message_length - header;
+
+    switch (data[header - 1]) {
+    case MSG_CONNACK:
+        if (state != STATE_CONNECTING || length < 1) {
+            break;
+        }
+        if (data[header] != RC_ACCEPTED) {
+            RINGLOG_WARN(RL_MQTT_SN_REJECTED, MSG_CONNECT, data[header]);
+            connection_lost(MQTT_SN_REASON_REJECTED);
+            break;
+        }
+        state = STATE_CONNECTED;
+        ctimer_set(&timer, keep_alive, timer_expired, NULL);
+        callback(MQTT_SN_EVENT_CONNECTED, NULL);
+        break;
+
+    case MSG_PUBLISH:
+        if (state == STATE_CONNECTED) {
+            receive_publish(&data[header], length);
+        }
+        break;
+
+    // A rejected message is left unacknowledged, its publisher sends it again
+    case MSG_PUBACK:
+        if (length < 5) {
+            break;
+        }
+        if (data[header + 4] != RC_ACCEPTED) {
+            RINGLOG_WARN(RL_MQTT_SN_REJECTED, MSG_PUBLISH, data[header + 4]);
+            break;
+        }
+        msg_id = get_u16(&data[header + 2]);
+        callback(MQTT_SN_EVENT_PUBACK, &msg_id);
+        break;
+
+    case MSG_SUBACK:
+        if (length < 6) {
+            break;
+        }
+        if (data[header + 5] != RC_ACCEPTED) {
+            RINGLOG_WARN(RL_MQTT_SN_REJECTED, MSG_SUBSCRIBE, data[header + 5]);
+            break;
+        }
+        suback.topic_id = get_u16(&data[header + 1]);
+        suback.msg_id = get_u16(&data[header + 3]);
+        callback(MQTT_SN_EVENT_SUBACK, &suback);
+        break;
+
+    case MSG_PINGREQ:
+        send_empty(MSG_PINGRESP);
+        break;
+
+    case MSG_PINGRESP:
+        if (ping_pending) {
+            ping_pending = false;
+            ctimer_set(&timer, keep_alive, timer_expired, NULL);
+        }
+        break;
+
+    case MSG_DISCONNECT:
+        connection_lost(MQTT_SN_REASON_GATEWAY);
+        break;
+
+    default:
+        break;
+    }
+}
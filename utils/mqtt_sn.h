@@ -0,0 +1,81 @@
+#ifndef MQTT_SN_H
+#define MQTT_SN_H
+
+#include "contiki.h"
+#include "net/ipv6/uip.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+// MQTT-SN 1.2 client over UDP, for a single gateway that bridges to an MQTT broker (e.g.
+// tools/mqtt_sn_gateway.py). Only what the collector uses: pre-defined topic IDs (no REGISTER), topic names
+// only to subscribe, QoS 0 and 1, a clean session and no will. Every datagram is a whole message, so
+// there is no stream to stall on a lost packet: a QoS 1 message is sent again by its publisher, with the
+// DUP flag. The gateway is pinged when nothing was sent for a keep-alive period; a CONNECT or PINGREQ
+// unanswered after MQTT_SN_MAX_RETRIES retries ends the connection.
+
+// Local UDP port of the client
+#ifdef MQTT_SN_CONF_LOCAL_PORT
+#define MQTT_SN_LOCAL_PORT MQTT_SN_CONF_LOCAL_PORT
+#else
+#define MQTT_SN_LOCAL_PORT 10001
+#endif
+
+// Wait for a CONNACK or PINGRESP before sending again (T_retry)
+#ifdef MQTT_SN_CONF_RETRY_INTERVAL
+#define MQTT_SN_RETRY_INTERVAL MQTT_SN_CONF_RETRY_INTERVAL
+#else
+#define MQTT_SN_RETRY_INTERVAL (CLOCK_SECOND * 5)
+#endif
+
+#ifdef MQTT_SN_CONF_MAX_RETRIES
+#define MQTT_SN_MAX_RETRIES MQTT_SN_CONF_MAX_RETRIES
+#else
+#define MQTT_SN_MAX_RETRIES 3
+#endif
+
+typedef enum {
+    MQTT_SN_EVENT_CONNECTED,
+    MQTT_SN_EVENT_DISCONNECTED, // data: const uint8_t *, one of MQTT_SN_REASON_*
+    MQTT_SN_EVENT_PUBLISH, // data: const mqtt_sn_message_t *
+    MQTT_SN_EVENT_SUBACK, // data: const mqtt_sn_suback_t *
+    MQTT_SN_EVENT_PUBACK, // data: const uint16_t *, message ID of the PUBLISH
+} mqtt_sn_event_t;
+
+#define MQTT_SN_REASON_LOCAL 0 // mqtt_sn_disconnect()
+#define MQTT_SN_REASON_TIMEOUT 1 // the gateway did not answer
+#define MQTT_SN_REASON_REJECTED 2 // CONNACK with an error
+#define MQTT_SN_REASON_GATEWAY 3 // DISCONNECT from the gateway
+
+typedef struct {
+    uint16_t topic_id;
+    const uint8_t *payload;
+    uint16_t length;
+} mqtt_sn_message_t;
+
+typedef struct {
+    uint16_t msg_id; // of the SUBSCRIBE
+    uint16_t topic_id; // given by the gateway to a topic subscribed by name, its PUBLISH messages carry it
+} mqtt_sn_suback_t;
+
+// Called from the UDP and timer callbacks, like the event callback of the MQTT client
+typedef void (*mqtt_sn_callback_t)(mqtt_sn_event_t event, const void *data);
+
+// buffer holds one outgoing message: the largest payload plus 7 bytes of PUBLISH header. It belongs to
+// the caller, so that the firmwares without an MQTT-SN client pay no RAM
+void mqtt_sn_init(uint8_t *buffer, uint16_t size, const char *client_id, mqtt_sn_callback_t callback);
+
+// Connect to the gateway, MQTT_SN_EVENT_CONNECTED or MQTT_SN_EVENT_DISCONNECTED follows
+void mqtt_sn_connect(const uip_ipaddr_t *gateway, uint16_t port, uint16_t keep_alive_s);
+bool mqtt_sn_connected(void);
+void mqtt_sn_disconnect(void);
+
+// Topic IDs are pre-defined. A message ID is given to QoS 1 messages only. A retransmission (dup) keeps the
+// message ID of the first transmission, passed in *msg_id. The payload is copied: the buffer is free again
+// on return
+bool mqtt_sn_publish(uint16_t topic_id, const uint8_t *payload, uint16_t length, uint8_t qos, bool dup,
+                     uint16_t *msg_id);
+bool mqtt_sn_subscribe(uint16_t topic_id, uint8_t qos, uint16_t *msg_id);
+// Subscribe to a topic name without wildcards, e.g. one naming the node. The topic ID comes with the SUBACK
+bool mqtt_sn_subscribe_topic(const char *name, uint8_t qos, uint16_t *msg_id);
+
+#endif // MQTT_SN_H
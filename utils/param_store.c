@@ -0,0 +1,318 @@
+#include "param_store.h"
+#include "json_extract.h"
+#include "coap-engine.h"
+#include "ringlog.h"
+#if PARAM_STORE_PERSIST
+#include "cfs/cfs.h"
+#include "lib/crc16.h"
+#endif
+#include <string.h>
+
+// A saved copy is a header, the CRC-16 and the length of the text (little endian), followed by the report
+#define COPY_HEADER_SIZE 4
+
+static const char *const status_names[] = { "ok", "unknown", "invalid", "malformed", "not saved" };
+
+static int32_t log_level = RINGLOG_LEVEL;
+static const param_t log_level_param = { "log_level", &log_level, RINGLOG_LEVEL_NONE, RINGLOG_LEVEL };
+
+static const param_t *params;
+static uint8_t param_count;
+static param_store_callback_t applied_callback;
+static uint32_t version;
+static uint8_t last_status;
+static char last_error[PARAM_NAME_MAX_LEN + 1]; // name of the member the last update failed at
+
+// The report, rendered for the resource and the saved copies
+static char text[PARAM_STORE_TEXT_SIZE];
+
+static const param_t *find_param(const char *name, size_t len) {
+    if (json_span_equals(name, len, log_level_param.name)) {
+        return &log_level_param;
+    }
+    for (uint8_t i = 0; i < param_count; i++) {
+        if (json_span_equals(name, len, params[i].name)) {
+            return &params[i];
+        }
+    }
+    return NULL;
+}
+
+// Decimal integer, without decimals or exponent
+static bool parse_int32(const char *str, size_t len, int32_t *value) {
+    size_t i = len > 0 && str[0] == '-' ? 1 : 0;
+    int64_t magnitude = 0;
+
+    if (i == len) {
+        return false;
+    }
+    for (; i < len; i++) {
+        if (str[i] < '0' || str[i] > '9') {
+            return false;
+        }
+        magnitude = magnitude * 10 + (str[i] - '0');
+        if (magnitude > (int64_t)INT32_MAX + 1) {
+            return false;
+        }
+    }
+    magnitude = str[0] == '-' ? -magnitude : magnitude;
+    if (magnitude > INT32_MAX) {
+        return false;
+    }
+    *value = (int32_t)magnitude;
+    return true;
+}
+
+static bool parse_member(const param_t *param, const char *value, size_t len, int32_t *number) {
+    return parse_int32(value, len, number) && *number >= param->min && *number <= param->max;
+}
+
+// Check every member of an update, and with apply set write them to their variables. Records the name of the
+// first member at fault
+static uint8_t apply_members(const char *json, size_t len, bool apply) {
+    size_t offset = 0;
+    const char *key;
+    const char *value;
+    size_t key_len;
+    size_t value_len;
+    const param_t *param;
+    int32_t number;
+    int member;
+    payload_writer_t writer;
+
+    while ((member = json_next_member(json, len, &offset, &key, &key_len, &value, &value_len)) == 1) {
+        param = find_param(key, key_len);
+        if (param == NULL || !parse_member(param, value, value_len, &number)) {
+            payload_writer_init(&writer, last_error, sizeof(last_error));
+            payload_write_len(&writer, key, key_len);
+            return param == NULL ? PARAM_STORE_UNKNOWN : PARAM_STORE_INVALID;
+        }
+        if (apply) {
+            *param->value = number;
+        }
+    }
+    return member == 0 ? PARAM_STORE_OK : PARAM_STORE_MALFORMED;
+}
+
+void param_store_write(payload_writer_t *writer) {
+    payload_write_char(writer, '{');
+    payload_write_key(writer, "version");
+    payload_write_uint64(writer, version);
+    payload_write_string_field(writer, "status", status_names[last_status]);
+    if (last_error[0] != '\0') {
+        payload_write_key(writer, "error");
+        payload_write_char(writer, '"');
+        payload_write_escaped(writer, last_error, strlen(last_error));
+        payload_write_char(writer, '"');
+    }
+    payload_write_int_field(writer, log_level_param.name, log_level);
+    for (uint8_t i = 0; i < param_count; i++) {
+        payload_write_int_field(writer, params[i].name, *params[i].value);
+    }
+    payload_write_char(writer, '}');
+}
+
+// Render the report into text, 0 when it does not fit
+static size_t render_report(void) {
+    payload_writer_t writer;
+
+    payload_writer_init(&writer, text, sizeof(text));
+    param_store_write(&writer);
+    if (writer.overflow) {
+        RINGLOG_ERR(RL_PARAMS_TOO_LARGE, PARAM_STORE_TEXT_SIZE);
+        return 0;
+    }
+    return writer.length;
+}
+
+#if PARAM_STORE_PERSIST
+// The copies are written in turn, by the parity of the version
+static const char *copy_name(uint32_t of_version) {
+    return of_version & 1 ? PARAM_STORE_FILE ".1" : PARAM_STORE_FILE ".0";
+}
+
+static bool save(void) {
+    uint8_t header[COPY_HEADER_SIZE];
+    size_t length = render_report();
+    uint16_t crc;
+    int fd;
+    bool written;
+
+    if (length == 0) {
+        return false;
+    }
+    crc = crc16_data((const unsigned char *)text, length, 0);
+    header[0] = (uint8_t)crc;
+    header[1] = (uint8_t)(crc >> 8);
+    header[2] = (uint8_t)length;
+    header[3] = (uint8_t)(length >> 8);
+
+    cfs_remove(copy_name(version));
+    fd = cfs_open(copy_name(version), CFS_WRITE);
+    if (fd < 0) {
+        return false;
+    }
+    written = cfs_write(fd, header, sizeof(header)) == sizeof(header) &&
+              cfs_write(fd, text, length) == (int)length;
+    cfs_close(fd);
+    return written;
+}
+
+// Read a saved copy into text, 0 when it is missing or damaged
+static size_t read_copy(const char *name) {
+    uint8_t header[COPY_HEADER_SIZE];
+    size_t length;
+    int fd = cfs_open(name, CFS_READ);
+    bool valid;
+
+    if (fd < 0) {
+        return 0;
+    }
+    valid = cfs_read(fd, header, sizeof(header)) == sizeof(header);
+    length = valid ? (size_t)(header[2] | header[3] << 8) : 0;
+    valid = valid && length > 0 && length <= sizeof(text) && cfs_read(fd, text, length) == (int)length &&
+            crc16_data((const unsigned char *)text, length, 0) == (uint16_t)(header[0] | header[1] << 8);
+    cfs_close(fd);
+    return valid ? length : 0;
+}
+
+// Version of the copy in text
+static bool copy_version(size_t length, uint32_t *value) {
+    const char *span;
+    size_t span_len;
+    int32_t number;
+
+    if (json_extract(text, length, "version", &span, &span_len) != 0 || !parse_int32(span, span_len, &number) ||
+        number < 0) {
+        return false;
+    }
+    *value = (uint32_t)number;
+    return true;
+}
+
+// Load the latest valid copy. Its members are taken one by one: the parameters of a previous firmware, or
+// out of the ranges of this one, keep their defaults
+static void load(void) {
+    size_t length;
+    uint32_t latest = 0;
+    uint32_t found;
+    int latest_copy = -1;
+    size_t offset = 0;
+    const char *key;
+    const char *value;
+    size_t key_len;
+    size_t value_len;
+    const param_t *param;
+    int32_t number;
+
+    for (int copy = 0; copy < 2; copy++) {
+        length = read_copy(copy_name((uint32_t)copy));
+        if (length > 0 && copy_version(length, &found) && (latest_copy < 0 || found > latest)) {
+            latest = found;
+            latest_copy = copy;
+        }
+    }
+    if (latest_copy < 0) {
+        return;
+    }
+
+    length = read_copy(copy_name((uint32_t)latest_copy));
+    while (json_next_member(text, length, &offset, &key, &key_len, &value, &value_len) == 1) {
+        param = find_param(key, key_len);
+        if (param != NULL && parse_member(param, value, value_len, &number)) {
+            *param->value = number;
+        }
+    }
+    version = latest;
+    RINGLOG_INFO(RL_PARAMS_LOADED, (int32_t)version);
+}
+#else
+static bool save(void) {
+    return true;
+}
+#endif
+
+extern coap_resource_t res_params;
+
+void param_store_init(const param_t *table, uint8_t count, param_store_callback_t applied) {
+    params = table;
+    param_count = count;
+    applied_callback = applied;
+#if PARAM_STORE_PERSIST
+    load();
+#endif
+    ringlog_set_level((uint8_t)log_level);
+    coap_activate_resource(&res_params, "params");
+}
+
+uint8_t param_store_update(const char *json, size_t len) {
+    last_error[0] = '\0';
+    last_status = apply_members(json, len, false);
+    if (last_status != PARAM_STORE_OK) {
+        RINGLOG_WARN_STR(last_error, strlen(last_error), RL_PARAMS_REJECTED, last_status);
+        return last_status;
+    }
+
+    apply_members(json, len, true);
+    version++;
+    ringlog_set_level((uint8_t)log_level);
+    if (applied_callback != NULL) {
+        applied_callback();
+    }
+    RINGLOG_INFO(RL_PARAMS_UPDATED, (int32_t)version);
+    if (!save()) {
+        RINGLOG_WARN(RL_PARAMS_NOT_SAVED, (int32_t)version);
+        last_status = PARAM_STORE_NOT_SAVED;
+    }
+    return last_status;
+}
+
+// The report, block-wise when it is larger than the preferred size
+static void params_get_handler(coap_message_t *request, coap_message_t *response,
+                               uint8_t *buffer, uint16_t preferred_size, int32_t *offset) {
+    size_t length = render_report();
+    size_t chunk;
+
+    if (*offset >= (int32_t)length) {
+        coap_set_status_code(response, BAD_OPTION_4_02);
+        return;
+    }
+    chunk = length - (size_t)*offset < preferred_size ? length - (size_t)*offset : preferred_size;
+    memcpy(buffer, text + *offset, chunk);
+    *offset += (int32_t)chunk;
+    if (*offset >= (int32_t)length) {
+        *offset = -1;
+    }
+    coap_set_header_content_format(response, APPLICATION_JSON);
+    coap_set_payload(response, buffer, chunk);
+}
+
+// An update, answered with its status and the member at fault, e.g. "invalid: poll_ms"
+static void params_put_handler(coap_message_t *request, coap_message_t *response,
+                               uint8_t *buffer, uint16_t preferred_size, int32_t *offset) {
+    const uint8_t *payload;
+    size_t len = coap_get_payload(request, &payload);
+    uint8_t more = 0;
+    uint8_t status;
+    payload_writer_t writer;
+
+    if (coap_get_header_block1(request, NULL, &more, NULL, NULL) && more) {
+        coap_set_status_code(response, REQUEST_ENTITY_TOO_LARGE_4_13);
+        return;
+    }
+    status = param_store_update((const char *)payload, len);
+
+    payload_writer_init(&writer, (char *)buffer, preferred_size);
+    payload_write_str(&writer, status_names[status]);
+    if (last_error[0] != '\0') {
+        payload_write_str(&writer, ": ");
+        payload_write_str(&writer, last_error);
+    }
+    coap_set_status_code(response, status == PARAM_STORE_OK || status == PARAM_STORE_NOT_SAVED ?
+                                   CHANGED_2_04 : BAD_REQUEST_4_00);
+    coap_set_header_content_format(response, TEXT_PLAIN);
+    coap_set_payload(response, buffer, writer.length);
+}
+
+RESOURCE(res_params, "title=\"Parameters\";rt=\"params\"", params_get_handler, params_put_handler,
+         params_put_handler, NULL);
@@ -0,0 +1,72 @@
+#ifndef PARAM_STORE_H
+#define PARAM_STORE_H
+
+#include "contiki.h"
+#include "payload_writer.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Run-time parameters of a firmware, tuned remotely instead of reflashing. The firmware lists its knobs as
+// int32_t variables with a name and a valid range, initialized with their compile-time defaults.
+// An update is a JSON object of names and values, e.g. {"poll_ms":500,"log_level":2}: every member is checked
+// before any is applied, so an update is applied whole or rejected whole. Applied values are saved to flash
+// and loaded again at boot. Two copies are kept, written in turn with a CRC, so that a write cut short by a
+// reset leaves the previous copy.
+// The report gives the values in effect and the outcome of the last update:
+//   {"version":<updates applied>,"status":"ok","error":"<name>","log_level":3,"<name>":<value>,...}
+// Every store has "log_level", the run-time threshold of the ring log. The params resource reads the report
+// (GET, block-wise) and applies updates (PUT or POST, in a single block), answering with the status.
+
+// Save the values to flash (CFS)
+#ifdef PARAM_STORE_CONF_PERSIST
+#define PARAM_STORE_PERSIST PARAM_STORE_CONF_PERSIST
+#else
+#define PARAM_STORE_PERSIST 1
+#endif
+
+// Name of the saved copies, followed by ".0" and ".1"
+#ifdef PARAM_STORE_CONF_FILE
+#define PARAM_STORE_FILE PARAM_STORE_CONF_FILE
+#else
+#define PARAM_STORE_FILE "params"
+#endif
+
+// Largest report, saved copies included
+#ifdef PARAM_STORE_CONF_TEXT_SIZE
+#define PARAM_STORE_TEXT_SIZE PARAM_STORE_CONF_TEXT_SIZE
+#else
+#define PARAM_STORE_TEXT_SIZE 192
+#endif
+
+#define PARAM_NAME_MAX_LEN 23
+
+// Outcome of an update
+#define PARAM_STORE_OK 0
+#define PARAM_STORE_UNKNOWN 1 // a member names no parameter
+#define PARAM_STORE_INVALID 2 // a value is not an integer within the range of its parameter
+#define PARAM_STORE_MALFORMED 3 // not a JSON object
+#define PARAM_STORE_NOT_SAVED 4 // applied, but the flash write failed
+
+typedef struct {
+    const char *name;
+    int32_t *value;
+    int32_t min;
+    int32_t max;
+} param_t;
+
+// Called once an update is applied, for the values the firmware copies elsewhere (e.g. a timer period)
+typedef void (*param_store_callback_t)(void);
+
+// Load the saved values into the variables of the table, which belongs to the caller, and expose the params
+// resource. The saved values out of range or of unknown names are left out, the firmware reads the variables
+// after this call
+void param_store_init(const param_t *params, uint8_t count, param_store_callback_t applied);
+
+// Apply an update, one of PARAM_STORE_*
+uint8_t param_store_update(const char *json, size_t len);
+
+// Write the report object
+void param_store_write(payload_writer_t *writer);
+
+#endif // PARAM_STORE_H
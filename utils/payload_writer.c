@@ -0,0 +1,165 @@
+#include "payload_writer.h"
+#include <string.h>
+
+void payload_writer_init(payload_writer_t *writer, char *buffer, size_t size) {
+    writer->buffer = buffer;
+    writer->size = size;
+    writer->length = 0;
+    writer->overflow = size == 0;
+    writer->last = '\0';
+    if (size > 0 && buffer != NULL) {
+        buffer[0] = '\0';
+    }
+}
+
+void payload_write_len(payload_writer_t *writer, const char *str, size_t len) {
+    if (writer->overflow) {
+        return;
+    }
+
+    // One byte is always reserved for the terminator
+    if (writer->length + len >= writer->size) {
+        len = writer->size - 1 - writer->length;
+        writer->overflow = true;
+    }
+    if (writer->buffer != NULL) {
+        memcpy(writer->buffer + writer->length, str, len);
+        writer->buffer[writer->length + len] = '\0';
+    }
+    if (len > 0) {
+        writer->last = str[len - 1];
+    }
+    writer->length += len;
+}
+
+void payload_write_char(payload_writer_t *writer, char c) {
+    if (writer->overflow) {
+        return;
+    }
+    if (writer->length + 1 >= writer->size) {
+        writer->overflow = true;
+        return;
+    }
+    if (writer->buffer != NULL) {
+        writer->buffer[writer->length] = c;
+        writer->buffer[writer->length + 1] = '\0';
+    }
+    writer->last = c;
+    writer->length++;
+}
+
+void payload_write_str(payload_writer_t *writer, const char *str) {
+    payload_write_len(writer, str, strlen(str));
+}
+
+// Write the decimal digits of an unsigned value, padded with zeros to at least min_digits
+static void write_digits(payload_writer_t *writer, uint32_t value, uint8_t min_digits) {
+    char digits[10];
+    uint8_t count = 0;
+
+    do {
+        digits[sizeof(digits) - 1 - count++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0 && count < sizeof(digits));
+
+    while (count < min_digits && count < sizeof(digits)) {
+        digits[sizeof(digits) - 1 - count++] = '0';
+    }
+    payload_write_len(writer, digits + sizeof(digits) - count, count);
+}
+
+void payload_write_int(payload_writer_t *writer, int32_t value) {
+    uint32_t magnitude = value < 0 ? -(uint32_t)value : (uint32_t)value;
+
+    if (value < 0) {
+        payload_write_char(writer, '-');
+    }
+    write_digits(writer, magnitude, 1);
+}
+
+void payload_write_uint64(payload_writer_t *writer, uint64_t value) {
+    // Split in base 10^9 parts, so that only the divisions by 10^9 need 64-bit arithmetic
+    if (value >= 1000000000ULL) {
+        payload_write_uint64(writer, value / 1000000000ULL);
+        write_digits(writer, (uint32_t)(value % 1000000000ULL), 9);
+    } else {
+        write_digits(writer, (uint32_t)value, 1);
+    }
+}
+
+void payload_write_hex8(payload_writer_t *writer, uint8_t value) {
+    static const char hex[] = "0123456789abcdef";
+    char digits[2] = {hex[value >> 4], hex[value & 0x0f]};
+    payload_write_len(writer, digits, 2);
+}
+
+void payload_write_fixed(payload_writer_t *writer, int32_t value, uint8_t decimals) {
+    uint32_t magnitude = value < 0 ? -(uint32_t)value : (uint32_t)value;
+    uint32_t scale = 1;
+
+    for (uint8_t i = 0; i < decimals; i++) {
+        scale *= 10;
+    }
+
+    if (value < 0) {
+        payload_write_char(writer, '-');
+    }
+    write_digits(writer, magnitude / scale, 1);
+    if (decimals > 0) {
+        payload_write_char(writer, '.');
+        write_digits(writer, magnitude % scale, decimals);
+    }
+}
+
+// Half away from zero, without libm
+int32_t payload_round_fixed(float value, uint8_t decimals) {
+    for (uint8_t i = 0; i < decimals; i++) {
+        value *= 10;
+    }
+    return (int32_t)(value < 0 ? value - 0.5f : value + 0.5f);
+}
+
+void payload_write_escaped(payload_writer_t *writer, const char *str, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    size_t start = 0;
+
+    // Copy runs of plain characters at once, escape the others
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = str[i];
+        if (c != '"' && c != '\\' && c >= 0x20) {
+            continue;
+        }
+        payload_write_len(writer, str + start, i - start);
+        start = i + 1;
+
+        if (c == '"' || c == '\\') {
+            char escaped[2] = {'\\', c};
+            payload_write_len(writer, escaped, 2);
+        } else {
+            char escaped[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0x0f]};
+            payload_write_len(writer, escaped, 6);
+        }
+    }
+    payload_write_len(writer, str + start, len - start);
+}
+
+void payload_write_key(payload_writer_t *writer, const char *key) {
+    if (writer->length > 0 && writer->last != '{' && writer->last != '[') {
+        payload_write_char(writer, ',');
+    }
+    payload_write_char(writer, '"');
+    payload_write_escaped(writer, key, strlen(key));
+    payload_write_len(writer, "\":", 2);
+}
+
+void payload_write_string_field(payload_writer_t *writer, const char *key, const char *value) {
+    payload_write_key(writer, key);
+    payload_write_char(writer, '"');
+    payload_write_escaped(writer, value, strlen(value));
+    payload_write_char(writer, '"');
+}
+
+void payload_write_int_field(payload_writer_t *writer, const char *key, int32_t value) {
+    payload_write_key(writer, key);
+    payload_write_int(writer, value);
+}
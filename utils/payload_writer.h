@@ -0,0 +1,41 @@
+#ifndef PAYLOAD_WRITER_H
+#define PAYLOAD_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Append-style writer used to build every text payload without snprintf.
+// The buffer is always kept NUL-terminated; when it is too small the output is truncated
+// and the overflow flag is set, so callers check it once after building the payload.
+// A writer with a NULL buffer only measures, as if it had size bytes, e.g. to check a payload fits.
+typedef struct {
+    char *buffer;
+    size_t size;
+    size_t length;
+    bool overflow;
+    char last; // last character written, for the separators
+} payload_writer_t;
+
+void payload_writer_init(payload_writer_t *writer, char *buffer, size_t size);
+
+// Primitives
+void payload_write_char(payload_writer_t *writer, char c);
+void payload_write_str(payload_writer_t *writer, const char *str);
+void payload_write_len(payload_writer_t *writer, const char *str, size_t len);
+void payload_write_int(payload_writer_t *writer, int32_t value);
+void payload_write_uint64(payload_writer_t *writer, uint64_t value);
+void payload_write_hex8(payload_writer_t *writer, uint8_t value);
+// Fixed-point value: writes value / 10^decimals with exactly `decimals` digits, e.g. (3250, 2) -> 32.50
+void payload_write_fixed(payload_writer_t *writer, int32_t value, uint8_t decimals);
+// Fixed-point value of a float, rounded to the nearest as printf does, e.g. (32.499f, 2) -> 3250
+int32_t payload_round_fixed(float value, uint8_t decimals);
+// String contents with JSON escaping, without the quotes
+void payload_write_escaped(payload_writer_t *writer, const char *str, size_t len);
+
+// JSON helpers. The key helper adds the separating comma when the object already has members
+void payload_write_key(payload_writer_t *writer, const char *key);
+void payload_write_string_field(payload_writer_t *writer, const char *key, const char *value);
+void payload_write_int_field(payload_writer_t *writer, const char *key, int32_t value);
+
+#endif // PAYLOAD_WRITER_H
@@ -0,0 +1,129 @@
+#include "publish_queue.h"
+#include <string.h>
+
+void publish_queue_init(publish_queue_t *queue, publish_slot_t *slots, char *buffers, uint8_t count, uint16_t size,
+                        uint8_t window, clock_time_t ack_timeout) {
+    memset(queue, 0, sizeof(*queue));
+    memset(slots, 0, count * sizeof(*slots));
+    queue->slots = slots;
+    queue->count = count;
+    queue->size = size;
+    queue->window = window > 0 ? window : 1;
+    queue->ack_timeout = ack_timeout;
+    for (uint8_t i = 0; i < count; i++) {
+        slots[i].buffer = buffers + (size_t)i * size;
+    }
+}
+
+// Oldest slot in the given state
+static publish_slot_t *oldest(publish_queue_t *queue, uint8_t state) {
+    publish_slot_t *found = NULL;
+
+    for (uint8_t i = 0; i < queue->count; i++) {
+        publish_slot_t *slot = &queue->slots[i];
+        if (slot->state == state && (found == NULL || (int32_t)(slot->order - found->order) < 0)) {
+            found = slot;
+        }
+    }
+    return found;
+}
+
+static uint8_t count_state(const publish_queue_t *queue, uint8_t state) {
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < queue->count; i++) {
+        count += queue->slots[i].state == state;
+    }
+    return count;
+}
+
+static publish_slot_t *prepare(publish_slot_t *slot) {
+    if (slot != NULL) {
+        slot->state = PUBLISH_SLOT_FREE;
+        slot->length = 0;
+        slot->attempts = 0;
+    }
+    return slot;
+}
+
+publish_slot_t *publish_queue_reserve(publish_queue_t *queue) {
+    return prepare(oldest(queue, PUBLISH_SLOT_FREE));
+}
+
+// A slot being sent is still read by the client, only a queued one can be replaced
+publish_slot_t *publish_queue_replace(publish_queue_t *queue) {
+    publish_slot_t *slot = oldest(queue, PUBLISH_SLOT_QUEUED);
+
+    if (slot != NULL) {
+        queue->dropped++;
+    }
+    return prepare(slot);
+}
+
+void publish_queue_commit(publish_queue_t *queue, publish_slot_t *slot, uint16_t length, uint32_t id) {
+    slot->length = length;
+    slot->id = id;
+    slot->order = ++queue->order;
+    slot->state = PUBLISH_SLOT_QUEUED;
+}
+
+publish_slot_t *publish_queue_next(publish_queue_t *queue) {
+    if (count_state(queue, PUBLISH_SLOT_SENT) >= queue->window) {
+        return NULL;
+    }
+    return oldest(queue, PUBLISH_SLOT_QUEUED);
+}
+
+void publish_queue_sent(publish_queue_t *queue, publish_slot_t *slot, uint16_t mid) {
+    slot->mid = mid;
+    slot->sent_at = clock_time();
+    slot->state = PUBLISH_SLOT_SENT;
+    if (slot->attempts < UINT8_MAX) {
+        slot->attempts++;
+    }
+    queue->sent++;
+    if (slot->attempts > 1) {
+        queue->retransmitted++;
+    }
+}
+
+publish_slot_t *publish_queue_find(publish_queue_t *queue, uint16_t mid) {
+    for (uint8_t i = 0; i < queue->count; i++) {
+        if (queue->slots[i].state == PUBLISH_SLOT_SENT && queue->slots[i].mid == mid) {
+            return &queue->slots[i];
+        }
+    }
+    return NULL;
+}
+
+void publish_queue_ack(publish_queue_t *queue, publish_slot_t *slot) {
+    if (slot->state == PUBLISH_SLOT_SENT) {
+        queue->acknowledged++;
+    }
+    slot->state = PUBLISH_SLOT_FREE;
+}
+
+publish_slot_t *publish_queue_expired(publish_queue_t *queue) {
+    publish_slot_t *slot = oldest(queue, PUBLISH_SLOT_SENT);
+
+    if (slot == NULL || CLOCK_LT(clock_time(), slot->sent_at + queue->ack_timeout)) {
+        return NULL;
+    }
+    return slot;
+}
+
+uint8_t publish_queue_requeue(publish_queue_t *queue) {
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < queue->count; i++) {
+        if (queue->slots[i].state == PUBLISH_SLOT_SENT) {
+            queue->slots[i].state = PUBLISH_SLOT_QUEUED;
+            count++;
+        }
+    }
+    return count;
+}
+
+uint8_t publish_queue_pending(const publish_queue_t *queue) {
+    return count_state(queue, PUBLISH_SLOT_QUEUED) + count_state(queue, PUBLISH_SLOT_SENT);
+}
@@ -0,0 +1,74 @@
+#ifndef PUBLISH_QUEUE_H
+#define PUBLISH_QUEUE_H
+
+#include "contiki.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Messages waiting to be published through a client that keeps the payload until it is sent, e.g. MQTT.
+// Each slot has its own payload buffer, so a message can be encoded while the previous ones are sent or
+// wait for their acknowledgement. Slots are sent oldest first, with at most `window` slots sent and not yet
+// acknowledged. A slot not acknowledged after `ack_timeout` is reported as expired, a slot queued again
+// (e.g. after a reconnection) is sent again with the same payload, so the receiver sees the same message ID.
+// When every slot is used, a new message replaces the oldest one still queued: the freshest readings win.
+// The slots and their buffers belong to the caller, so that the firmwares without a publisher pay no RAM.
+
+#define PUBLISH_SLOT_FREE 0
+#define PUBLISH_SLOT_QUEUED 1
+#define PUBLISH_SLOT_SENT 2
+
+typedef struct {
+    char *buffer;
+    uint16_t length;
+    uint16_t mid; // ID given by the client to the last transmission, e.g. the MQTT packet ID
+    uint32_t id; // ID of the message in its payload, e.g. the sequence number
+    uint32_t order; // commit order, the oldest slot has the lowest
+    clock_time_t sent_at;
+    uint8_t state;
+    uint8_t attempts;
+} publish_slot_t;
+
+typedef struct {
+    publish_slot_t *slots;
+    uint8_t count;
+    uint8_t window;
+    uint16_t size; // of each buffer
+    clock_time_t ack_timeout;
+    uint32_t order;
+    // Counters since the start
+    uint32_t sent;
+    uint32_t retransmitted;
+    uint32_t acknowledged;
+    uint32_t dropped; // replaced before being sent
+} publish_queue_t;
+
+// buffers holds count buffers of size bytes, one after the other
+void publish_queue_init(publish_queue_t *queue, publish_slot_t *slots, char *buffers, uint8_t count, uint16_t size,
+                        uint8_t window, clock_time_t ack_timeout);
+
+// Free slot to encode the next message into, NULL when every slot is in use
+publish_slot_t *publish_queue_reserve(publish_queue_t *queue);
+// Oldest queued slot, freed to encode the next message into in its place. NULL when all the slots are sent
+// and not acknowledged. The caller checks that the message fits first: the replaced one is lost
+publish_slot_t *publish_queue_replace(publish_queue_t *queue);
+// The message is encoded: queue it for sending
+void publish_queue_commit(publish_queue_t *queue, publish_slot_t *slot, uint16_t length, uint32_t id);
+
+// Oldest queued slot, when the window has room
+publish_slot_t *publish_queue_next(publish_queue_t *queue);
+void publish_queue_sent(publish_queue_t *queue, publish_slot_t *slot, uint16_t mid);
+// Sent slot of a client packet ID, NULL when there is none (e.g. a late acknowledgement)
+publish_slot_t *publish_queue_find(publish_queue_t *queue, uint16_t mid);
+// The slot is delivered, or handed over for good at QoS 0: it is free again
+void publish_queue_ack(publish_queue_t *queue, publish_slot_t *slot);
+
+// Oldest sent slot waiting for its acknowledgement for longer than the timeout, NULL when none
+publish_slot_t *publish_queue_expired(publish_queue_t *queue);
+// Queue the sent slots again, returns how many
+uint8_t publish_queue_requeue(publish_queue_t *queue);
+
+// Slots queued or sent, not yet acknowledged
+uint8_t publish_queue_pending(const publish_queue_t *queue);
+
+#endif // PUBLISH_QUEUE_H
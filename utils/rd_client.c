@@ -0,0 +1,95 @@
+#include "contiki.h"
+#include "coap-engine.h"
+#include "coap-blocking-api.h"
+#include "net/routing/routing.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/uiplib.h"
+#include "rd_client.h"
+#include "payload_writer.h"
+#include "ringlog.h"
+#include <string.h>
+
+// Delay before retrying when the network is not ready or the registration failed
+#define RD_CLIENT_RETRY_INTERVAL (CLOCK_SECOND * 10)
+
+static coap_endpoint_t rd_endpoint;
+static coap_message_t request[1];
+static char rd_query[96];
+static struct etimer rd_timer;
+static bool registered = false;
+
+PROCESS(rd_client_process, "Resource Directory Client");
+
+void rd_client_start(void) {
+    process_start(&rd_client_process, NULL);
+}
+
+// Build the registration query. The endpoint name is the link-local address, the same address
+// used to identify the nodes in config.xml
+static void build_registration_query(void) {
+    char endpoint_name[UIPLIB_IPV6_MAX_STR_LEN];
+    uip_ds6_addr_t *link_local = uip_ds6_get_link_local(-1);
+    payload_writer_t writer;
+
+    payload_writer_init(&writer, rd_query, sizeof(rd_query));
+    if (link_local == NULL) {
+        return;
+    }
+    uiplib_ipaddr_snprint(endpoint_name, sizeof(endpoint_name), &link_local->ipaddr);
+
+    payload_write_str(&writer, "ep=");
+    payload_write_str(&writer, endpoint_name);
+    payload_write_str(&writer, "&lt=");
+    payload_write_int(&writer, RD_CLIENT_LIFETIME);
+#ifdef RD_CLIENT_SECTOR
+    payload_write_str(&writer, "&d=");
+    payload_write_str(&writer, RD_CLIENT_SECTOR);
+#endif
+}
+
+// Callback for the registration requests
+static void registration_callback(coap_message_t *response) {
+    if (response == NULL) {
+        RINGLOG_WARN(RL_RD_REGISTRATION_TIMEOUT);
+        registered = false;
+        return;
+    }
+
+    registered = response->code == CREATED_2_01 || response->code == CHANGED_2_04;
+    if (!registered) {
+        RINGLOG_WARN(RL_RD_REGISTRATION_REJECTED, response->code);
+    }
+}
+
+PROCESS_THREAD(rd_client_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  coap_endpoint_parse(RD_CLIENT_SERVER_EP, strlen(RD_CLIENT_SERVER_EP), &rd_endpoint);
+  etimer_set(&rd_timer, RD_CLIENT_RETRY_INTERVAL);
+
+  while (1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER && data == &rd_timer);
+
+    if (NETSTACK_ROUTING.node_is_reachable()) {
+      build_registration_query();
+
+      // Simple registration: empty payload, the directory fetches /.well-known/core
+      coap_init_message(request, COAP_TYPE_CON, COAP_POST, 0);
+      coap_set_header_uri_path(request, ".well-known/rd");
+      coap_set_header_uri_query(request, rd_query);
+      COAP_BLOCKING_REQUEST(&rd_endpoint, request, registration_callback);
+    } else {
+      registered = false;
+    }
+
+    // Refresh at half lifetime, retry sooner if the registration did not go through
+    if (registered) {
+      etimer_set(&rd_timer, (RD_CLIENT_LIFETIME / 2) * CLOCK_SECOND);
+    } else {
+      etimer_set(&rd_timer, RD_CLIENT_RETRY_INTERVAL);
+    }
+  }
+
+  PROCESS_END();
+}
@@ -0,0 +1,32 @@
+#ifndef RD_CLIENT_H
+#define RD_CLIENT_H
+
+// Resource directory (RFC 9176) client. Nodes use simple registration: an empty POST to
+// /.well-known/rd, after which the directory reads /.well-known/core from the node itself.
+// Registrations are refreshed every half lifetime, so the directory only does work when a node
+// appears or changes address.
+
+// Address of the resource directory, hosted next to the MQTT broker on the border router side
+#ifdef RD_CLIENT_CONF_SERVER_EP
+#define RD_CLIENT_SERVER_EP RD_CLIENT_CONF_SERVER_EP
+#else
+#define RD_CLIENT_SERVER_EP "coap://[fd00::1]:5683"
+#endif
+
+// Registration lifetime in seconds
+#ifdef RD_CLIENT_CONF_LIFETIME
+#define RD_CLIENT_LIFETIME RD_CLIENT_CONF_LIFETIME
+#else
+#define RD_CLIENT_LIFETIME 300
+#endif
+
+// Optional sector (the bin ID) the node belongs to. When it is not set, the directory assigns
+// the node to a bin using config.xml
+#ifdef RD_CLIENT_CONF_SECTOR
+#define RD_CLIENT_SECTOR RD_CLIENT_CONF_SECTOR
+#endif
+
+// Start registering the resources activated on this node with the resource directory
+void rd_client_start(void);
+
+#endif // RD_CLIENT_H
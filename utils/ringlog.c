@@ -0,0 +1,177 @@
+#include "ringlog.h"
+#include <stdio.h>
+#include <string.h>
+
+// Record layout: format, flags (level in bits 0-2, argument count in bits 3-5, string in bit 6),
+// time in milliseconds (4 bytes), arguments (4 bytes each), then the string length and bytes.
+// Multi-byte values are little endian.
+#define RECORD_HEADER_SIZE 6
+#define RECORD_MAX_SIZE (RECORD_HEADER_SIZE + 4 * RINGLOG_MAX_ARGS + 1 + RINGLOG_MAX_STR)
+#define FLAG_STRING 0x40
+
+// Dropped count and drain time
+#define CHUNK_HEADER_SIZE 8
+
+// A console line carries at least one record of any size
+#define CONSOLE_CHUNK_SIZE (CHUNK_HEADER_SIZE + RECORD_MAX_SIZE)
+
+static uint8_t ring[RINGLOG_SIZE];
+static size_t ring_head; // next byte written
+static size_t ring_tail; // first byte of the oldest record
+static size_t ring_used;
+static uint32_t dropped;
+static uint8_t runtime_level = RINGLOG_LEVEL;
+
+static void put_byte(uint8_t value) {
+    ring[ring_head] = value;
+    ring_head = (ring_head + 1) % RINGLOG_SIZE;
+}
+
+static uint32_t time_ms(void) {
+    return (uint32_t)((uint64_t)clock_time() * 1000 / CLOCK_SECOND);
+}
+
+static void put_u32(uint32_t value) {
+    for (uint8_t i = 0; i < 4; i++) {
+        put_byte((uint8_t)(value >> (8 * i)));
+    }
+}
+
+static uint8_t peek(size_t offset) {
+    return ring[(ring_tail + offset) % RINGLOG_SIZE];
+}
+
+// Length of the oldest record
+static size_t oldest_record_size(void) {
+    uint8_t flags = peek(1);
+    size_t size = RECORD_HEADER_SIZE + 4 * ((flags >> 3) & 0x07);
+
+    if (flags & FLAG_STRING) {
+        size += 1 + peek(size);
+    }
+    return size;
+}
+
+static void remove_oldest_record(void) {
+    size_t size = oldest_record_size();
+
+    ring_tail = (ring_tail + size) % RINGLOG_SIZE;
+    ring_used -= size;
+}
+
+void ringlog_set_level(uint8_t level) {
+    runtime_level = level < RINGLOG_LEVEL ? level : RINGLOG_LEVEL;
+}
+
+void ringlog_write(uint8_t level, const char *str, size_t str_len, const int32_t *values, uint8_t count) {
+    uint8_t argc = count - 1 < RINGLOG_MAX_ARGS ? count - 1 : RINGLOG_MAX_ARGS;
+    size_t size = RECORD_HEADER_SIZE + 4 * argc;
+
+    if (level > runtime_level) {
+        return;
+    }
+    if (str != NULL) {
+        str_len = str_len < RINGLOG_MAX_STR ? str_len : RINGLOG_MAX_STR;
+        size += 1 + str_len;
+    }
+    while (RINGLOG_SIZE - ring_used < size) {
+        remove_oldest_record();
+        dropped++;
+    }
+
+    put_byte((uint8_t)values[0]);
+    put_byte((uint8_t)(level | (argc << 3) | (str != NULL ? FLAG_STRING : 0)));
+    put_u32(time_ms());
+    for (uint8_t i = 1; i <= argc; i++) {
+        put_u32((uint32_t)values[i]);
+    }
+    if (str != NULL) {
+        put_byte((uint8_t)str_len);
+        for (size_t i = 0; i < str_len; i++) {
+            put_byte((uint8_t)str[i]);
+        }
+    }
+    ring_used += size;
+}
+
+size_t ringlog_drain(uint8_t *buffer, size_t size) {
+    size_t length = CHUNK_HEADER_SIZE;
+    uint32_t now = time_ms();
+
+    if (size < length || (ring_used == 0 && dropped == 0)) {
+        return 0;
+    }
+    for (uint8_t i = 0; i < 4; i++) {
+        buffer[i] = (uint8_t)(dropped >> (8 * i));
+        buffer[4 + i] = (uint8_t)(now >> (8 * i));
+    }
+    dropped = 0;
+
+    while (ring_used > 0 && length + oldest_record_size() <= size) {
+        size_t record_size = oldest_record_size();
+        for (size_t i = 0; i < record_size; i++) {
+            buffer[length++] = peek(i);
+        }
+        remove_oldest_record();
+    }
+    return length;
+}
+
+PROCESS(ringlog_process, "Ring Log Drain");
+extern coap_resource_t res_ringlog;
+
+void ringlog_start(void) {
+    coap_activate_resource(&res_ringlog, "log");
+#if RINGLOG_CONSOLE_DRAIN
+    process_start(&ringlog_process, NULL);
+#endif
+}
+
+// One chunk per line, the next one queued behind the events already pending
+PROCESS_THREAD(ringlog_process, ev, data) {
+    static struct etimer drain_timer;
+    static uint8_t chunk[CONSOLE_CHUNK_SIZE];
+    static char line[sizeof("RL:") + 2 * CONSOLE_CHUNK_SIZE];
+    static const char hex[] = "0123456789abcdef";
+    static bool continue_posted;
+    size_t length;
+
+    PROCESS_BEGIN();
+
+    etimer_set(&drain_timer, RINGLOG_DRAIN_INTERVAL);
+    while (1) {
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_CONTINUE || etimer_expired(&drain_timer));
+        if (ev == PROCESS_EVENT_CONTINUE) {
+            continue_posted = false;
+        }
+        if (etimer_expired(&drain_timer)) {
+            etimer_restart(&drain_timer);
+        }
+
+        length = ringlog_drain(chunk, sizeof(chunk));
+        if (length > 0) {
+            memcpy(line, "RL:", 3);
+            for (size_t i = 0; i < length; i++) {
+                line[3 + 2 * i] = hex[chunk[i] >> 4];
+                line[4 + 2 * i] = hex[chunk[i] & 0x0f];
+            }
+            line[3 + 2 * length] = '\0';
+            puts(line);
+        }
+        if (ring_used > 0 && !continue_posted) {
+            continue_posted = process_post(PROCESS_CURRENT(), PROCESS_EVENT_CONTINUE, NULL) == PROCESS_ERR_OK;
+        }
+    }
+
+    PROCESS_END();
+}
+
+static void ringlog_get_handler(coap_message_t *request, coap_message_t *response,
+                                uint8_t *buffer, uint16_t preferred_size, int32_t *offset) {
+    size_t length = ringlog_drain(buffer, preferred_size);
+
+    coap_set_header_content_format(response, APPLICATION_OCTET_STREAM);
+    coap_set_payload(response, buffer, length);
+}
+
+RESOURCE(res_ringlog, "title=\"Log\";rt=\"ringlog\"", ringlog_get_handler, NULL, NULL, NULL);
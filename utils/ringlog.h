@@ -0,0 +1,120 @@
+#ifndef RINGLOG_H
+#define RINGLOG_H
+
+#include "contiki.h"
+#include "coap-engine.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Deferred binary logging. A record is the ID of its format in ringlog_formats.h, the time, up to
+// RINGLOG_MAX_ARGS integer arguments and an optional string of up to RINGLOG_MAX_STR bytes, stored in
+// a RAM ring buffer: logging costs a few dozen byte copies and the format strings are not in the firmware.
+// The records are drained later, as hex lines "RL:<chunk>" on the console behind the other pending events,
+// or read over CoAP from the log resource. tools/ringlog_decode.py turns them back into text.
+// When the buffer is full the oldest records are dropped, the drained chunks carry the number dropped.
+//
+// Records more detailed than RINGLOG_LEVEL compile to nothing, their arguments are not evaluated:
+//   RINGLOG_INFO(RL_COLLECTOR_POLLING_NODES, sensor_node_count);
+//   RINGLOG_WARN_STR(payload, len, RL_ACTUATOR_INVALID_COMMAND);
+// The string of a record fills the %s of its format, the integers fill the other conversions in order.
+
+#define RINGLOG_LEVEL_NONE 0
+#define RINGLOG_LEVEL_ERR 1
+#define RINGLOG_LEVEL_WARN 2
+#define RINGLOG_LEVEL_INFO 3
+#define RINGLOG_LEVEL_DBG 4
+
+#ifdef RINGLOG_CONF_LEVEL
+#define RINGLOG_LEVEL RINGLOG_CONF_LEVEL
+#else
+#define RINGLOG_LEVEL RINGLOG_LEVEL_INFO
+#endif
+
+// Size of the ring buffer in bytes, a record takes 6 to 55 bytes
+#ifdef RINGLOG_CONF_SIZE
+#define RINGLOG_SIZE RINGLOG_CONF_SIZE
+#else
+#define RINGLOG_SIZE 1024
+#endif
+
+// Drain the records to the console. Without it they stay in the buffer until read over CoAP
+#ifdef RINGLOG_CONF_CONSOLE_DRAIN
+#define RINGLOG_CONSOLE_DRAIN RINGLOG_CONF_CONSOLE_DRAIN
+#else
+#define RINGLOG_CONSOLE_DRAIN 1
+#endif
+
+#ifdef RINGLOG_CONF_DRAIN_INTERVAL
+#define RINGLOG_DRAIN_INTERVAL RINGLOG_CONF_DRAIN_INTERVAL
+#else
+#define RINGLOG_DRAIN_INTERVAL CLOCK_SECOND
+#endif
+
+#define RINGLOG_MAX_ARGS 4
+#define RINGLOG_MAX_STR 32
+
+typedef enum {
+#define RINGLOG_FORMAT(name, text) name,
+#include "ringlog_formats.h"
+#undef RINGLOG_FORMAT
+    RINGLOG_FORMAT_COUNT
+} ringlog_format_t;
+
+// values[0] is the format, followed by the arguments
+void ringlog_write(uint8_t level, const char *str, size_t str_len, const int32_t *values, uint8_t count);
+
+#define RINGLOG_RECORD(level, str, str_len, ...) \
+    ringlog_write(level, str, str_len, (const int32_t[]){__VA_ARGS__}, \
+                  (uint8_t)(sizeof((const int32_t[]){__VA_ARGS__}) / sizeof(int32_t)))
+
+// A disabled record still names its arguments, in sizeof only, so that they are not left unused
+#define RINGLOG_DISCARD(str, str_len, ...) \
+    ((void)sizeof(str), (void)sizeof(str_len), (void)sizeof((const int32_t[]){__VA_ARGS__}))
+
+#if RINGLOG_LEVEL >= RINGLOG_LEVEL_ERR
+#define RINGLOG_ERR(...) RINGLOG_RECORD(RINGLOG_LEVEL_ERR, NULL, 0, __VA_ARGS__)
+#define RINGLOG_ERR_STR(str, str_len, ...) RINGLOG_RECORD(RINGLOG_LEVEL_ERR, str, str_len, __VA_ARGS__)
+#else
+#define RINGLOG_ERR(...) RINGLOG_DISCARD(NULL, 0, __VA_ARGS__)
+#define RINGLOG_ERR_STR(str, str_len, ...) RINGLOG_DISCARD(str, str_len, __VA_ARGS__)
+#endif
+
+#if RINGLOG_LEVEL >= RINGLOG_LEVEL_WARN
+#define RINGLOG_WARN(...) RINGLOG_RECORD(RINGLOG_LEVEL_WARN, NULL, 0, __VA_ARGS__)
+#define RINGLOG_WARN_STR(str, str_len, ...) RINGLOG_RECORD(RINGLOG_LEVEL_WARN, str, str_len, __VA_ARGS__)
+#else
+#define RINGLOG_WARN(...) RINGLOG_DISCARD(NULL, 0, __VA_ARGS__)
+#define RINGLOG_WARN_STR(str, str_len, ...) RINGLOG_DISCARD(str, str_len, __VA_ARGS__)
+#endif
+
+#if RINGLOG_LEVEL >= RINGLOG_LEVEL_INFO
+#define RINGLOG_INFO(...) RINGLOG_RECORD(RINGLOG_LEVEL_INFO, NULL, 0, __VA_ARGS__)
+#define RINGLOG_INFO_STR(str, str_len, ...) RINGLOG_RECORD(RINGLOG_LEVEL_INFO, str, str_len, __VA_ARGS__)
+#else
+#define RINGLOG_INFO(...) RINGLOG_DISCARD(NULL, 0, __VA_ARGS__)
+#define RINGLOG_INFO_STR(str, str_len, ...) RINGLOG_DISCARD(str, str_len, __VA_ARGS__)
+#endif
+
+#if RINGLOG_LEVEL >= RINGLOG_LEVEL_DBG
+#define RINGLOG_DBG(...) RINGLOG_RECORD(RINGLOG_LEVEL_DBG, NULL, 0, __VA_ARGS__)
+#define RINGLOG_DBG_STR(str, str_len, ...) RINGLOG_RECORD(RINGLOG_LEVEL_DBG, str, str_len, __VA_ARGS__)
+#else
+#define RINGLOG_DBG(...) RINGLOG_DISCARD(NULL, 0, __VA_ARGS__)
+#define RINGLOG_DBG_STR(str, str_len, ...) RINGLOG_DISCARD(str, str_len, __VA_ARGS__)
+#endif
+
+// Move the oldest whole records into a chunk: the number of records dropped since the previous chunk and the
+// time of the drain in milliseconds (4 bytes each, little endian), followed by the records. The drain time
+// tells the age of the records. 63 bytes hold a record of any size, so a 64-byte CoAP chunk always moves
+// the log forward. Returns the chunk length, 0 when there is nothing to report
+size_t ringlog_drain(uint8_t *buffer, size_t size);
+
+// Run-time threshold, at most RINGLOG_LEVEL: the records compiled in but more detailed are not stored
+void ringlog_set_level(uint8_t level);
+
+// Expose the log resource at /log, GET takes the oldest records as a drained chunk (application/octet-stream),
+// and start draining to the console (RINGLOG_CONSOLE_DRAIN)
+void ringlog_start(void);
+
+#endif // RINGLOG_H
@@ -0,0 +1,114 @@
+// Formats of the ring log records, included by ringlog.h to number them and parsed by tools/ringlog_decode.py.
+// The ID of a format is its position in this file: new formats go at the end, so that logs recorded by older
+// firmwares still decode. One RINGLOG_FORMAT per line, no conditionals, no include guard.
+// %s is the string of the record, %a its 16 bytes shown as an IPv6 address, the other conversions take the
+// integer arguments in order.
+
+// Collector
+RINGLOG_FORMAT(RL_COLLECTOR_POLLING_NODES, "Polling %u sensor nodes.")
+RINGLOG_FORMAT(RL_COLLECTOR_LOOKUP_TIMEOUT, "Resource directory lookup for %s timed out.")
+RINGLOG_FORMAT(RL_COLLECTOR_NOT_FOUND, "No %s found in the resource directory.")
+RINGLOG_FORMAT(RL_COLLECTOR_DISCOVERED, "Discovered %s.")
+RINGLOG_FORMAT(RL_COLLECTOR_MQTT_MESSAGE, "MQTT message on %s, %u bytes.")
+RINGLOG_FORMAT(RL_COLLECTOR_CONFIG_IGNORED, "Configuration for another collector ignored.")
+RINGLOG_FORMAT(RL_COLLECTOR_BIN_ID_TRUNCATED, "Bin ID truncated to %u characters.")
+RINGLOG_FORMAT(RL_COLLECTOR_CONFIG_RECEIVED, "Received configuration for bin %s, %u sensors to discover.")
+RINGLOG_FORMAT(RL_COLLECTOR_MQTT_CONNECTED, "MQTT connected.")
+RINGLOG_FORMAT(RL_COLLECTOR_MQTT_DISCONNECTED, "MQTT disconnected, reason %u.")
+RINGLOG_FORMAT(RL_COLLECTOR_MQTT_SUBACK, "Subscription acknowledged.")
+RINGLOG_FORMAT(RL_COLLECTOR_MQTT_UNSUBACK, "Unsubscription acknowledged.")
+RINGLOG_FORMAT(RL_COLLECTOR_MQTT_PUBACK, "Publish acknowledged.")
+RINGLOG_FORMAT(RL_COLLECTOR_MQTT_UNHANDLED, "Unhandled MQTT event %u.")
+RINGLOG_FORMAT(RL_COLLECTOR_INVALID_READING, "Invalid reading of sensor %u: %s")
+// Logged by the firmwares before the sensor table, kept so that the later IDs do not move
+RINGLOG_FORMAT(RL_COLLECTOR_RFID_TRUNCATED, "RFID code truncated to %u characters.")
+RINGLOG_FORMAT(RL_COLLECTOR_SENSOR_UPDATED, "Sensor %u updated to: %s")
+RINGLOG_FORMAT(RL_COLLECTOR_STATE_DECODE_FAILED, "Failed to decode node state payload.")
+RINGLOG_FORMAT(RL_COLLECTOR_NODE_TIMEOUT, "CoAP request for sensor node %s timed out.")
+RINGLOG_FORMAT(RL_COLLECTOR_MESSAGE_TOO_LARGE, "Aggregated message does not fit in the publish buffer.")
+RINGLOG_FORMAT(RL_COLLECTOR_PUBLISHED, "Published aggregated message %u, %u bytes.")
+RINGLOG_FORMAT(RL_COLLECTOR_CONNECTING, "Connecting to MQTT broker.")
+RINGLOG_FORMAT(RL_COLLECTOR_SUBSCRIBED, "Subscribed to %s.")
+RINGLOG_FORMAT(RL_COLLECTOR_SUBSCRIBE_FAILED, "Failed to subscribe to %s.")
+RINGLOG_FORMAT(RL_COLLECTOR_CONFIG_REQUEST, "Requesting the CoAP server configuration.")
+RINGLOG_FORMAT(RL_COLLECTOR_CONFIG_REQUEST_FAILED, "Failed to publish the configuration request, MQTT status %d.")
+RINGLOG_FORMAT(RL_COLLECTOR_FETCHING, "Fetching sensor states, cycle %u.")
+RINGLOG_FORMAT(RL_COLLECTOR_RECONNECTING, "Disconnected. Retrying.")
+
+// Sensors
+RINGLOG_FORMAT(RL_SENSOR_NODE_STATE_FULL, "Cannot register sensor %s: node state is full.")
+RINGLOG_FORMAT(RL_SENSOR_COLLECTOR_CONFIGURED, "Configured collector address: %s")
+RINGLOG_FORMAT(RL_SENSOR_INVALID_COLLECTOR, "Invalid or empty collector configuration.")
+RINGLOG_FORMAT(RL_SENSOR_NOTIFY_COLLECTOR, "Notifying the collector of compactor state %u.")
+RINGLOG_FORMAT(RL_SENSOR_COMPACTOR_TIMER_EXPIRED, "Compactor set to inactive. Red LED turned off.")
+RINGLOG_FORMAT(RL_SENSOR_COMPACTOR_ALREADY_ACTIVE, "Compactor is already active. Timer maintained.")
+RINGLOG_FORMAT(RL_SENSOR_COMPACTOR_ACTIVATED, "Compactor activated, red LED on.")
+RINGLOG_FORMAT(RL_SENSOR_COMPACTOR_DEACTIVATED, "Compactor deactivated, red LED off.")
+RINGLOG_FORMAT(RL_SENSOR_LID_OPENED, "Lid opened, RFID value assigned: %s")
+RINGLOG_FORMAT(RL_SENSOR_LID_CLOSED, "Lid closed, RFID value reset.")
+RINGLOG_FORMAT(RL_SENSOR_INVALID_LID_STATE, "Invalid payload for lid state: %s")
+RINGLOG_FORMAT(RL_SENSOR_SCALE_UPDATED, "Scale updated by %s to %u.%02u.")
+RINGLOG_FORMAT(RL_SENSOR_WASTE_LEVEL_UPDATED, "Waste level updated to %d%%.")
+
+// Actuators
+RINGLOG_FORMAT(RL_ACTUATOR_STARTED, "%s actuator started.")
+RINGLOG_FORMAT(RL_ACTUATOR_BUTTON, "Button pressed.")
+RINGLOG_FORMAT(RL_ACTUATOR_COMMAND_PAYLOAD, "Command payload: %s")
+RINGLOG_FORMAT(RL_ACTUATOR_COMMAND, "Command received: %s.")
+RINGLOG_FORMAT(RL_ACTUATOR_INVALID_COMMAND, "Invalid command received: %s")
+RINGLOG_FORMAT(RL_ACTUATOR_EMPTY_COMMAND, "Empty command payload.")
+RINGLOG_FORMAT(RL_ACTUATOR_CONFIG_PAYLOAD, "Configuration payload: %s")
+RINGLOG_FORMAT(RL_ACTUATOR_SENSOR_CONFIGURED, "Configured sensor endpoint: %s")
+RINGLOG_FORMAT(RL_ACTUATOR_INVALID_ENDPOINT, "Invalid CoAP endpoint: %s")
+RINGLOG_FORMAT(RL_ACTUATOR_INVALID_CONFIG, "Invalid configuration payload.")
+RINGLOG_FORMAT(RL_ACTUATOR_SENSOR_UNAVAILABLE, "Sensor %s, command dropped.")
+RINGLOG_FORMAT(RL_ACTUATOR_LID_TOGGLE, "Toggling lid sensor state to: %u")
+RINGLOG_FORMAT(RL_ACTUATOR_LID_SENT, "Lid sensor state update sent: %u")
+RINGLOG_FORMAT(RL_ACTUATOR_COMPACTOR_SEND, "Sending request to turn the compactor %s.")
+
+// CoAP clients
+RINGLOG_FORMAT(RL_REQUEST_TIMEOUT, "Request timed out.")
+RINGLOG_FORMAT(RL_RESPONSE_PAYLOAD, "|%s")
+
+// Utils
+RINGLOG_FORMAT(RL_RD_REGISTRATION_TIMEOUT, "Resource directory registration timed out.")
+RINGLOG_FORMAT(RL_RD_REGISTRATION_REJECTED, "Resource directory registration rejected: %u")
+RINGLOG_FORMAT(RL_NODE_ADDED, "Node %u is [%a]:%u.")
+RINGLOG_FORMAT(RL_NODE_BACK, "Node %u is back after %u failed requests.")
+RINGLOG_FORMAT(RL_NODE_DOWN, "Node %u is down after %u failed requests, next probe in %u s.")
+RINGLOG_FORMAT(RL_SCHEDULER_OVERRUN, "Cycle overrun: %u ms, %u deadlines skipped.")
+
+// Collector, publish queue
+RINGLOG_FORMAT(RL_COLLECTOR_PUBLISH_DROPPED, "No publish slot free, aggregated message %u dropped.")
+RINGLOG_FORMAT(RL_COLLECTOR_PUBACK_TIMEOUT, "No PUBACK for aggregated message %u, reconnecting.")
+RINGLOG_FORMAT(RL_COLLECTOR_PUBLISH_REQUEUED, "%u unacknowledged messages queued again.")
+RINGLOG_FORMAT(RL_COLLECTOR_PUBLISH_RETRANSMITTED, "Published aggregated message %u again, attempt %u.")
+RINGLOG_FORMAT(RL_COLLECTOR_PUBACK_RETRY, "No PUBACK for aggregated message %u, sending again.")
+
+// MQTT-SN client
+RINGLOG_FORMAT(RL_MQTT_SN_GATEWAY_LOST, "MQTT-SN gateway did not answer %u retries.")
+RINGLOG_FORMAT(RL_MQTT_SN_REJECTED, "MQTT-SN message type %u rejected, return code %u.")
+
+// Collector, sensor table
+RINGLOG_FORMAT(RL_COLLECTOR_SENSORS_LEFT_OUT, "%u configured sensors left out: invalid, or more than %u.")
+RINGLOG_FORMAT(RL_COLLECTOR_NODES_FULL, "Sensor %s left out: more than %u sensor nodes.")
+
+// Parameter store
+RINGLOG_FORMAT(RL_PARAMS_LOADED, "Parameters version %u loaded from flash.")
+RINGLOG_FORMAT(RL_PARAMS_UPDATED, "Parameters updated to version %u.")
+RINGLOG_FORMAT(RL_PARAMS_REJECTED, "Parameter update rejected at %s, status %u.")
+RINGLOG_FORMAT(RL_PARAMS_NOT_SAVED, "Parameters version %u not saved to flash.")
+RINGLOG_FORMAT(RL_PARAMS_TOO_LARGE, "Parameter report larger than %u bytes.")
+
+// Endpoint registry
+RINGLOG_FORMAT(RL_NODE_REGISTRY_FULL, "All %u node entries are held, node not added.")
+
+// Collector, sensor table readings
+RINGLOG_FORMAT(RL_COLLECTOR_READING_TRUNCATED, "Reading of %s truncated to %u characters.")
+
+// Collector, staged configuration
+RINGLOG_FORMAT(RL_COLLECTOR_CONFIG_REPEATED, "Configuration response to a repeated request ignored.")
+RINGLOG_FORMAT(RL_COLLECTOR_CONFIG_TOO_LARGE, "Configuration response of %u bytes larger than %u, ignored.")
+
+// Collector, clock synchronization
+RINGLOG_FORMAT(RL_COLLECTOR_CLOCK_SYNCED, "Clock synchronized, round trip %u ms.")
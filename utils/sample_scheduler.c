@@ -0,0 +1,57 @@
+#include "sample_scheduler.h"
+#include "ringlog.h"
+
+// FNV-1a, spreads IDs that differ in a single byte, as consecutive node addresses do
+clock_time_t sample_scheduler_phase(const uint8_t *id, size_t len, clock_time_t period) {
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ id[i]) * 16777619u;
+    }
+    return period > 0 ? (clock_time_t)(hash % period) : 0;
+}
+
+void sample_scheduler_init(sample_scheduler_t *scheduler, struct etimer *timer, clock_time_t period, clock_time_t phase) {
+    scheduler->period = period;
+    scheduler->deadline = clock_time() + phase;
+    scheduler->cycle_start = scheduler->deadline;
+    scheduler->max_lag = 0;
+    scheduler->cycles = 0;
+    scheduler->overruns = 0;
+    scheduler->skipped = 0;
+    etimer_set(timer, phase);
+}
+
+void sample_scheduler_begin(sample_scheduler_t *scheduler) {
+    clock_time_t now = clock_time();
+    clock_time_t lag = CLOCK_LT(now, scheduler->deadline) ? 0 : now - scheduler->deadline;
+
+    if (lag > scheduler->max_lag) {
+        scheduler->max_lag = lag;
+    }
+    scheduler->cycle_start = now;
+    scheduler->cycles++;
+    scheduler->deadline += scheduler->period;
+}
+
+void sample_scheduler_end(sample_scheduler_t *scheduler, struct etimer *timer) {
+    clock_time_t now = clock_time();
+
+    // The timer is set relative to now, for the remaining time to the absolute deadline
+    if (!CLOCK_LT(now, scheduler->deadline)) {
+        uint32_t missed = (now - scheduler->deadline) / scheduler->period + 1;
+        scheduler->overruns++;
+        scheduler->skipped += missed;
+        scheduler->deadline += missed * scheduler->period;
+        RINGLOG_WARN(RL_SCHEDULER_OVERRUN, (int32_t)((now - scheduler->cycle_start) * 1000 / CLOCK_SECOND),
+                     (int32_t)missed);
+    }
+    etimer_set(timer, scheduler->deadline - now);
+}
+
+uint32_t sample_scheduler_take_max_lag_ms(sample_scheduler_t *scheduler) {
+    uint32_t lag_ms = (uint32_t)((uint64_t)scheduler->max_lag * 1000 / CLOCK_SECOND);
+
+    scheduler->max_lag = 0;
+    return lag_ms;
+}
@@ -0,0 +1,40 @@
+#ifndef SAMPLE_SCHEDULER_H
+#define SAMPLE_SCHEDULER_H
+
+#include "contiki.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Periodic cycle on absolute deadlines: deadline n is phase + n * period from the start, whatever the time
+// spent in the cycles. A cycle running past the next deadline is an overrun, the deadlines it missed are
+// skipped instead of being run back to back, so the phase is kept.
+// The phase spreads the cycles of nodes booted together over the period: it is derived from the node ID,
+// so that it is the same after every reboot and differs from one node to the next.
+
+typedef struct {
+    clock_time_t period;
+    clock_time_t deadline; // absolute time of the next cycle
+    clock_time_t cycle_start;
+    clock_time_t max_lag; // largest delay between a deadline and the start of its cycle, since the last report
+    uint32_t cycles;
+    uint32_t overruns; // cycles that ended after the next deadline
+    uint32_t skipped; // deadlines skipped after overruns
+} sample_scheduler_t;
+
+// Phase in [0, period) derived from a node ID, e.g. the link-layer address
+clock_time_t sample_scheduler_phase(const uint8_t *id, size_t len, clock_time_t period);
+
+// Start the schedule, the first cycle is at now + phase
+void sample_scheduler_init(sample_scheduler_t *scheduler, struct etimer *timer, clock_time_t period, clock_time_t phase);
+
+// Start of the cycle of the expired timer, records its lag
+void sample_scheduler_begin(sample_scheduler_t *scheduler);
+
+// End of the cycle: counts an overrun when the next deadline is already past and sets the timer for the
+// next deadline ahead
+void sample_scheduler_end(sample_scheduler_t *scheduler, struct etimer *timer);
+
+// Maximum lag since the previous call, in milliseconds
+uint32_t sample_scheduler_take_max_lag_ms(sample_scheduler_t *scheduler);
+
+#endif // SAMPLE_SCHEDULER_H
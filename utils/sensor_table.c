@@ -0,0 +1,217 @@
+#include "sensor_table.h"
+#include "json_extract.h"
+#include <string.h>
+
+#define SENSOR_MAX_DECIMALS 9
+#define SENSOR_DEFAULT_PATH "/state"
+
+void sensor_table_init(sensor_table_t *table, sensor_t *sensors, uint8_t capacity) {
+    table->sensors = sensors;
+    table->capacity = capacity;
+    table->count = 0;
+}
+
+// Parse a decimal reading into a fixed-point value with the given number of decimals, e.g.
+// ("32.5", 2) -> 3250. Extra decimals are dropped, a comma is accepted as the decimal separator
+static bool parse_fixed(const char *str, size_t len, uint8_t decimals, int32_t *value) {
+    size_t i = 0;
+    bool negative = len > 0 && str[0] == '-';
+    bool digits = false;
+    int64_t magnitude = 0;
+
+    if (negative) {
+        i++;
+    }
+    for (; i < len && str[i] >= '0' && str[i] <= '9'; i++) {
+        magnitude = magnitude * 10 + (str[i] - '0');
+        digits = true;
+        if (magnitude > INT32_MAX) {
+            return false;
+        }
+    }
+    if (i < len && (str[i] == '.' || str[i] == ',')) {
+        i++;
+    }
+    for (uint8_t d = 0; d < decimals; d++) {
+        magnitude *= 10;
+        if (i < len && str[i] >= '0' && str[i] <= '9') {
+            magnitude += str[i++] - '0';
+            digits = true;
+        }
+    }
+    while (i < len && str[i] >= '0' && str[i] <= '9') {
+        i++;
+    }
+    if (!digits || i != len || magnitude > INT32_MAX) {
+        return false;
+    }
+    *value = negative ? -(int32_t)magnitude : (int32_t)magnitude;
+    return true;
+}
+
+// Copy a string member of the sensor object, or the default when it is missing. False when it does not fit, or
+// holds an escape: the messages of the collector are sized for members that need no escaping
+static bool copy_member(const char *object, size_t object_len, const char *key, const char *fallback,
+                        char *buffer, size_t size) {
+    const char *value;
+    size_t len;
+    payload_writer_t writer;
+
+    payload_writer_init(&writer, buffer, size);
+    if (json_extract(object, object_len, key, &value, &len) == 0) {
+        if (memchr(value, '\\', len) != NULL) {
+            return false;
+        }
+        payload_write_len(&writer, value, len);
+    } else {
+        payload_write_str(&writer, fallback);
+    }
+    return !writer.overflow;
+}
+
+// Number member of the sensor object, with the given number of decimals
+static bool number_member(const char *object, size_t object_len, const char *key, uint8_t decimals,
+                          int32_t fallback, int32_t *number) {
+    const char *value;
+    size_t len;
+
+    if (json_extract(object, object_len, key, &value, &len) != 0) {
+        *number = fallback;
+        return true;
+    }
+    return parse_fixed(value, len, decimals, number);
+}
+
+// Fill a sensor from its object in the configuration, false when the object is not a valid sensor
+static bool load_sensor(sensor_t *sensor, const char *object, size_t object_len) {
+    const char *value;
+    size_t len;
+    int32_t number;
+
+    memset(sensor, 0, sizeof(*sensor));
+    if (!copy_member(object, object_len, "name", "", sensor->name, sizeof(sensor->name)) ||
+        sensor->name[0] == '\0' ||
+        !copy_member(object, object_len, "field", sensor->name, sensor->field, sizeof(sensor->field)) ||
+        !copy_member(object, object_len, "path", SENSOR_DEFAULT_PATH, sensor->path, sizeof(sensor->path)) ||
+        !copy_member(object, object_len, "false", "false", sensor->labels[0], sizeof(sensor->labels[0])) ||
+        !copy_member(object, object_len, "true", "true", sensor->labels[1], sizeof(sensor->labels[1]))) {
+        return false;
+    }
+
+    if (json_extract(object, object_len, "type", &value, &len) != 0) {
+        return false;
+    } else if (json_span_equals(value, len, "bool")) {
+        sensor->type = SENSOR_TYPE_BOOL;
+    } else if (json_span_equals(value, len, "number")) {
+        sensor->type = SENSOR_TYPE_NUMBER;
+    } else if (json_span_equals(value, len, "text")) {
+        sensor->type = SENSOR_TYPE_TEXT;
+    } else {
+        return false;
+    }
+
+    if (!number_member(object, object_len, "decimals", 0, 0, &number) || number < 0 ||
+        number > SENSOR_MAX_DECIMALS) {
+        return false;
+    }
+    sensor->decimals = (uint8_t)number;
+    if (!number_member(object, object_len, "min", sensor->decimals, INT32_MIN, &sensor->min) ||
+        !number_member(object, object_len, "max", sensor->decimals, INT32_MAX, &sensor->max) ||
+        !number_member(object, object_len, "poll", 0, 1, &number) || number < 0 || number > UINT8_MAX) {
+        return false;
+    }
+    sensor->poll = (uint8_t)number;
+
+    // An empty address is the same as a missing one
+    if (json_extract(object, object_len, "address", &value, &len) == 0 && len > 0) {
+        sensor->located = coap_endpoint_parse(value, len, &sensor->endpoint);
+    }
+    return true;
+}
+
+int sensor_table_load(sensor_table_t *table, const char *json, size_t len) {
+    char path[sizeof("sensors.255")];
+    const char *object;
+    size_t object_len;
+    payload_writer_t writer;
+    int listed;
+
+    // Without an array the choice is left to the caller, an empty one is a bin without sensors
+    if (json_extract(json, len, "sensors", &object, &object_len) != 0 || object_len == 0 || object[0] != '[') {
+        return -1;
+    }
+
+    table->count = 0;
+    for (listed = 0; listed <= UINT8_MAX; listed++) {
+        payload_writer_init(&writer, path, sizeof(path));
+        payload_write_str(&writer, "sensors.");
+        payload_write_int(&writer, listed);
+        if (json_extract(json, len, writer.buffer, &object, &object_len) != 0) {
+            break;
+        }
+        if (table->count < table->capacity && object_len > 0 && object[0] == '{' &&
+            load_sensor(&table->sensors[table->count], object, object_len)) {
+            table->count++;
+        }
+    }
+    return listed;
+}
+
+sensor_t *sensor_table_find(sensor_table_t *table, const char *name, size_t name_len) {
+    for (uint8_t i = 0; i < table->count; i++) {
+        if (strlen(table->sensors[i].name) == name_len && memcmp(table->sensors[i].name, name, name_len) == 0) {
+            return &table->sensors[i];
+        }
+    }
+    return NULL;
+}
+
+uint8_t sensor_store(sensor_t *sensor, const char *value, size_t value_len) {
+    int32_t number;
+    payload_writer_t writer;
+
+    switch (sensor->type) {
+    case SENSOR_TYPE_BOOL:
+        sensor->value.state = json_span_equals(value, value_len, "true");
+        break;
+    case SENSOR_TYPE_NUMBER:
+        if (!parse_fixed(value, value_len, sensor->decimals, &number) || number < sensor->min ||
+            number > sensor->max) {
+            return SENSOR_INVALID;
+        }
+        sensor->value.number = number;
+        break;
+    default:
+        payload_writer_init(&writer, sensor->value.text, sizeof(sensor->value.text));
+        payload_write_len(&writer, value, value_len);
+        sensor->received = true;
+        return writer.overflow ? SENSOR_TRUNCATED : SENSOR_STORED;
+    }
+    sensor->received = true;
+    return SENSOR_STORED;
+}
+
+void sensor_table_write(const sensor_table_t *table, payload_writer_t *writer) {
+    for (uint8_t i = 0; i < table->count; i++) {
+        const sensor_t *sensor = &table->sensors[i];
+
+        payload_write_key(writer, sensor->field);
+        payload_write_char(writer, '"');
+        if (sensor->received) {
+            switch (sensor->type) {
+            case SENSOR_TYPE_BOOL: {
+                const char *label = sensor->labels[sensor->value.state];
+                payload_write_escaped(writer, label, strlen(label));
+                break;
+            }
+            case SENSOR_TYPE_NUMBER:
+                payload_write_fixed(writer, sensor->value.number, sensor->decimals);
+                break;
+            default:
+                payload_write_escaped(writer, sensor->value.text, strlen(sensor->value.text));
+                break;
+            }
+        }
+        payload_write_char(writer, '"');
+    }
+}
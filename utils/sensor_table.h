@@ -0,0 +1,83 @@
+#ifndef SENSOR_TABLE_H
+#define SENSOR_TABLE_H
+
+#include "contiki.h"
+#include "coap-engine.h"
+#include "payload_writer.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Sensors read by a collector, described by data rather than code. Each sensor is given by an object of the
+// "sensors" array of the configuration, e.g.
+//   {"name":"scale_sensor","field":"scale","type":"number","decimals":2,"address":"coap://[fe80::1]",
+//    "path":"/state","poll":1}
+// name: key of the sensor in the node answers, and its resource type in the resource directory
+// field: key of the reading in the aggregated message, the name by default
+// type: "bool", "number" (fixed-point with "decimals", optionally within "min" and "max") or "text"
+// true, false: text published for a bool, "true" and "false" by default
+// address: endpoint of the node, looked up in the resource directory when missing
+// path: resource read on the node, "/state" by default. The answer is a map of sensor names to text values,
+//   so the node state and the resource of a single sensor are read alike
+// poll: poll class, the sensor is read every `poll` cycles. 0 for a sensor without a node of its own, whose
+//   value comes with the answers read for the other sensors
+// The text members are plain: a sensor whose name, field, path or labels hold a JSON escape is left out.
+// The sensors and their values belong to the caller, so that the firmwares without a collector pay no RAM.
+
+#define SENSOR_NAME_MAX_LEN 23
+#define SENSOR_PATH_MAX_LEN 15
+#define SENSOR_LABEL_MAX_LEN 7
+#define SENSOR_TEXT_MAX_LEN 15
+
+#define SENSOR_TYPE_BOOL 0
+#define SENSOR_TYPE_NUMBER 1
+#define SENSOR_TYPE_TEXT 2
+
+// Outcome of sensor_store
+#define SENSOR_STORED 0
+#define SENSOR_TRUNCATED 1 // text longer than SENSOR_TEXT_MAX_LEN, the start is kept
+#define SENSOR_INVALID 2 // the previous reading is kept
+
+typedef struct {
+    char name[SENSOR_NAME_MAX_LEN + 1];
+    char field[SENSOR_NAME_MAX_LEN + 1];
+    char path[SENSOR_PATH_MAX_LEN + 1];
+    char labels[2][SENSOR_LABEL_MAX_LEN + 1]; // text of false and true
+    int32_t min;
+    int32_t max;
+    coap_endpoint_t endpoint; // valid once located is set
+    uint8_t type;
+    uint8_t decimals;
+    uint8_t poll;
+    bool located;
+    bool received; // read at least once, the others are published as empty strings
+    union {
+        bool state;
+        int32_t number; // in units of 10^-decimals, "32.50" with 2 decimals is 3250
+        char text[SENSOR_TEXT_MAX_LEN + 1];
+    } value;
+} sensor_t;
+
+typedef struct {
+    sensor_t *sensors;
+    uint8_t capacity;
+    uint8_t count;
+} sensor_table_t;
+
+void sensor_table_init(sensor_table_t *table, sensor_t *sensors, uint8_t capacity);
+
+// Replace the sensors with the "sensors" array of a JSON configuration. Returns the number of objects in the
+// array, which is more than table->count when some are invalid or do not fit. -1 when there is no array, the
+// table is left as it was
+int sensor_table_load(sensor_table_t *table, const char *json, size_t len);
+
+// Sensor of a name, NULL when it is not in the table
+sensor_t *sensor_table_find(sensor_table_t *table, const char *name, size_t name_len);
+
+// Decode a text value reported by a node, one of SENSOR_STORED, SENSOR_TRUNCATED or SENSOR_INVALID
+uint8_t sensor_store(sensor_t *sensor, const char *value, size_t value_len);
+
+// Write the "<field>":"<reading>" member of every sensor, in the order of the table
+void sensor_table_write(const sensor_table_t *table, payload_writer_t *writer);
+
+#endif // SENSOR_TABLE_H